@@ -0,0 +1,317 @@
+/*! \file
+	\brief Overlapping Allan deviation of the six sensor channels.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "AllanVariance.h"
+#include "ThreadPool.h"
+
+// Bias instability is the flat bottom of the curve divided by this,
+//   sqrt(2 ln 2 / pi)
+#define AV_FLICKER_FACTOR	0.664
+
+struct AllanSeries_t
+{
+	double *pTheta[N_SENSOR_IDX];			//!< Running sums, Count + 1 points from 0
+	double First[N_SENSOR_IDX];				//!< First reading, taken off every reading
+	UInt64 Count;							//!< Readings added
+	UInt64 Capacity;						//!< Points each pTheta can hold
+};
+
+//! One averaging time of one channel
+typedef struct
+{
+	const double *pTheta;
+	UInt64 Points;
+	UInt32 m;
+	double *pAdev;
+} AllanJob_t;
+
+
+/*! Create an empty series.
+	\return The series, or NULL if out of memory.*/
+AllanSeries_t *avCreate(void)
+{
+	return (AllanSeries_t *)calloc(1, sizeof(AllanSeries_t));
+
+}// avCreate
+
+
+/*! Add one reading of every channel.
+	\param pSeries points to the series.
+	\param Sample holds the readings, in IMUSensorIndex_t order.
+	\return FALSE if out of memory.*/
+BOOL avAdd(AllanSeries_t *pSeries, const float Sample[N_SENSOR_IDX])
+{
+	UInt64 k = pSeries->Count;
+	UInt32 n;
+
+	if (k + 2 > pSeries->Capacity)
+	{
+		UInt64 Capacity = pSeries->Capacity ? 2 * pSeries->Capacity : 65536;
+
+		for (n = 0; n < N_SENSOR_IDX; n++)
+		{
+			double *pTheta = (double *)realloc(pSeries->pTheta[n], (size_t)Capacity * sizeof(double));
+
+			if (pTheta == NULL)
+				return FALSE;
+			pSeries->pTheta[n] = pTheta;
+		}
+		pSeries->Capacity = Capacity;
+	}
+
+	for (n = 0; n < N_SENSOR_IDX; n++)
+	{
+		double *pTheta = pSeries->pTheta[n];
+
+		if (k == 0)
+		{
+			pSeries->First[n] = Sample[n];
+			pTheta[0] = 0.0;
+		}
+		pTheta[k + 1] = pTheta[k] + (Sample[n] - pSeries->First[n]);
+	}
+
+	pSeries->Count++;
+
+	return TRUE;
+
+}// avAdd
+
+
+/*! Get the number of readings added.
+	\param pSeries points to the series.
+	\return The number of readings.*/
+UInt64 avCount(const AllanSeries_t *pSeries)
+{
+	return pSeries->Count;
+
+}// avCount
+
+
+/*! Get the mean reading of a channel.
+	\param pSeries points to the series.
+	\param Channel is the IMUSensorIndex_t.
+	\return The mean, 0 if the series is empty.*/
+double avMean(const AllanSeries_t *pSeries, UInt32 Channel)
+{
+	if (pSeries->Count == 0)
+		return 0.0;
+
+	return pSeries->First[Channel] + pSeries->pTheta[Channel][pSeries->Count] / pSeries->Count;
+
+}// avMean
+
+
+/*! Free a series.
+	\param pSeries points to the series.*/
+void avDestroy(AllanSeries_t *pSeries)
+{
+	UInt32 n;
+
+	if (pSeries == NULL)
+		return;
+
+	for (n = 0; n < N_SENSOR_IDX; n++)
+		free(pSeries->pTheta[n]);
+	free(pSeries);
+
+}// avDestroy
+
+
+/*! Choose log spaced averaging times.
+	\param Count is the number of readings.
+	\param PerDecade is the number of averaging times per decade.
+	\param pM points to space to receive the averaging times in samples,
+		   increasing.
+	\param Max is the most averaging times to return.
+	\return The number of averaging times.*/
+UInt32 avTaus(UInt64 Count, UInt32 PerDecade, UInt32 *pM, UInt32 Max)
+{
+	UInt64 Largest = Count / AV_MIN_TERMS_DIV;
+	UInt32 Taus = 0, j;
+
+	for (j = 0; Taus < Max; j++)
+	{
+		double m = floor(pow(10.0, (double)j / PerDecade) + 0.5);
+
+		if (m > Largest)
+			break;
+
+		// Low decades give the same integer more than once
+		if ((Taus == 0) || ((UInt32)m > pM[Taus - 1]))
+			pM[Taus++] = (UInt32)m;
+	}
+
+	return Taus;
+
+}// avTaus
+
+
+/*! Sweep the series once for one averaging time.
+	\param pArg points to the AllanJob_t.*/
+static void AdevJob(void *pArg)
+{
+	AllanJob_t *pJob = (AllanJob_t *)pArg;
+	const double *a = pJob->pTheta;
+	const double *b = pJob->pTheta + pJob->m;
+	const double *c = pJob->pTheta + 2 * pJob->m;
+	UInt64 Terms = pJob->Points - 2 * pJob->m, k;
+	double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0, d0, d1, d2, d3;
+
+	// Four partial sums keep the adds independent
+	for (k = 0; k + 4 <= Terms; k += 4)
+	{
+		d0 = c[k] - 2.0 * b[k] + a[k];
+		d1 = c[k + 1] - 2.0 * b[k + 1] + a[k + 1];
+		d2 = c[k + 2] - 2.0 * b[k + 2] + a[k + 2];
+		d3 = c[k + 3] - 2.0 * b[k + 3] + a[k + 3];
+		s0 += d0 * d0;
+		s1 += d1 * d1;
+		s2 += d2 * d2;
+		s3 += d3 * d3;
+	}
+	for (; k < Terms; k++)
+	{
+		d0 = c[k] - 2.0 * b[k] + a[k];
+		s0 += d0 * d0;
+	}
+
+	// The sums are of readings, not of readings times tau0, so tau0 cancels
+	*pJob->pAdev = sqrt((s0 + s1 + s2 + s3) / (2.0 * (double)pJob->m * pJob->m * Terms));
+
+}// AdevJob
+
+
+/*! Compute the overlapping Allan deviation of every channel.
+	\param pSeries points to the series.
+	\param pM points to the averaging times in samples, from avTaus().
+	\param TauCount is the number of averaging times.
+	\param Threads is the number of worker threads, 0 for one per CPU.
+	\param pAdev points to space for N_SENSOR_IDX * TauCount deviations,
+		   channel by channel, in the channel's units.
+	\return FALSE if out of memory or a tau is too long for the series.*/
+BOOL avCompute(const AllanSeries_t *pSeries, const UInt32 *pM, UInt32 TauCount, UInt32 Threads, double *pAdev)
+{
+	ThreadPool_t *pPool;
+	AllanJob_t *pJobs;
+	UInt32 n, t;
+
+	for (t = 0; t < TauCount; t++)
+		if ((pM[t] == 0) || (2 * (UInt64)pM[t] >= pSeries->Count + 1))
+			return FALSE;
+
+	pJobs = (AllanJob_t *)malloc((size_t)N_SENSOR_IDX * TauCount * sizeof(AllanJob_t));
+	pPool = tpCreate(Threads);
+	if ((pJobs == NULL) || (pPool == NULL))
+	{
+		free(pJobs);
+		tpDestroy(pPool);
+		return FALSE;
+	}
+
+	for (n = 0; n < N_SENSOR_IDX; n++)
+	{
+		for (t = 0; t < TauCount; t++)
+		{
+			AllanJob_t *pJob = &pJobs[n * TauCount + t];
+
+			pJob->pTheta = pSeries->pTheta[n];
+			pJob->Points = pSeries->Count + 1;
+			pJob->m = pM[t];
+			pJob->pAdev = &pAdev[n * TauCount + t];
+
+			// Run it here if the queue can't grow
+			if (!tpSubmit(pPool, AdevJob, pJob))
+				AdevJob(pJob);
+		}
+	}
+
+	tpWait(pPool);
+	tpDestroy(pPool);
+	free(pJobs);
+
+	return TRUE;
+
+}// avCompute
+
+
+/*! Log-log slope of a deviation curve at a point, from its neighbours.*/
+static double Slope(const double *pTau, const double *pAdev, UInt32 Count, UInt32 i)
+{
+	UInt32 Lo = i ? i - 1 : 0, Hi = (i + 1 < Count) ? i + 1 : i;
+
+	if ((Hi == Lo) || (pAdev[Lo] <= 0.0) || (pAdev[Hi] <= 0.0))
+		return 0.0;
+
+	return log(pAdev[Hi] / pAdev[Lo]) / log(pTau[Hi] / pTau[Lo]);
+
+}// Slope
+
+
+/*! Read the noise terms off a deviation curve.
+	\param pTau points to the averaging times in seconds, increasing.
+	\param pAdev points to the deviations.
+	\param Count is the number of points.
+	\param pNoise points to space to receive the terms.*/
+void avFitNoise(const double *pTau, const double *pAdev, UInt32 Count, AllanNoise_t *pNoise)
+{
+	double Best, Error;
+	UInt32 i, Min = 0, At = 0;
+
+	memset(pNoise, 0, sizeof(*pNoise));
+	if (Count < 3)
+		return;
+
+	pNoise->SampleDev = pAdev[0];
+
+	for (i = 1; i < Count; i++)
+		if (pAdev[i] < pAdev[Min])
+			Min = i;
+
+	// White noise: the point left of the bottom whose slope is nearest -1/2
+	for (Best = AV_SLOPE_TOLERANCE, i = 0; i <= Min; i++)
+	{
+		Error = fabs(Slope(pTau, pAdev, Count, i) + 0.5);
+		if (Error <= Best)
+		{
+			Best = Error;
+			At = i;
+			pNoise->HaveWhite = TRUE;
+		}
+	}
+	if (pNoise->HaveWhite)
+	{
+		pNoise->White = pAdev[At] * sqrt(pTau[At]);
+		pNoise->WhiteTau = pTau[At];
+	}
+
+	// A bottom at either end is just where the curve was cut off
+	if ((Min > 0) && (Min + 1 < Count))
+	{
+		pNoise->HaveInstability = TRUE;
+		pNoise->Instability = pAdev[Min] / AV_FLICKER_FACTOR;
+		pNoise->InstabilityTau = pTau[Min];
+	}
+
+	// Rate random walk: right of the bottom, slope nearest +1/2
+	for (Best = AV_SLOPE_TOLERANCE, i = Min + 1; i < Count; i++)
+	{
+		Error = fabs(Slope(pTau, pAdev, Count, i) - 0.5);
+		if (Error <= Best)
+		{
+			Best = Error;
+			At = i;
+			pNoise->HaveRateWalk = TRUE;
+		}
+	}
+	if (pNoise->HaveRateWalk)
+	{
+		pNoise->RateWalk = pAdev[At] * sqrt(3.0 / pTau[At]);
+		pNoise->RateWalkTau = pTau[At];
+	}
+
+}// avFitNoise
@@ -0,0 +1,110 @@
+/*! \file
+	\brief Latency compensated forward prediction of the filtered angle.
+*/
+
+#include "AnglePredict.h"
+
+// Rate at which the offset floor rises, as a fraction of elapsed time.
+//   Covers several hundred ppm of drift between the host and IMU clocks.
+#define AP_FLOOR_LEAK		(0.0005)
+
+// Weight of a new latency measurement in the smoothed latency
+#define AP_LATENCY_ALPHA	(0.05f)
+
+
+/*! Initialize a predictor.
+	\param pAP points to the predictor to initialize.
+	\param TransferMs is the time one packet occupies the serial line, i.e.
+		   bytes * 10 * 1000 / baud.*/
+void apInit(AnglePredictor_t *pAP, float TransferMs)
+{
+	pAP->TransferMs = TransferMs;
+	pAP->DeviceMs = 0;
+	pAP->LastPPSMs = 0;
+	pAP->LastArrivalNs = 0;
+	pAP->MinOffsetMs = 0;
+	pAP->LatencyMs = TransferMs;
+	pAP->MaxLatencyMs = 0;
+	pAP->SampleNs = 0;
+	pAP->Angle = 0;
+	pAP->Rate = 0;
+	pAP->Count = 0;
+
+}// apInit
+
+
+/*! Feed the predictor with the filter state after a packet was filtered.
+	\param pAP points to the predictor.
+	\param pKF points to the filter that was just updated with the packet.
+	\param TimeSincePPS is the IMU time of the packet in milliseconds.
+	\param ArrivalNs is the host time at which the packet was completed.*/
+void apUpdate(AnglePredictor_t *pAP, const KFilter_t *pKF, float TimeSincePPS, UInt64 ArrivalNs)
+{
+	double ArrivalMs = ArrivalNs / 1.0e6;
+	double OffsetMs, Latency;
+
+	if (pAP->Count == 0)
+	{
+		pAP->DeviceMs = TimeSincePPS;
+		pAP->MinOffsetMs = ArrivalMs - pAP->DeviceMs;
+	}
+	else
+	{
+		double StepMs = TimeSincePPS - pAP->LastPPSMs;
+
+		// TimeSincePPS restarts on every PPS edge; bridge the wrap with the
+		//   host's idea of the elapsed time
+		if (StepMs < 0)
+			StepMs = (ArrivalNs - pAP->LastArrivalNs) / 1.0e6;
+
+		pAP->DeviceMs += StepMs;
+
+		// Let the floor rise with elapsed time so clock drift can't pin it
+		pAP->MinOffsetMs += StepMs * AP_FLOOR_LEAK;
+	}
+
+	pAP->LastPPSMs = TimeSincePPS;
+	pAP->LastArrivalNs = ArrivalNs;
+	pAP->Count++;
+
+	// Update the floor, then measure this packet against it
+	OffsetMs = ArrivalMs - pAP->DeviceMs;
+	if (OffsetMs < pAP->MinOffsetMs)
+		pAP->MinOffsetMs = OffsetMs;
+
+	Latency = (OffsetMs - pAP->MinOffsetMs) + pAP->TransferMs;
+
+	pAP->LatencyMs += AP_LATENCY_ALPHA * ((float)Latency - pAP->LatencyMs);
+	if (Latency > pAP->MaxLatencyMs)
+		pAP->MaxLatencyMs = (float)Latency;
+
+	// The sample was taken one full latency before it arrived
+	pAP->SampleNs = ArrivalNs - (UInt64)(Latency * 1.0e6);
+	pAP->Angle = pKF->angle;
+	pAP->Rate = pKF->rate;
+
+}// apUpdate
+
+
+/*! Extrapolate the filtered angle to a host time.
+	\param pAP points to the predictor.
+	\param TargetNs is the host time the angle is wanted for, typically the
+		   time the next motor command takes effect.
+	\return The predicted angle, in the units of the filter.*/
+float apPredict(const AnglePredictor_t *pAP, UInt64 TargetNs)
+{
+	float dt = (float)((double)((SInt64)(TargetNs - pAP->SampleNs)) / 1.0e9);
+
+	return pAP->Angle + pAP->Rate * dt;
+
+}// apPredict
+
+
+/*! Get the smoothed latency between sampling and packet arrival.
+	\param pAP points to the predictor.
+	\return The latency in milliseconds.*/
+float apGetLatencyMs(const AnglePredictor_t *pAP)
+{
+	return pAP->LatencyMs;
+
+}// apGetLatencyMs
@@ -64,7 +64,7 @@ UInt32 DataToUInt24(const UInt8* pData)
 UInt32 DataToUInt32(const UInt8* pData)
 {
 	// In the little endian targets we do things the hard way
-	return (UInt32)((pData[0] << 24) | (pData[1] << 16) | (pData[2] <<8) | pData[3]);
+	return (UInt32)(((UInt32)pData[0] << 24) | (pData[1] << 16) | (pData[2] <<8) | pData[3]);
 }//DataToUInt32
 
 
@@ -179,7 +179,7 @@ UInt32 UInt32ToData(UInt8* pData, UInt32 Value)
 	pData[2] = (UInt8)(Value>>8);
 	pData[3] = (UInt8)(Value);		// LSByte
 
-	return (UInt32)sizeof(Value);
+	return 4;	// SInt32/UInt32 are wider on LP64 hosts
 
 }// UInt32ToData
 
@@ -198,7 +198,7 @@ UInt32 SInt32ToData(UInt8* pData, SInt32 Value)
 	pData[2] = (UInt8)(Value>>8);
 	pData[3] = (UInt8)(Value);		// LSByte
 
-	return (UInt32)sizeof(Value);
+	return 4;	// SInt32/UInt32 are wider on LP64 hosts
 
 }// SInt32ToData
 
@@ -285,7 +285,7 @@ UInt32 UInt32ToleData(UInt8* pData, UInt32 Value)
 	//   accesses and then assemble the result in a register.
 	*((UInt32*)pData) = Value;
 
-	return (UInt32)sizeof(Value);
+	return 4;	// SInt32/UInt32 are wider on LP64 hosts
 
 }// UInt32ToData
 
@@ -302,7 +302,7 @@ UInt32 SInt32ToleData(UInt8* pData, SInt32 Value)
 	//   accesses and then assemble the result in a register.
 	*((SInt32*)pData) = Value;
 
-	return (UInt32)sizeof(Value);
+	return 4;	// SInt32/UInt32 are wider on LP64 hosts
 
 }// SInt32ToData
 
@@ -1,54 +1,49 @@
 #include "CalcAngle.h"
 
-/* Kalman filter variables */
-float Q_angle; // Process noise variance for the accelerometer
-float Q_bias; // Process noise variance for the gyro bias
-float R_measure; // Measurement noise variance - this is actually the variance of the measurement noise
+/* Filter used by the single filter interface */
+static KFilter_t KFilter;
 
-float angle; // The angle calculated by the Kalman filter - part of the 2x1 state vector
-float bias; // The gyro bias calculated by the Kalman filter - part of the 2x1 state vector
-float rate; // Unbiased rate calculated from the rate and the calculated bias - you have to call getAngle to update the rate
-
-float P[2][2]; // Error covariance matrix - This is a 2x2 matrix
-
-void initKFilter()
+void kfInit(KFilter_t *pKF)
 {
 	/* We will set the variables like so, these can also be tuned by the user */
-	Q_angle = 0.001f;
-	Q_bias = 0.003f;
-	R_measure = 0.03f;
-
-	angle = 0.0f; // Reset the angle
-	bias = 0.0f; // Reset bias
-
-	P[0][0] = 0.0f; // Since we assume that the bias is 0 and we know the starting angle (use setAngle), the error covariance matrix is set like so - see: http://en.wikipedia.org/wiki/Kalman_filter#Example_application.2C_technical
-	P[0][1] = 0.0f;
-	P[1][0] = 0.0f;
-	P[1][1] = 0.0f;
+	pKF->Q_angle = 0.001f;
+	pKF->Q_bias = 0.003f;
+	pKF->R_measure = 0.03f;
+
+	pKF->angle = 0.0f; // Reset the angle
+	pKF->bias = 0.0f; // Reset bias
+	pKF->rate = 0.0f;
+
+	pKF->P[0][0] = 0.0f; // Since we assume that the bias is 0 and we know the starting angle (use setAngle), the error covariance matrix is set like so - see: http://en.wikipedia.org/wiki/Kalman_filter#Example_application.2C_technical
+	pKF->P[0][1] = 0.0f;
+	pKF->P[1][0] = 0.0f;
+	pKF->P[1][1] = 0.0f;
 }
 
-float getAngle(float newAngle, float newRate, float dt) {
+float kfGetAngle(KFilter_t *pKF, float newAngle, float newRate, float dt) {
 	// KasBot V2  -  Kalman filter module - http://www.x-firm.com/?page_id=145
 	// Modified by Kristian Lauszus
 	// See my blog post for more information: http://blog.tkjelectronics.dk/2012/09/a-practical-approach-to-kalman-filter-and-how-to-implement-it
 
+	float (*P)[2] = pKF->P;
+
 	// Discrete Kalman filter time update equations - Time Update ("Predict")
 	// Update xhat - Project the state ahead
 	/* Step 1 */
-	rate = newRate - bias;
-	angle += dt * rate;
+	pKF->rate = newRate - pKF->bias;
+	pKF->angle += dt * pKF->rate;
 
 	// Update estimation error covariance - Project the error covariance ahead
 	/* Step 2 */
-	P[0][0] += dt * (dt*P[1][1] - P[0][1] - P[1][0] + Q_angle);
+	P[0][0] += dt * (dt*P[1][1] - P[0][1] - P[1][0] + pKF->Q_angle);
 	P[0][1] -= dt * P[1][1];
 	P[1][0] -= dt * P[1][1];
-	P[1][1] += Q_bias * dt;
+	P[1][1] += pKF->Q_bias * dt;
 
 	// Discrete Kalman filter measurement update equations - Measurement Update ("Correct")
 	// Calculate Kalman gain - Compute the Kalman gain
 	/* Step 4 */
-	float S = P[0][0] + R_measure; // Estimate error
+	float S = P[0][0] + pKF->R_measure; // Estimate error
 	/* Step 5 */
 	float K[2]; // Kalman gain - This is a 2x1 vector
 	K[0] = P[0][0] / S;
@@ -56,10 +51,10 @@ float getAngle(float newAngle, float newRate, float dt) {
 
 	// Calculate angle and bias - Update estimate with measurement zk (newAngle)
 	/* Step 3 */
-	float y = newAngle - angle; // Angle difference
+	float y = newAngle - pKF->angle; // Angle difference
 	/* Step 6 */
-	angle += K[0] * y;
-	bias += K[1] * y;
+	pKF->angle += K[0] * y;
+	pKF->bias += K[1] * y;
 
 	// Calculate estimation error covariance - Update the error covariance
 	/* Step 7 */
@@ -71,17 +66,22 @@ float getAngle(float newAngle, float newRate, float dt) {
 	P[1][0] -= K[1] * P00_temp;
 	P[1][1] -= K[1] * P01_temp;
 
-	return angle;
+	return pKF->angle;
 }
 
-void setAngle(float newAngle) { angle = newAngle; }; // Used to set angle, this should be set as the starting angle
-float getRate() { return rate; }; // Return the unbiased rate
+void initKFilter() { kfInit(&KFilter); };
+float getAngle(float newAngle, float newRate, float dt) { return kfGetAngle(&KFilter, newAngle, newRate, dt); };
+
+void setAngle(float newAngle) { KFilter.angle = newAngle; }; // Used to set angle, this should be set as the starting angle
+float getRate() { return KFilter.rate; }; // Return the unbiased rate
 
 /* These are used to tune the Kalman filter */
-void setQangle(float newQ_angle) { Q_angle = newQ_angle; };
-void setQbias(float newQ_bias) { Q_bias = newQ_bias; };
-void setRmeasure(float newR_measure) { R_measure = newR_measure; };
+void setQangle(float newQ_angle) { KFilter.Q_angle = newQ_angle; };
+void setQbias(float newQ_bias) { KFilter.Q_bias = newQ_bias; };
+void setRmeasure(float newR_measure) { KFilter.R_measure = newR_measure; };
+
+float getQangle() { return KFilter.Q_angle; };
+float getQbias() { return KFilter.Q_bias; };
+float getRmeasure() { return KFilter.R_measure; };
 
-float getQangle() { return Q_angle; };
-float getQbias() { return Q_bias; };
-float getRmeasure() { return R_measure; };
\ No newline at end of file
+KFilter_t *getKFilter() { return &KFilter; }; // Direct access to the filter state, e.g. for the predictor
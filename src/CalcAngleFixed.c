@@ -0,0 +1,198 @@
+/*! \file
+	\brief Fixed point version of the angle Kalman filter.
+*/
+
+#include "CalcAngleFixed.h"
+
+/*! Initialize a fixed point filter with the same defaults as kfInit().
+	\param pKF points to the filter to initialize.*/
+void kfqInit(KFilterQ_t *pKF)
+{
+	pKF->Q_angle = FLOAT_TO_Q24(0.001);
+	pKF->Q_bias = FLOAT_TO_Q24(0.003);
+	pKF->R_measure = FLOAT_TO_Q24(0.03);
+
+	pKF->angle = 0;
+	pKF->bias = 0;
+	pKF->rate = 0;
+
+	pKF->P[0][0] = 0;
+	pKF->P[0][1] = 0;
+	pKF->P[1][0] = 0;
+	pKF->P[1][1] = 0;
+
+}// kfqInit
+
+
+/*! Run one predict and correct step.  See getAngle() for the equations.
+	\param pKF points to the filter.
+	\param newAngle is the measured angle (accelerometer tilt), Q16.16 degrees.
+	\param newRate is the measured rate (gyro), Q16.16 deg/s.
+	\param dt is the time since the last step, Q16.16 seconds.
+	\return The filtered angle, Q16.16 degrees.*/
+Q16_t kfqGetAngle(KFilterQ_t *pKF, Q16_t newAngle, Q16_t newRate, Q16_t dt)
+{
+	Q24_t (*P)[2] = pKF->P;
+	Q24_t S, P00_temp, P01_temp, dtP11;
+	SInt64 K0, K1;		// Q2.30
+	Q16_t y;
+
+	// Predict the state
+	pKF->rate = newRate - pKF->bias;
+	pKF->angle += (Q16_t)(((SInt64)dt * pKF->rate) >> 16);
+
+	// Predict the error covariance
+	dtP11 = (Q24_t)(((SInt64)dt * P[1][1]) >> 16);
+	P[0][0] += (Q24_t)(((SInt64)dt * (dtP11 - P[0][1] - P[1][0] + pKF->Q_angle)) >> 16);
+	P[0][1] -= dtP11;
+	P[1][0] -= dtP11;
+	P[1][1] += (Q24_t)(((SInt64)pKF->Q_bias * dt) >> 16);
+
+	// Kalman gain
+	S = P[0][0] + pKF->R_measure;
+	if (S <= 0)
+		S = 1;
+	K0 = ((SInt64)P[0][0] << 30) / S;
+	K1 = ((SInt64)P[1][0] << 30) / S;
+
+	// Correct the state with the measurement
+	y = newAngle - pKF->angle;
+	pKF->angle += (Q16_t)((K0 * y) >> 30);
+	pKF->bias += (Q16_t)((K1 * y) >> 30);
+
+	// Correct the error covariance
+	P00_temp = P[0][0];
+	P01_temp = P[0][1];
+
+	P[0][0] -= (Q24_t)((K0 * P00_temp) >> 30);
+	P[0][1] -= (Q24_t)((K0 * P01_temp) >> 30);
+	P[1][0] -= (Q24_t)((K1 * P00_temp) >> 30);
+	P[1][1] -= (Q24_t)((K1 * P01_temp) >> 30);
+
+	return pKF->angle;
+
+}// kfqGetAngle
+
+
+/*! Load a fixed point filter from a floating point one, e.g. after the
+	startup calibration has seeded it.
+	\param pKF points to the fixed point filter to set.
+	\param pFloat points to the floating point filter to copy.*/
+void kfqFromFloat(KFilterQ_t *pKF, const KFilter_t *pFloat)
+{
+	pKF->Q_angle = FLOAT_TO_Q24(pFloat->Q_angle);
+	pKF->Q_bias = FLOAT_TO_Q24(pFloat->Q_bias);
+	pKF->R_measure = FLOAT_TO_Q24(pFloat->R_measure);
+
+	pKF->angle = FLOAT_TO_Q16(pFloat->angle);
+	pKF->bias = FLOAT_TO_Q16(pFloat->bias);
+	pKF->rate = FLOAT_TO_Q16(pFloat->rate);
+
+	pKF->P[0][0] = FLOAT_TO_Q24(pFloat->P[0][0]);
+	pKF->P[0][1] = FLOAT_TO_Q24(pFloat->P[0][1]);
+	pKF->P[1][0] = FLOAT_TO_Q24(pFloat->P[1][0]);
+	pKF->P[1][1] = FLOAT_TO_Q24(pFloat->P[1][1]);
+
+}// kfqFromFloat
+
+
+/*! Copy a fixed point filter into a floating point one, so code written for
+	the float filter (the predictor, state saving) can use it.
+	\param pKF points to the fixed point filter to copy.
+	\param pFloat points to the floating point filter to set.*/
+void kfqToFloat(const KFilterQ_t *pKF, KFilter_t *pFloat)
+{
+	pFloat->Q_angle = Q24_TO_FLOAT(pKF->Q_angle);
+	pFloat->Q_bias = Q24_TO_FLOAT(pKF->Q_bias);
+	pFloat->R_measure = Q24_TO_FLOAT(pKF->R_measure);
+
+	pFloat->angle = Q16_TO_FLOAT(pKF->angle);
+	pFloat->bias = Q16_TO_FLOAT(pKF->bias);
+	pFloat->rate = Q16_TO_FLOAT(pKF->rate);
+
+	pFloat->P[0][0] = Q24_TO_FLOAT(pKF->P[0][0]);
+	pFloat->P[0][1] = Q24_TO_FLOAT(pKF->P[0][1]);
+	pFloat->P[1][0] = Q24_TO_FLOAT(pKF->P[1][0]);
+	pFloat->P[1][1] = Q24_TO_FLOAT(pKF->P[1][1]);
+
+}// kfqToFloat
+
+
+#ifdef KFIXED_TEST
+
+#include <stdio.h>
+#include <math.h>
+#include "ByteOrder.h"
+#include "Tilt.h"
+
+/*! Run the float and fixed point pipelines side by side on synthetic high
+	speed packets and report how far the fixed point angle strays.
+	\return TRUE if the divergence stays within 0.05 degrees.*/
+BOOL TestKFilterFixed(void)
+{
+	IMUPacket_t Pkt;
+	IMUData_t Data;
+	IMUDataQ_t DataQ;
+	IMUFixedScale_t Scale;
+	KFilter_t KF;
+	KFilterQ_t KFQ;
+	UInt32 Seed = 12345;
+	double MaxErr = 0, MaxTiltErr = 0;
+	int n, s;
+
+	Data.GyroRange = 300.0f;
+	Data.AccelRange = 10.0f;
+	SetFixedScale(&Scale, &Data);
+
+	kfInit(&KF);
+	kfqInit(&KFQ);
+
+	for (n = 0; n < 20000; n++)
+	{
+		double t = n * 0.02;
+		double Roll = 20.0 * sin(t * 1.3);
+		double Rate = 20.0 * 1.3 * cos(t * 1.3) + 1.5;		// 1.5 deg/s gyro bias
+		double Value[N_SENSOR_IDX];
+		UInt8 i = 0;
+		float Angle;
+		Q16_t AngleQ;
+
+		Value[GYROX_IDX] = Rate / ((2.0 * Data.GyroRange) / 65535.0);
+		Value[GYROY_IDX] = 0;
+		Value[GYROZ_IDX] = 0;
+		Value[ACCELX_IDX] = 0;
+		Value[ACCELY_IDX] = 9.81 * sin(Roll / 57.2957795) / ((2.0 * Data.AccelRange * 9.81) / 65535.0);
+		Value[ACCELZ_IDX] = 9.81 * cos(Roll / 57.2957795) / ((2.0 * Data.AccelRange * 9.81) / 65535.0);
+
+		for (s = 0; s < N_SENSOR_IDX; s++)
+		{
+			// A few counts of noise
+			Seed = Seed * 1103515245 + 12345;
+			i += SInt16ToData(&Pkt.data[i], RoundToSInt16(Value[s] + (int)((Seed >> 16) % 41) - 20));
+		}
+		i += UInt32ToData(&Pkt.data[i], (UInt32)(n * 200000UL));
+		Pkt.data[i++] = 0;
+		Pkt.data[i++] = (UInt8)n;
+		Pkt.type = HS_SERIAL_IMU_MSG;
+		Pkt.len = i;
+
+		DecodeIMUPacket(&Pkt, &Data);
+		DecodeHighSpeedDataPacketQ(&Pkt, &Scale, &DataQ);
+
+		Angle = kfGetAngle(&KF, TiltRollDeg(&Data), Data.SensorsConverted[GYROX_IDX], 0.02f);
+		AngleQ = kfqGetAngle(&KFQ, TiltRollQ(&DataQ), DataQ.Converted[GYROX_IDX], FLOAT_TO_Q16(0.02));
+
+		if (fabs(Q16_TO_FLOAT(TiltRollQ(&DataQ)) - TiltRollDeg(&Data)) > MaxTiltErr)
+			MaxTiltErr = fabs(Q16_TO_FLOAT(TiltRollQ(&DataQ)) - TiltRollDeg(&Data));
+		if (fabs(Q16_TO_FLOAT(AngleQ) - Angle) > MaxErr)
+			MaxErr = fabs(Q16_TO_FLOAT(AngleQ) - Angle);
+	}
+
+	printf("Fixed point: max tilt error %.5f deg, max angle divergence %.5f deg, bias %.4f vs %.4f\n",
+		   MaxTiltErr, MaxErr, Q16_TO_FLOAT(KFQ.bias), KF.bias);
+
+	return (MaxErr < 0.05);
+
+}// TestKFilterFixed
+
+#endif
@@ -0,0 +1,247 @@
+/*! \file
+	\brief Memory mapped reader for serial capture files.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "CaptureReader.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/*! Map a whole file read-only.
+	\param pPath is the file name.
+	\param pSize points to space to receive the file size.
+	\return The mapping, or NULL if the file can't be mapped.*/
+static const void *MapFile(const char *pPath, size_t *pSize)
+{
+#ifdef WIN32
+	HANDLE File, Mapping;
+	LARGE_INTEGER Size;
+	void *pMap = NULL;
+
+	// Replay reads front to back
+	File = CreateFileA(pPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+					   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (File == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	if (!GetFileSizeEx(File, &Size) || (Size.QuadPart == 0) || ((UInt64)Size.QuadPart > (size_t)-1))
+	{
+		CloseHandle(File);
+		return NULL;
+	}
+
+	// The view keeps the mapping, and the mapping the file, open once the handles are closed
+	Mapping = CreateFileMappingA(File, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (Mapping)
+	{
+		pMap = MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(Mapping);
+	}
+	CloseHandle(File);
+
+	if (pMap == NULL)
+		return NULL;
+
+	*pSize = (size_t)Size.QuadPart;
+	return pMap;
+#else
+	struct stat St;
+	void *pMap;
+	int fd = open(pPath, O_RDONLY);
+
+	if (fd < 0)
+		return NULL;
+
+	if ((fstat(fd, &St) != 0) || (St.st_size == 0))
+	{
+		close(fd);
+		return NULL;
+	}
+
+	pMap = mmap(NULL, (size_t)St.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (pMap == MAP_FAILED)
+		return NULL;
+
+	// Replay reads front to back
+	madvise(pMap, (size_t)St.st_size, MADV_SEQUENTIAL);
+
+	*pSize = (size_t)St.st_size;
+	return pMap;
+#endif
+
+}// MapFile
+
+
+/*! Unmap a file mapped by MapFile().
+	\param pMap is the mapping.
+	\param Size is the file size.*/
+static void UnmapFile(const void *pMap, size_t Size)
+{
+#ifdef WIN32
+	(void)Size;
+
+	UnmapViewOfFile(pMap);
+#else
+	munmap((void *)pMap, Size);
+#endif
+
+}// UnmapFile
+
+
+/*! Open a capture file and its index.
+	\param pReader points to the reader to open.
+	\param pPath is the name of the capture file.
+	\return TRUE if the capture was opened.*/
+BOOL crOpen(CaptureReader_t *pReader, const char *pPath)
+{
+	const CaptureFileHeader_t *pHeader;
+	char *pIndexPath;
+
+	memset(pReader, 0, sizeof(*pReader));
+
+	pReader->pBase = (const UInt8 *)MapFile(pPath, &pReader->Size);
+	if (pReader->pBase == NULL)
+		return FALSE;
+
+	pHeader = (const CaptureFileHeader_t *)pReader->pBase;
+	if ((pReader->Size < sizeof(*pHeader)) ||
+		(memcmp(pHeader->Magic, CAP_MAGIC, sizeof(pHeader->Magic)) != 0) ||
+		(pHeader->ByteOrder != CAP_BYTE_ORDER_MARK))
+	{
+		crClose(pReader);
+		return FALSE;
+	}
+	pReader->StartNs = pHeader->StartNs;
+
+	// The index is optional
+	pIndexPath = (char *)malloc(strlen(pPath) + 5);
+	if (pIndexPath)
+	{
+		strcpy(pIndexPath, pPath);
+		strcat(pIndexPath, ".idx");
+		pReader->pIndexMap = MapFile(pIndexPath, &pReader->IndexMapSize);
+		free(pIndexPath);
+	}
+
+	if (pReader->pIndexMap)
+	{
+		const CaptureIndexHeader_t *pIndexHeader = (const CaptureIndexHeader_t *)pReader->pIndexMap;
+
+		if ((pReader->IndexMapSize >= sizeof(*pIndexHeader)) &&
+			(memcmp(pIndexHeader->Magic, CAP_INDEX_MAGIC, sizeof(pIndexHeader->Magic)) == 0) &&
+			(pIndexHeader->ByteOrder == CAP_BYTE_ORDER_MARK) &&
+			(pIndexHeader->EntryBytes == sizeof(CaptureIndexEntry_t)))
+		{
+			pReader->pIndex = (const CaptureIndexEntry_t *)(pIndexHeader + 1);
+			pReader->IndexCount = (pReader->IndexMapSize - sizeof(*pIndexHeader)) / sizeof(CaptureIndexEntry_t);
+		}
+	}
+
+	return TRUE;
+
+}// crOpen
+
+
+/*! Unmap a capture opened with crOpen().
+	\param pReader points to the reader to close.*/
+void crClose(CaptureReader_t *pReader)
+{
+	if (pReader->pBase)
+		UnmapFile(pReader->pBase, pReader->Size);
+	if (pReader->pIndexMap)
+		UnmapFile(pReader->pIndexMap, pReader->IndexMapSize);
+
+	memset(pReader, 0, sizeof(*pReader));
+
+}// crClose
+
+
+/*! Get the offset of the first chunk.
+	\param pReader points to an open reader.
+	\return The file offset of the first chunk.*/
+UInt64 crFirstChunk(const CaptureReader_t *pReader)
+{
+	return ((const CaptureFileHeader_t *)pReader->pBase)->HeaderBytes;
+
+}// crFirstChunk
+
+
+/*! Get the chunk at a file offset.
+	\param pReader points to an open reader.
+	\param Offset is the offset of a chunk, from crFirstChunk(),
+		   crSeekTime() or the Next field of a previous chunk.
+	\param pChunk points to space to receive the chunk.
+	\return TRUE if a complete chunk is there, FALSE at the end of the
+			capture (including a chunk cut short by a crash).*/
+BOOL crChunkAt(const CaptureReader_t *pReader, UInt64 Offset, CaptureChunk_t *pChunk)
+{
+	const CaptureChunkHeader_t *pHeader;
+
+	if (Offset + sizeof(CaptureChunkHeader_t) > pReader->Size)
+		return FALSE;
+
+	pHeader = (const CaptureChunkHeader_t *)(pReader->pBase + Offset);
+	if (Offset + sizeof(CaptureChunkHeader_t) + pHeader->Length > pReader->Size)
+		return FALSE;
+
+	pChunk->HostNs = pHeader->HostNs;
+	pChunk->pData = (const UInt8 *)(pHeader + 1);
+	pChunk->Length = pHeader->Length;
+	pChunk->Dropped = pHeader->Dropped;
+	pChunk->Offset = Offset;
+	pChunk->Next = Offset + CAP_CHUNK_BYTES(pHeader->Length);
+
+	return TRUE;
+
+}// crChunkAt
+
+
+/*! Find the first chunk read at or after a host time.
+	\param pReader points to an open reader.
+	\param HostNs is the time to look for.
+	\return The offset of the chunk, or the capture size if every chunk is
+			earlier.*/
+UInt64 crSeekTime(const CaptureReader_t *pReader, UInt64 HostNs)
+{
+	UInt64 Offset = crFirstChunk(pReader);
+	CaptureChunk_t Chunk;
+
+	// Last index entry at or before the time
+	if (pReader->IndexCount && (pReader->pIndex[0].HostNs <= HostNs))
+	{
+		size_t Lo = 0, Hi = pReader->IndexCount;
+
+		while (Hi - Lo > 1)
+		{
+			size_t Mid = Lo + (Hi - Lo) / 2;
+
+			if (pReader->pIndex[Mid].HostNs <= HostNs)
+				Lo = Mid;
+			else
+				Hi = Mid;
+		}
+
+		Offset = pReader->pIndex[Lo].Offset;
+	}
+
+	// Walk the remaining chunks of the interval
+	while (crChunkAt(pReader, Offset, &Chunk))
+	{
+		if (Chunk.HostNs >= HostNs)
+			return Offset;
+		Offset = Chunk.Next;
+	}
+
+	return pReader->Size;
+
+}// crSeekTime
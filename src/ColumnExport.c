@@ -0,0 +1,327 @@
+/*! \file
+	\brief Columnar export of decoded high speed samples.
+*/
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ColumnExport.h"
+
+// Column numbers, in ColumnExportColumns order
+enum
+{
+	CE_HOST_NS,
+	CE_TIME_SINCE_PPS,
+	CE_PPS_COUNT,
+	CE_SEQ,
+	CE_SENSORS,
+	CE_ANGLE = CE_SENSORS + N_SENSOR_IDX,
+	CE_BIAS
+};
+
+// Offsets are filled in when the file is closed
+const ColumnDesc_t ColumnExportColumns[CE_COLUMNS] =
+{
+	{ "host_ns",        "<u8", 8, 0 },
+	{ "time_since_pps", "<f4", 4, 0 },
+	{ "pps_count",      "|u1", 1, 0 },
+	{ "seq",            "|u1", 1, 0 },
+	{ "gyro_x",         "<f4", 4, 0 },
+	{ "gyro_y",         "<f4", 4, 0 },
+	{ "gyro_z",         "<f4", 4, 0 },
+	{ "accel_x",        "<f4", 4, 0 },
+	{ "accel_y",        "<f4", 4, 0 },
+	{ "accel_z",        "<f4", 4, 0 },
+	{ "angle",          "<f4", 4, 0 },
+	{ "bias",           "<f4", 4, 0 },
+};
+
+struct ColumnWriter_t
+{
+	FILE *pFile;
+	UInt8 *pChunk[CE_COLUMNS];				//!< Rows not yet spilled, little-endian
+	FILE *pSpill[CE_COLUMNS];				//!< Spilled chunks, created on the first spill
+	UInt32 Count;							//!< Rows in the chunks
+	UInt64 Rows;							//!< Rows in total
+	BOOL Error;
+};
+
+
+/*! Store the low Bytes bytes of a value little-endian.*/
+static void PutLE(UInt8 *pData, uint64_t Value, UInt32 Bytes)
+{
+	UInt32 i;
+
+	for (i = 0; i < Bytes; i++, Value >>= 8)
+		pData[i] = (UInt8)Value;
+
+}// PutLE
+
+
+/*! Load Bytes bytes stored little-endian.*/
+static uint64_t GetLE(const UInt8 *pData, UInt32 Bytes)
+{
+	uint64_t Value = 0;
+
+	while (Bytes--)
+		Value = (Value << 8) | pData[Bytes];
+
+	return Value;
+
+}// GetLE
+
+
+/*! Store a float little-endian.*/
+static void PutFloatLE(UInt8 *pData, float Value)
+{
+	uint32_t Bits;
+
+	memcpy(&Bits, &Value, sizeof(Bits));
+	PutLE(pData, Bits, 4);
+
+}// PutFloatLE
+
+
+/*! Fill a row from decoded data.
+	\param pRow points to the row to fill.
+	\param pData points to the decoded high speed data.
+	\param HostNs is the host arrival time of the packet.
+	\param Angle is the filtered angle.
+	\param Bias is the filter's gyro bias estimate.*/
+void ceFillRow(ColumnRow_t *pRow, const IMUData_t *pData, UInt64 HostNs, float Angle, float Bias)
+{
+	int i;
+
+	pRow->HostNs = HostNs;
+	pRow->TimeSincePPS = pData->TimeSincePPS;
+	pRow->PPSCount = pData->PPSCount;
+	pRow->SequenceNumber = pData->SequenceNumber;
+	for (i = 0; i < N_SENSOR_IDX; i++)
+		pRow->Sensors[i] = pData->SensorsConverted[i];
+	pRow->Angle = Angle;
+	pRow->Bias = Bias;
+
+}// ceFillRow
+
+
+/*! Create a column file.
+	\param pPath is the name of the file to create.
+	\return The writer, or NULL if it could not be created.*/
+ColumnWriter_t *ceOpen(const char *pPath)
+{
+	ColumnWriter_t *pWriter = (ColumnWriter_t *)calloc(1, sizeof(ColumnWriter_t));
+	UInt32 c;
+
+	if (pWriter == NULL)
+		return NULL;
+
+	for (c = 0; c < CE_COLUMNS; c++)
+	{
+		pWriter->pChunk[c] = (UInt8 *)malloc((size_t)CE_CHUNK_ROWS * ColumnExportColumns[c].ElementBytes);
+		if (pWriter->pChunk[c] == NULL)
+			break;
+	}
+
+	if ((c < CE_COLUMNS) || ((pWriter->pFile = fopen(pPath, "wb")) == NULL))
+	{
+		for (c = 0; c < CE_COLUMNS; c++)
+			free(pWriter->pChunk[c]);
+		free(pWriter);
+		return NULL;
+	}
+
+	return pWriter;
+
+}// ceOpen
+
+
+/*! Move the buffered rows of every column to its spill file.  The chunks
+	are empty afterwards even if that failed, the error is then kept.
+	\param pWriter points to the writer.*/
+static void Spill(ColumnWriter_t *pWriter)
+{
+	UInt32 c;
+
+	for (c = 0; c < CE_COLUMNS && !pWriter->Error; c++)
+	{
+		if ((pWriter->pSpill[c] == NULL) && ((pWriter->pSpill[c] = tmpfile()) == NULL))
+		{
+			pWriter->Error = TRUE;
+			break;
+		}
+
+		if (fwrite(pWriter->pChunk[c], ColumnExportColumns[c].ElementBytes, pWriter->Count,
+				   pWriter->pSpill[c]) != pWriter->Count)
+			pWriter->Error = TRUE;
+	}
+
+	pWriter->Count = 0;
+
+}// Spill
+
+
+/*! Append a row.
+	\param pWriter points to the writer.
+	\param pRow points to the row.
+	\return FALSE if a spill file could not be written, the row and every
+			one after it are then dropped.*/
+BOOL cePut(ColumnWriter_t *pWriter, const ColumnRow_t *pRow)
+{
+	UInt32 i = pWriter->Count, n;
+
+	if (pWriter->Error)
+		return FALSE;
+
+	PutLE(pWriter->pChunk[CE_HOST_NS] + 8 * i, pRow->HostNs, 8);
+	PutFloatLE(pWriter->pChunk[CE_TIME_SINCE_PPS] + 4 * i, pRow->TimeSincePPS);
+	pWriter->pChunk[CE_PPS_COUNT][i] = pRow->PPSCount;
+	pWriter->pChunk[CE_SEQ][i] = pRow->SequenceNumber;
+	for (n = 0; n < N_SENSOR_IDX; n++)
+		PutFloatLE(pWriter->pChunk[CE_SENSORS + n] + 4 * i, pRow->Sensors[n]);
+	PutFloatLE(pWriter->pChunk[CE_ANGLE] + 4 * i, pRow->Angle);
+	PutFloatLE(pWriter->pChunk[CE_BIAS] + 4 * i, pRow->Bias);
+
+	pWriter->Rows++;
+	if (++pWriter->Count == CE_CHUNK_ROWS)
+		Spill(pWriter);
+
+	return !pWriter->Error;
+
+}// cePut
+
+
+/*! Get the number of rows appended so far.
+	\param pWriter points to the writer.
+	\return The number of rows.*/
+UInt64 ceRows(const ColumnWriter_t *pWriter)
+{
+	return pWriter->Rows;
+
+}// ceRows
+
+
+/*! Write zero bytes up to an aligned file offset.
+	\param pFile is the output file.
+	\param Offset is the current offset.
+	\param Target is the offset to pad to.*/
+static void Pad(FILE *pFile, UInt64 Offset, UInt64 Target)
+{
+	static const UInt8 Zeros[CE_ALIGN_BYTES];
+
+	if (Target > Offset)
+		fwrite(Zeros, 1, (size_t)(Target - Offset), pFile);
+
+}// Pad
+
+
+/*! Write the header and the columns, close the file and free the writer.
+	\param pWriter points to the writer.
+	\return FALSE if anything could not be written, the file is then
+			incomplete.*/
+BOOL ceClose(ColumnWriter_t *pWriter)
+{
+	UInt8 Header[sizeof(ColumnFileHeader_t)], Desc[sizeof(ColumnDesc_t)], Copy[4096];
+	UInt64 Offsets[CE_COLUMNS], Offset;
+	UInt32 HeaderBytes = sizeof(ColumnFileHeader_t) + CE_COLUMNS * sizeof(ColumnDesc_t);
+	UInt32 c;
+	size_t Bytes;
+	BOOL Ok;
+
+	if (pWriter == NULL)
+		return FALSE;
+
+	// Only a capture longer than a chunk goes through the spill files
+	if (pWriter->pSpill[0] && pWriter->Count)
+		Spill(pWriter);
+
+	// Lay the columns out back to back, each aligned
+	Offset = HeaderBytes;
+	for (c = 0; c < CE_COLUMNS; c++)
+	{
+		Offset = (Offset + CE_ALIGN_BYTES - 1) / CE_ALIGN_BYTES * CE_ALIGN_BYTES;
+		Offsets[c] = Offset;
+		Offset += pWriter->Rows * ColumnExportColumns[c].ElementBytes;
+	}
+
+	memset(Header, 0, sizeof(Header));
+	memcpy(Header + offsetof(ColumnFileHeader_t, Magic), CE_MAGIC, 8);
+	PutLE(Header + offsetof(ColumnFileHeader_t, HeaderBytes), HeaderBytes, 4);
+	PutLE(Header + offsetof(ColumnFileHeader_t, ColumnCount), CE_COLUMNS, 4);
+	PutLE(Header + offsetof(ColumnFileHeader_t, Rows), pWriter->Rows, 8);
+	PutLE(Header + offsetof(ColumnFileHeader_t, Align), CE_ALIGN_BYTES, 4);
+	fwrite(Header, sizeof(Header), 1, pWriter->pFile);
+
+	for (c = 0; c < CE_COLUMNS; c++)
+	{
+		memset(Desc, 0, sizeof(Desc));
+		memcpy(Desc + offsetof(ColumnDesc_t, Name), ColumnExportColumns[c].Name, CE_NAME_LEN);
+		memcpy(Desc + offsetof(ColumnDesc_t, DType), ColumnExportColumns[c].DType, 4);
+		PutLE(Desc + offsetof(ColumnDesc_t, ElementBytes), ColumnExportColumns[c].ElementBytes, 4);
+		PutLE(Desc + offsetof(ColumnDesc_t, Offset), Offsets[c], 8);
+		fwrite(Desc, sizeof(Desc), 1, pWriter->pFile);
+	}
+
+	Offset = HeaderBytes;
+	for (c = 0; c < CE_COLUMNS; c++)
+	{
+		Pad(pWriter->pFile, Offset, Offsets[c]);
+		Offset = Offsets[c] + pWriter->Rows * ColumnExportColumns[c].ElementBytes;
+
+		if (pWriter->pSpill[c])
+		{
+			rewind(pWriter->pSpill[c]);
+			while ((Bytes = fread(Copy, 1, sizeof(Copy), pWriter->pSpill[c])) > 0)
+				fwrite(Copy, 1, Bytes, pWriter->pFile);
+			fclose(pWriter->pSpill[c]);
+		}
+		else
+			fwrite(pWriter->pChunk[c], ColumnExportColumns[c].ElementBytes, pWriter->Count, pWriter->pFile);
+
+		free(pWriter->pChunk[c]);
+	}
+
+	Ok = !pWriter->Error && !ferror(pWriter->pFile) && ((UInt64)ftell(pWriter->pFile) == Offset);
+	Ok = (fclose(pWriter->pFile) == 0) && Ok;
+	free(pWriter);
+
+	return Ok;
+
+}// ceClose
+
+
+/*! Read and check the header and column table of a column file.
+	\param pFile is the file, positioned at the start.
+	\param pHeader points to space to receive the header in host byte order.
+	\param pColumns points to space for MaxColumns descriptors in host byte
+		   order.
+	\param MaxColumns is the most descriptors to return.
+	\return FALSE if the file is not a column file.*/
+BOOL ceReadHeader(FILE *pFile, ColumnFileHeader_t *pHeader, ColumnDesc_t *pColumns, UInt32 MaxColumns)
+{
+	UInt8 Header[sizeof(ColumnFileHeader_t)], Desc[sizeof(ColumnDesc_t)];
+	UInt32 c;
+
+	if ((fread(Header, sizeof(Header), 1, pFile) != 1) || (memcmp(Header, CE_MAGIC, 8) != 0))
+		return FALSE;
+
+	memcpy(pHeader->Magic, Header, 8);
+	pHeader->HeaderBytes = (uint32_t)GetLE(Header + offsetof(ColumnFileHeader_t, HeaderBytes), 4);
+	pHeader->ColumnCount = (uint32_t)GetLE(Header + offsetof(ColumnFileHeader_t, ColumnCount), 4);
+	pHeader->Rows = GetLE(Header + offsetof(ColumnFileHeader_t, Rows), 8);
+	pHeader->Align = (uint32_t)GetLE(Header + offsetof(ColumnFileHeader_t, Align), 4);
+	pHeader->Reserved = 0;
+
+	for (c = 0; (c < pHeader->ColumnCount) && (c < MaxColumns); c++)
+	{
+		if (fread(Desc, sizeof(Desc), 1, pFile) != 1)
+			return FALSE;
+
+		memcpy(pColumns[c].Name, Desc + offsetof(ColumnDesc_t, Name), CE_NAME_LEN);
+		memcpy(pColumns[c].DType, Desc + offsetof(ColumnDesc_t, DType), 4);
+		pColumns[c].ElementBytes = (uint32_t)GetLE(Desc + offsetof(ColumnDesc_t, ElementBytes), 4);
+		pColumns[c].Offset = GetLE(Desc + offsetof(ColumnDesc_t, Offset), 8);
+	}
+
+	return TRUE;
+
+}// ceReadHeader
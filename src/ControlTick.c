@@ -0,0 +1,316 @@
+/*! \file
+	\brief Fixed rate control tick, decoupled from IMU packet arrival.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "Atomic.h"
+#include "ControlTick.h"
+#include "HostTime.h"
+
+#ifdef WIN32
+#include <windows.h>
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION	0x00000002
+#endif
+#else
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#endif
+
+// Attempts at a consistent snapshot before keeping the last one
+#define CT_READ_TRIES		64
+
+struct ControlTick_t
+{
+	ControlTickConfig_t Config;
+	UInt64 PeriodNs;
+	volatile UInt32 Stop;					//!< Set to ask the thread to exit
+	ControlTickStats_t Stats;				//!< Written by the tick thread only
+
+#ifdef WIN32
+	HANDLE Timer;
+	HANDLE Thread;
+#else
+	pthread_t Thread;
+#endif
+};
+
+
+/*! Empty a snapshot.
+	\param pSnapshot is the snapshot.*/
+void ctInitSnapshot(ControlSnapshot_t *pSnapshot)
+{
+	memset(pSnapshot, 0, sizeof(*pSnapshot));
+
+}// ctInitSnapshot
+
+
+/*! Publish the predictor state after a sample was filtered.  Never blocks;
+	only one thread may publish to a snapshot.
+	\param pSnapshot is the snapshot.
+	\param pPredictor is the predictor just updated with the sample.*/
+void ctPublish(ControlSnapshot_t *pSnapshot, const AnglePredictor_t *pPredictor)
+{
+	UInt32 Sequence = pSnapshot->Sequence;
+
+	// Odd tells readers a copy taken now may be torn
+	atomicStoreRelaxed(&pSnapshot->Sequence, Sequence + 1);
+	atomicFence();
+
+	pSnapshot->Predictor = *pPredictor;
+	pSnapshot->Published++;
+
+	atomicStoreRelease(&pSnapshot->Sequence, Sequence + 2);
+
+}// ctPublish
+
+
+/*! Copy the latest predictor state.
+	\param pSnapshot is the snapshot.
+	\param pPredictor receives the state, unchanged on failure.
+	\param pPublished receives the number of samples published, unchanged
+		   on failure.
+	\return TRUE if a consistent copy was taken.*/
+BOOL ctRead(const ControlSnapshot_t *pSnapshot, AnglePredictor_t *pPredictor, UInt32 *pPublished)
+{
+	AnglePredictor_t Copy;
+	UInt32 Before, Published, Try;
+
+	for (Try = 0; Try < CT_READ_TRIES; Try++)
+	{
+		Before = atomicLoadAcquire(&pSnapshot->Sequence);
+		if (Before & 1)
+			continue;
+
+		Copy = pSnapshot->Predictor;
+		Published = pSnapshot->Published;
+
+		// The copy must be done before the sequence is checked again
+		atomicFence();
+
+		if (atomicLoadRelaxed(&pSnapshot->Sequence) == Before)
+		{
+			*pPredictor = Copy;
+			*pPublished = Published;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+
+}// ctRead
+
+
+#ifdef WIN32
+/*! Sleep until a host time.
+	\param pTick is the tick, for its timer.
+	\param DeadlineNs is the htNowNs() time to wake at.*/
+static void SleepUntil(ControlTick_t *pTick, UInt64 DeadlineNs)
+{
+	UInt64 Now = htNowNs();
+	LARGE_INTEGER Due;
+
+	if (DeadlineNs <= Now)
+		return;
+
+	// Waitable timers take absolute times on the wall clock only, so relative it is, in 100 ns units
+	Due.QuadPart = -(LONGLONG)((DeadlineNs - Now + 99) / 100);
+
+	if (pTick->Timer && SetWaitableTimer(pTick->Timer, &Due, 0, NULL, NULL, FALSE))
+		WaitForSingleObject(pTick->Timer, INFINITE);
+	else
+		Sleep((DWORD)((DeadlineNs - Now) / 1000000));
+
+}// SleepUntil
+#else
+/*! Sleep until a host time.
+	\param pTick is the tick.
+	\param DeadlineNs is the htNowNs() time to wake at.*/
+static void SleepUntil(ControlTick_t *pTick, UInt64 DeadlineNs)
+{
+	struct timespec Due;
+
+	(void)pTick;
+
+	Due.tv_sec = (time_t)(DeadlineNs / 1000000000ULL);
+	Due.tv_nsec = (long)(DeadlineNs % 1000000000ULL);
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &Due, NULL) == EINTR)
+		;
+
+}// SleepUntil
+#endif
+
+
+/*! Tick thread, runs until ctStop() sets Stop.
+	\param pArg points to the tick.*/
+#ifdef WIN32
+static DWORD WINAPI TickThread(LPVOID pArg)
+#else
+static void *TickThread(void *pArg)
+#endif
+{
+	ControlTick_t *pTick = (ControlTick_t *)pArg;
+	const ControlTickConfig_t *pConfig = &pTick->Config;
+	ControlTickStats_t *pStats = &pTick->Stats;
+	ControlTickInfo_t Info;
+	AnglePredictor_t Predictor;
+	UInt32 Published = 0, LastPublished = 0;
+	UInt64 Next, Now, Skipped;
+
+	if (pConfig->pRealTime)
+		pStats->RealTime = rtEnter(pConfig->pRealTime);
+
+	memset(&Info, 0, sizeof(Info));
+	memset(&Predictor, 0, sizeof(Predictor));
+
+	Next = htNowNs() + pTick->PeriodNs;
+
+	while (!atomicLoadAcquire(&pTick->Stop))
+	{
+		SleepUntil(pTick, Next);
+
+		Info.WakeNs = htNowNs();
+		Info.DeadlineNs = Next;
+
+		// A failed read leaves the last copy, which then counts as stale
+		ctRead(pConfig->pSnapshot, &Predictor, &Published);
+
+		Info.Samples = Published;
+		if (Published)
+		{
+			Info.Angle = apPredict(&Predictor, Next + pConfig->LeadNs);
+			Info.Rate = Predictor.Rate;
+			Info.SampleAngle = Predictor.Angle;
+			Info.SampleAgeMs = (float)((double)(SInt64)(Next - Predictor.SampleNs) / 1.0e6);
+		}
+
+		if (Published == LastPublished)
+			pStats->Stale++;
+		LastPublished = Published;
+
+		pConfig->pCallback(pConfig->pArg, &Info);
+
+		Now = htNowNs();
+		lhAdd(&pStats->Jitter, (Info.WakeNs > Next) ? Info.WakeNs - Next : 0);
+		lhAdd(&pStats->Run, Now - Info.WakeNs);
+		pStats->Ticks++;
+
+		Next += pTick->PeriodNs;
+		Info.Tick++;
+
+		// Run a late deadline at once, skip those a whole period gone
+		if (Now > Next)
+		{
+			pStats->Overruns++;
+
+			Skipped = (Now - Next) / pTick->PeriodNs;
+			Next += Skipped * pTick->PeriodNs;
+			Info.Tick += Skipped;
+			pStats->Missed += Skipped;
+		}
+	}
+
+	return 0;
+
+}// TickThread
+
+
+/*! Start running a callback at a fixed rate.
+	\param pConfig is the settings, which are copied.
+	\return The tick, or NULL if it couldn't be started.*/
+ControlTick_t *ctStart(const ControlTickConfig_t *pConfig)
+{
+	ControlTick_t *pTick;
+
+	if (pConfig->RateHz <= 0 || pConfig->pCallback == NULL || pConfig->pSnapshot == NULL)
+		return NULL;
+
+	pTick = (ControlTick_t *)calloc(1, sizeof(ControlTick_t));
+	if (pTick == NULL)
+		return NULL;
+
+	pTick->Config = *pConfig;
+	pTick->PeriodNs = (UInt64)(1.0e9 / pConfig->RateHz + 0.5);
+	lhReset(&pTick->Stats.Jitter);
+	lhReset(&pTick->Stats.Run);
+
+#ifdef WIN32
+	pTick->Timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (pTick->Timer == NULL)
+		pTick->Timer = CreateWaitableTimer(NULL, TRUE, NULL);
+
+	pTick->Thread = CreateThread(NULL, 0, TickThread, pTick, 0, NULL);
+	if (pTick->Thread == NULL)
+	{
+		if (pTick->Timer)
+			CloseHandle(pTick->Timer);
+#else
+	if (pthread_create(&pTick->Thread, NULL, TickThread, pTick) != 0)
+	{
+#endif
+		free(pTick);
+		return NULL;
+	}
+
+	return pTick;
+
+}// ctStart
+
+
+/*! Copy the counters and histograms.  While the tick runs they can be off
+	by the tick in progress.
+	\param pTick is the tick.
+	\param pStats receives the statistics.*/
+void ctGetStats(const ControlTick_t *pTick, ControlTickStats_t *pStats)
+{
+	*pStats = pTick->Stats;
+
+}// ctGetStats
+
+
+/*! Print the counters and a line per histogram, straight from the tick's
+	own statistics so nothing is copied or allocated; like ctGetStats() the
+	numbers may be a tick apart.
+	\param pTick is the tick.
+	\param pFile is where to print.*/
+void ctPrintStats(const ControlTick_t *pTick, FILE *pFile)
+{
+	const ControlTickStats_t *pStats = &pTick->Stats;
+
+	fprintf(pFile, "control tick %.1f Hz: %llu ticks, %llu missed, %llu overruns, %llu without a new sample\n",
+			pTick->Config.RateHz, (unsigned long long)pStats->Ticks, (unsigned long long)pStats->Missed,
+			(unsigned long long)pStats->Overruns, (unsigned long long)pStats->Stale);
+
+	if (pStats->Ticks)
+	{
+		lhPrintSummary(pFile, "tick jitter", &pStats->Jitter);
+		lhPrintSummary(pFile, "tick run", &pStats->Run);
+	}
+
+}// ctPrintStats
+
+
+/*! Stop the tick, waiting for the callback in progress, if any.
+	\param pTick is the tick, which is freed.*/
+void ctStop(ControlTick_t *pTick)
+{
+	if (pTick == NULL)
+		return;
+
+	atomicStoreRelease(&pTick->Stop, 1);
+
+#ifdef WIN32
+	WaitForSingleObject(pTick->Thread, INFINITE);
+	CloseHandle(pTick->Thread);
+	if (pTick->Timer)
+		CloseHandle(pTick->Timer);
+#else
+	pthread_join(pTick->Thread, NULL);
+#endif
+
+	free(pTick);
+
+}// ctStop
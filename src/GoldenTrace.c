@@ -0,0 +1,384 @@
+/*! \file
+	\brief Golden traces of the decode and filter pipeline.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CalcAngle.h"
+#include "GoldenTrace.h"
+#include "IMUPacket.h"
+#include "IMUSerial.h"
+#include "Recording.h"
+#include "Tilt.h"
+
+#define GT_MAGIC			"CIMUGLD1"
+
+const char *const GoldenFieldNames[GT_FIELDS] =
+{
+	"time", "gyro_x", "gyro_y", "gyro_z", "accel_x", "accel_y", "accel_z", "angle", "bias"
+};
+
+
+/*! Fill in the default tolerances.
+	\param pTol points to the tolerances.*/
+void gtDefaultTolerance(GoldenTolerance_t *pTol)
+{
+	pTol->Field[GT_TIME] = GT_TOL_TIME;
+	pTol->Field[GT_GYROX] = pTol->Field[GT_GYROY] = pTol->Field[GT_GYROZ] = GT_TOL_GYRO;
+	pTol->Field[GT_ACCELX] = pTol->Field[GT_ACCELY] = pTol->Field[GT_ACCELZ] = GT_TOL_ACCEL;
+	pTol->Field[GT_ANGLE] = GT_TOL_ANGLE;
+	pTol->Field[GT_BIAS] = GT_TOL_BIAS;
+
+}// gtDefaultTolerance
+
+
+/*! Append a sample to a trace.
+	\param pTrace points to the trace.
+	\param pSample points to the sample.
+	\return FALSE if out of memory.*/
+static BOOL Append(GoldenTrace_t *pTrace, const GoldenSample_t *pSample)
+{
+	if (pTrace->TraceCount == pTrace->TraceCapacity)
+	{
+		UInt32 Capacity = pTrace->TraceCapacity ? 2 * pTrace->TraceCapacity : 4096;
+		GoldenSample_t *pNew = (GoldenSample_t *)realloc(pTrace->pTrace, Capacity * sizeof(GoldenSample_t));
+
+		if (pNew == NULL)
+			return FALSE;
+		pTrace->pTrace = pNew;
+		pTrace->TraceCapacity = Capacity;
+	}
+
+	pTrace->pTrace[pTrace->TraceCount++] = *pSample;
+
+	return TRUE;
+
+}// Append
+
+
+/*! Run a byte stream through the pipeline.
+	\param pBytes points to the stream.
+	\param Count is the stream length.
+	\param TraceEvery traces one sample in this many, 0 is taken as 1.
+	\param pTrace points to the trace to fill, zeroed or from an earlier
+		   run, whose memory is reused.
+	\return FALSE if out of memory.*/
+BOOL gtRun(const UInt8 *pBytes, UInt64 Count, UInt32 TraceEvery, GoldenTrace_t *pTrace)
+{
+	GoldenSample_t *pKeep = pTrace->pTrace, Sample;
+	UInt32 KeepCapacity = pTrace->TraceCapacity, f;
+	double Sum[GT_FIELDS];
+	IMUPacket_t Pkt;
+	IMUData_t IMU;
+	KFilter_t KF;
+	RecordingClock_t Clock;
+	BOOL Waiting = TRUE;
+	UInt64 i;
+
+	memset(pTrace, 0, sizeof(*pTrace));
+	pTrace->pTrace = pKeep;
+	pTrace->TraceCapacity = KeepCapacity;
+	pTrace->Bytes = Count;
+	pTrace->TraceEvery = TraceEvery ? TraceEvery : 1;
+
+	memset(Sum, 0, sizeof(Sum));
+	memset(&IMU, 0, sizeof(IMU));
+	Pkt.state = SERIAL_STATE_SYNC0;
+	kfInit(&KF);
+	recClockInit(&Clock);
+
+	for (i = 0; i < Count; i++)
+	{
+		if (!LookForIMUPacketInByte(pBytes[i], &Pkt))
+			continue;
+
+		pTrace->Packets++;
+		pTrace->TypeCount[Pkt.type]++;
+
+		DecodeIMUPacket(&Pkt, &IMU);
+		if (Pkt.type == RESOLUTION_IMU_MSG)
+			Waiting = FALSE;
+		if (Pkt.type != HS_SERIAL_IMU_MSG)
+			continue;
+		if (Waiting)
+		{
+			pTrace->Skipped++;
+			continue;
+		}
+
+		kfGetAngle(&KF, TiltRollDeg(&IMU), IMU.SensorsConverted[GYROX_IDX], recClockStep(&Clock, &IMU));
+
+		Sample.PPSCount = IMU.PPSCount;
+		Sample.SequenceNumber = IMU.SequenceNumber;
+		Sample.Value[GT_TIME] = IMU.TimeSincePPS;
+		for (f = 0; f < N_SENSOR_IDX; f++)
+			Sample.Value[GT_GYROX + f] = IMU.SensorsConverted[f];
+		Sample.Value[GT_ANGLE] = KF.angle;
+		Sample.Value[GT_BIAS] = KF.bias;
+
+		for (f = 0; f < GT_FIELDS; f++)
+			Sum[f] += Sample.Value[f];
+
+		if ((pTrace->Samples % pTrace->TraceEvery == 0) && !Append(pTrace, &Sample))
+			return FALSE;
+		pTrace->Samples++;
+	}
+
+	for (f = 0; f < GT_FIELDS; f++)
+		pTrace->Mean[f] = pTrace->Samples ? Sum[f] / pTrace->Samples : 0.0;
+
+	return TRUE;
+
+}// gtRun
+
+
+/*! Free the memory of a trace.
+	\param pTrace points to the trace.*/
+void gtFree(GoldenTrace_t *pTrace)
+{
+	free(pTrace->pTrace);
+	memset(pTrace, 0, sizeof(*pTrace));
+
+}// gtFree
+
+
+/*! Store a trace as a golden file.
+	\param pPath is the file to write.
+	\param pName names the corpus entry, one word.
+	\param pTrace points to the trace.
+	\return FALSE if the file can't be written.*/
+BOOL gtWrite(const char *pPath, const char *pName, const GoldenTrace_t *pTrace)
+{
+	FILE *pFile = fopen(pPath, "w");
+	UInt32 i, f;
+
+	if (pFile == NULL)
+		return FALSE;
+
+	fprintf(pFile, "%s %s\n", GT_MAGIC, pName);
+	fprintf(pFile, "bytes %llu\n", (unsigned long long)pTrace->Bytes);
+	fprintf(pFile, "packets %llu\n", (unsigned long long)pTrace->Packets);
+	for (i = 0; i < 256; i++)
+		if (pTrace->TypeCount[i])
+			fprintf(pFile, "type 0x%02X %llu\n", (unsigned)i, (unsigned long long)pTrace->TypeCount[i]);
+	fprintf(pFile, "skipped %llu\n", (unsigned long long)pTrace->Skipped);
+	fprintf(pFile, "samples %llu\n", (unsigned long long)pTrace->Samples);
+	fprintf(pFile, "every %lu\n", (unsigned long)pTrace->TraceEvery);
+	fprintf(pFile, "throughput %.0f\n", pTrace->SamplesPerSec);
+
+	fprintf(pFile, "mean");
+	for (f = 0; f < GT_FIELDS; f++)
+		fprintf(pFile, " %.17g", pTrace->Mean[f]);
+
+	fprintf(pFile, "\ntrace %lu\n# pps seq", (unsigned long)pTrace->TraceCount);
+	for (f = 0; f < GT_FIELDS; f++)
+		fprintf(pFile, " %s", GoldenFieldNames[f]);
+	fprintf(pFile, "\n");
+
+	for (i = 0; i < pTrace->TraceCount; i++)
+	{
+		const GoldenSample_t *pSample = &pTrace->pTrace[i];
+
+		fprintf(pFile, "%u %u", (unsigned)pSample->PPSCount, (unsigned)pSample->SequenceNumber);
+		for (f = 0; f < GT_FIELDS; f++)
+			fprintf(pFile, " %.9g", pSample->Value[f]);
+		fprintf(pFile, "\n");
+	}
+
+	return fclose(pFile) == 0;
+
+}// gtWrite
+
+
+/*! Read a golden file.
+	\param pPath is the file.
+	\param pTrace points to a zeroed trace to fill, free it with gtFree()
+		   whatever the result.
+	\return FALSE if the file can't be read or is not a golden file.*/
+BOOL gtRead(const char *pPath, GoldenTrace_t *pTrace)
+{
+	FILE *pFile = fopen(pPath, "r");
+	char Line[512];
+	unsigned long long Value;
+	unsigned long Traced = 0;
+	unsigned Type, PPS, Seq;
+	GoldenSample_t Sample;
+	BOOL Ok = FALSE;
+	UInt32 f;
+	int Used;
+	char *p;
+
+	if (pFile == NULL)
+		return FALSE;
+
+	if (!fgets(Line, sizeof(Line), pFile) || (strncmp(Line, GT_MAGIC, strlen(GT_MAGIC)) != 0))
+	{
+		fclose(pFile);
+		return FALSE;
+	}
+
+	while (fgets(Line, sizeof(Line), pFile))
+	{
+		if (sscanf(Line, "bytes %llu", &Value) == 1)
+			pTrace->Bytes = Value;
+		else if (sscanf(Line, "packets %llu", &Value) == 1)
+			pTrace->Packets = Value;
+		else if ((sscanf(Line, "type %x %llu", &Type, &Value) == 2) && (Type < 256))
+			pTrace->TypeCount[Type] = Value;
+		else if (sscanf(Line, "skipped %llu", &Value) == 1)
+			pTrace->Skipped = Value;
+		else if (sscanf(Line, "samples %llu", &Value) == 1)
+			pTrace->Samples = Value;
+		else if (sscanf(Line, "every %llu", &Value) == 1)
+			pTrace->TraceEvery = (UInt32)Value;
+		else if (sscanf(Line, "throughput %lf", &pTrace->SamplesPerSec) == 1)
+			;
+		else if (strncmp(Line, "mean", 4) == 0)
+		{
+			for (p = Line + 4, f = 0; (f < GT_FIELDS) && (sscanf(p, "%lf%n", &pTrace->Mean[f], &Used) == 1); f++)
+				p += Used;
+			if (f != GT_FIELDS)
+				break;
+		}
+		else if (sscanf(Line, "trace %lu", &Traced) == 1)
+		{
+			Ok = TRUE;
+			break;
+		}
+	}
+
+	// The samples follow the trace line, after a heading
+	while (Ok && (pTrace->TraceCount < Traced) && fgets(Line, sizeof(Line), pFile))
+	{
+		if (Line[0] == '#')
+			continue;
+
+		Ok = (sscanf(Line, "%u %u%n", &PPS, &Seq, &Used) == 2);
+		for (p = Line, f = 0; Ok && (f < GT_FIELDS); f++)
+		{
+			p += Used;
+			Ok = (sscanf(p, "%f%n", &Sample.Value[f], &Used) == 1);
+		}
+
+		Sample.PPSCount = (UInt8)PPS;
+		Sample.SequenceNumber = (UInt8)Seq;
+		Ok = Ok && Append(pTrace, &Sample);
+	}
+
+	fclose(pFile);
+
+	return Ok && (pTrace->TraceCount == Traced);
+
+}// gtRead
+
+
+/*! Check a count.
+	\return 1 if it doesn't match, else 0.*/
+static UInt64 CheckCount(const char *pWhat, UInt64 Golden, UInt64 Got, FILE *pReport)
+{
+	if (Golden == Got)
+		return 0;
+
+	if (pReport)
+		fprintf(pReport, "  %s: %llu, golden %llu\n", pWhat, (unsigned long long)Got, (unsigned long long)Golden);
+
+	return 1;
+
+}// CheckCount
+
+
+/*! Compare a trace with a golden one.
+	\param pGolden points to the golden trace.
+	\param pTrace points to the new trace.
+	\param pTol points to the tolerances.
+	\param pReport is where to describe the differences, may be NULL.
+	\return The number of counts, samples and fields that differ.*/
+UInt64 gtCompare(const GoldenTrace_t *pGolden, const GoldenTrace_t *pTrace, const GoldenTolerance_t *pTol,
+				 FILE *pReport)
+{
+	UInt64 Bad = 0, Wrong[GT_FIELDS], Order = 0;
+	double Worst[GT_FIELDS], Diff;
+	UInt32 WorstAt[GT_FIELDS], i, f, Count;
+	char What[32];
+
+	Bad += CheckCount("bytes", pGolden->Bytes, pTrace->Bytes, pReport);
+	Bad += CheckCount("packets", pGolden->Packets, pTrace->Packets, pReport);
+	for (i = 0; i < 256; i++)
+	{
+		sprintf(What, "type 0x%02X packets", (unsigned)i);
+		Bad += CheckCount(What, pGolden->TypeCount[i], pTrace->TypeCount[i], pReport);
+	}
+	Bad += CheckCount("samples before the resolution packet", pGolden->Skipped, pTrace->Skipped, pReport);
+	Bad += CheckCount("samples", pGolden->Samples, pTrace->Samples, pReport);
+	Bad += CheckCount("trace spacing", pGolden->TraceEvery, pTrace->TraceEvery, pReport);
+	Bad += CheckCount("traced samples", pGolden->TraceCount, pTrace->TraceCount, pReport);
+
+	for (f = 0; f < GT_FIELDS; f++)
+	{
+		Diff = fabs(pTrace->Mean[f] - pGolden->Mean[f]);
+		if (!(Diff <= pTol->Field[f]))
+		{
+			Bad++;
+			if (pReport)
+				fprintf(pReport, "  mean %s: %.9g, golden %.9g\n", GoldenFieldNames[f], pTrace->Mean[f], pGolden->Mean[f]);
+		}
+
+		Wrong[f] = 0;
+		Worst[f] = 0.0;
+		WorstAt[f] = 0;
+	}
+
+	// Sample by sample, only as far as both go if the spacing matches
+	Count = (pGolden->TraceCount < pTrace->TraceCount) ? pGolden->TraceCount : pTrace->TraceCount;
+	if (pGolden->TraceEvery != pTrace->TraceEvery)
+		Count = 0;
+
+	for (i = 0; i < Count; i++)
+	{
+		const GoldenSample_t *pG = &pGolden->pTrace[i], *pT = &pTrace->pTrace[i];
+
+		if ((pG->PPSCount != pT->PPSCount) || (pG->SequenceNumber != pT->SequenceNumber))
+		{
+			if (pReport && (Order < GT_MAX_REPORTS))
+				fprintf(pReport, "  sample %llu: pps %u seq %u, golden pps %u seq %u\n",
+						(unsigned long long)i * pTrace->TraceEvery, (unsigned)pT->PPSCount,
+						(unsigned)pT->SequenceNumber, (unsigned)pG->PPSCount, (unsigned)pG->SequenceNumber);
+			Order++;
+		}
+
+		for (f = 0; f < GT_FIELDS; f++)
+		{
+			// A NaN on either side is never within tolerance
+			Diff = fabs((double)pT->Value[f] - pG->Value[f]);
+			if (Diff <= pTol->Field[f])
+				continue;
+
+			if (pReport && (Wrong[f] < GT_MAX_REPORTS))
+				fprintf(pReport, "  sample %llu %s: %.9g, golden %.9g\n", (unsigned long long)i * pTrace->TraceEvery,
+						GoldenFieldNames[f], pT->Value[f], pG->Value[f]);
+			if (!(Diff <= Worst[f]))
+			{
+				Worst[f] = Diff;
+				WorstAt[f] = i;
+			}
+			Wrong[f]++;
+		}
+	}
+
+	Bad += Order;
+	if (pReport && (Order > GT_MAX_REPORTS))
+		fprintf(pReport, "  %llu samples out of order in all\n", (unsigned long long)Order);
+
+	for (f = 0; f < GT_FIELDS; f++)
+	{
+		Bad += Wrong[f];
+		if (pReport && Wrong[f])
+			fprintf(pReport, "  %s: %llu samples out of tolerance %g, worst %.3g at sample %llu\n", GoldenFieldNames[f],
+					(unsigned long long)Wrong[f], pTol->Field[f], Worst[f],
+					(unsigned long long)WorstAt[f] * pTrace->TraceEvery);
+	}
+
+	return Bad;
+
+}// gtCompare
@@ -0,0 +1,68 @@
+/*! \file
+	\brief Monotonic host clock.
+*/
+
+#include "HostTime.h"
+
+#ifdef WIN32
+
+#include <windows.h>
+
+/*! Get the current monotonic host time.
+	\return Nanoseconds since an arbitrary, fixed starting point.*/
+UInt64 htNowNs(void)
+{
+	static LARGE_INTEGER Freq;
+	LARGE_INTEGER Count;
+
+	if (Freq.QuadPart == 0)
+		QueryPerformanceFrequency(&Freq);
+
+	QueryPerformanceCounter(&Count);
+
+	// Split the conversion to avoid overflowing 64 bits
+	return (UInt64)((Count.QuadPart / Freq.QuadPart) * 1000000000 +
+					((Count.QuadPart % Freq.QuadPart) * 1000000000) / Freq.QuadPart);
+
+}// htNowNs
+
+
+/*! Suspend the calling thread.
+	\param Ms is the number of milliseconds to sleep.*/
+void htSleepMs(UInt32 Ms)
+{
+	Sleep(Ms);
+
+}// htSleepMs
+
+#else
+
+#include <time.h>
+
+/*! Get the current monotonic host time.
+	\return Nanoseconds since an arbitrary, fixed starting point.*/
+UInt64 htNowNs(void)
+{
+	struct timespec Ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &Ts);
+
+	return (UInt64)Ts.tv_sec * 1000000000ULL + (UInt64)Ts.tv_nsec;
+
+}// htNowNs
+
+
+/*! Suspend the calling thread.
+	\param Ms is the number of milliseconds to sleep.*/
+void htSleepMs(UInt32 Ms)
+{
+	struct timespec Ts;
+
+	Ts.tv_sec = Ms / 1000;
+	Ts.tv_nsec = (long)(Ms % 1000) * 1000000L;
+
+	nanosleep(&Ts, NULL);
+
+}// htSleepMs
+
+#endif
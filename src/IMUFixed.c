@@ -0,0 +1,130 @@
+/*! \file
+	\brief Fixed point decode path for targets without an FPU.
+*/
+
+#include "ByteOrder.h"
+#include "IMUFixed.h"
+#include "Tilt.h"
+
+// FastAtan2f() coefficients in Q15, scaled to degrees
+#define ATANQ_C1	((SInt32)( 0.99997726 * 57.2957795 * 32768))
+#define ATANQ_C3	((SInt32)(-0.33262347 * 57.2957795 * 32768))
+#define ATANQ_C5	((SInt32)( 0.19354346 * 57.2957795 * 32768))
+#define ATANQ_C7	((SInt32)(-0.11643287 * 57.2957795 * 32768))
+#define ATANQ_C9	((SInt32)( 0.05265332 * 57.2957795 * 32768))
+#define ATANQ_C11	((SInt32)(-0.01172120 * 57.2957795 * 32768))
+
+
+/*! Compute the count to engineering unit multipliers.  This is the only
+	place floating point is used, and it runs once per configuration.
+	\param pScale points to space to receive the multipliers.
+	\param pData points to IMU data holding the decoded sensor ranges.*/
+void SetFixedScale(IMUFixedScale_t *pScale, const IMUData_t *pData)
+{
+	// Same resolutions as DecodeHighSpeedDataPacket(), times 2^32
+	pScale->GyroMul  = (UInt32)((2.0 * pData->GyroRange) / 65535.0 * 4294967296.0 + 0.5);
+	pScale->AccelMul = (UInt32)((2.0 * pData->AccelRange * 9.81) / 65535.0 * 4294967296.0 + 0.5);
+
+}// SetFixedScale
+
+
+/*! Decodes an incoming high-speed converted telemetry data packet into
+ *  fixed point.
+ *  \param pPkt A pointer to the received packet meant to be decoded.
+ *  \param pScale The multipliers computed by SetFixedScale().
+ *  \param pData The data container in which to store the IMU data. */
+void DecodeHighSpeedDataPacketQ(const IMUPacket_t *pPkt, const IMUFixedScale_t *pScale, IMUDataQ_t *pData)
+{
+	UInt8 i = 0, s;
+
+	// Raw sensor data
+	for (s = 0; s < N_SENSOR_IDX; s++, i += 2)
+	{
+		SInt64 Mul = (s < ACCELX_IDX) ? pScale->GyroMul : pScale->AccelMul;
+
+		pData->Raw[s] = DataToSInt16(&pPkt->data[i]);
+		pData->Converted[s] = (Q16_t)((pData->Raw[s] * Mul) >> 16);
+	}
+
+	// PPS data
+	pData->PPSTicks = DataToUInt32(&pPkt->data[i]) & 0xFFFFFFFF; i += 4;
+	pData->PPSCount = pPkt->data[i++];
+
+	// Packet sequence number
+	pData->SequenceNumber = pPkt->data[i];
+
+}// DecodeHighSpeedDataPacketQ
+
+
+/*! Fill the high speed fields of the float IMU data from a fixed point
+	sample, for consumers that take floats.  The rest is left alone.
+	\param pData points to the IMU data to fill.
+	\param pDataQ points to the fixed point sample.*/
+void IMUDataFromQ(IMUData_t *pData, const IMUDataQ_t *pDataQ)
+{
+	int s;
+
+	for (s = 0; s < N_SENSOR_IDX; s++)
+		pData->SensorsConverted[s] = Q16_TO_FLOAT(pDataQ->Converted[s]);
+
+	pData->TimeSincePPS = (float)(pDataQ->PPSTicks / 10000.0);
+	pData->PPSCount = pDataQ->PPSCount;
+	pData->SequenceNumber = pDataQ->SequenceNumber;
+
+}// IMUDataFromQ
+
+
+/*! Integer atan2, the fixed point counterpart of FastAtan2f().
+	\param y is the ordinate, in any fixed point format.
+	\param x is the abscissa, in the same format as y.
+	\return The angle of (x, y) in Q16.16 degrees, in the range [-180, 180].
+			Returns 0 for (0, 0).*/
+Q16_t FixedAtan2Deg(SInt32 y, SInt32 x)
+{
+	UInt32 ax = (x < 0) ? (UInt32)-(SInt64)x : (UInt32)x;
+	UInt32 ay = (y < 0) ? (UInt32)-(SInt64)y : (UInt32)y;
+	UInt32 Max = (ax > ay) ? ax : ay;
+	UInt32 Min = (ax > ay) ? ay : ax;
+	SInt32 a, s, r;
+
+	if (Max == 0)
+		return 0;
+
+	// Reduce to the first octant, a and s in Q15
+	a = (SInt32)(((UInt64)Min << 15) / Max);
+	s = (a * a) >> 15;
+
+	// Polynomial in Q15 degrees, then scale by a and go to Q16.16
+	r = ATANQ_C11;
+	r = (SInt32)(((SInt64)r * s) >> 15) + ATANQ_C9;
+	r = (SInt32)(((SInt64)r * s) >> 15) + ATANQ_C7;
+	r = (SInt32)(((SInt64)r * s) >> 15) + ATANQ_C5;
+	r = (SInt32)(((SInt64)r * s) >> 15) + ATANQ_C3;
+	r = (SInt32)(((SInt64)r * s) >> 15) + ATANQ_C1;
+	r = (SInt32)(((SInt64)r * a) >> 14);
+
+	// Unfold the octant and quadrant
+	if (ay > ax)
+		r = 90 * Q16_ONE - r;
+	if (x < 0)
+		r = 180 * Q16_ONE - r;
+	if (y < 0)
+		r = -r;
+
+	return r;
+
+}// FixedAtan2Deg
+
+
+/*! Compute the roll angle (rotation about the X axis) from the accelerometers,
+	for the mounting set with TiltSetMounting().
+	\param pData points to the fixed point IMU data.
+	\return The roll angle in Q16.16 degrees.*/
+Q16_t TiltRollQ(const IMUDataQ_t *pData)
+{
+	SInt32 Sign = (TiltGetMounting() == TILT_Z_DOWN) ? -1 : 1;
+
+	// The raw counts share a scale, so they give the same angle
+	return FixedAtan2Deg(Sign * pData->Raw[ACCELY_IDX], Sign * pData->Raw[ACCELZ_IDX]);
+
+}// TiltRollQ
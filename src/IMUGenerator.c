@@ -0,0 +1,366 @@
+/*! \file
+	\brief Synthetic IMU byte stream generator.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "IMUGenerator.h"
+
+#define GEN_PI			3.14159265358979
+#define GEN_GRAVITY		9.81
+
+// Nominal sensor transfer functions for HS_RAW_IMU_MSG: null voltage and
+//   volts at full scale away from it
+#define GEN_GYRO_NULL_VOLTS		2.5
+#define GEN_ACCEL_NULL_VOLTS	2.048
+#define GEN_SPAN_VOLTS			2.0
+
+
+/*! Get a uniformly distributed number from the xorshift generator.
+	\param pGen points to the generator.
+	\return A number in (0, 1].*/
+static double GenUniform(IMUGenerator_t *pGen)
+{
+	uint32_t x = pGen->Rng;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	pGen->Rng = x;
+
+	return (x + 1.0) / 4294967296.0;
+
+}// GenUniform
+
+
+/*! Get a normally distributed number (Box-Muller, both deviates used).
+	\param pGen points to the generator.
+	\return A number with zero mean and unit variance.*/
+static double GenNormal(IMUGenerator_t *pGen)
+{
+	double r, t;
+
+	if (pGen->HaveSpare)
+	{
+		pGen->HaveSpare = FALSE;
+		return pGen->Spare;
+	}
+
+	r = sqrt(-2.0 * log(GenUniform(pGen)));
+	t = 2.0 * GEN_PI * GenUniform(pGen);
+
+	pGen->Spare = r * sin(t);
+	pGen->HaveSpare = TRUE;
+
+	return r * cos(t);
+
+}// GenNormal
+
+
+/*! Evaluate the motion profile.
+	\param pGen points to the generator.
+	\param Time is the time in seconds, not earlier than the last call.
+	\param pAngle points to space to receive the angle in degrees.
+	\param pRate points to space to receive the rate in deg/s.
+	\return FALSE once the profile has ended.*/
+static BOOL GenMotion(IMUGenerator_t *pGen, double Time, double *pAngle, double *pRate)
+{
+	const GenSegment_t *pSeg;
+	double t, w;
+
+	// Advance past finished segments
+	for (;;)
+	{
+		if (pGen->Segment >= pGen->Config.ProfileCount)
+			return FALSE;
+
+		pSeg = &pGen->Config.pProfile[pGen->Segment];
+		if (Time < pGen->SegmentStart + pSeg->Duration)
+			break;
+
+		// The next segment starts where this one ended
+		if (pSeg->Motion == GEN_SINE)
+			pGen->StartAngle += pSeg->Angle * sin(2.0 * GEN_PI * pSeg->FreqHz * pSeg->Duration);
+		else
+			pGen->StartAngle = pSeg->Angle;
+		pGen->SegmentStart += pSeg->Duration;
+		pGen->Segment++;
+	}
+
+	t = Time - pGen->SegmentStart;
+
+	switch (pSeg->Motion)
+	{
+	case GEN_HOLD:
+		*pAngle = pSeg->Angle;
+		*pRate = 0;
+		break;
+
+	case GEN_RAMP:
+		*pRate = (pSeg->Angle - pGen->StartAngle) / pSeg->Duration;
+		*pAngle = pGen->StartAngle + *pRate * t;
+		break;
+
+	case GEN_SINE:
+		w = 2.0 * GEN_PI * pSeg->FreqHz;
+		*pAngle = pGen->StartAngle + pSeg->Angle * sin(w * t);
+		*pRate = pSeg->Angle * w * cos(w * t);
+		break;
+	}
+
+	return TRUE;
+
+}// GenMotion
+
+
+/*! Fill in a configuration with a Crista-like sensor at 100 Hz, realistic
+	noise and no profile.
+	\param pConfig points to the configuration to fill in.*/
+void genDefaultConfig(GenConfig_t *pConfig)
+{
+	memset(pConfig, 0, sizeof(*pConfig));
+
+	pConfig->RateHz = 100.0;
+	pConfig->GyroRange = 300.0f;
+	pConfig->AccelRange = 10.0f;
+	pConfig->GyroNoise = 0.2;
+	pConfig->AccelNoise = 0.05;
+	pConfig->GyroBias = 0.5;
+	pConfig->BiasWalk = 0.01;
+	pConfig->Seed = 1;
+
+}// genDefaultConfig
+
+
+/*! Start a generator.
+	\param pGen points to the generator.
+	\param pConfig points to the settings, which are copied; the profile
+		   they point to must stay valid.*/
+void genInit(IMUGenerator_t *pGen, const GenConfig_t *pConfig)
+{
+	IMUData_t *pData = &pGen->Data;
+
+	memset(pGen, 0, sizeof(*pGen));
+	pGen->Config = *pConfig;
+	pGen->Rng = pConfig->Seed ? pConfig->Seed : 1;
+	pGen->Bias[0] = pConfig->GyroBias;
+
+	// What the configuration responses report
+	pData->GyroRange = pConfig->GyroRange;
+	pData->AccelRange = pConfig->AccelRange;
+	pData->OutputDevice = OUTPUT_DEVICE_SERIAL;
+	pData->OutputMode = OUTPUT_MODE_CONVERTED;
+	pData->OutputRate = (float)pConfig->RateHz;
+	pData->OversampleRatio = 1;
+	pData->MajorVersion = 1;
+	pData->Released = TRUE;
+	pData->VersionMonth = pData->BuildMonth = pData->CalMonth = 1;
+	pData->VersionDay = pData->BuildDay = pData->CalDay = 1;
+	pData->VersionYear = pData->BuildYear = pData->CalYear = 2000;
+	pData->SerialNumber = 1;
+
+}// genInit
+
+
+/*! Get the length of a profile.
+	\param pConfig points to the settings.
+	\return The total duration of the profile segments in seconds.*/
+double genDuration(const GenConfig_t *pConfig)
+{
+	double Duration = 0;
+	UInt32 i;
+
+	for (i = 0; i < pConfig->ProfileCount; i++)
+		Duration += pConfig->pProfile[i].Duration;
+
+	return Duration;
+
+}// genDuration
+
+
+/*! Produce the responses to a configuration request: resolution, output
+	settings, software version, hardware configuration and dates.
+	\param pGen points to the generator.
+	\param pOut points to space for at least GEN_MAX_CONFIG_BYTES.
+	\return The number of bytes produced.*/
+UInt32 genConfigResponse(IMUGenerator_t *pGen, UInt8 *pOut)
+{
+	IMUPacket_t Pkt;
+	UInt32 Bytes = 0;
+
+	FormResolutionPacket(&Pkt, &pGen->Data);
+	Bytes += IMUPacketToBytes(&Pkt, &pOut[Bytes]);
+	FormSettingsReplyPacket(&Pkt, &pGen->Data);
+	Bytes += IMUPacketToBytes(&Pkt, &pOut[Bytes]);
+	FormSoftwareVersionPacket(&Pkt, &pGen->Data);
+	Bytes += IMUPacketToBytes(&Pkt, &pOut[Bytes]);
+	FormHardwareConfigPacket(&Pkt, &pGen->Data);
+	Bytes += IMUPacketToBytes(&Pkt, &pOut[Bytes]);
+	FormDatesPacket(&Pkt, &pGen->Data);
+	Bytes += IMUPacketToBytes(&Pkt, &pOut[Bytes]);
+
+	return Bytes;
+
+}// genConfigResponse
+
+
+/*! Produce the packets for the next sample.
+	\param pGen points to the generator.
+	\param pOut points to space for at least GEN_MAX_STEP_BYTES.
+	\param pTruth points to space to receive the true state, may be NULL.
+	\return The number of bytes produced, 0 once the profile has ended.*/
+UInt32 genStep(IMUGenerator_t *pGen, UInt8 *pOut, GenTruth_t *pTruth)
+{
+	const GenConfig_t *pConfig = &pGen->Config;
+	IMUData_t *pData = &pGen->Data;
+	IMUPacket_t Pkt;
+	double Time = pGen->Sample / pConfig->RateHz;
+	double Walk = pConfig->BiasWalk * sqrt(1.0 / pConfig->RateHz);
+	double Angle = 0, Rate = 0, Roll, Second;
+	UInt32 Bytes = 0, i;
+
+	if (!GenMotion(pGen, Time, &Angle, &Rate))
+		return 0;
+
+	// Gyro biases drift, then the sensors see motion plus bias plus noise
+	for (i = 0; i < 3; i++)
+		pGen->Bias[i] += Walk * GenNormal(pGen);
+
+	Roll = Angle * GEN_PI / 180.0;
+	pData->SensorsConverted[GYROX_IDX]  = (float)(Rate + pGen->Bias[0] + pConfig->GyroNoise * GenNormal(pGen));
+	pData->SensorsConverted[GYROY_IDX]  = (float)(pGen->Bias[1] + pConfig->GyroNoise * GenNormal(pGen));
+	pData->SensorsConverted[GYROZ_IDX]  = (float)(pGen->Bias[2] + pConfig->GyroNoise * GenNormal(pGen));
+	pData->SensorsConverted[ACCELX_IDX] = (float)(pConfig->AccelNoise * GenNormal(pGen));
+	pData->SensorsConverted[ACCELY_IDX] = (float)(GEN_GRAVITY * sin(Roll) + pConfig->AccelNoise * GenNormal(pGen));
+	pData->SensorsConverted[ACCELZ_IDX] = (float)(GEN_GRAVITY * cos(Roll) + pConfig->AccelNoise * GenNormal(pGen));
+
+	// A PPS pulse every whole second
+	Second = floor(Time);
+	pData->TimeSincePPS = (float)((Time - Second) * 1000.0);
+	pData->PPSCount = (UInt8)((UInt32)Second & 0xFF);
+	pData->SequenceNumber = (UInt8)(pGen->Sample & 0xFF);
+
+	FormHighSpeedDataPacket(&Pkt, pData);
+	Bytes += IMUPacketToBytes(&Pkt, &pOut[Bytes]);
+
+	if (pConfig->RawEvery && (pGen->Sample % pConfig->RawEvery) == 0)
+	{
+		for (i = GYROX_IDX; i <= GYROZ_IDX; i++)
+			pData->SensorsVolts[i] = (float)(GEN_GYRO_NULL_VOLTS +
+				GEN_SPAN_VOLTS * pData->SensorsConverted[i] / pConfig->GyroRange);
+		for (i = ACCELX_IDX; i <= ACCELZ_IDX; i++)
+			pData->SensorsVolts[i] = (float)(GEN_ACCEL_NULL_VOLTS +
+				GEN_SPAN_VOLTS * pData->SensorsConverted[i] / (pConfig->AccelRange * GEN_GRAVITY));
+
+		FormHighSpeedRawDataPacket(&Pkt, pData);
+		Bytes += IMUPacketToBytes(&Pkt, &pOut[Bytes]);
+	}
+
+	if (pConfig->TimingEvery && (pGen->Sample % pConfig->TimingEvery) == 0)
+	{
+		FormTimingPacket(&Pkt, pData);
+		Bytes += IMUPacketToBytes(&Pkt, &pOut[Bytes]);
+	}
+
+	if (pTruth)
+	{
+		pTruth->Time = Time;
+		pTruth->Angle = (float)Angle;
+		pTruth->Rate = (float)Rate;
+		pTruth->Bias = (float)pGen->Bias[0];
+		pTruth->SequenceNumber = pData->SequenceNumber;
+	}
+
+	pGen->Angle = Angle;
+	pGen->Sample++;
+
+	return Bytes;
+
+}// genStep
+
+
+/*! Fill a memory buffer with as many whole samples as surely fit.
+	\param pGen points to the generator.
+	\param pBuf points to the buffer.
+	\param Size is the buffer size in bytes.
+	\param pSamples points to space to receive the number of samples, may be
+		   NULL.
+	\return The number of bytes produced, 0 once the profile has ended.*/
+UInt32 genFill(IMUGenerator_t *pGen, UInt8 *pBuf, UInt32 Size, UInt32 *pSamples)
+{
+	UInt32 Bytes = 0, Samples = 0, n;
+
+	while (Size - Bytes >= GEN_MAX_STEP_BYTES)
+	{
+		n = genStep(pGen, &pBuf[Bytes], NULL);
+		if (n == 0)
+			break;
+		Bytes += n;
+		Samples++;
+	}
+
+	if (pSamples)
+		*pSamples = Samples;
+
+	return Bytes;
+
+}// genFill
+
+
+/*! Read a motion profile script.
+	\param pPath is the script file.
+	\param pSegments points to space for the segments.
+	\param Max is the number of segments that fit.
+	\return The number of segments read, or -1 if the file can't be read or
+			a line is not understood (reported on stderr).*/
+int genLoadProfile(const char *pPath, GenSegment_t *pSegments, UInt32 Max)
+{
+	FILE *pFile = fopen(pPath, "r");
+	char Line[256], Word[16];
+	GenSegment_t Seg;
+	int Count = 0, LineNo = 0, Fields;
+	char *p;
+
+	if (pFile == NULL)
+	{
+		fprintf(stderr, "Can't open %s\n", pPath);
+		return -1;
+	}
+
+	while (fgets(Line, sizeof(Line), pFile))
+	{
+		LineNo++;
+
+		if ((p = strchr(Line, '#')) != NULL)
+			*p = 0;
+
+		memset(&Seg, 0, sizeof(Seg));
+		Fields = sscanf(Line, "%15s %lf %lf %lf", Word, &Seg.Duration, &Seg.Angle, &Seg.FreqHz);
+		if (Fields <= 0)
+			continue;
+
+		if (strcmp(Word, "hold") == 0 && Fields == 3)
+			Seg.Motion = GEN_HOLD;
+		else if (strcmp(Word, "ramp") == 0 && Fields == 3)
+			Seg.Motion = GEN_RAMP;
+		else if (strcmp(Word, "sine") == 0 && Fields == 4)
+			Seg.Motion = GEN_SINE;
+		else
+			Fields = -1;
+
+		if (Fields < 0 || Seg.Duration <= 0 || (UInt32)Count >= Max)
+		{
+			fprintf(stderr, "%s:%d: bad or too many segments\n", pPath, LineNo);
+			fclose(pFile);
+			return -1;
+		}
+
+		pSegments[Count++] = Seg;
+	}
+
+	fclose(pFile);
+
+	return Count;
+
+}// genLoadProfile
@@ -10,6 +10,7 @@
 ///////////////////////////////////
 
 #include "ByteOrder.h"
+#include "CRC16.h"
 #include "IMUPacket.h"
 
 // Telemetry packet parsing functions
@@ -30,9 +31,6 @@ static void DecodeHardwareConfigPacket(const IMUPacket_t *pPkt, IMUData_t *pData
 static void DecodeDatesPacket(const IMUPacket_t *pPkt, IMUData_t *pData);
 static void DecodeResolutionPacket(const IMUPacket_t *pPkt, IMUData_t *pData);
 
-// Function to create a formed packet's header
-static void MakeIMUPacket(IMUPacket_t *pPkt, UInt8 Type, UInt8 Len);
-
 
 /*! Decodes an incoming packet from an IMU and stores all data locally.
  *  \param pPkt A pointer to the received packet meant to be decoded.
@@ -315,6 +313,10 @@ void FormCalibrationParameterRequestPacket(IMUPacket_t *pPkt, UInt8 Number)
 }// FormCalibrationParameterRequestPacket
 
 
+/*! Fill in the header of a formed packet and append the CRC.
+ *  \param pPkt A pointer to the packet whose payload has been filled in.
+ *  \param Type The message type.
+ *  \param Len The payload length in bytes. */
 void MakeIMUPacket(IMUPacket_t *pPkt, UInt8 Type, UInt8 Len)
 {
 	pPkt->sync0 = SYNC_BYTE0;
@@ -324,4 +326,204 @@ void MakeIMUPacket(IMUPacket_t *pPkt, UInt8 Type, UInt8 Len)
 
 	UInt16ToData(&pPkt->data[Len], CRC16((UInt8 *)pPkt, Len + 4));
 
-}// MakeIMUPacket
\ No newline at end of file
+}// MakeIMUPacket
+
+
+/*! Serialize a formed packet the way it goes over the wire.  This is the
+ *  packet structure itself, except that HS_RAW_IMU_MSG has no length byte.
+ *  \param pPkt A pointer to a packet formed by one of the Form functions.
+ *  \param pBytes Space to receive the bytes, at least MAX_PAYLOAD_BYTES + 6.
+ *  \return The number of bytes written. */
+UInt32 IMUPacketToBytes(const IMUPacket_t *pPkt, UInt8 *pBytes)
+{
+	UInt32 i = 0, j;
+
+	pBytes[i++] = pPkt->sync0;
+	pBytes[i++] = pPkt->sync1;
+	pBytes[i++] = pPkt->type;
+
+	if (pPkt->type != HS_RAW_IMU_MSG)
+		pBytes[i++] = pPkt->len;
+
+	for (j = 0; j < (UInt32)pPkt->len + 2; j++)
+		pBytes[i++] = pPkt->data[j];
+
+	return i;
+
+}// IMUPacketToBytes
+
+
+/*! Forms a high-speed converted telemetry data packet, the counterpart of
+ *  DecodeHighSpeedDataPacket().
+ *  \param pPkt A pointer to the packet to form.
+ *  \param pData The IMU data holding the sensor ranges and readings. */
+void FormHighSpeedDataPacket(IMUPacket_t *pPkt, const IMUData_t *pData)
+{
+	UInt8 i = 0;
+	double GyroRes  = (2.0 * pData->GyroRange) / 65535.0;
+	double AccelRes = (2.0 * pData->AccelRange * 9.81) / 65535.0;
+
+	// Raw sensor data
+	i += SInt16ToData(&pPkt->data[i], RoundToSInt16(pData->SensorsConverted[GYROX_IDX]  / GyroRes));
+	i += SInt16ToData(&pPkt->data[i], RoundToSInt16(pData->SensorsConverted[GYROY_IDX]  / GyroRes));
+	i += SInt16ToData(&pPkt->data[i], RoundToSInt16(pData->SensorsConverted[GYROZ_IDX]  / GyroRes));
+	i += SInt16ToData(&pPkt->data[i], RoundToSInt16(pData->SensorsConverted[ACCELX_IDX] / AccelRes));
+	i += SInt16ToData(&pPkt->data[i], RoundToSInt16(pData->SensorsConverted[ACCELY_IDX] / AccelRes));
+	i += SInt16ToData(&pPkt->data[i], RoundToSInt16(pData->SensorsConverted[ACCELZ_IDX] / AccelRes));
+
+	// PPS data
+	i += UInt32ToData(&pPkt->data[i], RoundToUInt32(pData->TimeSincePPS * 10000.0));
+	pPkt->data[i++] = pData->PPSCount;
+
+	// Packet sequence number
+	pPkt->data[i++] = pData->SequenceNumber;
+
+	MakeIMUPacket(pPkt, HS_SERIAL_IMU_MSG, i);
+
+}// FormHighSpeedDataPacket
+
+
+/*! Forms a high-speed raw telemetry data packet, the counterpart of
+ *  DecodeHighSpeedRawDataPacket().  This packet has no length byte, so its
+ *  CRC covers the header without it.
+ *  \param pPkt A pointer to the packet to form.
+ *  \param pData The IMU data holding the sensor voltages. */
+void FormHighSpeedRawDataPacket(IMUPacket_t *pPkt, const IMUData_t *pData)
+{
+	UInt8 i = 0, j;
+	UInt16 crc;
+
+	// Raw sensor data
+	i += UInt16ToData(&pPkt->data[i], RoundToUInt16(pData->SensorsVolts[GYROX_IDX]  / AD16_TO_GYROVOLTS));
+	i += UInt16ToData(&pPkt->data[i], RoundToUInt16(pData->SensorsVolts[GYROY_IDX]  / AD16_TO_GYROVOLTS));
+	i += UInt16ToData(&pPkt->data[i], RoundToUInt16(pData->SensorsVolts[GYROZ_IDX]  / AD16_TO_GYROVOLTS));
+	i += UInt16ToData(&pPkt->data[i], RoundToUInt16(pData->SensorsVolts[ACCELX_IDX] / AD16_TO_VOLTS));
+	i += UInt16ToData(&pPkt->data[i], RoundToUInt16(pData->SensorsVolts[ACCELY_IDX] / AD16_TO_VOLTS));
+	i += UInt16ToData(&pPkt->data[i], RoundToUInt16(pData->SensorsVolts[ACCELZ_IDX] / AD16_TO_VOLTS));
+
+	// Packet sequence number
+	pPkt->data[i++] = pData->SequenceNumber;
+
+	pPkt->sync0 = SYNC_BYTE0;
+	pPkt->sync1 = SYNC_BYTE1;
+	pPkt->type  = HS_RAW_IMU_MSG;
+	pPkt->len   = i;
+
+	// Header without the length byte, then the payload
+	crc = CRC16((UInt8 *)pPkt, 3);
+	for (j = 0; j < i; j++)
+		crc = CRC16OneByte(pPkt->data[j], crc);
+
+	UInt16ToData(&pPkt->data[i], crc);
+
+}// FormHighSpeedRawDataPacket
+
+
+/*! Forms a timing packet, the counterpart of DecodeTimingPacket().
+ *  \param pPkt A pointer to the packet to form.
+ *  \param pData The IMU data holding the PPS data. */
+void FormTimingPacket(IMUPacket_t *pPkt, const IMUData_t *pData)
+{
+	UInt8 i = 0;
+
+	i += UInt32ToData(&pPkt->data[i], RoundToUInt32(pData->TimeSincePPS * 10000.0));
+	pPkt->data[i++] = pData->PPSCount;
+	pPkt->data[i++] = pData->SequenceNumber;
+	i += SInt16ToData(&pPkt->data[i], pData->ClockError);
+
+	MakeIMUPacket(pPkt, TIMING_IMU_MSG, i);
+
+}// FormTimingPacket
+
+
+/*! Forms a sensor resolution packet, the counterpart of
+ *  DecodeResolutionPacket().
+ *  \param pPkt A pointer to the packet to form.
+ *  \param pData The IMU data holding the sensor ranges. */
+void FormResolutionPacket(IMUPacket_t *pPkt, const IMUData_t *pData)
+{
+	UInt8 i = 0;
+
+	i += FloatToData(&pPkt->data[i], pData->GyroRange);
+	i += FloatToData(&pPkt->data[i], pData->AccelRange);
+
+	MakeIMUPacket(pPkt, RESOLUTION_IMU_MSG, i);
+
+}// FormResolutionPacket
+
+
+/*! Forms an output settings report, the counterpart of
+ *  DecodeSettingsPacket().
+ *  \param pPkt A pointer to the packet to form.
+ *  \param pData The IMU data holding the output settings. */
+void FormSettingsReplyPacket(IMUPacket_t *pPkt, const IMUData_t *pData)
+{
+	// Same layout as the settings we send, different message type
+	FormSettingsPacket(pPkt, pData);
+	MakeIMUPacket(pPkt, SETTINGS_IMU_MSG, pPkt->len);
+
+}// FormSettingsReplyPacket
+
+
+/*! Forms a software version packet, the counterpart of
+ *  DecodeSoftwareVersionPacket().
+ *  \param pPkt A pointer to the packet to form.
+ *  \param pData The IMU data holding the version information. */
+void FormSoftwareVersionPacket(IMUPacket_t *pPkt, const IMUData_t *pData)
+{
+	UInt8 i = 0;
+
+	pPkt->data[i++] = pData->MajorVersion;
+	pPkt->data[i++] = pData->MinorVersion;
+	pPkt->data[i++] = pData->SubVersion;
+	pPkt->data[i++] = (UInt8)(((pData->PatchNumber & 0x3F) << 1) |
+							  (pData->Released ? 0x01 : 0) |
+							  (pData->EnhancedProcessor ? 0x80 : 0));
+	pPkt->data[i++] = pData->VersionMonth;
+	pPkt->data[i++] = pData->VersionDay;
+	i += UInt16ToData(&pPkt->data[i], pData->VersionYear);
+
+	MakeIMUPacket(pPkt, SWVERSION_IMU_MSG, i);
+
+}// FormSoftwareVersionPacket
+
+
+/*! Forms a hardware configuration packet, the counterpart of
+ *  DecodeHardwareConfigPacket().
+ *  \param pPkt A pointer to the packet to form.
+ *  \param pData The IMU data holding the hardware configuration. */
+void FormHardwareConfigPacket(IMUPacket_t *pPkt, const IMUData_t *pData)
+{
+	UInt8 i = 0;
+
+	i += UInt16ToData(&pPkt->data[i], pData->SerialNumber);
+	pPkt->data[i++] = pData->EepromVersion;
+	pPkt->data[i++] = pData->HwRevMajor;
+	pPkt->data[i++] = pData->HwRevMinor;
+	pPkt->data[i++] = pData->AccelConfig;
+	pPkt->data[i++] = pData->GyroConfig;
+	pPkt->data[i++] = pData->ConfigBits;
+
+	MakeIMUPacket(pPkt, SERIALNUMCONFIG_IMU_MSG, i);
+
+}// FormHardwareConfigPacket
+
+
+/*! Forms a manufacture and calibration date packet, the counterpart of
+ *  DecodeDatesPacket().
+ *  \param pPkt A pointer to the packet to form.
+ *  \param pData The IMU data holding the dates. */
+void FormDatesPacket(IMUPacket_t *pPkt, const IMUData_t *pData)
+{
+	UInt8 i = 0;
+
+	pPkt->data[i++] = pData->BuildMonth;
+	pPkt->data[i++] = pData->BuildDay;
+	i += UInt16ToData(&pPkt->data[i], pData->BuildYear);
+	pPkt->data[i++] = pData->CalMonth;
+	pPkt->data[i++] = pData->CalDay;
+	i += UInt16ToData(&pPkt->data[i], pData->CalYear);
+
+	MakeIMUPacket(pPkt, MFRCALDATE_IMU_MSG, i);
+
+}// FormDatesPacket
@@ -1,6 +1,7 @@
 
 #include "CRC16.h"
 #include "IMUSerial.h"
+#include "Metrics.h"
 
 static BOOL ValidateReceivedPacket(IMUPacket_t *pPkt);
 
@@ -53,6 +54,14 @@ BOOL LookForIMUPacketInByte(UInt8 Byte, IMUPacket_t *pPkt)
 		// Copy in the payload length and go to the next state
 		if (pPkt->type != HS_RAW_IMU_MSG)
 		{
+			// A length that can't fit the payload buffer is line noise
+			if (Byte > MAX_PAYLOAD_BYTES)
+			{
+				mtCount(MT_LENGTH_ERRORS, 1);
+				pPkt->state = SERIAL_STATE_SYNC0;
+				break;
+			}
+
 			pPkt->len = Byte;
 			pPkt->state++;
 			break;
@@ -107,7 +116,14 @@ static BOOL ValidateReceivedPacket(IMUPacket_t *pPkt)
 			crcCalc = CRC16OneByte(pPkt->data[i], crcCalc);
 	}
 
-	// Finally, return TRUE if the two values match, or FALSE if not
-	return (crcPacket == crcCalc);
+	// Finally, count the packet and return TRUE if the two values match, or FALSE if not
+	if (crcPacket != crcCalc)
+	{
+		mtCount(MT_CRC_ERRORS, 1);
+		return FALSE;
+	}
+
+	mtCount(MT_PACKETS, 1);
+	return TRUE;
 
 }// ValidateReceivedPacket
\ No newline at end of file
@@ -0,0 +1,523 @@
+/*! \file
+	\brief Several IMUs read by one thread, with time aligned sample sets.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "CalcAngle.h"
+#include "HostTime.h"
+#include "IMUSerial.h"
+#include "ImuAggregator.h"
+#include "Tilt.h"
+
+// Largest read() of one port
+#define AG_READ_BYTES		4096
+
+// Bits on the wire per byte, start and stop bits included
+#define AG_BITS_PER_BYTE	10
+
+typedef struct
+{
+	int Fd;
+	BOOL Owned;								//!< Opened by agOpenPort(), closed with the aggregator
+	char Name[AG_NAME_BYTES];
+	UInt64 ByteNs;							//!< Time one byte takes on the wire
+	float Dt;								//!< Filter time step, seconds
+
+	IMUPacket_t Pkt;						//!< Parser state
+	IMUData_t Data;							//!< Decoded data
+	KFilter_t Filter;
+	BOOL Configured;						//!< Sensor ranges received
+	BOOL Seeded;							//!< Filter angle started from the first tilt
+
+	AggSample_t History[AG_HISTORY];		//!< Newest samples, indexed by Count
+	UInt32 Count;							//!< Samples ever stored
+	AggPortStats_t Stats;
+} AggPort_t;
+
+struct Aggregator_t
+{
+	int Epoll;
+	UInt32 Ports;
+	UInt64 MaxSilenceNs;					//!< Silence that leaves a port out of the sets
+	AggSetCallback_t pCallback;
+	void *pArg;
+	UInt64 LastSetNs;						//!< Time of the last set given to the callback
+	AggSet_t Set;							//!< Set being given to the callback
+	UInt8 Buffer[AG_READ_BYTES];
+	AggPort_t Port[AG_MAX_PORTS];
+};
+
+
+/*! Get the newest sample of a port.
+	\param pPort points to the port, which must have a sample.
+	\return The sample.*/
+static const AggSample_t *Newest(const AggPort_t *pPort)
+{
+	return &pPort->History[(pPort->Count - 1) & (AG_HISTORY - 1)];
+
+}// Newest
+
+
+/*! Interpolate a port's sample at a time.
+	\param pPort points to the port.
+	\param TimeNs is the time.
+	\param pOut receives the sample.
+	\return TRUE if the port has samples either side of the time.*/
+static BOOL Interpolate(const AggPort_t *pPort, UInt64 TimeNs, AggPortSample_t *pOut)
+{
+	const AggSample_t *pNewer, *pOlder = NULL;
+	UInt32 Kept = pPort->Count < AG_HISTORY ? pPort->Count : AG_HISTORY;
+	UInt32 n;
+	float w;
+	int i;
+
+	pOut->Valid = FALSE;
+	pOut->GyroRange = pPort->Data.GyroRange;
+	pOut->AccelRange = pPort->Data.AccelRange;
+	if (Kept == 0 || Newest(pPort)->HostNs < TimeNs)
+		return FALSE;
+
+	// Walk back to the first sample at or before the time
+	for (n = 1; n <= Kept; n++)
+	{
+		pOlder = &pPort->History[(pPort->Count - n) & (AG_HISTORY - 1)];
+		if (pOlder->HostNs <= TimeNs)
+			break;
+	}
+	if (n > Kept)
+		return FALSE;
+
+	if (pOlder->HostNs == TimeNs)
+	{
+		pOut->Sample = *pOlder;
+		pOut->GapNs = 0;
+		pOut->Valid = TRUE;
+		return TRUE;
+	}
+
+	pNewer = &pPort->History[(pPort->Count - n + 1) & (AG_HISTORY - 1)];
+	pOut->GapNs = pNewer->HostNs - pOlder->HostNs;
+	w = (float)(TimeNs - pOlder->HostNs) / (float)pOut->GapNs;
+
+	pOut->Sample.HostNs = TimeNs;
+	for (i = 0; i < N_SENSOR_IDX; i++)
+		pOut->Sample.Sensors[i] = pOlder->Sensors[i] + w * (pNewer->Sensors[i] - pOlder->Sensors[i]);
+	pOut->Sample.Angle = pOlder->Angle + w * (pNewer->Angle - pOlder->Angle);
+	pOut->Sample.Rate = pOlder->Rate + w * (pNewer->Rate - pOlder->Rate);
+	pOut->Sample.Bias = pOlder->Bias + w * (pNewer->Bias - pOlder->Bias);
+	pOut->Sample.AngleVar = pOlder->AngleVar + w * (pNewer->AngleVar - pOlder->AngleVar);
+	pOut->Sample.SequenceNumber = w < 0.5f ? pOlder->SequenceNumber : pNewer->SequenceNumber;
+	pOut->Sample.Missed = pNewer->Missed;
+	pOut->Valid = TRUE;
+
+	return TRUE;
+
+}// Interpolate
+
+
+/*! Handle a packet a port's parser completed.
+	\param pPort points to the port.
+	\param HostNs is when its last byte arrived.
+	\return 1 if it gave a filtered sample, else 0.*/
+static UInt32 HandlePacket(AggPort_t *pPort, UInt64 HostNs)
+{
+	AggSample_t *pSample;
+	IMUPacket_t Request;
+	float Tilt;
+	int i;
+
+	pPort->Stats.Packets++;
+	DecodeIMUPacket(&pPort->Pkt, &pPort->Data);
+
+	// Keep asking for the configuration until the sensor ranges arrive
+	if (!pPort->Configured)
+	{
+		if (pPort->Pkt.type == RESOLUTION_IMU_MSG)
+			pPort->Configured = TRUE;
+		else
+		{
+			FormConfigurationRequestPacket(&Request, &pPort->Data);
+			if (write(pPort->Fd, (UInt8 *)&Request, Request.len + 6) > 0)
+				pPort->Stats.ConfigRequests++;
+		}
+		return 0;
+	}
+
+	if (pPort->Pkt.type != HS_SERIAL_IMU_MSG)
+		return 0;
+
+	pSample = &pPort->History[pPort->Count & (AG_HISTORY - 1)];
+	pSample->Missed = 0;
+
+	if (pPort->Count)
+	{
+		const AggSample_t *pLast = Newest(pPort);
+
+		pSample->Missed = (UInt8)(pPort->Data.SequenceNumber - pLast->SequenceNumber - 1);
+		pPort->Stats.SequenceGaps += pSample->Missed;
+
+		// The wire time correction must not put a sample before the last one
+		if (HostNs < pLast->HostNs)
+			HostNs = pLast->HostNs;
+	}
+
+	Tilt = TiltRollDeg(&pPort->Data);
+	if (!pPort->Seeded)
+	{
+		pPort->Filter.angle = Tilt;
+		pPort->Seeded = TRUE;
+	}
+
+	pSample->HostNs = HostNs;
+	for (i = 0; i < N_SENSOR_IDX; i++)
+		pSample->Sensors[i] = pPort->Data.SensorsConverted[i];
+	pSample->Angle = kfGetAngle(&pPort->Filter, Tilt, pPort->Data.SensorsConverted[GYROX_IDX], pPort->Dt);
+	pSample->Rate = pPort->Filter.rate;
+	pSample->Bias = pPort->Filter.bias;
+	pSample->AngleVar = pPort->Filter.P[0][0];
+	pSample->SequenceNumber = pPort->Data.SequenceNumber;
+
+	pPort->Count++;
+	pPort->Stats.Samples++;
+
+	return 1;
+
+}// HandlePacket
+
+
+/*! Read and parse everything a port has.
+	\param pAgg points to the aggregator.
+	\param pPort points to the port.
+	\return The number of filtered samples.*/
+static UInt32 ReadPort(Aggregator_t *pAgg, AggPort_t *pPort)
+{
+	UInt32 Samples = 0;
+	ssize_t Count, n;
+	UInt64 Now;
+
+	do
+	{
+		Count = read(pPort->Fd, pAgg->Buffer, sizeof(pAgg->Buffer));
+		if (Count <= 0)
+		{
+			// The other end went away, stop polling it
+			if (Count == 0 || (errno != EAGAIN && errno != EINTR))
+			{
+				epoll_ctl(pAgg->Epoll, EPOLL_CTL_DEL, pPort->Fd, NULL);
+			}
+			break;
+		}
+
+		Now = htNowNs();
+		pPort->Stats.Bytes += (UInt64)Count;
+		pPort->Stats.Reads++;
+
+		for (n = 0; n < Count; n++)
+		{
+			// Back out the time the bytes after this one spent on the wire
+			if (LookForIMUPacketInByte(pAgg->Buffer[n], &pPort->Pkt))
+				Samples += HandlePacket(pPort, Now - (UInt64)(Count - 1 - n) * pPort->ByteNs);
+		}
+
+	// A short read has emptied the port, don't spend a call finding that out
+	} while (Count == (ssize_t)sizeof(pAgg->Buffer));
+
+	return Samples;
+
+}// ReadPort
+
+
+/*! Give the callback the set at the newest time every live port has reached.
+	\param pAgg points to the aggregator.*/
+static void EmitSet(Aggregator_t *pAgg)
+{
+	UInt64 Now = htNowNs(), Common = 0;
+	UInt32 p;
+
+	for (p = 0; p < pAgg->Ports; p++)
+	{
+		const AggPort_t *pPort = &pAgg->Port[p];
+		UInt64 NewestNs;
+
+		if (pPort->Count == 0)
+			continue;
+
+		NewestNs = Newest(pPort)->HostNs;
+		if (Now - NewestNs > pAgg->MaxSilenceNs)
+			continue;
+
+		if (Common == 0 || NewestNs < Common)
+			Common = NewestNs;
+	}
+
+	if (Common <= pAgg->LastSetNs)
+		return;
+
+	pAgg->LastSetNs = Common;
+	agAlign(pAgg, Common, &pAgg->Set);
+	pAgg->pCallback(pAgg->pArg, &pAgg->Set);
+
+}// EmitSet
+
+
+/*! Create an aggregator with no ports.
+	\param MaxSilenceNs is how long a port may go without a sample before
+		   sets stop waiting for it, a few sample periods.
+	\param pCallback is called with each set from agPoll(), or NULL for
+		   none; agAlign() gives sets on demand either way.
+	\param pArg is passed to the callback.
+	\return The aggregator, or NULL if it could not be created.*/
+Aggregator_t *agCreate(UInt64 MaxSilenceNs, AggSetCallback_t pCallback, void *pArg)
+{
+	Aggregator_t *pAgg = (Aggregator_t *)calloc(1, sizeof(Aggregator_t));
+
+	if (pAgg == NULL)
+		return NULL;
+
+	pAgg->Epoll = epoll_create1(EPOLL_CLOEXEC);
+	if (pAgg->Epoll < 0)
+	{
+		free(pAgg);
+		return NULL;
+	}
+
+	pAgg->MaxSilenceNs = MaxSilenceNs;
+	pAgg->pCallback = pCallback;
+	pAgg->pArg = pArg;
+
+	return pAgg;
+
+}// agCreate
+
+
+/*! Add an open port.  It is made non-blocking; agDestroy() leaves it open.
+	\param pAgg points to the aggregator.
+	\param Fd is the port, a tty, pipe or socket carrying the IMU's bytes.
+	\param pName names the port.
+	\param Baud is the port's bit rate, used to time packets from reads.
+		   0 for a port with no wire, where the read time is the time.
+	\param SampleHz is the IMU's high speed sample rate, the filter step.
+	\return The port number, or -1 if it could not be added.*/
+int agAddPort(Aggregator_t *pAgg, int Fd, const char *pName, UInt32 Baud, double SampleHz)
+{
+	struct epoll_event Event;
+	AggPort_t *pPort;
+	int Flags;
+
+	if (pAgg->Ports == AG_MAX_PORTS || SampleHz <= 0)
+		return -1;
+
+	Flags = fcntl(Fd, F_GETFL);
+	if (Flags < 0 || fcntl(Fd, F_SETFL, Flags | O_NONBLOCK) < 0)
+		return -1;
+
+	memset(&Event, 0, sizeof(Event));
+	Event.events = EPOLLIN;
+	Event.data.u32 = pAgg->Ports;
+	if (epoll_ctl(pAgg->Epoll, EPOLL_CTL_ADD, Fd, &Event) < 0)
+		return -1;
+
+	pPort = &pAgg->Port[pAgg->Ports];
+	memset(pPort, 0, sizeof(*pPort));
+	pPort->Fd = Fd;
+	strncpy(pPort->Name, pName, sizeof(pPort->Name) - 1);
+	pPort->ByteNs = Baud ? (UInt64)(AG_BITS_PER_BYTE * 1.0e9 / Baud) : 0;
+	pPort->Dt = (float)(1.0 / SampleHz);
+	pPort->Pkt.state = SERIAL_STATE_SYNC0;
+	kfInit(&pPort->Filter);
+
+	return (int)pAgg->Ports++;
+
+}// agAddPort
+
+
+/*! Get the termios speed for a bit rate.
+	\param Baud is the bit rate.
+	\return The speed, or B0 if it isn't one.*/
+static speed_t BaudToSpeed(UInt32 Baud)
+{
+	switch (Baud)
+	{
+	case 9600:    return B9600;
+	case 19200:   return B19200;
+	case 38400:   return B38400;
+	case 57600:   return B57600;
+	case 115200:  return B115200;
+	case 230400:  return B230400;
+	case 460800:  return B460800;
+	case 921600:  return B921600;
+	default:      return B0;
+	}
+
+}// BaudToSpeed
+
+
+/*! Open a serial device raw at a bit rate and add it.
+	\param pAgg points to the aggregator.
+	\param pDevice is the device, e.g. "/dev/ttyUSB0", also the port name.
+	\param Baud is the bit rate.
+	\param SampleHz is the IMU's high speed sample rate.
+	\return The port number, or -1 if it could not be opened.*/
+int agOpenPort(Aggregator_t *pAgg, const char *pDevice, UInt32 Baud, double SampleHz)
+{
+	speed_t Speed = BaudToSpeed(Baud);
+	struct termios Tio;
+	int Fd, Port;
+
+	if (Speed == B0)
+		return -1;
+
+	Fd = open(pDevice, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (Fd < 0)
+		return -1;
+
+	if (tcgetattr(Fd, &Tio) < 0)
+	{
+		close(Fd);
+		return -1;
+	}
+
+	cfmakeraw(&Tio);
+	cfsetispeed(&Tio, Speed);
+	cfsetospeed(&Tio, Speed);
+	Tio.c_cflag |= CLOCAL | CREAD;
+	Tio.c_cc[VMIN] = 0;
+	Tio.c_cc[VTIME] = 0;
+
+	Port = tcsetattr(Fd, TCSANOW, &Tio) < 0 ? -1 : agAddPort(pAgg, Fd, pDevice, Baud, SampleHz);
+	if (Port < 0)
+	{
+		close(Fd);
+		return -1;
+	}
+
+	tcflush(Fd, TCIFLUSH);
+	pAgg->Port[Port].Owned = TRUE;
+
+	return Port;
+
+}// agOpenPort
+
+
+/*! Wait for bytes on any port, read and filter them, and give the callback
+	the new set if there is one.
+	\param pAgg points to the aggregator.
+	\param TimeoutMs is the longest to wait, -1 for no limit.
+	\return The number of samples filtered.*/
+UInt32 agPoll(Aggregator_t *pAgg, int TimeoutMs)
+{
+	struct epoll_event Events[AG_MAX_PORTS];
+	UInt32 Samples = 0;
+	int Ready, i;
+
+	Ready = epoll_wait(pAgg->Epoll, Events, AG_MAX_PORTS, TimeoutMs);
+
+	for (i = 0; i < Ready; i++)
+		Samples += ReadPort(pAgg, &pAgg->Port[Events[i].data.u32]);
+
+	if (Samples && pAgg->pCallback)
+		EmitSet(pAgg);
+
+	return Samples;
+
+}// agPoll
+
+
+/*! Get every port's sample at a time.  Only the polling thread may call
+	this.
+	\param pAgg points to the aggregator.
+	\param TimeNs is the time on the htNowNs() clock.
+	\param pSet receives the set.
+	\return TRUE if any port had a sample at the time.*/
+BOOL agAlign(const Aggregator_t *pAgg, UInt64 TimeNs, AggSet_t *pSet)
+{
+	UInt32 p;
+
+	pSet->TimeNs = TimeNs;
+	pSet->Ports = pAgg->Ports;
+	pSet->ValidPorts = 0;
+
+	for (p = 0; p < pAgg->Ports; p++)
+		pSet->ValidPorts += Interpolate(&pAgg->Port[p], TimeNs, &pSet->Port[p]);
+
+	return pSet->ValidPorts > 0;
+
+}// agAlign
+
+
+/*! Get the newest sample of a port.
+	\param pAgg points to the aggregator.
+	\param Port is the port number.
+	\param pSample receives the sample.
+	\return TRUE if the port has one.*/
+BOOL agNewest(const Aggregator_t *pAgg, UInt32 Port, AggSample_t *pSample)
+{
+	if (Port >= pAgg->Ports || pAgg->Port[Port].Count == 0)
+		return FALSE;
+
+	*pSample = *Newest(&pAgg->Port[Port]);
+	return TRUE;
+
+}// agNewest
+
+
+/*! Get the number of ports.
+	\param pAgg points to the aggregator.
+	\return The number of ports.*/
+UInt32 agPorts(const Aggregator_t *pAgg)
+{
+	return pAgg->Ports;
+
+}// agPorts
+
+
+/*! Get a port's name.
+	\param pAgg points to the aggregator.
+	\param Port is the port number.
+	\return The name.*/
+const char *agPortName(const Aggregator_t *pAgg, UInt32 Port)
+{
+	return Port < pAgg->Ports ? pAgg->Port[Port].Name : "";
+
+}// agPortName
+
+
+/*! Get a port's counters.
+	\param pAgg points to the aggregator.
+	\param Port is the port number.
+	\param pStats receives the counters.*/
+void agGetPortStats(const Aggregator_t *pAgg, UInt32 Port, AggPortStats_t *pStats)
+{
+	if (Port < pAgg->Ports)
+		*pStats = pAgg->Port[Port].Stats;
+	else
+		memset(pStats, 0, sizeof(*pStats));
+
+}// agGetPortStats
+
+
+/*! Close the ports agOpenPort() opened and free the aggregator.
+	\param pAgg points to the aggregator, which is freed.*/
+void agDestroy(Aggregator_t *pAgg)
+{
+	UInt32 p;
+
+	if (pAgg == NULL)
+		return;
+
+	for (p = 0; p < pAgg->Ports; p++)
+	{
+		if (pAgg->Port[p].Owned)
+			close(pAgg->Port[p].Fd);
+	}
+
+	close(pAgg->Epoll);
+	free(pAgg);
+
+}// agDestroy
@@ -0,0 +1,345 @@
+/*! \file
+	\brief Offline search for the Kalman filter noise parameters.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CalcAngle.h"
+#include "KalmanTune.h"
+
+#define KT_DIMS			3					//!< Parameters searched
+#define KT_TOLERANCE	1.0e-4				//!< Relative score spread that ends Nelder-Mead
+#define KT_MIN_SPREAD	1.0e-3				//!< Simplex size in decades that ends it too
+
+//! One batch of one run, for tpForEach()
+typedef struct
+{
+	const TuneRun_t *pRuns;
+	UInt32 Runs;
+	const KalmanParams_t *pParams;
+	UInt32 Count;
+	double *pSumSquares;					//!< KT_LANES per item
+	UInt64 *pScored;
+} ScoreJob_t;
+
+//! A simplex vertex, parameters as base 10 logarithms
+typedef struct
+{
+	double x[KT_DIMS];
+	double Score;
+} Vertex_t;
+
+
+/*! Filter one run with up to KT_LANES candidates and sum the squared
+	errors against the reference.
+	\param pRun points to the run.
+	\param pParams points to the candidates.
+	\param Count is the number of candidates, 1 to KT_LANES.
+	\param pSumSquares points to space for Count sums.
+	\param pScored points to space to receive the number of samples
+		   scored.*/
+void ktScoreBatch(const TuneRun_t *pRun, const KalmanParams_t *pParams, UInt32 Count,
+				  double *pSumSquares, UInt64 *pScored)
+{
+	float Q_angle[KT_LANES], Q_bias[KT_LANES], R_measure[KT_LANES];
+	float Angle[KT_LANES], Bias[KT_LANES];
+	float P00[KT_LANES], P01[KT_LANES], P10[KT_LANES], P11[KT_LANES];
+	double Sum[KT_LANES];
+	KFilter_t Init;
+	UInt32 i, l;
+
+	// Short batches repeat the last candidate so every lane does the same work
+	kfInit(&Init);
+	for (l = 0; l < KT_LANES; l++)
+	{
+		const KalmanParams_t *p = &pParams[(l < Count) ? l : Count - 1];
+
+		Q_angle[l] = p->Q_angle;
+		Q_bias[l] = p->Q_bias;
+		R_measure[l] = p->R_measure;
+		Angle[l] = pRun->Count ? pRun->pTilt[0] : 0.0f;
+		Bias[l] = Init.bias;
+		P00[l] = Init.P[0][0];
+		P01[l] = Init.P[0][1];
+		P10[l] = Init.P[1][0];
+		P11[l] = Init.P[1][1];
+		Sum[l] = 0.0;
+	}
+
+	for (i = 0; i < pRun->Count; i++)
+	{
+		float dt = pRun->pStep[i], NewRate = pRun->pRate[i], NewAngle = pRun->pTilt[i];
+		float Reference = pRun->pReference[i];
+		BOOL Scored = (i >= pRun->Skip);
+
+		// kfGetAngle() across the lanes
+		for (l = 0; l < KT_LANES; l++)
+		{
+			float Rate, S, K0, K1, y, P00_temp, P01_temp, Error;
+
+			Rate = NewRate - Bias[l];
+			Angle[l] += dt * Rate;
+
+			P00[l] += dt * (dt * P11[l] - P01[l] - P10[l] + Q_angle[l]);
+			P01[l] -= dt * P11[l];
+			P10[l] -= dt * P11[l];
+			P11[l] += Q_bias[l] * dt;
+
+			S = P00[l] + R_measure[l];
+			K0 = P00[l] / S;
+			K1 = P10[l] / S;
+
+			y = NewAngle - Angle[l];
+			Angle[l] += K0 * y;
+			Bias[l] += K1 * y;
+
+			P00_temp = P00[l];
+			P01_temp = P01[l];
+			P00[l] -= K0 * P00_temp;
+			P01[l] -= K0 * P01_temp;
+			P10[l] -= K1 * P00_temp;
+			P11[l] -= K1 * P01_temp;
+
+			Error = Scored ? Angle[l] - Reference : 0.0f;
+			Sum[l] += (double)Error * Error;
+		}
+	}
+
+	for (l = 0; l < Count; l++)
+		pSumSquares[l] = Sum[l];
+	*pScored = (pRun->Count > pRun->Skip) ? pRun->Count - pRun->Skip : 0;
+
+}// ktScoreBatch
+
+
+/*! Score one batch against one run.
+	\param pArg points to the ScoreJob_t.
+	\param Index is batch * runs + run.*/
+static void ScoreItem(void *pArg, UInt32 Index)
+{
+	ScoreJob_t *pJob = (ScoreJob_t *)pArg;
+	UInt32 Batch = Index / pJob->Runs, Run = Index % pJob->Runs;
+	UInt32 First = Batch * KT_LANES;
+	UInt32 Count = (pJob->Count - First < KT_LANES) ? pJob->Count - First : KT_LANES;
+
+	ktScoreBatch(&pJob->pRuns[Run], &pJob->pParams[First], Count,
+				 &pJob->pSumSquares[(size_t)Index * KT_LANES], &pJob->pScored[Index]);
+
+}// ScoreItem
+
+
+/*! Score candidates over every run.
+	\param pRuns points to the runs.
+	\param Runs is the number of runs.
+	\param pParams points to the candidates.
+	\param Count is the number of candidates.
+	\param pPool is the pool to run on.
+	\param pScores points to space to receive the RMS angle error of each
+		   candidate over all the scored samples, degrees.
+	\return FALSE if out of memory.*/
+BOOL ktScore(const TuneRun_t *pRuns, UInt32 Runs, const KalmanParams_t *pParams, UInt32 Count,
+			 ThreadPool_t *pPool, double *pScores)
+{
+	UInt32 Batches = (Count + KT_LANES - 1) / KT_LANES, Items = Batches * Runs, c, r;
+	ScoreJob_t Job;
+	BOOL Ok;
+
+	Job.pRuns = pRuns;
+	Job.Runs = Runs;
+	Job.pParams = pParams;
+	Job.Count = Count;
+	Job.pSumSquares = (double *)calloc((size_t)Items * KT_LANES, sizeof(double));
+	Job.pScored = (UInt64 *)calloc(Items, sizeof(UInt64));
+
+	Ok = (Job.pSumSquares != NULL) && (Job.pScored != NULL) && tpForEach(pPool, Items, ScoreItem, &Job);
+
+	for (c = 0; Ok && (c < Count); c++)
+	{
+		double Sum = 0.0;
+		UInt64 Scored = 0;
+
+		for (r = 0; r < Runs; r++)
+		{
+			UInt32 Item = (c / KT_LANES) * Runs + r;
+
+			Sum += Job.pSumSquares[(size_t)Item * KT_LANES + c % KT_LANES];
+			Scored += Job.pScored[Item];
+		}
+
+		// A diverged filter gives NaN, which must lose every comparison
+		pScores[c] = (Scored && (Sum == Sum)) ? sqrt(Sum / Scored) : HUGE_VAL;
+	}
+
+	free(Job.pSumSquares);
+	free(Job.pScored);
+
+	return Ok;
+
+}// ktScore
+
+
+/*! Fill a log spaced grid.
+	\param pLo points to the smallest value of each parameter.
+	\param pHi points to the largest value of each parameter.
+	\param Steps is the number of values of each parameter, at least 2.
+	\param pOut points to space for Steps^3 candidates.
+	\return The number of candidates.*/
+UInt32 ktGrid(const KalmanParams_t *pLo, const KalmanParams_t *pHi, UInt32 Steps, KalmanParams_t *pOut)
+{
+	UInt32 a, b, r, n = 0;
+
+	for (a = 0; a < Steps; a++)
+	{
+		for (b = 0; b < Steps; b++)
+		{
+			for (r = 0; r < Steps; r++, n++)
+			{
+				pOut[n].Q_angle = (float)(pLo->Q_angle * pow(pHi->Q_angle / pLo->Q_angle, (double)a / (Steps - 1)));
+				pOut[n].Q_bias = (float)(pLo->Q_bias * pow(pHi->Q_bias / pLo->Q_bias, (double)b / (Steps - 1)));
+				pOut[n].R_measure = (float)(pLo->R_measure * pow(pHi->R_measure / pLo->R_measure, (double)r / (Steps - 1)));
+			}
+		}
+	}
+
+	return n;
+
+}// ktGrid
+
+
+/*! Parameters of a vertex.*/
+static void ToParams(const double *x, KalmanParams_t *pParams)
+{
+	pParams->Q_angle = (float)pow(10.0, x[0]);
+	pParams->Q_bias = (float)pow(10.0, x[1]);
+	pParams->R_measure = (float)pow(10.0, x[2]);
+
+}// ToParams
+
+
+/*! Score a list of vertices as one batch.
+	\return FALSE if out of memory.*/
+static BOOL ScoreVertices(const TuneRun_t *pRuns, UInt32 Runs, ThreadPool_t *pPool, Vertex_t **ppVertices, UInt32 Count)
+{
+	KalmanParams_t Params[KT_LANES];
+	double Scores[KT_LANES];
+	UInt32 i;
+
+	for (i = 0; i < Count; i++)
+		ToParams(ppVertices[i]->x, &Params[i]);
+
+	if (!ktScore(pRuns, Runs, Params, Count, pPool, Scores))
+		return FALSE;
+
+	for (i = 0; i < Count; i++)
+		ppVertices[i]->Score = Scores[i];
+
+	return TRUE;
+
+}// ScoreVertices
+
+
+/*! Order vertices by score, best first.*/
+static int CompareVertices(const void *pA, const void *pB)
+{
+	double a = ((const Vertex_t *)pA)->Score, b = ((const Vertex_t *)pB)->Score;
+
+	return (a < b) ? -1 : (a > b) ? 1 : 0;
+
+}// CompareVertices
+
+
+/*! Refine a candidate with Nelder-Mead on the logarithms of the parameters.
+	\param pRuns points to the runs.
+	\param Runs is the number of runs.
+	\param pPool is the pool to score on.
+	\param pBest points to the starting candidate, and receives the best
+		   one found.
+	\param Spread is the size of the starting simplex in decades.
+	\param MaxSteps is the most steps to take.
+	\param pSteps points to space to receive the steps taken, may be NULL.
+	\return The score of the best candidate, HUGE_VAL if out of memory.*/
+double ktNelderMead(const TuneRun_t *pRuns, UInt32 Runs, ThreadPool_t *pPool, KalmanParams_t *pBest,
+					double Spread, UInt32 MaxSteps, UInt32 *pSteps)
+{
+	Vertex_t Simplex[KT_DIMS + 1], Trial[4], *pList[KT_LANES];
+	Vertex_t *pWorst = &Simplex[KT_DIMS];
+	double Centroid[KT_DIMS], Size;
+	UInt32 Step, i, d;
+
+	Simplex[0].x[0] = log10(pBest->Q_angle);
+	Simplex[0].x[1] = log10(pBest->Q_bias);
+	Simplex[0].x[2] = log10(pBest->R_measure);
+	for (i = 1; i <= KT_DIMS; i++)
+	{
+		Simplex[i] = Simplex[0];
+		Simplex[i].x[i - 1] += Spread;
+	}
+	for (i = 0; i <= KT_DIMS; i++)
+		pList[i] = &Simplex[i];
+	if (!ScoreVertices(pRuns, Runs, pPool, pList, KT_DIMS + 1))
+		return HUGE_VAL;
+
+	for (Step = 0; Step < MaxSteps; Step++)
+	{
+		qsort(Simplex, KT_DIMS + 1, sizeof(Vertex_t), CompareVertices);
+
+		// Converged when the scores agree or the simplex has shrunk away
+		for (Size = 0.0, i = 1; i <= KT_DIMS; i++)
+			for (d = 0; d < KT_DIMS; d++)
+				Size = fmax(Size, fabs(Simplex[i].x[d] - Simplex[0].x[d]));
+		if ((pWorst->Score - Simplex[0].Score <= KT_TOLERANCE * Simplex[0].Score) || (Size < KT_MIN_SPREAD))
+			break;
+
+		for (d = 0; d < KT_DIMS; d++)
+		{
+			for (Centroid[d] = 0.0, i = 0; i < KT_DIMS; i++)
+				Centroid[d] += Simplex[i].x[d];
+			Centroid[d] /= KT_DIMS;
+		}
+
+		// Reflection, expansion, outside and inside contraction in one batch
+		for (d = 0; d < KT_DIMS; d++)
+		{
+			double Away = Centroid[d] - pWorst->x[d];
+
+			Trial[0].x[d] = Centroid[d] + Away;
+			Trial[1].x[d] = Centroid[d] + 2.0 * Away;
+			Trial[2].x[d] = Centroid[d] + 0.5 * Away;
+			Trial[3].x[d] = Centroid[d] - 0.5 * Away;
+		}
+		for (i = 0; i < 4; i++)
+			pList[i] = &Trial[i];
+		if (!ScoreVertices(pRuns, Runs, pPool, pList, 4))
+			return HUGE_VAL;
+
+		if (Trial[0].Score < Simplex[0].Score)
+			*pWorst = (Trial[1].Score < Trial[0].Score) ? Trial[1] : Trial[0];
+		else if (Trial[0].Score < Simplex[KT_DIMS - 1].Score)
+			*pWorst = Trial[0];
+		else if ((Trial[0].Score < pWorst->Score) && (Trial[2].Score <= Trial[0].Score))
+			*pWorst = Trial[2];
+		else if ((Trial[0].Score >= pWorst->Score) && (Trial[3].Score < pWorst->Score))
+			*pWorst = Trial[3];
+		else
+		{
+			// Shrink towards the best
+			for (i = 1; i <= KT_DIMS; i++)
+			{
+				for (d = 0; d < KT_DIMS; d++)
+					Simplex[i].x[d] = Simplex[0].x[d] + 0.5 * (Simplex[i].x[d] - Simplex[0].x[d]);
+				pList[i - 1] = &Simplex[i];
+			}
+			if (!ScoreVertices(pRuns, Runs, pPool, pList, KT_DIMS))
+				return HUGE_VAL;
+		}
+	}
+
+	qsort(Simplex, KT_DIMS + 1, sizeof(Vertex_t), CompareVertices);
+	ToParams(Simplex[0].x, pBest);
+	if (pSteps)
+		*pSteps = Step;
+
+	return Simplex[0].Score;
+
+}// ktNelderMead
@@ -0,0 +1,186 @@
+/*! \file
+	\brief Fixed size latency histogram with log-linear buckets.
+*/
+
+#include <string.h>
+#include "LatencyHistogram.h"
+
+
+/*! Get the bucket of a latency.
+	\param Ns is the latency.
+	\return The bucket, four per power of two above 4 ns.*/
+static UInt32 Bucket(UInt64 Ns)
+{
+	UInt32 Log2;
+
+	if (Ns < (1 << LH_SUB_BITS))
+		return (UInt32)Ns;
+
+#ifdef __GNUC__
+	Log2 = 63 - (UInt32)__builtin_clzll(Ns);
+#else
+	for (Log2 = 0; (Ns >> Log2) > 1; Log2++)
+		;
+#endif
+
+	return ((Log2 - LH_SUB_BITS + 1) << LH_SUB_BITS) +
+		   (UInt32)((Ns >> (Log2 - LH_SUB_BITS)) & ((1 << LH_SUB_BITS) - 1));
+
+}// Bucket
+
+
+/*! Get the lowest latency of a bucket.
+	\param Index is the bucket.
+	\return The latency in nanoseconds.*/
+static UInt64 BucketLow(UInt32 Index)
+{
+	UInt32 Shift;
+
+	if (Index < (1 << LH_SUB_BITS))
+		return Index;
+
+	Shift = (Index >> LH_SUB_BITS) - 1;
+
+	return (UInt64)((1 << LH_SUB_BITS) + (Index & ((1 << LH_SUB_BITS) - 1))) << Shift;
+
+}// BucketLow
+
+
+/*! Empty a histogram.
+	\param pHist is the histogram.*/
+void lhReset(LatencyHistogram_t *pHist)
+{
+	memset(pHist, 0, sizeof(*pHist));
+	pHist->Min = ~(UInt64)0;
+
+}// lhReset
+
+
+/*! Add a latency.
+	\param pHist is the histogram.
+	\param Ns is the latency in nanoseconds.*/
+void lhAdd(LatencyHistogram_t *pHist, UInt64 Ns)
+{
+	pHist->Buckets[Bucket(Ns)]++;
+	pHist->Count++;
+	pHist->Sum += (double)Ns;
+
+	if (Ns < pHist->Min)
+		pHist->Min = Ns;
+	if (Ns > pHist->Max)
+		pHist->Max = Ns;
+
+}// lhAdd
+
+
+/*! Get a percentile.
+	\param pHist is the histogram.
+	\param Fraction is the percentile as a fraction.
+	\return The top of the bucket holding the percentile, in nanoseconds,
+			0 if the histogram is empty.*/
+UInt64 lhPercentile(const LatencyHistogram_t *pHist, double Fraction)
+{
+	UInt64 Rank = (UInt64)(Fraction * (double)pHist->Count), Below = 0;
+	UInt32 b;
+
+	if (pHist->Count == 0)
+		return 0;
+
+	for (b = 0; b < LH_BUCKETS; b++)
+	{
+		Below += pHist->Buckets[b];
+		if (Below > Rank)
+			break;
+	}
+
+	if (b >= LH_BUCKETS - 1)
+		return pHist->Max;
+
+	// The exact extremes are known, bucket edges are only better in between
+	return (BucketLow(b + 1) - 1 < pHist->Max) ? BucketLow(b + 1) - 1 : pHist->Max;
+
+}// lhPercentile
+
+
+/*! Format a latency with a unit that keeps it short.
+	\param Ns is the latency in nanoseconds.
+	\param pText receives the text, LH_TEXT_BYTES.
+	\return pText.*/
+const char *lhFormatNs(double Ns, char *pText)
+{
+	if (Ns < 1.0e3)
+		sprintf(pText, "%.0f ns", Ns);
+	else if (Ns < 1.0e6)
+		sprintf(pText, "%.1f us", Ns / 1.0e3);
+	else if (Ns < 1.0e9)
+		sprintf(pText, "%.2f ms", Ns / 1.0e6);
+	else
+		sprintf(pText, "%.2f s", Ns / 1.0e9);
+
+	return pText;
+
+}// lhFormatNs
+
+
+/*! Print the distribution with a bar per bucket.
+	\param pFile is where to print.
+	\param pName is what was measured.
+	\param pHist is the histogram.*/
+void lhPrint(FILE *pFile, const char *pName, const LatencyHistogram_t *pHist)
+{
+	char Low[LH_TEXT_BYTES], High[LH_TEXT_BYTES];
+	UInt64 Peak = 0;
+	UInt32 b, First, Last;
+
+	fprintf(pFile, "%s: %llu samples", pName, (unsigned long long)pHist->Count);
+	if (pHist->Count == 0)
+	{
+		fprintf(pFile, "\n\n");
+		return;
+	}
+
+	fprintf(pFile, ", min %s", lhFormatNs((double)pHist->Min, Low));
+	fprintf(pFile, " mean %s", lhFormatNs(pHist->Sum / pHist->Count, Low));
+	fprintf(pFile, " p50 %s", lhFormatNs((double)lhPercentile(pHist, 0.5), Low));
+	fprintf(pFile, " p90 %s", lhFormatNs((double)lhPercentile(pHist, 0.9), Low));
+	fprintf(pFile, " p99 %s", lhFormatNs((double)lhPercentile(pHist, 0.99), Low));
+	fprintf(pFile, " p99.9 %s", lhFormatNs((double)lhPercentile(pHist, 0.999), Low));
+	fprintf(pFile, " max %s\n", lhFormatNs((double)pHist->Max, Low));
+
+	First = Bucket(pHist->Min);
+	Last = Bucket(pHist->Max);
+
+	for (b = First; b <= Last; b++)
+		if (pHist->Buckets[b] > Peak)
+			Peak = pHist->Buckets[b];
+
+	for (b = First; b <= Last; b++)
+	{
+		UInt32 Bar = (UInt32)((pHist->Buckets[b] * 50 + Peak - 1) / Peak);
+
+		lhFormatNs((double)BucketLow(b), Low);
+		lhFormatNs((double)BucketLow(b + 1), High);
+		fprintf(pFile, "  %10s - %-10s %10llu %.*s\n", Low, High, (unsigned long long)pHist->Buckets[b],
+				(int)Bar, "##################################################");
+	}
+
+	fprintf(pFile, "\n");
+
+}// lhPrint
+
+
+/*! Print one line of percentiles, short enough to print periodically from
+	a running loop.
+	\param pFile is where to print.
+	\param pName is what was measured.
+	\param pHist is the histogram.*/
+void lhPrintSummary(FILE *pFile, const char *pName, const LatencyHistogram_t *pHist)
+{
+	char P50[LH_TEXT_BYTES], P99[LH_TEXT_BYTES], Max[LH_TEXT_BYTES];
+
+	fprintf(pFile, "%-14s p50 %-10s p99 %-10s max %-10s (%llu)\n", pName,
+			lhFormatNs((double)lhPercentile(pHist, 0.5), P50),
+			lhFormatNs((double)lhPercentile(pHist, 0.99), P99),
+			lhFormatNs((double)pHist->Max, Max), (unsigned long long)pHist->Count);
+
+}// lhPrintSummary
@@ -0,0 +1,269 @@
+/*! \file
+	\brief Per-thread stage rings, latency histograms and Chrome trace export.
+*/
+
+#include "LatencyTrace.h"
+
+#ifdef IMU_LATENCY_TRACE
+
+#include <stdlib.h>
+#include "HostTime.h"
+#include "LatencyHistogram.h"
+
+#define LT_SPANS		4					//!< Intervals reported, see SpanNames
+
+LT_THREAD_LOCAL LatencyRing_t *pLatencyRing;
+
+static LatencyRing_t *volatile pRings;		// Every ring made, newest first
+static volatile UInt32 Threads;
+static LatencyRing_t Sink;					// Stamps of threads whose ring couldn't be made
+static LatencyHistogram_t SummaryHist[LT_SPANS];	// ltPrintSummary()'s, so it never allocates
+
+// Start and end stage of each interval, the last being the whole pipeline
+static const LatencyStage_t SpanFrom[LT_SPANS] = { LT_SERIAL_READ, LT_FRAME_COMPLETE, LT_DECODE_DONE, LT_SERIAL_READ };
+static const LatencyStage_t SpanTo[LT_SPANS] = { LT_FRAME_COMPLETE, LT_DECODE_DONE, LT_FILTER_DONE, LT_FILTER_DONE };
+static const char *SpanNames[LT_SPANS] = { "read-frame", "frame-decode", "decode-filter", "read-filter" };
+
+// Chrome trace slice names of the stage ending at each stamp
+static const char *StageNames[LT_STAGES] = { "read", "frame", "decode", "filter" };
+
+#ifdef LT_USE_TSC
+static UInt64 BaseTicks, BaseNs;			// Clock pair taken with the first ring
+#endif
+
+
+#ifdef LT_USE_TSC
+/*! Read the clock the time stamp counter is calibrated against.
+	\return Nanoseconds of CLOCK_MONOTONIC_RAW.*/
+static UInt64 RawNs(void)
+{
+	struct timespec Ts;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &Ts);
+	return (UInt64)Ts.tv_sec * 1000000000ULL + (UInt64)Ts.tv_nsec;
+
+}// RawNs
+#endif
+
+
+/*! Get the length of a stamp clock tick.
+	\return Nanoseconds per tick, 1 unless the time stamp counter is used.*/
+static double NsPerTick(void)
+{
+#ifdef LT_USE_TSC
+	UInt64 Ticks, Ns;
+
+	// Give the rate at least 10 ms of both clocks to be measured over
+	if (RawNs() - BaseNs < 10000000)
+		htSleepMs(20);
+
+	Ns = RawNs();
+	Ticks = __rdtsc();
+
+	return (double)(Ns - BaseNs) / (double)(Ticks - BaseTicks);
+#else
+	return 1.0;
+#endif
+
+}// NsPerTick
+
+
+/*! Make the calling thread's ring and add it to the list of rings.
+	\return The ring, never NULL.*/
+LatencyRing_t *ltMakeRing(void)
+{
+	LatencyRing_t *pRing = (LatencyRing_t *)calloc(1, sizeof(LatencyRing_t));
+
+	if (pRing == NULL)
+	{
+		// Keep stamping somewhere rather than check in every stamp
+		pLatencyRing = &Sink;
+		return &Sink;
+	}
+
+#ifdef LT_USE_TSC
+	if (BaseTicks == 0)
+	{
+		BaseNs = RawNs();
+		BaseTicks = __rdtsc();
+	}
+#endif
+
+	pRing->Thread = atomicAddRelaxed(&Threads, 1);
+
+	do
+	{
+		pRing->pNext = atomicLoadAcquire(&pRings);
+	} while (!atomicCasPtr(&pRings, pRing->pNext, pRing));
+
+	pLatencyRing = pRing;
+
+	return pRing;
+
+}// ltMakeRing
+
+
+/*! Get the records a ring still holds.
+	\param pRing is the ring.
+	\param pFirst receives the sequence number of the oldest record.
+	\return The number of records from *pFirst.*/
+static UInt64 RingRecords(const LatencyRing_t *pRing, UInt64 *pFirst)
+{
+	UInt64 Head = atomicLoadAcquire(&pRing->Head);
+	UInt64 Count = (Head < LT_RING_RECORDS) ? Head : LT_RING_RECORDS;
+
+	*pFirst = Head - Count;
+
+	return Count;
+
+}// RingRecords
+
+
+/*! Build the histograms of every interval from all the rings.
+	\param pHist receives LT_SPANS histograms.*/
+static void BuildHistograms(LatencyHistogram_t *pHist)
+{
+	const LatencyRing_t *pRing;
+	double Scale = NsPerTick();
+	UInt64 First, Count, i;
+	UInt32 s;
+
+	for (s = 0; s < LT_SPANS; s++)
+		lhReset(&pHist[s]);
+
+	for (pRing = atomicLoadAcquire(&pRings); pRing; pRing = pRing->pNext)
+	{
+		Count = RingRecords(pRing, &First);
+
+		for (i = First; i < First + Count; i++)
+		{
+			const LatencyRecord_t *pRecord = &pRing->Records[i & (LT_RING_RECORDS - 1)];
+
+			for (s = 0; s < LT_SPANS; s++)
+			{
+				UInt64 From = pRecord->Stamp[SpanFrom[s]], To = pRecord->Stamp[SpanTo[s]];
+
+				// Stages not reached, or a record torn by the writer
+				if (From != 0 && To >= From)
+					lhAdd(&pHist[s], (UInt64)((To - From) * Scale));
+			}
+		}
+	}
+
+}// BuildHistograms
+
+
+/*! Print the distribution of every interval with a bar per bucket.
+	\param pFile is where to print.*/
+void ltPrintHistograms(FILE *pFile)
+{
+	LatencyHistogram_t *pHist = (LatencyHistogram_t *)malloc(LT_SPANS * sizeof(LatencyHistogram_t));
+	UInt32 s;
+
+	if (pHist == NULL)
+		return;
+
+	BuildHistograms(pHist);
+
+	for (s = 0; s < LT_SPANS; s++)
+		lhPrint(pFile, SpanNames[s], &pHist[s]);
+
+	free(pHist);
+
+}// ltPrintHistograms
+
+
+/*! Print a line of percentiles per interval, short enough to print
+	periodically from a running program.  Builds the histograms in static
+	storage, so only one thread may call it at a time.
+	\param pFile is where to print.*/
+void ltPrintSummary(FILE *pFile)
+{
+	UInt32 s;
+
+	BuildHistograms(SummaryHist);
+
+	for (s = 0; s < LT_SPANS; s++)
+		if (SummaryHist[s].Count)
+			lhPrintSummary(pFile, SpanNames[s], &SummaryHist[s]);
+
+}// ltPrintSummary
+
+
+/*! Write every record held as Chrome trace event JSON, a track per thread
+	with a slice per packet and nested slices for its stages.
+	\param pPath is the file to write.
+	\return TRUE if the file was written.*/
+BOOL ltWriteChromeTrace(const char *pPath)
+{
+	const LatencyRing_t *pRing;
+	FILE *pFile = fopen(pPath, "w");
+	double Scale = NsPerTick();
+	UInt64 Origin = ~(UInt64)0, First, Count, i;
+	BOOL Comma = FALSE, Ok;
+	UInt32 s;
+
+	if (pFile == NULL)
+		return FALSE;
+
+	// Times are from the oldest stamp held, which keeps them short
+	for (pRing = atomicLoadAcquire(&pRings); pRing; pRing = pRing->pNext)
+	{
+		Count = RingRecords(pRing, &First);
+		if (Count && pRing->Records[First & (LT_RING_RECORDS - 1)].Stamp[LT_SERIAL_READ] < Origin)
+			Origin = pRing->Records[First & (LT_RING_RECORDS - 1)].Stamp[LT_SERIAL_READ];
+	}
+
+	fprintf(pFile, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+	for (pRing = atomicLoadAcquire(&pRings); pRing; pRing = pRing->pNext)
+	{
+		fprintf(pFile, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"imu %u\"}}",
+				Comma ? ",\n" : "", (unsigned)pRing->Thread, (unsigned)pRing->Thread);
+		Comma = TRUE;
+
+		Count = RingRecords(pRing, &First);
+
+		for (i = First; i < First + Count; i++)
+		{
+			const LatencyRecord_t *pRecord = &pRing->Records[i & (LT_RING_RECORDS - 1)];
+			LatencyStage_t Last = LT_SERIAL_READ;
+
+			if (pRecord->Stamp[LT_SERIAL_READ] < Origin)
+				continue;
+
+			for (s = LT_FRAME_COMPLETE; s < LT_STAGES; s++)
+				if (pRecord->Stamp[s] >= pRecord->Stamp[Last])
+					Last = (LatencyStage_t)s;
+
+			fprintf(pFile, ",\n{\"name\":\"packet 0x%02X\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+					"\"args\":{\"packet\":%u,\"type\":%u}}",
+					(unsigned)pRecord->Type, (unsigned)pRing->Thread,
+					(pRecord->Stamp[LT_SERIAL_READ] - Origin) * Scale / 1.0e3,
+					(pRecord->Stamp[Last] - pRecord->Stamp[LT_SERIAL_READ]) * Scale / 1.0e3,
+					(unsigned)pRecord->Packet, (unsigned)pRecord->Type);
+
+			for (s = LT_FRAME_COMPLETE; s <= Last; s++)
+			{
+				if (pRecord->Stamp[s] < pRecord->Stamp[s - 1] || pRecord->Stamp[s - 1] == 0)
+					continue;
+
+				fprintf(pFile, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+						StageNames[s], (unsigned)pRing->Thread,
+						(pRecord->Stamp[s - 1] - Origin) * Scale / 1.0e3,
+						(pRecord->Stamp[s] - pRecord->Stamp[s - 1]) * Scale / 1.0e3);
+			}
+		}
+	}
+
+	fprintf(pFile, "\n]}\n");
+
+	Ok = !ferror(pFile);
+	if (fclose(pFile) != 0)
+		Ok = FALSE;
+
+	return Ok;
+
+}// ltWriteChromeTrace
+
+#endif // IMU_LATENCY_TRACE
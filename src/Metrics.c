@@ -0,0 +1,559 @@
+/*! \file
+	\brief Pipeline health metrics in the Prometheus text format.
+*/
+
+#ifdef WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "HostTime.h"
+#include "Metrics.h"
+
+#define MT_TEXT_BYTES		65536			//!< Room for the rendered text
+#define MT_REQUEST_BYTES	2048			//!< Most of a request looked at
+#define MT_POLL_MS			200				//!< How often the exporter checks for a stop
+#define MT_DEFAULT_HOST		"127.0.0.1"		//!< Where "http:port" listens
+
+#ifdef WIN32
+typedef SOCKET Socket_t;
+#else
+typedef int Socket_t;
+#define INVALID_SOCKET		(-1)
+#define closesocket			close
+#endif
+
+// A client gone before the answer is sent mustn't raise SIGPIPE, which kills the process
+#ifdef MSG_NOSIGNAL
+#define MT_SEND_FLAGS		MSG_NOSIGNAL
+#else
+#define MT_SEND_FLAGS		0
+#endif
+
+//! Name and help text of a metric
+typedef struct
+{
+	const char *pName;
+	const char *pHelp;
+	const char *pLabel;						//!< Extra label, NULL for none
+} MetricInfo_t;
+
+struct MetricsExporter_t
+{
+	volatile UInt32 Stop;					//!< Set to ask the thread to exit
+	Socket_t Listen;						//!< HTTP socket, INVALID_SOCKET for a file
+	char *pPath;							//!< Metrics file, NULL for HTTP
+	char *pText;							//!< MT_TEXT_BYTES of rendered text
+
+#ifdef WIN32
+	HANDLE Thread;
+#else
+	pthread_t Thread;
+#endif
+};
+
+// Entries of one metric with different labels follow each other
+static const MetricInfo_t CounterInfo[MT_COUNTERS] =
+{
+	{ "cristaimu_serial_bytes_total",      "Bytes read from the serial port.",              NULL },
+	{ "cristaimu_packets_total",           "IMU packets received with a good CRC.",         NULL },
+	{ "cristaimu_crc_errors_total",        "IMU packets received with a bad CRC.",          NULL },
+	{ "cristaimu_length_errors_total",     "Packet lengths too long for any IMU packet.",   NULL },
+	{ "cristaimu_samples_filtered_total",  "Samples run through the tilt filter.",          NULL },
+	{ "cristaimu_telemetry_dropped_total", "Telemetry records dropped on a full queue.",    "queue=\"log\"" },
+	{ "cristaimu_telemetry_dropped_total", "Telemetry records dropped on a full queue.",    "queue=\"stream\"" },
+	{ "cristaimu_health_raised_total",     "Sensor health checks raised.",                  "check=\"saturated\"" },
+	{ "cristaimu_health_raised_total",     "Sensor health checks raised.",                  "check=\"flat\"" },
+	{ "cristaimu_health_raised_total",     "Sensor health checks raised.",                  "check=\"dropout\"" },
+	{ "cristaimu_health_raised_total",     "Sensor health checks raised.",                  "check=\"temp_drift\"" },
+};
+
+static const MetricInfo_t GaugeInfo[MT_GAUGES] =
+{
+	{ "cristaimu_filter_angle_degrees",    "Filtered tilt angle.",                          NULL },
+	{ "cristaimu_filter_rate_dps",         "Bias corrected tilt rate, degrees per second.", NULL },
+	{ "cristaimu_filter_bias_dps",         "Estimated gyro bias, degrees per second.",      NULL },
+	{ "cristaimu_telemetry_queue_depth",   "Telemetry records waiting to be written.",      "queue=\"log\"" },
+	{ "cristaimu_telemetry_queue_depth",   "Telemetry records waiting to be written.",      "queue=\"stream\"" },
+	{ "cristaimu_telemetry_lost_records",  "Telemetry log records lost to failed writes.",  NULL },
+	{ "cristaimu_health_active_checks",    "Sensor health checks raised now.",              NULL },
+};
+
+static const double Quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+MT_THREAD_LOCAL MetricsBlock_t *pMetricsBlock;
+
+// Every thread's block, newest first
+static MetricsBlock_t *pBlocks;
+
+
+/*! Make the calling thread's block, once, and add it to the list.
+	\param pName is the thread's label, e.g. "serial".
+	\return The block, or NULL if out of memory, when nothing is counted.*/
+MetricsBlock_t *mtRegister(const char *pName)
+{
+	MetricsBlock_t *pBlock = pMetricsBlock;
+
+	if (pBlock)
+		return pBlock;
+
+	pBlock = (MetricsBlock_t *)calloc(1, sizeof(MetricsBlock_t));
+	if (pBlock == NULL)
+		return NULL;
+
+	strncpy(pBlock->Name, pName, sizeof(pBlock->Name) - 1);
+	lhReset(&pBlock->Latency);
+
+	do
+	{
+		pBlock->pNext = atomicLoadAcquire(&pBlocks);
+	} while (!atomicCasPtr(&pBlocks, pBlock->pNext, pBlock));
+
+	pMetricsBlock = pBlock;
+
+	return pBlock;
+
+}// mtRegister
+
+
+/*! Add formatted text, as far as there's room.
+	\param pText is the text.
+	\param Bytes is its size.
+	\param Used is the length so far.
+	\param pFormat is the printf() format.
+	\return The new length.*/
+static size_t Append(char *pText, size_t Bytes, size_t Used, const char *pFormat, ...)
+{
+	va_list Args;
+	int Length;
+
+	if (Used + 1 >= Bytes)
+		return Used;
+
+	va_start(Args, pFormat);
+	Length = vsnprintf(pText + Used, Bytes - Used, pFormat, Args);
+	va_end(Args);
+
+	if (Length < 0)
+		return Used;
+
+	return (Used + Length < Bytes) ? Used + Length : Bytes - 1;
+
+}// Append
+
+
+/*! Add the help and type lines of a metric, unless the last entry had them.
+	\param pText is the text.
+	\param Bytes is its size.
+	\param Used is the length so far.
+	\param pInfo is the metric's entry.
+	\param pLast is the entry before, NULL for none.
+	\param pType is the Prometheus type.
+	\return The new length.*/
+static size_t AppendHeader(char *pText, size_t Bytes, size_t Used, const MetricInfo_t *pInfo,
+						   const MetricInfo_t *pLast, const char *pType)
+{
+	if (pLast && strcmp(pLast->pName, pInfo->pName) == 0)
+		return Used;
+
+	Used = Append(pText, Bytes, Used, "# HELP %s %s\n", pInfo->pName, pInfo->pHelp);
+
+	return Append(pText, Bytes, Used, "# TYPE %s %s\n", pInfo->pName, pType);
+
+}// AppendHeader
+
+
+/*! Format every thread's metrics.
+	\param pText receives the text, always terminated.
+	\param Bytes is its size.
+	\return The length of the text, Bytes - 1 if it was cut short.*/
+size_t mtRender(char *pText, size_t Bytes)
+{
+	const MetricsBlock_t *pFirst = atomicLoadAcquire(&pBlocks), *pBlock;
+	LatencyHistogram_t Latency;
+	size_t Used = 0;
+	UInt32 m, b, q;
+
+	if (Bytes == 0)
+		return 0;
+	pText[0] = 0;
+
+	for (m = 0; m < MT_COUNTERS; m++)
+	{
+		Used = AppendHeader(pText, Bytes, Used, &CounterInfo[m], m ? &CounterInfo[m - 1] : NULL, "counter");
+
+		for (pBlock = pFirst; pBlock; pBlock = pBlock->pNext)
+			Used = Append(pText, Bytes, Used, "%s{thread=\"%s\"%s%s} %llu\n", CounterInfo[m].pName, pBlock->Name,
+						  CounterInfo[m].pLabel ? "," : "", CounterInfo[m].pLabel ? CounterInfo[m].pLabel : "",
+						  (unsigned long long)atomicLoadRelaxed(&pBlock->Counters[m]));
+	}
+
+	for (m = 0; m < MT_GAUGES; m++)
+	{
+		Used = AppendHeader(pText, Bytes, Used, &GaugeInfo[m], m ? &GaugeInfo[m - 1] : NULL, "gauge");
+
+		for (pBlock = pFirst; pBlock; pBlock = pBlock->pNext)
+			if (pBlock->GaugesSet & (1u << m))
+				Used = Append(pText, Bytes, Used, "%s{thread=\"%s\"%s%s} %.9g\n", GaugeInfo[m].pName, pBlock->Name,
+							  GaugeInfo[m].pLabel ? "," : "", GaugeInfo[m].pLabel ? GaugeInfo[m].pLabel : "",
+							  pBlock->Gauges[m]);
+	}
+
+	Used = Append(pText, Bytes, Used, "# HELP cristaimu_pipeline_latency_seconds "
+				  "Packet complete to filtered angle.\n# TYPE cristaimu_pipeline_latency_seconds summary\n");
+
+	for (pBlock = pFirst; pBlock; pBlock = pBlock->pNext)
+	{
+		// The owner keeps adding while this copies, so count what the buckets hold
+		Latency = pBlock->Latency;
+		for (Latency.Count = 0, b = 0; b < LH_BUCKETS; b++)
+			Latency.Count += Latency.Buckets[b];
+
+		if (Latency.Count == 0)
+			continue;
+
+		for (q = 0; q < sizeof(Quantiles) / sizeof(Quantiles[0]); q++)
+			Used = Append(pText, Bytes, Used, "cristaimu_pipeline_latency_seconds{thread=\"%s\",quantile=\"%g\"} %.9f\n",
+						  pBlock->Name, Quantiles[q], lhPercentile(&Latency, Quantiles[q]) * 1.0e-9);
+
+		Used = Append(pText, Bytes, Used, "cristaimu_pipeline_latency_seconds_sum{thread=\"%s\"} %.9f\n",
+					  pBlock->Name, Latency.Sum * 1.0e-9);
+		Used = Append(pText, Bytes, Used, "cristaimu_pipeline_latency_seconds_count{thread=\"%s\"} %llu\n",
+					  pBlock->Name, (unsigned long long)Latency.Count);
+	}
+
+	return Used;
+
+}// mtRender
+
+
+/*! Answer one HTTP connection.
+	\param pExporter is the exporter.
+	\param Client is the connection, closed here.*/
+static void AnswerRequest(MetricsExporter_t *pExporter, Socket_t Client)
+{
+	char Request[MT_REQUEST_BYTES], Head[160];
+	const char *pStatus = "200 OK", *pBody = pExporter->pText;
+	size_t Used = 0, BodyBytes;
+	int Got;
+#ifdef WIN32
+	DWORD Timeout = MT_POLL_MS * 5;
+#else
+	struct timeval Timeout = { (MT_POLL_MS * 5) / 1000, ((MT_POLL_MS * 5) % 1000) * 1000 };
+#endif
+#ifdef SO_NOSIGPIPE
+	int Yes = 1;
+#endif
+
+	// A client that never sends mustn't hold up the next one, or mtStop(),
+	//   so one that can't be given a timeout isn't read at all
+	if (setsockopt(Client, SOL_SOCKET, SO_RCVTIMEO, (const char *)&Timeout, sizeof(Timeout)) != 0)
+	{
+		closesocket(Client);
+		return;
+	}
+#ifdef SO_NOSIGPIPE
+	// Where send() has no MSG_NOSIGNAL the socket is told instead
+	setsockopt(Client, SOL_SOCKET, SO_NOSIGPIPE, &Yes, sizeof(Yes));
+#endif
+
+	// The request line is all that matters, read until the headers end or the space does
+	while (Used + 1 < sizeof(Request))
+	{
+		Got = recv(Client, Request + Used, (int)(sizeof(Request) - 1 - Used), 0);
+		if (Got <= 0)
+			break;
+
+		Used += (size_t)Got;
+		Request[Used] = 0;
+		if (strstr(Request, "\r\n\r\n") || strstr(Request, "\n\n"))
+			break;
+	}
+	Request[Used] = 0;
+
+	if (strncmp(Request, "GET ", 4) != 0)
+	{
+		pStatus = "405 Method Not Allowed";
+		pBody = "GET only\n";
+	}
+	else if (strncmp(Request + 4, "/metrics ", 9) != 0 && strncmp(Request + 4, "/ ", 2) != 0)
+	{
+		pStatus = "404 Not Found";
+		pBody = "Metrics are at /metrics\n";
+	}
+	else
+		mtRender(pExporter->pText, MT_TEXT_BYTES);
+
+	BodyBytes = strlen(pBody);
+	snprintf(Head, sizeof(Head), "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\n"
+			 "Content-Length: %lu\r\nConnection: close\r\n\r\n", pStatus, (unsigned long)BodyBytes);
+
+	if (send(Client, Head, (int)strlen(Head), MT_SEND_FLAGS) <= 0)
+		BodyBytes = 0;
+	while (BodyBytes)
+	{
+		Got = send(Client, pBody, (int)BodyBytes, MT_SEND_FLAGS);
+		if (Got <= 0)
+			break;
+
+		pBody += Got;
+		BodyBytes -= (size_t)Got;
+	}
+
+	closesocket(Client);
+
+}// AnswerRequest
+
+
+/*! Wait for the listening socket to have a connection.
+	\param Listen is the socket.
+	\param TimeoutMs is the longest to wait.
+	\return TRUE if accept() won't wait.*/
+static BOOL WaitForClient(Socket_t Listen, UInt32 TimeoutMs)
+{
+#ifdef WIN32
+	struct timeval Timeout;
+	fd_set Readable;
+
+	FD_ZERO(&Readable);
+	FD_SET(Listen, &Readable);
+	Timeout.tv_sec = (long)(TimeoutMs / 1000);
+	Timeout.tv_usec = (long)(TimeoutMs % 1000) * 1000;
+
+	return select(0, &Readable, NULL, NULL, &Timeout) > 0;
+#else
+	struct pollfd Poll;
+
+	Poll.fd = Listen;
+	Poll.events = POLLIN;
+
+	return poll(&Poll, 1, (int)TimeoutMs) > 0;
+#endif
+
+}// WaitForClient
+
+
+/*! Rewrite the metrics file.
+	\param pExporter is the exporter.*/
+static void WriteFile(MetricsExporter_t *pExporter)
+{
+	char Temp[1024];
+	size_t Length = mtRender(pExporter->pText, MT_TEXT_BYTES);
+	FILE *pFile;
+
+	snprintf(Temp, sizeof(Temp), "%s.tmp", pExporter->pPath);
+
+	pFile = fopen(Temp, "wb");
+	if (pFile == NULL)
+		return;
+
+	fwrite(pExporter->pText, 1, Length, pFile);
+	if (fclose(pFile) != 0)
+		return;
+
+#ifdef WIN32
+	MoveFileExA(Temp, pExporter->pPath, MOVEFILE_REPLACE_EXISTING);
+#else
+	rename(Temp, pExporter->pPath);
+#endif
+
+}// WriteFile
+
+
+/*! Exporter thread, runs until mtStop() sets Stop.
+	\param pArg points to the exporter.*/
+#ifdef WIN32
+static DWORD WINAPI ExporterThread(LPVOID pArg)
+#else
+static void *ExporterThread(void *pArg)
+#endif
+{
+	MetricsExporter_t *pExporter = (MetricsExporter_t *)pArg;
+	UInt64 NextNs = htNowNs();
+
+	while (!atomicLoadAcquire(&pExporter->Stop))
+	{
+		if (pExporter->pPath)
+		{
+			if (htNowNs() >= NextNs)
+			{
+				WriteFile(pExporter);
+				NextNs += (UInt64)MT_FILE_PERIOD_MS * 1000000;
+			}
+			htSleepMs(MT_POLL_MS);
+		}
+		else if (WaitForClient(pExporter->Listen, MT_POLL_MS))
+		{
+			Socket_t Client = accept(pExporter->Listen, NULL, NULL);
+
+			if (Client != INVALID_SOCKET)
+				AnswerRequest(pExporter, Client);
+		}
+	}
+
+	return 0;
+
+}// ExporterThread
+
+
+/*! Open the HTTP listening socket.
+	\param pAddress is "port" or "host:port", IPv6 hosts in brackets.
+	\return The socket, or INVALID_SOCKET.*/
+static Socket_t OpenListen(const char *pAddress)
+{
+	struct addrinfo Hints, *pInfo;
+	const char *pPort = strrchr(pAddress, ':');
+	char Host[128];
+	Socket_t Listen;
+	int Yes = 1;
+
+	if (pPort == NULL)
+	{
+		strcpy(Host, MT_DEFAULT_HOST);
+		pPort = pAddress;
+	}
+	else
+	{
+		size_t Length = (size_t)(pPort - pAddress);
+
+		if (Length >= sizeof(Host))
+			return INVALID_SOCKET;
+		memcpy(Host, pAddress, Length);
+		Host[Length] = 0;
+		if (Length >= 2 && Host[0] == '[' && Host[Length - 1] == ']')
+		{
+			memmove(Host, Host + 1, Length - 2);
+			Host[Length - 2] = 0;
+		}
+		pPort++;
+	}
+
+	memset(&Hints, 0, sizeof(Hints));
+	Hints.ai_family = AF_UNSPEC;
+	Hints.ai_socktype = SOCK_STREAM;
+	Hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+
+	if (getaddrinfo(Host[0] ? Host : NULL, pPort, &Hints, &pInfo) != 0)
+		return INVALID_SOCKET;
+
+	Listen = socket(pInfo->ai_family, SOCK_STREAM, 0);
+	if (Listen != INVALID_SOCKET)
+	{
+		setsockopt(Listen, SOL_SOCKET, SO_REUSEADDR, (const char *)&Yes, sizeof(Yes));
+
+		if (bind(Listen, pInfo->ai_addr, (int)pInfo->ai_addrlen) != 0 || listen(Listen, 8) != 0)
+		{
+			closesocket(Listen);
+			Listen = INVALID_SOCKET;
+		}
+	}
+
+	freeaddrinfo(pInfo);
+
+	return Listen;
+
+}// OpenListen
+
+
+/*! Start serving the metrics.
+	\param pWhere is "http:[host:]port", host 127.0.0.1 if left out, or
+		   "file:path".
+	\return The exporter, or NULL if it couldn't be started.*/
+MetricsExporter_t *mtStart(const char *pWhere)
+{
+	MetricsExporter_t *pExporter = (MetricsExporter_t *)calloc(1, sizeof(MetricsExporter_t));
+
+	if (pExporter == NULL)
+		return NULL;
+
+	pExporter->Listen = INVALID_SOCKET;
+	pExporter->pText = (char *)malloc(MT_TEXT_BYTES);
+
+#ifdef WIN32
+	{
+		WSADATA Data;
+
+		WSAStartup(MAKEWORD(2, 2), &Data);
+	}
+#endif
+
+	if (pExporter->pText && strncmp(pWhere, "file:", 5) == 0 && pWhere[5])
+	{
+		pExporter->pPath = (char *)malloc(strlen(pWhere + 5) + 1);
+		if (pExporter->pPath)
+			strcpy(pExporter->pPath, pWhere + 5);
+	}
+	else if (pExporter->pText && strncmp(pWhere, "http:", 5) == 0)
+		pExporter->Listen = OpenListen(pWhere + 5);
+
+	if (pExporter->pPath == NULL && pExporter->Listen == INVALID_SOCKET)
+	{
+		free(pExporter->pText);
+		free(pExporter);
+#ifdef WIN32
+		WSACleanup();
+#endif
+		return NULL;
+	}
+
+#ifdef WIN32
+	pExporter->Thread = CreateThread(NULL, 0, ExporterThread, pExporter, 0, NULL);
+	if (pExporter->Thread == NULL)
+#else
+	if (pthread_create(&pExporter->Thread, NULL, ExporterThread, pExporter) != 0)
+#endif
+	{
+		if (pExporter->Listen != INVALID_SOCKET)
+			closesocket(pExporter->Listen);
+		free(pExporter->pPath);
+		free(pExporter->pText);
+		free(pExporter);
+#ifdef WIN32
+		WSACleanup();
+#endif
+		return NULL;
+	}
+
+	return pExporter;
+
+}// mtStart
+
+
+/*! Stop serving the metrics, waiting for a request in progress.
+	\param pExporter is the exporter, which is freed.*/
+void mtStop(MetricsExporter_t *pExporter)
+{
+	if (pExporter == NULL)
+		return;
+
+	atomicStoreRelease(&pExporter->Stop, 1);
+
+#ifdef WIN32
+	WaitForSingleObject(pExporter->Thread, INFINITE);
+	CloseHandle(pExporter->Thread);
+#else
+	pthread_join(pExporter->Thread, NULL);
+#endif
+
+	if (pExporter->Listen != INVALID_SOCKET)
+		closesocket(pExporter->Listen);
+#ifdef WIN32
+	WSACleanup();
+#endif
+
+	free(pExporter->pPath);
+	free(pExporter->pText);
+	free(pExporter);
+
+}// mtStop
@@ -0,0 +1,411 @@
+/*! \file
+	\brief Parallel framing of capture files.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "HostTime.h"
+#include "IMUSerial.h"
+#include "ParallelDecode.h"
+#include "ThreadPool.h"
+
+//! A stretch [Begin, End) of unit bytes over which the parser sat in SYNC0
+typedef struct
+{
+	UInt64 Begin;
+	UInt64 End;
+} SyncRun_t;
+
+//! One unit of work and its results
+typedef struct
+{
+	const CaptureReader_t *pReader;
+	UInt64 Start;							//!< File offset of the first chunk
+	UInt64 End;								//!< File offset past the last chunk
+	BOOL Search;							//!< Look for the first frame, FALSE for the first unit
+
+	DecodedFrame_t *pFrames;				//!< Frames, Position relative to the unit
+	size_t FrameCount;
+	size_t FrameCapacity;
+	SyncRun_t *pRuns;						//!< SYNC0 stretches, in order
+	size_t RunCount;
+	size_t RunCapacity;
+	UInt64 Bytes;							//!< Stream bytes in the unit
+	IMUPacket_t EndState;					//!< Parser at the end of the unit
+	BOOL Failed;							//!< Out of memory
+} DecodeUnit_t;
+
+
+/*! Make room for one more element in a growable array.
+	\param ppArray points to the array pointer.
+	\param pCapacity points to the capacity in elements.
+	\param Count is the number of elements in use.
+	\param Size is the element size.
+	\return FALSE if out of memory.*/
+static BOOL Reserve(void **ppArray, size_t *pCapacity, size_t Count, size_t Size)
+{
+	size_t Capacity = *pCapacity ? 2 * *pCapacity : 1024;
+	void *pArray;
+
+	if (Count < *pCapacity)
+		return TRUE;
+
+	pArray = realloc(*ppArray, Capacity * Size);
+	if (pArray == NULL)
+		return FALSE;
+
+	*ppArray = pArray;
+	*pCapacity = Capacity;
+
+	return TRUE;
+
+}// Reserve
+
+
+/*! Find the first sync pair in a unit that starts a frame with a good CRC.
+	Frames that straddle chunks are passed over; this only picks a good
+	place to start, stitching makes the result exact either way.
+	\param pUnit points to the unit.
+	\return The unit offset to start parsing at, 0 if none was found.*/
+static UInt64 FindFirstFrame(const DecodeUnit_t *pUnit)
+{
+	CaptureChunk_t Chunk;
+	IMUPacket_t Pkt;
+	UInt64 Offset = pUnit->Start, Base = 0;
+	UInt32 i, j, Total;
+
+	while ((Offset < pUnit->End) && (Base < PD_SEARCH_BYTES) &&
+		   crChunkAt(pUnit->pReader, Offset, &Chunk))
+	{
+		for (i = 0; (i + 3 < Chunk.Length) && (Base + i < PD_SEARCH_BYTES); i++)
+		{
+			if ((Chunk.pData[i] != SYNC_BYTE0) || (Chunk.pData[i + 1] != SYNC_BYTE1))
+				continue;
+
+			if (Chunk.pData[i + 2] == HS_RAW_IMU_MSG)
+				Total = 3 + 13 + 2;
+			else if (Chunk.pData[i + 3] <= MAX_PAYLOAD_BYTES)
+				Total = Chunk.pData[i + 3] + 6;
+			else
+				continue;
+
+			if (i + Total > Chunk.Length)
+				continue;
+
+			// Let the parser itself judge the candidate
+			Pkt.state = SERIAL_STATE_SYNC0;
+			for (j = 0; j < Total - 1; j++)
+				LookForIMUPacketInByte(Chunk.pData[i + j], &Pkt);
+			if (LookForIMUPacketInByte(Chunk.pData[i + j], &Pkt))
+				return Base + i;
+		}
+
+		Base += Chunk.Length;
+		Offset = Chunk.Next;
+	}
+
+	return 0;
+
+}// FindFirstFrame
+
+
+/*! Frame one unit, recording frames and SYNC0 stretches.  Runs on a
+	worker.
+	\param pArg points to the DecodeUnit_t.*/
+static void DecodeUnit(void *pArg)
+{
+	DecodeUnit_t *pUnit = (DecodeUnit_t *)pArg;
+	CaptureChunk_t Chunk;
+	IMUPacket_t Pkt;
+	UInt64 Offset = pUnit->Start, Base = 0, Skip;
+	DecodedFrame_t *pFrame;
+	BOOL InSync = FALSE;
+	UInt32 i;
+
+	pUnit->FrameCount = 0;
+	pUnit->RunCount = 0;
+	pUnit->Failed = FALSE;
+
+	Skip = pUnit->Search ? FindFirstFrame(pUnit) : 0;
+	Pkt.state = SERIAL_STATE_SYNC0;
+
+	while ((Offset < pUnit->End) && crChunkAt(pUnit->pReader, Offset, &Chunk))
+	{
+		i = (Skip > Base) ? (UInt32)((Skip - Base < Chunk.Length) ? Skip - Base : Chunk.Length) : 0;
+
+		for (; i < Chunk.Length; i++)
+		{
+			// Track the SYNC0 stretches, this is the only extra work per byte
+			if ((Pkt.state == SERIAL_STATE_SYNC0) != InSync)
+			{
+				InSync = !InSync;
+
+				if (InSync)
+				{
+					if (!Reserve((void **)&pUnit->pRuns, &pUnit->RunCapacity, pUnit->RunCount, sizeof(SyncRun_t)))
+						goto Fail;
+					pUnit->pRuns[pUnit->RunCount].Begin = Base + i;
+				}
+				else
+					pUnit->pRuns[pUnit->RunCount++].End = Base + i;
+			}
+
+			if (LookForIMUPacketInByte(Chunk.pData[i], &Pkt))
+			{
+				if (!Reserve((void **)&pUnit->pFrames, &pUnit->FrameCapacity, pUnit->FrameCount, sizeof(DecodedFrame_t)))
+					goto Fail;
+
+				pFrame = &pUnit->pFrames[pUnit->FrameCount++];
+				pFrame->Pkt = Pkt;
+				pFrame->HostNs = Chunk.HostNs;
+				pFrame->Position = Base + i;
+			}
+		}
+
+		Base += Chunk.Length;
+		Offset = Chunk.Next;
+	}
+
+	if (InSync)
+		pUnit->pRuns[pUnit->RunCount++].End = Base;
+
+	pUnit->Bytes = Base;
+	pUnit->EndState = Pkt;
+	return;
+
+Fail:
+	pUnit->Failed = TRUE;
+
+}// DecodeUnit
+
+
+/*! Stitch a framed unit onto the stream and hand its frames to the callback.
+	\param pUnit points to the framed unit.
+	\param pPkt points to the true parser state at the start of the unit; on
+		   return it holds the state at the end.
+	\param StreamBase is the stream offset of the first unit byte.
+	\param pCallback is called for every frame.
+	\param pUser is passed to the callback.
+	\param pStats points to the statistics to update.*/
+static void StitchUnit(const DecodeUnit_t *pUnit, IMUPacket_t *pPkt, UInt64 StreamBase,
+					   FrameCallback_t pCallback, void *pUser, ParallelDecodeStats_t *pStats)
+{
+	CaptureChunk_t Chunk;
+	DecodedFrame_t Frame;
+	UInt64 Offset = pUnit->Start, Base = 0, Pos;
+	size_t Run = 0, f;
+	UInt32 i;
+
+	// Serial parser from the true state until it meets the worker's
+	while ((Offset < pUnit->End) && crChunkAt(pUnit->pReader, Offset, &Chunk))
+	{
+		for (i = 0; i < Chunk.Length; i++)
+		{
+			Pos = Base + i;
+
+			if (pPkt->state == SERIAL_STATE_SYNC0)
+			{
+				while ((Run < pUnit->RunCount) && (pUnit->pRuns[Run].End <= Pos))
+					Run++;
+
+				if ((Run < pUnit->RunCount) && (pUnit->pRuns[Run].Begin <= Pos))
+					goto Converged;
+			}
+
+			if (LookForIMUPacketInByte(Chunk.pData[i], pPkt))
+			{
+				Frame.Pkt = *pPkt;
+				Frame.HostNs = Chunk.HostNs;
+				Frame.Position = StreamBase + Pos;
+				pCallback(pUser, &Frame);
+				pStats->Frames++;
+			}
+		}
+
+		Base += Chunk.Length;
+		Offset = Chunk.Next;
+	}
+
+	// Never lined up, the serial run covered the unit
+	pStats->FixupBytes += Base;
+	return;
+
+Converged:
+	pStats->FixupBytes += Pos;
+
+	for (f = 0; (f < pUnit->FrameCount) && (pUnit->pFrames[f].Position < Pos); f++)
+		;
+
+	for (; f < pUnit->FrameCount; f++)
+	{
+		Frame = pUnit->pFrames[f];
+		Frame.Position += StreamBase;
+		pCallback(pUser, &Frame);
+		pStats->Frames++;
+	}
+
+	*pPkt = pUnit->EndState;
+
+}// StitchUnit
+
+
+/*! Split a capture into units at chunk boundaries.
+	\param pReader points to an open reader.
+	\param UnitBytes is the target unit size in file bytes.
+	\param pCount points to space to receive the number of units.
+	\return An array of Count + 1 chunk offsets, unit n runs from entry n to
+			entry n + 1; NULL if out of memory.  Free with free().*/
+static UInt64 *SplitCapture(const CaptureReader_t *pReader, UInt64 UnitBytes, size_t *pCount)
+{
+	CaptureChunk_t Chunk;
+	UInt64 *pSplits = NULL, Offset = crFirstChunk(pReader), Last = Offset;
+	size_t Count = 0, Capacity = 0, i;
+
+	if (!Reserve((void **)&pSplits, &Capacity, Count, sizeof(UInt64)))
+		return NULL;
+	pSplits[Count++] = Offset;
+
+	if (pReader->IndexCount)
+	{
+		// Index entries are chunk offsets in file order
+		for (i = 0; i < pReader->IndexCount; i++)
+		{
+			Offset = pReader->pIndex[i].Offset;
+			if ((Offset >= Last + UnitBytes) && (Offset < pReader->Size))
+			{
+				if (!Reserve((void **)&pSplits, &Capacity, Count, sizeof(UInt64)))
+					goto Fail;
+				pSplits[Count++] = Last = Offset;
+			}
+		}
+	}
+	else
+	{
+		// No index, walk the chunk headers
+		while (crChunkAt(pReader, Offset, &Chunk))
+		{
+			if (Offset >= Last + UnitBytes)
+			{
+				if (!Reserve((void **)&pSplits, &Capacity, Count, sizeof(UInt64)))
+					goto Fail;
+				pSplits[Count++] = Last = Offset;
+			}
+			Offset = Chunk.Next;
+		}
+	}
+
+	if (!Reserve((void **)&pSplits, &Capacity, Count, sizeof(UInt64)))
+		goto Fail;
+	pSplits[Count] = pReader->Size;
+
+	*pCount = Count;
+	return pSplits;
+
+Fail:
+	free(pSplits);
+	return NULL;
+
+}// SplitCapture
+
+
+/*! Frame a whole capture on a pool of threads and hand every frame, in
+	stream order, to a callback on the calling thread.
+	\param pReader points to an open reader.
+	\param Threads is the number of workers, 0 for one per CPU.
+	\param UnitBytes is the unit size in file bytes, 0 for PD_UNIT_BYTES.
+	\param pCallback is called for every frame in order.
+	\param pUser is passed to the callback.
+	\param pStats points to space to receive statistics, may be NULL.
+	\return FALSE if out of memory or the threads could not be started.*/
+BOOL pdDecodeCapture(const CaptureReader_t *pReader, UInt32 Threads, UInt32 UnitBytes,
+					 FrameCallback_t pCallback, void *pUser, ParallelDecodeStats_t *pStats)
+{
+	ParallelDecodeStats_t Stats;
+	ThreadPool_t *pPool;
+	DecodeUnit_t *pWaves[2] = { NULL, NULL }, *pUnit;
+	UInt64 *pSplits, Start = htNowNs(), StreamBase = 0;
+	IMUPacket_t Pkt;
+	size_t UnitCount, WaveUnits, Next = 0, Count[2] = { 0, 0 }, i;
+	BOOL Ok = FALSE;
+	int w = 0;
+
+	memset(&Stats, 0, sizeof(Stats));
+
+	pSplits = SplitCapture(pReader, UnitBytes ? UnitBytes : PD_UNIT_BYTES, &UnitCount);
+	if (pSplits == NULL)
+		return FALSE;
+
+	pPool = tpCreate(Threads);
+	if (pPool == NULL)
+	{
+		free(pSplits);
+		return FALSE;
+	}
+
+	WaveUnits = (size_t)tpThreads(pPool) * PD_UNITS_PER_THREAD;
+	pWaves[0] = (DecodeUnit_t *)calloc(WaveUnits, sizeof(DecodeUnit_t));
+	pWaves[1] = (DecodeUnit_t *)calloc(WaveUnits, sizeof(DecodeUnit_t));
+	if ((pWaves[0] == NULL) || (pWaves[1] == NULL))
+		goto Done;
+
+	Pkt.state = SERIAL_STATE_SYNC0;
+	Stats.Units = UnitCount;
+
+	// Frame a wave, then stitch it while the next one is framed
+	do
+	{
+		for (Count[w] = 0; (Count[w] < WaveUnits) && (Next < UnitCount); Count[w]++, Next++)
+		{
+			pUnit = &pWaves[w][Count[w]];
+			pUnit->pReader = pReader;
+			pUnit->Start = pSplits[Next];
+			pUnit->End = pSplits[Next + 1];
+			pUnit->Search = (Next != 0);
+			if (!tpSubmit(pPool, DecodeUnit, pUnit))
+				goto Done;
+		}
+
+		// Stitch the previous wave, its jobs finished at the last wait
+		for (i = 0; i < Count[!w]; i++)
+		{
+			pUnit = &pWaves[!w][i];
+			StitchUnit(pUnit, &Pkt, StreamBase, pCallback, pUser, &Stats);
+			StreamBase += pUnit->Bytes;
+		}
+		Count[!w] = 0;
+
+		tpWait(pPool);
+
+		for (i = 0; i < Count[w]; i++)
+			if (pWaves[w][i].Failed)
+				goto Done;
+
+		w = !w;
+
+	} while (Count[!w]);
+
+	Stats.Bytes = StreamBase;
+	Ok = TRUE;
+
+Done:
+	tpWait(pPool);
+	tpDestroy(pPool);
+
+	for (w = 0; w < 2; w++)
+	{
+		for (i = 0; pWaves[w] && (i < WaveUnits); i++)
+		{
+			free(pWaves[w][i].pFrames);
+			free(pWaves[w][i].pRuns);
+		}
+		free(pWaves[w]);
+	}
+	free(pSplits);
+
+	Stats.ElapsedNs = htNowNs() - Start;
+	if (pStats)
+		*pStats = Stats;
+
+	return Ok;
+
+}// pdDecodeCapture
@@ -0,0 +1,251 @@
+/*! \file
+	\brief Core pinning, SCHED_FIFO, memory locking and prefaulting.
+*/
+
+#ifndef WIN32
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include "RealTime.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#endif
+
+#define RT_DEFAULT_PRIORITY	80				// Above interrupt threads (50), below watchdogs (99)
+#define RT_PAGE_BYTES		4096			// Smallest page of any host, touching each is enough
+
+#ifdef WIN32
+#define RT_POLICY_NAME		"time critical"
+#else
+#define RT_POLICY_NAME		"SCHED_FIFO"
+#endif
+
+
+/*! Fill in the defaults: no pinning, SCHED_FIFO at RT_DEFAULT_PRIORITY,
+	memory locked and an RT_HEAP_BYTES heap reserve.
+	\param pConfig receives the settings.*/
+void rtDefaultConfig(RealTimeConfig_t *pConfig)
+{
+	pConfig->Cpu = -1;
+	pConfig->Priority = RT_DEFAULT_PRIORITY;
+	pConfig->LockMemory = TRUE;
+	pConfig->HeapBytes = RT_HEAP_BYTES;
+
+}// rtDefaultConfig
+
+
+/*! Read the core and priority from "cpu[:priority]", keeping the other
+	settings.
+	\param pText is the text.
+	\param pConfig receives the settings.
+	\return TRUE if the text was valid.*/
+BOOL rtParse(const char *pText, RealTimeConfig_t *pConfig)
+{
+	char *pEnd;
+	long Cpu, Priority = pConfig->Priority;
+
+	Cpu = strtol(pText, &pEnd, 10);
+	if (pEnd == pText || Cpu < 0)
+		return FALSE;
+
+	if (*pEnd == ':')
+	{
+		pText = pEnd + 1;
+		Priority = strtol(pText, &pEnd, 10);
+		if (pEnd == pText || Priority < 0 || Priority > 99)
+			return FALSE;
+	}
+
+	if (*pEnd != '\0')
+		return FALSE;
+
+	pConfig->Cpu = (int)Cpu;
+	pConfig->Priority = (int)Priority;
+
+	return TRUE;
+
+}// rtParse
+
+
+/*! Keep the threads the calling thread starts from now on off the
+	pipeline's core.  New threads inherit their creator's affinity, so this
+	is called before the background writers are started and rtEnter()
+	after.
+	\param pConfig is the settings.
+	\return TRUE if done, or there's nothing to do.*/
+BOOL rtBackground(const RealTimeConfig_t *pConfig)
+{
+#ifdef WIN32
+	DWORD_PTR Process, System;
+
+	if (pConfig->Cpu < 0)
+		return TRUE;
+
+	if (!GetProcessAffinityMask(GetCurrentProcess(), &Process, &System))
+		return FALSE;
+
+	Process &= ~((DWORD_PTR)1 << pConfig->Cpu);
+
+	return (Process != 0) && SetThreadAffinityMask(GetCurrentThread(), Process) != 0;
+#else
+	cpu_set_t Set;
+
+	if (pConfig->Cpu < 0)
+		return TRUE;
+
+	if (sched_getaffinity(0, sizeof(Set), &Set) != 0)
+		return FALSE;
+
+	// A single core host has nowhere else to put them
+	CPU_CLR(pConfig->Cpu, &Set);
+	if (CPU_COUNT(&Set) == 0)
+		return FALSE;
+
+	return sched_setaffinity(0, sizeof(Set), &Set) == 0;
+#endif
+
+}// rtBackground
+
+
+/*! Touch every page of a block of memory so it's resident before it's
+	needed.  The contents are kept.
+	\param pMemory is the block.
+	\param Bytes is its size.*/
+void rtPrefault(void *pMemory, size_t Bytes)
+{
+	volatile UInt8 *pByte = (volatile UInt8 *)pMemory;
+	size_t i;
+
+	// Writing back what's there faults in a writable page, copy on write included
+	for (i = 0; i < Bytes; i += RT_PAGE_BYTES)
+		pByte[i] = pByte[i];
+
+	if (Bytes)
+		pByte[Bytes - 1] = pByte[Bytes - 1];
+
+}// rtPrefault
+
+
+/*! Fault in RT_STACK_BYTES of stack below the caller.*/
+#ifdef __GNUC__
+__attribute__((noinline))
+#endif
+static void PrefaultStack(void)
+{
+	volatile UInt8 Stack[RT_STACK_BYTES];
+
+	memset((UInt8 *)Stack, 0, sizeof(Stack));
+
+}// PrefaultStack
+
+
+/*! Fault in a heap reserve and keep it, so later allocations up to that
+	size come from resident memory.
+	\param Bytes is the size of the reserve.
+	\return TRUE if the reserve was made.*/
+static BOOL PrefaultHeap(UInt32 Bytes)
+{
+	void *pReserve;
+
+#ifdef __GLIBC__
+	// Serve every allocation from the heap and never shrink it
+	mallopt(M_MMAP_MAX, 0);
+	mallopt(M_TRIM_THRESHOLD, -1);
+#endif
+
+	if (Bytes == 0)
+		return TRUE;
+
+	pReserve = malloc(Bytes);
+	if (pReserve == NULL)
+		return FALSE;
+
+	memset(pReserve, 0, Bytes);
+	free(pReserve);
+
+	return TRUE;
+
+}// PrefaultHeap
+
+
+/*! Make the calling thread the real-time pipeline thread.
+	\param pConfig is the settings.
+	\return The RT_ flags of the steps applied.*/
+UInt32 rtEnter(const RealTimeConfig_t *pConfig)
+{
+	UInt32 Applied = 0;
+	BOOL Prefaulted;
+
+#ifdef WIN32
+	if (pConfig->Cpu >= 0 && SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << pConfig->Cpu) != 0)
+		Applied |= RT_PINNED;
+
+	if (pConfig->Priority > 0 && SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+		Applied |= RT_FIFO;
+
+	Prefaulted = PrefaultHeap(pConfig->HeapBytes);
+#else
+	struct sched_param Param;
+	cpu_set_t Set;
+
+	if (pConfig->Cpu >= 0)
+	{
+		CPU_ZERO(&Set);
+		CPU_SET(pConfig->Cpu, &Set);
+		if (sched_setaffinity(0, sizeof(Set), &Set) == 0)
+			Applied |= RT_PINNED;
+	}
+
+	// Lock before prefaulting so the pages touched stay put
+	if (pConfig->LockMemory && mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+		Applied |= RT_LOCKED;
+
+	Prefaulted = PrefaultHeap(pConfig->HeapBytes);
+
+	// Last, so the setup above doesn't run ahead of everything else on the core
+	if (pConfig->Priority > 0)
+	{
+		memset(&Param, 0, sizeof(Param));
+		Param.sched_priority = pConfig->Priority;
+		if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &Param) == 0)
+			Applied |= RT_FIFO;
+	}
+#endif
+
+	PrefaultStack();
+	if (Prefaulted)
+		Applied |= RT_PREFAULTED;
+
+	return Applied;
+
+}// rtEnter
+
+
+/*! Print which of the requested steps were applied.
+	\param pFile is where to print.
+	\param pConfig is the settings rtEnter() was given.
+	\param Applied is what it returned.*/
+void rtPrintApplied(FILE *pFile, const RealTimeConfig_t *pConfig, UInt32 Applied)
+{
+	fprintf(pFile, "real-time:");
+
+	if (pConfig->Cpu >= 0)
+		fprintf(pFile, " cpu %d %s,", pConfig->Cpu, (Applied & RT_PINNED) ? "pinned" : "NOT pinned");
+	if (pConfig->Priority > 0)
+		fprintf(pFile, " " RT_POLICY_NAME " %d %s,", pConfig->Priority, (Applied & RT_FIFO) ? "set" : "NOT set");
+	if (pConfig->LockMemory)
+		fprintf(pFile, " memory %s,", (Applied & RT_LOCKED) ? "locked" : "NOT locked");
+
+	fprintf(pFile, " stack and heap %s\n", (Applied & RT_PREFAULTED) ? "prefaulted" : "NOT prefaulted");
+
+}// rtPrintApplied
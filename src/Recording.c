@@ -0,0 +1,251 @@
+/*! \file
+	\brief Read the high speed samples of a recording, whatever its format.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ParallelDecode.h"
+#include "Recording.h"
+#include "SampleLog.h"
+#include "Tilt.h"
+
+typedef struct
+{
+	SampleCallback_t pCallback;
+	void *pUser;
+	IMUData_t IMU;							//!< Holds the ranges between packets
+	BOOL HaveRanges;
+	UInt64 Skipped;
+} CaptureState_t;
+
+
+/*! Decode the frames of a capture and pass on the HS samples.
+	\param pUser points to the CaptureState_t.
+	\param pFrame points to the frame.*/
+static void CaptureFrame(void *pUser, const DecodedFrame_t *pFrame)
+{
+	CaptureState_t *pState = (CaptureState_t *)pUser;
+
+	if (pFrame->Pkt.type == RESOLUTION_IMU_MSG)
+		pState->HaveRanges = TRUE;
+	else if (pFrame->Pkt.type != HS_SERIAL_IMU_MSG)
+		return;
+	else if (!pState->HaveRanges)
+	{
+		pState->Skipped++;
+		return;
+	}
+
+	DecodeIMUPacket(&pFrame->Pkt, &pState->IMU);
+
+	if (pFrame->Pkt.type == HS_SERIAL_IMU_MSG)
+		pState->pCallback(pState->pUser, &pState->IMU, pFrame->HostNs);
+
+}// CaptureFrame
+
+
+/*! Read a recording.
+	\param pPath is the capture or sample log.
+	\param Threads is the number of threads to frame a capture on, 0 for
+		   one per CPU.
+	\param pCallback is called for each HS sample.
+	\param pUser is passed to the callback.
+	\param pSkipped points to space to receive the number of samples left
+		   out for want of a resolution packet, may be NULL.
+	\return FALSE if the file is neither a capture nor a sample log, or
+			could not be read to the end.*/
+BOOL recRead(const char *pPath, UInt32 Threads, SampleCallback_t pCallback, void *pUser, UInt64 *pSkipped)
+{
+	SampleLogReader_t *pReader = slrOpen(pPath);
+	CaptureReader_t Capture;
+	CaptureState_t State;
+	ParallelDecodeStats_t Stats;
+	BOOL Ok;
+
+	if (pSkipped)
+		*pSkipped = 0;
+
+	if (pReader)
+	{
+		static SampleBlock_t Block;
+		static float Converted[N_SENSOR_IDX][SL_BLOCK_SAMPLES];
+		float *pConverted[N_SENSOR_IDX];
+		IMUData_t IMU;
+		UInt32 i, n;
+
+		memset(&IMU, 0, sizeof(IMU));
+		for (n = 0; n < N_SENSOR_IDX; n++)
+			pConverted[n] = Converted[n];
+
+		while (slrNext(pReader, &Block))
+		{
+			slConvertBlock(&Block, pConverted);
+			IMU.GyroRange = Block.GyroRange;
+			IMU.AccelRange = Block.AccelRange;
+
+			for (i = 0; i < Block.Count; i++)
+			{
+				for (n = 0; n < N_SENSOR_IDX; n++)
+					IMU.SensorsConverted[n] = Converted[n][i];
+				IMU.TimeSincePPS = (float)(Block.PPSTicks[i] / 10000.0);
+				IMU.PPSCount = Block.PPSCount[i];
+				IMU.SequenceNumber = Block.SequenceNumber[i];
+
+				pCallback(pUser, &IMU, 0);
+			}
+		}
+
+		slrClose(pReader);
+		return TRUE;
+	}
+
+	if (!crOpen(&Capture, pPath))
+		return FALSE;
+
+	memset(&State, 0, sizeof(State));
+	State.pCallback = pCallback;
+	State.pUser = pUser;
+
+	Ok = pdDecodeCapture(&Capture, Threads, 0, CaptureFrame, &State, &Stats);
+	crClose(&Capture);
+
+	if (pSkipped)
+		*pSkipped = State.Skipped;
+
+	return Ok;
+
+}// recRead
+
+
+/*! Start a clock.
+	\param pClock points to the clock.*/
+void recClockInit(RecordingClock_t *pClock)
+{
+	memset(pClock, 0, sizeof(*pClock));
+	pClock->Step = REC_DEFAULT_STEP;
+
+}// recClockInit
+
+
+/*! Get the filter step to a sample from the one before.  The PPS count
+	moves on a second at each pulse.  Anything implausible, a dropout or a
+	clock reset, keeps the last step.
+	\param pClock points to the clock.
+	\param pData points to the sample.
+	\return The step in seconds.*/
+float recClockStep(RecordingClock_t *pClock, const IMUData_t *pData)
+{
+	float Time = pData->TimeSincePPS / 1000.0f;
+	float Step;
+
+	if (pClock->HaveTime)
+	{
+		Step = Time - pClock->LastTime + (UInt8)(pData->PPSCount - pClock->LastPPSCount);
+		if ((Step > 0.0f) && (Step <= 1.0f))
+			pClock->Step = Step;
+	}
+
+	pClock->LastTime = Time;
+	pClock->LastPPSCount = pData->PPSCount;
+	pClock->HaveTime = TRUE;
+
+	return pClock->Step;
+
+}// recClockStep
+
+
+/*! Store the filter inputs of one sample.
+	\param pUser points to the RecordingInputs_t.
+	\param pData points to the sample.
+	\param HostNs is not used.*/
+static void AddInputs(void *pUser, const IMUData_t *pData, UInt64 HostNs)
+{
+	RecordingInputs_t *pInputs = (RecordingInputs_t *)pUser;
+
+	if (pInputs->Count == pInputs->Capacity)
+	{
+		UInt32 Capacity = pInputs->Capacity ? 2 * pInputs->Capacity : 65536;
+		float *pTilt = (float *)realloc(pInputs->pTilt, Capacity * sizeof(float));
+		float *pRate = pTilt ? (float *)realloc(pInputs->pRate, Capacity * sizeof(float)) : NULL;
+		float *pStep = pRate ? (float *)realloc(pInputs->pStep, Capacity * sizeof(float)) : NULL;
+
+		if (pTilt)
+			pInputs->pTilt = pTilt;
+		if (pRate)
+			pInputs->pRate = pRate;
+		if (pStep == NULL)
+		{
+			pInputs->Ok = FALSE;
+			return;
+		}
+		pInputs->pStep = pStep;
+		pInputs->Capacity = Capacity;
+	}
+
+	pInputs->pTilt[pInputs->Count] = TiltRollDeg(pData);
+	pInputs->pRate[pInputs->Count] = pData->SensorsConverted[GYROX_IDX];
+	pInputs->pStep[pInputs->Count] = recClockStep(&pInputs->Clock, pData);
+	if (pInputs->Count)
+		pInputs->Elapsed += pInputs->pStep[pInputs->Count];
+	pInputs->Count++;
+
+}// AddInputs
+
+
+/*! Read the filter inputs of a whole recording.
+	\param pPath is the capture or sample log.
+	\param Threads is the number of threads to frame a capture on, 0 for
+		   one per CPU.
+	\param pInputs points to the inputs to fill, free them with
+		   recFreeInputs() whatever the result.
+	\return FALSE if the file can't be read or memory runs out.*/
+BOOL recLoadInputs(const char *pPath, UInt32 Threads, RecordingInputs_t *pInputs)
+{
+	memset(pInputs, 0, sizeof(*pInputs));
+	pInputs->Ok = TRUE;
+	recClockInit(&pInputs->Clock);
+
+	return recRead(pPath, Threads, AddInputs, pInputs, NULL) && pInputs->Ok;
+
+}// recLoadInputs
+
+
+/*! Free the arrays of recLoadInputs().
+	\param pInputs points to the inputs.*/
+void recFreeInputs(RecordingInputs_t *pInputs)
+{
+	free(pInputs->pTilt);
+	free(pInputs->pRate);
+	free(pInputs->pStep);
+	memset(pInputs, 0, sizeof(*pInputs));
+
+}// recFreeInputs
+
+
+/*! Read the Angle column of an imugen truth file.
+	\param pPath is the truth file.
+	\param pAngle points to space to receive the angles, deg.
+	\param Count is the number of samples of the recording.
+	\return FALSE if the file doesn't have a row for every sample.*/
+BOOL recLoadTruth(const char *pPath, float *pAngle, UInt32 Count)
+{
+	FILE *pFile = fopen(pPath, "r");
+	char Line[256];
+	UInt32 i = 0;
+	double Time, Angle;
+
+	if (pFile == NULL)
+		return FALSE;
+
+	// Skip the header
+	if (fgets(Line, sizeof(Line), pFile))
+		while ((i < Count) && fgets(Line, sizeof(Line), pFile) &&
+			   (sscanf(Line, "%lf,%lf", &Time, &Angle) == 2))
+			pAngle[i++] = (float)Angle;
+
+	fclose(pFile);
+
+	return i == Count;
+
+}// recLoadTruth
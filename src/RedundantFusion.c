@@ -0,0 +1,293 @@
+/*! \file
+	\brief Fused tilt and rate from redundant IMUs, voting out faulty ones.
+*/
+
+#include <math.h>
+#include <string.h>
+#include "RedundantFusion.h"
+
+// Default thresholds
+#define RF_STUCK_SAMPLES	4				// Sample periods unchanged that mark a unit stuck
+#define RF_SATURATION		0.98f
+#define RF_MAX_MISSED		2
+#define RF_DIVERGE_DEG		3.0f
+#define RF_DIVERGE_DPS		10.0f
+#define RF_MIN_ANGLE_VAR	1.0e-4f
+#define RF_RECOVER_NS		500000000ULL
+
+#define RF_GRAVITY			9.81f
+
+static const char *FaultNames[RF_FAULTS] =
+{
+	"ok", "missing", "stuck", "saturated", "dropout", "diverged"
+};
+
+
+/*! Get the default settings.
+	\param pConfig receives the settings.
+	\param SampleHz is the units' sample rate, which sets the stuck time.*/
+void rfDefaultConfig(FusionConfig_t *pConfig, double SampleHz)
+{
+	pConfig->StuckNs = (UInt64)(RF_STUCK_SAMPLES * 1.0e9 / SampleHz);
+	pConfig->StuckEpsilon = 0.0f;
+	pConfig->SaturationFraction = RF_SATURATION;
+	pConfig->MaxMissed = RF_MAX_MISSED;
+	pConfig->DivergeDeg = RF_DIVERGE_DEG;
+	pConfig->DivergeRateDps = RF_DIVERGE_DPS;
+	pConfig->MinAngleVar = RF_MIN_ANGLE_VAR;
+	pConfig->RecoverNs = RF_RECOVER_NS;
+
+}// rfDefaultConfig
+
+
+/*! Start a fusion with every unit trusted.
+	\param pFusion points to the fusion.
+	\param pConfig points to the settings, which are copied.*/
+void rfInit(RedundantFusion_t *pFusion, const FusionConfig_t *pConfig)
+{
+	memset(pFusion, 0, sizeof(*pFusion));
+	pFusion->Config = *pConfig;
+
+}// rfInit
+
+
+/*! Check one unit's own sample.
+	\param pFusion points to the fusion.
+	\param pUnit points to the unit's state.
+	\param pPort is the unit's part of the set.
+	\param TimeNs is the set's time.
+	\return The fault, RF_OK if none.*/
+static FusionFault_t CheckUnit(const RedundantFusion_t *pFusion, FusionUnit_t *pUnit,
+							   const AggPortSample_t *pPort, UInt64 TimeNs)
+{
+	const FusionConfig_t *pConfig = &pFusion->Config;
+	const float *pSensors = pPort->Sample.Sensors;
+	float GyroLimit = pConfig->SaturationFraction * pPort->GyroRange;
+	float AccelLimit = pConfig->SaturationFraction * pPort->AccelRange * RF_GRAVITY;
+	BOOL Changed = FALSE;
+	int i;
+
+	if (!pPort->Valid)
+	{
+		pUnit->Seen = FALSE;
+		return RF_MISSING;
+	}
+
+	for (i = 0; i < N_SENSOR_IDX; i++)
+		Changed |= fabsf(pSensors[i] - pUnit->Last[i]) > pConfig->StuckEpsilon;
+
+	if (pUnit->FirstNs == 0)
+		pUnit->FirstNs = TimeNs;
+
+	if (Changed || !pUnit->Seen)
+	{
+		memcpy(pUnit->Last, pSensors, sizeof(pUnit->Last));
+		pUnit->ChangedNs = TimeNs;
+		pUnit->Seen = TRUE;
+	}
+	else if (TimeNs - pUnit->ChangedNs >= pConfig->StuckNs)
+		return RF_STUCK;
+
+	// Ranges are 0 until the unit's configuration arrives
+	if (GyroLimit > 0)
+	{
+		for (i = GYROX_IDX; i <= GYROZ_IDX; i++)
+		{
+			if (fabsf(pSensors[i]) >= GyroLimit)
+				return RF_SATURATED;
+		}
+	}
+	if (AccelLimit > 0)
+	{
+		for (i = ACCELX_IDX; i <= ACCELZ_IDX; i++)
+		{
+			if (fabsf(pSensors[i]) >= AccelLimit)
+				return RF_SATURATED;
+		}
+	}
+
+	if (pPort->Sample.Missed > pConfig->MaxMissed)
+		return RF_DROPOUT;
+
+	return RF_OK;
+
+}// CheckUnit
+
+
+/*! Get the median of a few values.
+	\param pValues points to the values, which are sorted.
+	\param Count is the number of values, at least one.
+	\return The median.*/
+static float Median(float *pValues, UInt32 Count)
+{
+	UInt32 i, j;
+
+	for (i = 1; i < Count; i++)
+	{
+		float Value = pValues[i];
+
+		for (j = i; j > 0 && pValues[j - 1] > Value; j--)
+			pValues[j] = pValues[j - 1];
+		pValues[j] = Value;
+	}
+
+	return (Count & 1) ? pValues[Count / 2] : 0.5f * (pValues[Count / 2 - 1] + pValues[Count / 2]);
+
+}// Median
+
+
+/*! Outvote units far from the median of those with no fault of their own.
+	\param pFusion points to the fusion.
+	\param pSet is the set.
+	\param pFault holds each unit's fault, RF_DIVERGED is set here.*/
+static void Vote(RedundantFusion_t *pFusion, const AggSet_t *pSet, UInt8 *pFault)
+{
+	float Angles[AG_MAX_PORTS], Rates[AG_MAX_PORTS];
+	float MedianAngle, MedianRate;
+	UInt32 Voters = 0, First = 0, p;
+
+	for (p = 0; p < pSet->Ports; p++)
+	{
+		if (pFault[p] != RF_OK)
+			continue;
+
+		if (Voters == 0)
+			First = p;
+		Angles[Voters] = pSet->Port[p].Sample.Angle;
+		Rates[Voters++] = pSet->Port[p].Sample.Rate;
+	}
+
+	if (Voters < 2)
+		return;
+
+	MedianAngle = Median(Angles, Voters);
+	MedianRate = Median(Rates, Voters);
+
+	for (p = First; p < pSet->Ports; p++)
+	{
+		const AggSample_t *pSample = &pSet->Port[p].Sample;
+
+		if (pFault[p] != RF_OK)
+			continue;
+
+		if (fabsf(pSample->Angle - MedianAngle) > pFusion->Config.DivergeDeg ||
+			fabsf(pSample->Rate - MedianRate) > pFusion->Config.DivergeRateDps)
+		{
+			// Two units are each half their difference from the median: no majority
+			if (Voters == 2)
+			{
+				pFusion->Stats.Disagreements++;
+				return;
+			}
+			pFault[p] = RF_DIVERGED;
+		}
+	}
+
+}// Vote
+
+
+/*! Check every unit of a set and fuse the ones still trusted.
+	\param pFusion points to the fusion.
+	\param pSet is the set from the aggregator.
+	\param pEstimate receives the fused estimate.
+	\return TRUE if any unit could be trusted.*/
+BOOL rfUpdate(RedundantFusion_t *pFusion, const AggSet_t *pSet, FusedEstimate_t *pEstimate)
+{
+	const FusionConfig_t *pConfig = &pFusion->Config;
+	double SumWeight = 0, SumAngle = 0, SumRate = 0;
+	float FallbackVar = 0;
+	UInt32 p, Fallback = AG_MAX_PORTS;
+
+	pEstimate->TimeNs = pSet->TimeNs;
+	pEstimate->Units = pSet->Ports;
+	pEstimate->UsedMask = 0;
+
+	for (p = 0; p < pSet->Ports; p++)
+		pEstimate->Fault[p] = (UInt8)CheckUnit(pFusion, &pFusion->Unit[p], &pSet->Port[p], pSet->TimeNs);
+
+	Vote(pFusion, pSet, pEstimate->Fault);
+
+	for (p = 0; p < pSet->Ports; p++)
+	{
+		FusionUnit_t *pUnit = &pFusion->Unit[p];
+		const AggSample_t *pSample = &pSet->Port[p].Sample;
+		UInt8 Fault = pEstimate->Fault[p];
+		float AngleVar;
+
+		pEstimate->Weight[p] = 0;
+
+		if (Fault != RF_OK)
+		{
+			// A unit yet to send its first sample hasn't failed
+			if (Fault != pUnit->Fault && pUnit->FirstNs)
+				pFusion->Stats.Faults[p][Fault]++;
+
+			// A unit missing from this set, or outvoted while its filter is
+			// still converging, is left out of this set only
+			if (Fault != RF_MISSING &&
+				!(Fault == RF_DIVERGED && pSet->TimeNs - pUnit->FirstNs < pConfig->RecoverNs))
+				pUnit->FaultNs = pSet->TimeNs;
+		}
+		pUnit->Fault = Fault;
+
+		if (Fault != RF_OK)
+			continue;
+
+		AngleVar = pSample->AngleVar > pConfig->MinAngleVar ? pSample->AngleVar : pConfig->MinAngleVar;
+
+		// Leave out units faulted too recently, keeping the best of them in case no other is left
+		if (pUnit->FaultNs && pSet->TimeNs - pUnit->FaultNs < pConfig->RecoverNs)
+		{
+			if (Fallback == AG_MAX_PORTS || AngleVar < FallbackVar)
+			{
+				Fallback = p;
+				FallbackVar = AngleVar;
+			}
+			continue;
+		}
+
+		pEstimate->Weight[p] = 1.0f / AngleVar;
+		pEstimate->UsedMask |= 1u << p;
+		SumWeight += pEstimate->Weight[p];
+		SumAngle += pEstimate->Weight[p] * pSample->Angle;
+		SumRate += pEstimate->Weight[p] * pSample->Rate;
+	}
+
+	if (SumWeight == 0 && Fallback != AG_MAX_PORTS)
+	{
+		const AggSample_t *pSample = &pSet->Port[Fallback].Sample;
+
+		pFusion->Stats.Fallbacks++;
+		pEstimate->Weight[Fallback] = 1.0f / FallbackVar;
+		pEstimate->UsedMask = 1u << Fallback;
+		SumWeight = pEstimate->Weight[Fallback];
+		SumAngle = SumWeight * pSample->Angle;
+		SumRate = SumWeight * pSample->Rate;
+	}
+
+	pFusion->Stats.Sets++;
+	pEstimate->Valid = SumWeight > 0;
+	if (!pEstimate->Valid)
+	{
+		pFusion->Stats.Invalid++;
+		return FALSE;
+	}
+
+	pEstimate->Angle = (float)(SumAngle / SumWeight);
+	pEstimate->Rate = (float)(SumRate / SumWeight);
+	for (p = 0; p < pSet->Ports; p++)
+		pEstimate->Weight[p] = (float)(pEstimate->Weight[p] / SumWeight);
+
+	return TRUE;
+
+}// rfUpdate
+
+
+/*! Name a fault.
+	\param Fault is the fault.
+	\return Its name.*/
+const char *rfFaultName(FusionFault_t Fault)
+{
+	return (UInt32)Fault < RF_FAULTS ? FaultNames[Fault] : "unknown";
+
+}// rfFaultName
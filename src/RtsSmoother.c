@@ -0,0 +1,226 @@
+/*! \file
+	\brief Rauch-Tung-Striebel smoother for the angle filter.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include "RtsSmoother.h"
+
+//! Filtered state and covariance of one block, one array per field
+typedef struct
+{
+	float *pAngle;
+	float *pBias;
+	float *pP00;
+	float *pP01;
+	float *pP11;
+} FilteredBlock_t;
+
+//! Smoothed state and covariance of the sample after the one being smoothed
+typedef struct
+{
+	double Angle;
+	double Bias;
+	double P00;
+	double P01;
+	double P11;
+} Smoothed_t;
+
+
+/*! Get the block size used when none is given, sqrt(Count) so the
+	checkpoints and the block take about the same memory.
+	\param Count is the number of samples.
+	\return The block size in samples.*/
+UInt32 rtsDefaultBlock(UInt32 Count)
+{
+	UInt32 Block = (UInt32)sqrt((double)Count);
+
+	return (Block < RTS_MIN_BLOCK) ? RTS_MIN_BLOCK : Block;
+
+}// rtsDefaultBlock
+
+
+/*! Get the working memory of a smoothing run.
+	\param Count is the number of samples.
+	\param BlockSamples is the block size, 0 for rtsDefaultBlock().
+	\return The memory in bytes.*/
+UInt64 rtsMemory(UInt32 Count, UInt32 BlockSamples)
+{
+	UInt64 Block = BlockSamples ? BlockSamples : rtsDefaultBlock(Count);
+
+	if (Block > Count)
+		Block = Count;
+
+	return ((Count + Block - 1) / (Block ? Block : 1)) * sizeof(KFilter_t) + Block * 5 * sizeof(float);
+
+}// rtsMemory
+
+
+/*! Smooth one sample from the smoothed sample after it.
+	\param pKF holds the noise parameters.
+	\param pBlock points to the filtered block.
+	\param i is the index of the sample in the block.
+	\param Step is the filter step to the next sample.
+	\param Rate is the gyro rate of the next sample.
+	\param pNext points to the smoothed next sample, replaced by this one.*/
+static void SmoothSample(const KFilter_t *pKF, const FilteredBlock_t *pBlock, UInt32 i, double Step, double Rate,
+						 Smoothed_t *pNext)
+{
+	double Angle = pBlock->pAngle[i], Bias = pBlock->pBias[i];
+	double P00 = pBlock->pP00[i], P01 = pBlock->pP01[i], P11 = pBlock->pP11[i];
+	double Pp00, Pp01, Pp11, Det, M00, M10, C00, C01, C10, C11, dA, dB, D00, D01, D11, CD00, CD01, CD10, CD11;
+
+	// Prediction to the next sample, as kfGetAngle() makes it
+	Pp00 = P00 + Step * (Step * P11 - 2.0 * P01 + pKF->Q_angle);
+	Pp01 = P01 - Step * P11;
+	Pp11 = P11 + pKF->Q_bias * Step;
+	Det = Pp00 * Pp11 - Pp01 * Pp01;
+
+	if (!(Det > 0.0))
+	{
+		// Nothing to go on, e.g. a known start with no time to the next sample
+		pNext->Angle = Angle;
+		pNext->Bias = Bias;
+		pNext->P00 = P00;
+		pNext->P01 = P01;
+		pNext->P11 = P11;
+		return;
+	}
+
+	// C = P F' inv(Pp)
+	M00 = P00 - Step * P01;
+	M10 = P01 - Step * P11;
+	C00 = (M00 * Pp11 - P01 * Pp01) / Det;
+	C01 = (P01 * Pp00 - M00 * Pp01) / Det;
+	C10 = (M10 * Pp11 - P11 * Pp01) / Det;
+	C11 = (P11 * Pp00 - M10 * Pp01) / Det;
+
+	dA = pNext->Angle - (Angle + Step * (Rate - Bias));
+	dB = pNext->Bias - Bias;
+	D00 = pNext->P00 - Pp00;
+	D01 = pNext->P01 - Pp01;
+	D11 = pNext->P11 - Pp11;
+
+	CD00 = C00 * D00 + C01 * D01;
+	CD01 = C00 * D01 + C01 * D11;
+	CD10 = C10 * D00 + C11 * D01;
+	CD11 = C10 * D01 + C11 * D11;
+
+	pNext->Angle = Angle + C00 * dA + C01 * dB;
+	pNext->Bias = Bias + C10 * dA + C11 * dB;
+	pNext->P00 = P00 + CD00 * C00 + CD01 * C01;
+	pNext->P01 = P01 + CD00 * C10 + CD01 * C11;
+	pNext->P11 = P11 + CD10 * C10 + CD11 * C11;
+
+}// SmoothSample
+
+
+/*! Smooth a run.
+	\param pInit is the filter to start from, its noise parameters are
+		   used throughout, e.g. as set by kfInit().
+	\param pTilt is the accelerometer angle of each sample, deg.
+	\param pRate is the gyro rate of each sample, deg/s.
+	\param pStep is the filter step to each sample, s.
+	\param Count is the number of samples.
+	\param BlockSamples is the checkpoint spacing, 0 for rtsDefaultBlock().
+	\param pAngle points to space to receive the smoothed angles, may be
+		   pTilt.
+	\param pBias points to space to receive the smoothed gyro bias, may be
+		   NULL.
+	\param pAngleStd points to space to receive the standard deviation of
+		   the smoothed angles, may be NULL.
+	\return FALSE if out of memory.*/
+BOOL rtsSmooth(const KFilter_t *pInit, const float *pTilt, const float *pRate, const float *pStep,
+			   UInt32 Count, UInt32 BlockSamples, float *pAngle, float *pBias, float *pAngleStd)
+{
+	UInt32 Block = BlockSamples ? BlockSamples : rtsDefaultBlock(Count);
+	UInt32 Blocks, b, i, k, Start, End;
+	KFilter_t *pCheckpoints, KF;
+	FilteredBlock_t Filtered;
+	Smoothed_t Next;
+	float *pBuffer;
+
+	if (Count == 0)
+		return TRUE;
+	if (Block > Count)
+		Block = Count;
+
+	Blocks = (Count + Block - 1) / Block;
+	pCheckpoints = (KFilter_t *)malloc(Blocks * sizeof(KFilter_t));
+	pBuffer = (float *)malloc((size_t)Block * 5 * sizeof(float));
+	if ((pCheckpoints == NULL) || (pBuffer == NULL))
+	{
+		free(pCheckpoints);
+		free(pBuffer);
+		return FALSE;
+	}
+
+	Filtered.pAngle = pBuffer;
+	Filtered.pBias = pBuffer + Block;
+	Filtered.pP00 = pBuffer + 2 * Block;
+	Filtered.pP01 = pBuffer + 3 * Block;
+	Filtered.pP11 = pBuffer + 4 * Block;
+
+	// Forward, keeping the filter at the start of each block
+	KF = *pInit;
+	for (k = 0; k < Count; k++)
+	{
+		if (k % Block == 0)
+			pCheckpoints[k / Block] = KF;
+		kfGetAngle(&KF, pTilt[k], pRate[k], pStep[k]);
+	}
+
+	// Backward, a block at a time from the last
+	for (b = Blocks; b-- > 0; )
+	{
+		Start = b * Block;
+		End = (Start + Block < Count) ? Start + Block : Count;
+
+		KF = pCheckpoints[b];
+		for (k = Start; k < End; k++)
+		{
+			kfGetAngle(&KF, pTilt[k], pRate[k], pStep[k]);
+
+			i = k - Start;
+			Filtered.pAngle[i] = KF.angle;
+			Filtered.pBias[i] = KF.bias;
+			Filtered.pP00[i] = KF.P[0][0];
+			Filtered.pP01[i] = KF.P[0][1];
+			Filtered.pP11[i] = KF.P[1][1];
+		}
+
+		k = End - 1;
+		if (End == Count)
+		{
+			// The last sample has seen everything already
+			i = k - Start;
+			Next.Angle = Filtered.pAngle[i];
+			Next.Bias = Filtered.pBias[i];
+			Next.P00 = Filtered.pP00[i];
+			Next.P01 = Filtered.pP01[i];
+			Next.P11 = Filtered.pP11[i];
+		}
+		else
+			SmoothSample(&KF, &Filtered, k - Start, pStep[k + 1], pRate[k + 1], &Next);
+
+		for (;;)
+		{
+			pAngle[k] = (float)Next.Angle;
+			if (pBias)
+				pBias[k] = (float)Next.Bias;
+			if (pAngleStd)
+				pAngleStd[k] = (float)sqrt(Next.P00 > 0.0 ? Next.P00 : 0.0);
+
+			if (k == Start)
+				break;
+			k--;
+			SmoothSample(&KF, &Filtered, k - Start, pStep[k + 1], pRate[k + 1], &Next);
+		}
+	}
+
+	free(pCheckpoints);
+	free(pBuffer);
+
+	return TRUE;
+
+}// rtsSmooth
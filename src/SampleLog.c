@@ -0,0 +1,756 @@
+/*! \file
+	\brief Compact log of raw high speed samples.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ByteOrder.h"
+#include "SampleLog.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define SL_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+// Stream numbers after the six readings
+#define SL_TIME_STREAM	6
+#define SL_PPS_STREAM	7
+#define SL_SEQ_STREAM	8
+
+#define SL_HEADER_WORDS	(sizeof(SampleBlockHeader_t) / sizeof(uint64_t))
+
+struct SampleLogWriter_t
+{
+	FILE *pFile;
+	RawSample_t Samples[SL_BLOCK_SAMPLES];	//!< Samples of the block being built
+	UInt32 Count;
+	float GyroRange;						//!< Ranges of the block being built
+	float AccelRange;
+	RawSample_t Last;						//!< Last sample of the previous block
+	BOOL HaveLast;
+	uint64_t *pBlock;						//!< Encode buffer, slMaxBlockBytes()
+	UInt64 Bytes;							//!< Bytes written
+	BOOL Error;
+};
+
+struct SampleLogReader_t
+{
+	FILE *pFile;
+	uint64_t *pBlock;						//!< Read buffer, slMaxBlockBytes()
+};
+
+
+/*! Zig-zag encode, small magnitudes of either sign become small numbers.*/
+static uint64_t ZigZag(int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+
+}// ZigZag
+
+
+/*! Undo ZigZag().*/
+static int64_t UnZigZag(uint64_t u)
+{
+	return (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+
+}// UnZigZag
+
+
+/*! Time step from one sample to the next in ticks, unwrapped across PPS
+	pulses.  The inverse is in slDecodeBlock().*/
+static int64_t TimeStep(const RawSample_t *pPrev, const RawSample_t *pNext)
+{
+	return (int64_t)(int32_t)(pNext->PPSTicks - pPrev->PPSTicks) +
+		   (int64_t)SL_TICKS_PER_PPS * (int8_t)(pNext->PPSCount - pPrev->PPSCount);
+
+}// TimeStep
+
+
+/*! Number of bits needed to hold a value.*/
+static UInt32 BitWidth(uint64_t v)
+{
+	UInt32 Bits = 0;
+
+	while (v)
+	{
+		Bits++;
+		v >>= 1;
+	}
+
+	return Bits;
+
+}// BitWidth
+
+
+/*! Get the raw sample carried by a HS_SERIAL_IMU_MSG packet.
+	\param pPkt points to the packet.
+	\param pSample points to space to receive the sample.*/
+void slRawFromPacket(const IMUPacket_t *pPkt, RawSample_t *pSample)
+{
+	UInt8 i = 0, n;
+
+	for (n = 0; n < N_SENSOR_IDX; n++, i += 2)
+		pSample->Raw[n] = DataToSInt16(&pPkt->data[i]);
+
+	pSample->PPSTicks = (uint32_t)DataToUInt32(&pPkt->data[i]); i += 4;
+	pSample->PPSCount = pPkt->data[i++];
+	pSample->SequenceNumber = pPkt->data[i];
+
+}// slRawFromPacket
+
+
+/*! Convert the readings of a block to engineering units exactly as
+	DecodeHighSpeedDataPacket() does.
+	\param pBlock points to the decoded block.
+	\param pConverted points to one array of pBlock->Count floats per
+		   reading, in IMUSensorIndex_t order.*/
+void slConvertBlock(const SampleBlock_t *pBlock, float *pConverted[N_SENSOR_IDX])
+{
+	float GyroRes  = (2.0 * pBlock->GyroRange) / 65535.0;
+	float AccelRes = (2.0 * pBlock->AccelRange * 9.81) / 65535.0;
+	UInt32 n, i;
+
+	for (n = 0; n < N_SENSOR_IDX; n++)
+	{
+		float Res = (n <= GYROZ_IDX) ? GyroRes : AccelRes;
+
+		for (i = 0; i < pBlock->Count; i++)
+			pConverted[n][i] = pBlock->Raw[n][i] * Res;
+	}
+
+}// slConvertBlock
+
+
+/*! Get the largest size a block can encode to.
+	\return The size in bytes.*/
+UInt32 slMaxBlockBytes(void)
+{
+	return sizeof(SampleBlockHeader_t) + (SL_STREAMS * (SL_BLOCK_SAMPLES - 1) + 1) * sizeof(uint64_t);
+
+}// slMaxBlockBytes
+
+
+/*! Encode one block.
+	\param pSamples points to the samples.
+	\param Count is the number of samples, 1 to SL_BLOCK_SAMPLES.
+	\param GyroRange is the gyro range in effect, deg/s.
+	\param AccelRange is the accelerometer range in effect, g.
+	\param BaseStep is the time step from the sample before the block to the
+		   first one, 0 if there is none.
+	\param pOut points to space for slMaxBlockBytes().
+	\return The block size in bytes.*/
+UInt32 slEncodeBlock(const RawSample_t *pSamples, UInt32 Count, float GyroRange, float AccelRange,
+					 int64_t BaseStep, uint64_t *pOut)
+{
+	SampleBlockHeader_t *pHeader = (SampleBlockHeader_t *)pOut;
+	uint64_t Values[SL_STREAMS][SL_BLOCK_SAMPLES];
+	uint64_t Or, *pWord = pOut + SL_HEADER_WORDS;
+	int64_t Step, LastStep = BaseStep;
+	UInt32 s, i, n, Width, Words, Bit;
+
+	memset(pHeader, 0, sizeof(*pHeader));
+	pHeader->Count = (uint16_t)Count;
+	pHeader->GyroRange = GyroRange;
+	pHeader->AccelRange = AccelRange;
+	pHeader->BaseStep = BaseStep;
+	for (n = 0; n < N_SENSOR_IDX; n++)
+		pHeader->Base[n] = pSamples[0].Raw[n];
+	pHeader->BasePPSTicks = pSamples[0].PPSTicks;
+	pHeader->BasePPSCount = pSamples[0].PPSCount;
+	pHeader->BaseSequence = pSamples[0].SequenceNumber;
+
+	// Differences from the previous sample
+	for (i = 1; i < Count; i++)
+	{
+		const RawSample_t *pPrev = &pSamples[i - 1], *pCur = &pSamples[i];
+
+		for (n = 0; n < N_SENSOR_IDX; n++)
+			Values[n][i - 1] = ZigZag((int64_t)pCur->Raw[n] - pPrev->Raw[n]);
+
+		Step = TimeStep(pPrev, pCur);
+		Values[SL_TIME_STREAM][i - 1] = ZigZag(Step - LastStep);
+		LastStep = Step;
+
+		Values[SL_PPS_STREAM][i - 1] = ZigZag((int8_t)(pCur->PPSCount - pPrev->PPSCount));
+		Values[SL_SEQ_STREAM][i - 1] = ZigZag((int8_t)(pCur->SequenceNumber - pPrev->SequenceNumber - 1));
+	}
+
+	// Pack each stream at the width of its largest value
+	for (s = 0; s < SL_STREAMS; s++)
+	{
+		for (Or = 0, i = 0; i + 1 < Count; i++)
+			Or |= Values[s][i];
+
+		Width = BitWidth(Or);
+		Words = ((Count - 1) * Width + 63) / 64;
+		pHeader->Width[s] = (uint8_t)Width;
+		memset(pWord, 0, Words * sizeof(uint64_t));
+
+		for (i = 0; (i + 1 < Count) && Width; i++)
+		{
+			Bit = i * Width;
+			pWord[Bit / 64] |= Values[s][i] << (Bit % 64);
+			if ((Bit % 64) + Width > 64)
+				pWord[Bit / 64 + 1] |= Values[s][i] >> (64 - Bit % 64);
+		}
+
+		pWord += Words;
+	}
+
+	// Slack so the decoder may read one word past the last stream
+	*pWord++ = 0;
+
+	pHeader->BlockBytes = (uint32_t)((pWord - pOut) * sizeof(uint64_t));
+
+	return pHeader->BlockBytes;
+
+}// slEncodeBlock
+
+
+// Little-endian hosts lay the packed words out as a little-endian bit
+//   string, so any value of up to 57 bits is one unaligned 64-bit load away
+#if (defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)) || \
+	defined(_M_IX86) || defined(_M_X64) || defined(_M_ARM64)
+#define SL_LITTLE_ENDIAN
+#endif
+
+
+/*! Get value i of a stream of Width bit values.  Reads up to one word past
+	the value.*/
+static uint64_t Extract(const uint64_t *pWord, UInt32 Width, uint64_t Mask, UInt32 i)
+{
+	UInt32 Bit = i * Width;
+
+	// The second word's part is shifted in two steps so a shift of 0
+	//   doesn't become an undefined shift by 64
+	return ((pWord[Bit / 64] >> (Bit % 64)) | ((pWord[Bit / 64 + 1] << 1) << (63 - Bit % 64))) & Mask;
+
+}// Extract
+
+
+#ifdef SL_LITTLE_ENDIAN
+/*! Extract() for widths up to 57 bits on a little-endian host, one
+	unaligned load.*/
+static uint64_t ExtractLE(const uint64_t *pWord, UInt32 Width, uint64_t Mask, UInt32 i)
+{
+	UInt32 Bit = i * Width;
+	uint64_t v;
+
+	memcpy(&v, (const UInt8 *)pWord + Bit / 8, sizeof(v));
+	return (v >> (Bit % 8)) & Mask;
+
+}// ExtractLE
+#endif
+
+
+//! Mask of the low Width bits
+#define SL_MASK(Width)	(((Width) == 64) ? ~(uint64_t)0 : (((uint64_t)1 << (Width)) - 1))
+
+//! Words taken by a stream
+#define SL_WORDS(Deltas, Width)	(((Deltas) * (Width) + 63) / 64)
+
+
+#ifdef SL_LITTLE_ENDIAN
+// Widths unpacked by code specialised to the width
+#define SL_UNPACK_WIDTHS	32
+
+/*! Get a little-endian 64-bit word at any byte.*/
+static uint64_t LoadLE(const UInt8 *pBytes)
+{
+	uint64_t v;
+
+	memcpy(&v, pBytes, sizeof(v));
+	return v;
+
+}// LoadLE
+
+
+// Eight values of W bits take W bytes, so with W a constant each value of
+//   a group is a load, a shift and a mask at constant offsets
+#define SL_GET(W, j)	(uint32_t)((LoadLE(pBytes + (j) * (W) / 8) >> ((j) * (W) % 8)) & SL_MASK(W))
+
+#define SL_UNPACK(W)																		\
+static void Unpack##W(const UInt8 *pBytes, UInt32 Groups, uint32_t *pOut)					\
+{																							\
+	for (; Groups; Groups--, pBytes += (W), pOut += 8)										\
+	{																						\
+		pOut[0] = SL_GET(W, 0); pOut[1] = SL_GET(W, 1);										\
+		pOut[2] = SL_GET(W, 2); pOut[3] = SL_GET(W, 3);										\
+		pOut[4] = SL_GET(W, 4); pOut[5] = SL_GET(W, 5);										\
+		pOut[6] = SL_GET(W, 6); pOut[7] = SL_GET(W, 7);										\
+	}																						\
+}
+
+SL_UNPACK(1)  SL_UNPACK(2)  SL_UNPACK(3)  SL_UNPACK(4)  SL_UNPACK(5)  SL_UNPACK(6)  SL_UNPACK(7)  SL_UNPACK(8)
+SL_UNPACK(9)  SL_UNPACK(10) SL_UNPACK(11) SL_UNPACK(12) SL_UNPACK(13) SL_UNPACK(14) SL_UNPACK(15) SL_UNPACK(16)
+SL_UNPACK(17) SL_UNPACK(18) SL_UNPACK(19) SL_UNPACK(20) SL_UNPACK(21) SL_UNPACK(22) SL_UNPACK(23) SL_UNPACK(24)
+SL_UNPACK(25) SL_UNPACK(26) SL_UNPACK(27) SL_UNPACK(28) SL_UNPACK(29) SL_UNPACK(30) SL_UNPACK(31) SL_UNPACK(32)
+
+#undef SL_UNPACK
+#undef SL_GET
+
+static void (*const Unpackers[SL_UNPACK_WIDTHS + 1])(const UInt8 *, UInt32, uint32_t *) =
+{
+	NULL,
+	Unpack1,  Unpack2,  Unpack3,  Unpack4,  Unpack5,  Unpack6,  Unpack7,  Unpack8,
+	Unpack9,  Unpack10, Unpack11, Unpack12, Unpack13, Unpack14, Unpack15, Unpack16,
+	Unpack17, Unpack18, Unpack19, Unpack20, Unpack21, Unpack22, Unpack23, Unpack24,
+	Unpack25, Unpack26, Unpack27, Unpack28, Unpack29, Unpack30, Unpack31, Unpack32
+};
+
+
+/*! Unpack a stream of up to SL_UNPACK_WIDTHS bits per value, whole groups
+	of eight by the code for its width, the rest one at a time.
+	\param pWord points to the stream.
+	\param Width is the bits per value.
+	\param Count is the number of values.
+	\param pOut points to space for the values.*/
+static void UnpackStream(const uint64_t *pWord, UInt32 Width, UInt32 Count, uint32_t *pOut)
+{
+	UInt32 i = Count & ~7u;
+
+	if (Width == 0)
+	{
+		memset(pOut, 0, Count * sizeof(*pOut));
+		return;
+	}
+
+	Unpackers[Width]((const UInt8 *)pWord, Count / 8, pOut);
+	for (; i < Count; i++)
+		pOut[i] = (uint32_t)ExtractLE(pWord, Width, SL_MASK(Width), i);
+
+}// UnpackStream
+
+
+/*! UnZigZag() of a value up to 32 bits, modulo 2^32.*/
+static uint32_t UnZigZag32(uint32_t u)
+{
+	return (u >> 1) ^ (0u - (u & 1));
+
+}// UnZigZag32
+
+
+/*! slDecodeBlock() for blocks with no stream wider than SL_UNPACK_WIDTHS,
+	every stream unpacked whole before the running sums.
+	\param pHeader points to the block, already checked.
+	\param pBlock points to the block to fill, Count and the first sample
+		   set.
+	\return FALSE if a stream is too wide, pBlock is then untouched.*/
+static BOOL DecodeUnpacked(const SampleBlockHeader_t *pHeader, SampleBlock_t *pBlock)
+{
+	const uint64_t *pWord = (const uint64_t *)pHeader + SL_HEADER_WORDS;
+	uint32_t Values[SL_STREAMS][SL_BLOCK_SAMPLES];
+	UInt32 Deltas = pHeader->Count - 1, s, i;
+	uint32_t Step = (uint32_t)pHeader->BaseStep;
+	uint32_t Ticks = pBlock->PPSTicks[0];
+	UInt8 PPSCount = pBlock->PPSCount[0], Sequence = pBlock->SequenceNumber[0];
+	BOOL Steady;
+
+	for (s = 0; s < SL_STREAMS; s++)
+	{
+		if (pHeader->Width[s] > SL_UNPACK_WIDTHS)
+			return FALSE;
+	}
+
+	// Most blocks have no PPS pulse and no lost sample, only the time step
+	//   then varies and the other two streams are left packed
+	Steady = pHeader->Width[SL_PPS_STREAM] == 0 && pHeader->Width[SL_SEQ_STREAM] == 0;
+
+	for (s = 0; s < SL_STREAMS; s++)
+	{
+		if (!Steady || s < SL_PPS_STREAM)
+			UnpackStream(pWord, pHeader->Width[s], Deltas, Values[s]);
+		pWord += SL_WORDS(Deltas, pHeader->Width[s]);
+	}
+
+	// The readings wrap to 16 bits whatever the width of the sums
+	for (s = 0; s < N_SENSOR_IDX; s++)
+	{
+		SInt16 *pRaw = pBlock->Raw[s];
+		uint32_t Sum = (uint32_t)pRaw[0];
+
+		i = 0;
+#ifdef SL_USE_SSE2
+		{
+			const __m128i One = _mm_set1_epi32(1);
+			__m128i Carry = _mm_set1_epi16((short)Sum);
+
+			// Eight sums at a time: undo the zig-zag, narrow to 16 bits,
+			//   then a prefix sum in three shifted adds plus the carry in
+			for (; i + 8 <= Deltas; i += 8)
+			{
+				__m128i Lo = _mm_loadu_si128((const __m128i *)&Values[s][i]);
+				__m128i Hi = _mm_loadu_si128((const __m128i *)&Values[s][i + 4]);
+				__m128i x;
+
+				Lo = _mm_xor_si128(_mm_srli_epi32(Lo, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(Lo, One)));
+				Hi = _mm_xor_si128(_mm_srli_epi32(Hi, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(Hi, One)));
+				x = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(Lo, 16), 16), _mm_srai_epi32(_mm_slli_epi32(Hi, 16), 16));
+
+				x = _mm_add_epi16(x, _mm_slli_si128(x, 2));
+				x = _mm_add_epi16(x, _mm_slli_si128(x, 4));
+				x = _mm_add_epi16(x, _mm_slli_si128(x, 8));
+				x = _mm_add_epi16(x, Carry);
+
+				_mm_storeu_si128((__m128i *)&pRaw[i + 1], x);
+				Carry = _mm_shufflehi_epi16(x, 0xFF);
+				Carry = _mm_unpackhi_epi64(Carry, Carry);
+			}
+			Sum = (uint32_t)pRaw[i];
+		}
+#endif
+		for (; i < Deltas; i++)
+		{
+			Sum += UnZigZag32(Values[s][i]);
+			pRaw[i + 1] = (SInt16)Sum;
+		}
+	}
+
+	// Ticks keep 32 bits, so the time sums can too
+	if (Steady)
+	{
+		for (i = 0; i < Deltas; i++)
+		{
+			Step += UnZigZag32(Values[SL_TIME_STREAM][i]);
+			Ticks += Step;
+			pBlock->PPSTicks[i + 1] = Ticks;
+			pBlock->SequenceNumber[i + 1] = (UInt8)(Sequence + i + 1);
+		}
+		memset(&pBlock->PPSCount[1], PPSCount, Deltas);
+
+		return TRUE;
+	}
+
+	for (i = 0; i < Deltas; i++)
+	{
+		uint32_t PPSStep = UnZigZag32(Values[SL_PPS_STREAM][i]);
+
+		Step += UnZigZag32(Values[SL_TIME_STREAM][i]);
+		Ticks += Step - (uint32_t)SL_TICKS_PER_PPS * (uint32_t)(int8_t)PPSStep;
+		PPSCount += (UInt8)PPSStep;
+		Sequence += 1 + (UInt8)UnZigZag32(Values[SL_SEQ_STREAM][i]);
+
+		pBlock->PPSTicks[i + 1] = Ticks;
+		pBlock->PPSCount[i + 1] = PPSCount;
+		pBlock->SequenceNumber[i + 1] = Sequence;
+	}
+
+	return TRUE;
+
+}// DecodeUnpacked
+#endif
+
+
+/*! Decode one block.
+	\param pIn points to the block, 8-byte aligned.
+	\param Size is the number of bytes available at pIn.
+	\param pBlock points to space to receive the samples.
+	\return The block size in bytes, or 0 if the block is damaged or cut
+			short.*/
+UInt32 slDecodeBlock(const uint64_t *pIn, UInt32 Size, SampleBlock_t *pBlock)
+{
+	const SampleBlockHeader_t *pHeader = (const SampleBlockHeader_t *)pIn;
+	const uint64_t *pWord = pIn + SL_HEADER_WORDS;
+	const uint64_t *pPPS, *pSeq;
+	UInt32 Count, Deltas, s, i, Width, WidthPPS, WidthSeq, Words = 0;
+	uint64_t Mask, MaskPPS, MaskSeq;
+	int64_t Step;
+	int32_t Sum;
+	uint32_t Ticks;
+	UInt8 PPSCount, Sequence;
+
+	if (Size < sizeof(*pHeader) || pHeader->BlockBytes > Size ||
+		pHeader->Count == 0 || pHeader->Count > SL_BLOCK_SAMPLES)
+		return 0;
+
+	Count = pHeader->Count;
+	Deltas = Count - 1;
+
+	for (s = 0; s < SL_STREAMS; s++)
+	{
+		if (pHeader->Width[s] > 64)
+			return 0;
+		Words += SL_WORDS(Deltas, pHeader->Width[s]);
+	}
+	if (sizeof(*pHeader) + (Words + 1) * sizeof(uint64_t) != pHeader->BlockBytes)
+		return 0;
+
+	pBlock->Count = Count;
+	pBlock->GyroRange = pHeader->GyroRange;
+	pBlock->AccelRange = pHeader->AccelRange;
+	for (s = 0; s < N_SENSOR_IDX; s++)
+		pBlock->Raw[s][0] = pHeader->Base[s];
+	pBlock->PPSTicks[0] = pHeader->BasePPSTicks;
+	pBlock->PPSCount[0] = pHeader->BasePPSCount;
+	pBlock->SequenceNumber[0] = pHeader->BaseSequence;
+
+#ifdef SL_LITTLE_ENDIAN
+	if (DecodeUnpacked(pHeader, pBlock))
+		return pHeader->BlockBytes;
+#endif
+
+	// Readings: running sums of the differences, which fit 17 bits
+	for (s = 0; s < N_SENSOR_IDX; s++)
+	{
+		SInt16 *pRaw = pBlock->Raw[s];
+
+		Width = pHeader->Width[s];
+		Mask = SL_MASK(Width);
+		Sum = pHeader->Base[s];
+		pRaw[0] = (SInt16)Sum;
+
+#ifdef SL_LITTLE_ENDIAN
+		if (Width <= 57)
+		{
+			for (i = 0; i < Deltas; i++)
+			{
+				Sum += (int32_t)UnZigZag(ExtractLE(pWord, Width, Mask, i));
+				pRaw[i + 1] = (SInt16)Sum;
+			}
+		}
+		else
+#endif
+		{
+			for (i = 0; i < Deltas; i++)
+			{
+				Sum += (int32_t)UnZigZag(Extract(pWord, Width, Mask, i));
+				pRaw[i + 1] = (SInt16)Sum;
+			}
+		}
+
+		pWord += SL_WORDS(Deltas, Width);
+	}
+
+	// Time, PPS count and sequence number together, the time step is
+	//   unwrapped with the PPS count step
+	Width = pHeader->Width[SL_TIME_STREAM];
+	WidthPPS = pHeader->Width[SL_PPS_STREAM];
+	WidthSeq = pHeader->Width[SL_SEQ_STREAM];
+	Mask = SL_MASK(Width);
+	MaskPPS = SL_MASK(WidthPPS);
+	MaskSeq = SL_MASK(WidthSeq);
+	pPPS = pWord + SL_WORDS(Deltas, Width);
+	pSeq = pPPS + SL_WORDS(Deltas, WidthPPS);
+
+	Ticks = pBlock->PPSTicks[0] = pHeader->BasePPSTicks;
+	PPSCount = pBlock->PPSCount[0] = pHeader->BasePPSCount;
+	Sequence = pBlock->SequenceNumber[0] = pHeader->BaseSequence;
+	Step = pHeader->BaseStep;
+
+	// A width of 0 extracts 0 from the stream's first word, so no stream
+	//   needs a special case
+#define SL_DECODE_TIME(EXTRACT)																\
+	for (i = 0; i < Deltas; i++)															\
+	{																						\
+		int8_t PPSStep = (int8_t)UnZigZag(EXTRACT(pPPS, WidthPPS, MaskPPS, i));				\
+																							\
+		Step += UnZigZag(EXTRACT(pWord, Width, Mask, i));									\
+		Ticks += (uint32_t)(Step - (int64_t)SL_TICKS_PER_PPS * PPSStep);					\
+		PPSCount += PPSStep;																\
+		Sequence += 1 + (UInt8)UnZigZag(EXTRACT(pSeq, WidthSeq, MaskSeq, i));				\
+																							\
+		pBlock->PPSTicks[i + 1] = Ticks;													\
+		pBlock->PPSCount[i + 1] = PPSCount;													\
+		pBlock->SequenceNumber[i + 1] = Sequence;											\
+	}
+
+#ifdef SL_LITTLE_ENDIAN
+	if ((Width <= 57) && (WidthPPS <= 57) && (WidthSeq <= 57))
+	{
+		SL_DECODE_TIME(ExtractLE)
+	}
+	else
+#endif
+	{
+		SL_DECODE_TIME(Extract)
+	}
+
+#undef SL_DECODE_TIME
+
+	return pHeader->BlockBytes;
+
+}// slDecodeBlock
+
+
+/*! Encode and write the samples collected so far.
+	\param pWriter points to the writer.*/
+static void FlushBlock(SampleLogWriter_t *pWriter)
+{
+	UInt32 Bytes;
+	int64_t BaseStep = 0;
+
+	if (pWriter->Count == 0)
+		return;
+
+	if (pWriter->HaveLast)
+		BaseStep = TimeStep(&pWriter->Last, &pWriter->Samples[0]);
+
+	Bytes = slEncodeBlock(pWriter->Samples, pWriter->Count, pWriter->GyroRange,
+						  pWriter->AccelRange, BaseStep, pWriter->pBlock);
+
+	if (fwrite(pWriter->pBlock, 1, Bytes, pWriter->pFile) != Bytes)
+		pWriter->Error = TRUE;
+
+	pWriter->Bytes += Bytes;
+	pWriter->Last = pWriter->Samples[pWriter->Count - 1];
+	pWriter->HaveLast = TRUE;
+	pWriter->Count = 0;
+
+}// FlushBlock
+
+
+/*! Create a sample log.
+	\param pPath is the file name.
+	\return The writer, or NULL if the file could not be created.*/
+SampleLogWriter_t *slwOpen(const char *pPath)
+{
+	SampleLogWriter_t *pWriter = (SampleLogWriter_t *)calloc(1, sizeof(SampleLogWriter_t));
+	SampleLogHeader_t Header;
+
+	if (pWriter == NULL)
+		return NULL;
+
+	pWriter->pBlock = (uint64_t *)malloc(slMaxBlockBytes());
+	pWriter->pFile = fopen(pPath, "wb");
+	if ((pWriter->pBlock == NULL) || (pWriter->pFile == NULL))
+	{
+		if (pWriter->pFile)
+			fclose(pWriter->pFile);
+		free(pWriter->pBlock);
+		free(pWriter);
+		return NULL;
+	}
+
+	memset(&Header, 0, sizeof(Header));
+	memcpy(Header.Magic, SL_MAGIC, sizeof(Header.Magic));
+	Header.ByteOrder = SL_BYTE_ORDER_MARK;
+	Header.HeaderBytes = sizeof(Header);
+	Header.BlockSamples = SL_BLOCK_SAMPLES;
+	fwrite(&Header, sizeof(Header), 1, pWriter->pFile);
+	pWriter->Bytes = sizeof(Header);
+
+	return pWriter;
+
+}// slwOpen
+
+
+/*! Add a sample.  A change of range starts a new block.
+	\param pWriter points to the writer.
+	\param pSample points to the sample.
+	\param GyroRange is the gyro range in effect, deg/s.
+	\param AccelRange is the accelerometer range in effect, g.
+	\return FALSE if a write has failed.*/
+BOOL slwPut(SampleLogWriter_t *pWriter, const RawSample_t *pSample, float GyroRange, float AccelRange)
+{
+	if (pWriter->Count && ((GyroRange != pWriter->GyroRange) || (AccelRange != pWriter->AccelRange)))
+		FlushBlock(pWriter);
+
+	pWriter->GyroRange = GyroRange;
+	pWriter->AccelRange = AccelRange;
+	pWriter->Samples[pWriter->Count++] = *pSample;
+
+	if (pWriter->Count == SL_BLOCK_SAMPLES)
+		FlushBlock(pWriter);
+
+	return !pWriter->Error;
+
+}// slwPut
+
+
+/*! Get the size of the log so far.
+	\param pWriter points to the writer.
+	\return The bytes written, not counting the block being built.*/
+UInt64 slwBytes(const SampleLogWriter_t *pWriter)
+{
+	return pWriter->Bytes;
+
+}// slwBytes
+
+
+/*! Write the last block and close the log.
+	\param pWriter points to the writer, which is freed.
+	\return FALSE if any write failed.*/
+BOOL slwClose(SampleLogWriter_t *pWriter)
+{
+	BOOL Ok;
+
+	if (pWriter == NULL)
+		return FALSE;
+
+	FlushBlock(pWriter);
+	Ok = !pWriter->Error && (fclose(pWriter->pFile) == 0);
+	free(pWriter->pBlock);
+	free(pWriter);
+
+	return Ok;
+
+}// slwClose
+
+
+/*! Open a sample log for reading front to back.
+	\param pPath is the file name.
+	\return The reader, or NULL if the file is not a sample log.*/
+SampleLogReader_t *slrOpen(const char *pPath)
+{
+	SampleLogReader_t *pReader = (SampleLogReader_t *)calloc(1, sizeof(SampleLogReader_t));
+	SampleLogHeader_t Header;
+
+	if (pReader == NULL)
+		return NULL;
+
+	pReader->pBlock = (uint64_t *)malloc(slMaxBlockBytes());
+	pReader->pFile = fopen(pPath, "rb");
+	if ((pReader->pBlock == NULL) || (pReader->pFile == NULL) ||
+		(fread(&Header, sizeof(Header), 1, pReader->pFile) != 1) ||
+		(memcmp(Header.Magic, SL_MAGIC, sizeof(Header.Magic)) != 0) ||
+		(Header.ByteOrder != SL_BYTE_ORDER_MARK) ||
+		(Header.BlockSamples > SL_BLOCK_SAMPLES) ||
+		(fseek(pReader->pFile, Header.HeaderBytes, SEEK_SET) != 0))
+	{
+		slrClose(pReader);
+		return NULL;
+	}
+
+	return pReader;
+
+}// slrOpen
+
+
+/*! Read and decode the next block.
+	\param pReader points to the reader.
+	\param pBlock points to space to receive the samples.
+	\return FALSE at the end of the log or at a damaged block.*/
+BOOL slrNext(SampleLogReader_t *pReader, SampleBlock_t *pBlock)
+{
+	SampleBlockHeader_t *pHeader = (SampleBlockHeader_t *)pReader->pBlock;
+	UInt32 Rest;
+
+	if (fread(pHeader, sizeof(*pHeader), 1, pReader->pFile) != 1)
+		return FALSE;
+
+	if ((pHeader->BlockBytes < sizeof(*pHeader)) || (pHeader->BlockBytes > slMaxBlockBytes()))
+		return FALSE;
+
+	Rest = pHeader->BlockBytes - sizeof(*pHeader);
+	if (fread(pHeader + 1, 1, Rest, pReader->pFile) != Rest)
+		return FALSE;
+
+	return slDecodeBlock(pReader->pBlock, pHeader->BlockBytes, pBlock) != 0;
+
+}// slrNext
+
+
+/*! Close a reader.
+	\param pReader points to the reader, which is freed.*/
+void slrClose(SampleLogReader_t *pReader)
+{
+	if (pReader == NULL)
+		return;
+
+	if (pReader->pFile)
+		fclose(pReader->pFile);
+	free(pReader->pBlock);
+	free(pReader);
+
+}// slrClose
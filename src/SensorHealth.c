@@ -0,0 +1,261 @@
+/*! \file
+	\brief Online sanity checks of the IMU's channels.
+*/
+
+#include <math.h>
+#include <string.h>
+#include "Metrics.h"
+#include "SensorHealth.h"
+
+// Default thresholds
+#define HM_SATURATION			0.98f
+#define HM_SATURATION_SAMPLES	3
+#define HM_FLAT_SECONDS			0.1			// Window of the flat check...
+#define HM_FLAT_MIN_SAMPLES		8			// ...but never fewer samples than this
+#define HM_MAX_MISSED			2			// Isolated losses are normal on a serial link
+#define HM_CLEAR_SECONDS		0.5			// Gap free time that clears a dropout
+#define HM_TEMP_DRIFT_VOLTS		0.1f		// About 12 C on a 8.4 mV/C sensor
+
+#define HM_GRAVITY				9.81f
+
+static const char *CheckNames[HM_CHECKS] =
+{
+	"saturated", "flat", "dropout", "temp_drift"
+};
+
+
+/*! Get the default settings.
+	\param pConfig receives the settings, with no callback.
+	\param SampleHz is the high speed sample rate, which sets the windows.*/
+void hmDefaultConfig(HealthConfig_t *pConfig, double SampleHz)
+{
+	UInt32 Flat = (UInt32)(HM_FLAT_SECONDS * SampleHz);
+
+	pConfig->SaturationFraction = HM_SATURATION;
+	pConfig->SaturationSamples = HM_SATURATION_SAMPLES;
+	pConfig->FlatEpsilon = 0.0f;
+	pConfig->FlatSamples = Flat > HM_FLAT_MIN_SAMPLES ? Flat : HM_FLAT_MIN_SAMPLES;
+	pConfig->MaxMissed = HM_MAX_MISSED;
+	pConfig->DropoutClearSamples = (UInt32)(HM_CLEAR_SECONDS * SampleHz) + 1;
+	pConfig->TempDriftVolts = HM_TEMP_DRIFT_VOLTS;
+	pConfig->pCallback = NULL;
+	pConfig->pArg = NULL;
+
+}// hmDefaultConfig
+
+
+/*! Start a monitor with nothing raised.
+	\param pHealth points to the monitor.
+	\param pConfig points to the settings, which are copied.*/
+void hmInit(SensorHealth_t *pHealth, const HealthConfig_t *pConfig)
+{
+	memset(pHealth, 0, sizeof(*pHealth));
+	pHealth->Config = *pConfig;
+
+	// Full scale is 32767.5 counts either way
+	pHealth->SaturationCounts = (SInt32)(pConfig->SaturationFraction * 32767.5f + 0.5f);
+	pHealth->FlatEpsilonQ = FLOAT_TO_Q16(pConfig->FlatEpsilon);
+
+}// hmInit
+
+
+/*! Raise or clear a check on a channel, telling the callback if it changed.
+	\param pHealth points to the monitor.
+	\param Check is the check.
+	\param Channel is the channel.
+	\param Raise is TRUE to raise it, FALSE to clear it.
+	\param Value is the reading behind it.*/
+static void SetCheck(SensorHealth_t *pHealth, HealthCheck_t Check, UInt32 Channel, BOOL Raise, float Value)
+{
+	UInt32 Bit = HM_BIT(Check, Channel);
+	HealthEvent_t Event;
+
+	if (Raise == ((pHealth->Active & Bit) != 0))
+		return;
+
+	pHealth->Active ^= Bit;
+	if (Raise)
+	{
+		pHealth->ActiveCount++;
+		pHealth->Stats.Raised[Check]++;
+		mtCount((MetricCounter_t)(MT_HEALTH_SATURATED + Check), 1);
+	}
+	else
+		pHealth->ActiveCount--;
+
+	if (pHealth->Config.pCallback)
+	{
+		Event.Check = Check;
+		Event.Channel = Channel;
+		Event.Raised = Raise;
+		Event.Sample = pHealth->Stats.Samples;
+		Event.Value = Value;
+		pHealth->Config.pCallback(pHealth->Config.pArg, &Event);
+	}
+
+}// SetCheck
+
+
+/*! Check a sample's sequence number for samples missing before it.
+	\param pHealth points to the monitor.
+	\param Sequence is the sample's sequence number.*/
+static void CheckSequence(SensorHealth_t *pHealth, UInt8 Sequence)
+{
+	const HealthConfig_t *pConfig = &pHealth->Config;
+	UInt32 Missed;
+
+	if (pHealth->Stats.Samples)
+	{
+		Missed = (UInt8)(Sequence - pHealth->LastSequence - 1);
+		pHealth->Stats.Missed += Missed;
+
+		if (Missed > pConfig->MaxMissed)
+		{
+			pHealth->CleanRun = 0;
+			SetCheck(pHealth, HM_DROPOUT, 0, TRUE, (float)Missed);
+		}
+		else if (++pHealth->CleanRun >= pConfig->DropoutClearSamples)
+			SetCheck(pHealth, HM_DROPOUT, 0, FALSE, 0.0f);
+	}
+	pHealth->LastSequence = Sequence;
+
+}// CheckSequence
+
+
+/*! Check a high speed sample.
+	\param pHealth points to the monitor.
+	\param pData points to the decoded IMU data, its sensor ranges included.
+	\return The checks raised, HM_BIT() of each, 0 if the sample is sane.*/
+UInt32 hmUpdate(SensorHealth_t *pHealth, const IMUData_t *pData)
+{
+	const HealthConfig_t *pConfig = &pHealth->Config;
+	float GyroLimit = pConfig->SaturationFraction * pData->GyroRange;
+	float AccelLimit = pConfig->SaturationFraction * pData->AccelRange * HM_GRAVITY;
+	UInt32 i;
+
+	for (i = 0; i < N_SENSOR_IDX; i++)
+	{
+		float Value = pData->SensorsConverted[i];
+		float Limit = i < ACCELX_IDX ? GyroLimit : AccelLimit;
+
+		// Ranges are 0 until the resolution packet arrives
+		if (Limit > 0 && fabsf(Value) >= Limit)
+			pHealth->SaturatedRun[i]++;
+		else
+			pHealth->SaturatedRun[i] = 0;
+		SetCheck(pHealth, HM_SATURATED, i, pHealth->SaturatedRun[i] >= pConfig->SaturationSamples, Value);
+
+		// A run stays flat while every reading is near the one it started at
+		if (pHealth->Stats.Samples && fabsf(Value - pHealth->RunStart[i]) <= pConfig->FlatEpsilon)
+			pHealth->FlatRun[i]++;
+		else
+		{
+			pHealth->RunStart[i] = Value;
+			pHealth->FlatRun[i] = 1;
+		}
+		SetCheck(pHealth, HM_FLAT, i, pHealth->FlatRun[i] >= pConfig->FlatSamples, Value);
+	}
+
+	CheckSequence(pHealth, pData->SequenceNumber);
+	hmCheckTemp(pHealth, pData->GyroTempVolts);
+
+	pHealth->Stats.Samples++;
+
+	return pHealth->Active;
+
+}// hmUpdate
+
+
+/*! Check a high speed sample of the fixed point pipeline, in integers.
+	The float reading an event reports is only formed when a check changes.
+	\param pHealth points to the monitor.
+	\param pData points to the fixed point sample.
+	\return The checks raised, HM_BIT() of each, 0 if the sample is sane.*/
+UInt32 hmUpdateQ(SensorHealth_t *pHealth, const IMUDataQ_t *pData)
+{
+	const HealthConfig_t *pConfig = &pHealth->Config;
+	UInt32 i;
+
+	for (i = 0; i < N_SENSOR_IDX; i++)
+	{
+		SInt32 Count = pData->Raw[i] < 0 ? -pData->Raw[i] : pData->Raw[i];
+		Q16_t Value = pData->Converted[i], Change = Value - pHealth->RunStartQ[i];
+		BOOL Raise;
+
+		if (Count >= pHealth->SaturationCounts)
+			pHealth->SaturatedRun[i]++;
+		else
+			pHealth->SaturatedRun[i] = 0;
+		Raise = pHealth->SaturatedRun[i] >= pConfig->SaturationSamples;
+		if (Raise != ((pHealth->Active & HM_BIT(HM_SATURATED, i)) != 0))
+			SetCheck(pHealth, HM_SATURATED, i, Raise, Q16_TO_FLOAT(Value));
+
+		if (pHealth->Stats.Samples && Change <= pHealth->FlatEpsilonQ && -Change <= pHealth->FlatEpsilonQ)
+			pHealth->FlatRun[i]++;
+		else
+		{
+			pHealth->RunStartQ[i] = Value;
+			pHealth->FlatRun[i] = 1;
+		}
+		Raise = pHealth->FlatRun[i] >= pConfig->FlatSamples;
+		if (Raise != ((pHealth->Active & HM_BIT(HM_FLAT, i)) != 0))
+			SetCheck(pHealth, HM_FLAT, i, Raise, Q16_TO_FLOAT(Value));
+	}
+
+	CheckSequence(pHealth, pData->SequenceNumber);
+
+	pHealth->Stats.Samples++;
+
+	return pHealth->Active;
+
+}// hmUpdateQ
+
+
+/*! Check the gyro temperatures against their reference.  hmUpdate() does
+	this for every sample; with hmUpdateQ() call it as the temperatures
+	arrive.
+	\param pHealth points to the monitor.
+	\param pVolts points to the N_TEMP_IDX temperature readings, 0 for
+		   none yet.
+	\return The checks raised, HM_BIT() of each.*/
+UInt32 hmCheckTemp(SensorHealth_t *pHealth, const float *pVolts)
+{
+	float Drift;
+	UInt32 i;
+
+	for (i = 0; i < N_TEMP_IDX; i++)
+	{
+		// The first reading is the reference unless the calibration set one
+		if (pVolts[i] == 0.0f)
+			continue;
+		if (pHealth->TempReference[i] == 0.0f)
+			pHealth->TempReference[i] = pVolts[i];
+
+		Drift = pVolts[i] - pHealth->TempReference[i];
+		SetCheck(pHealth, HM_TEMP_DRIFT, i, fabsf(Drift) > pHealth->Config.TempDriftVolts, Drift);
+	}
+
+	return pHealth->Active;
+
+}// hmCheckTemp
+
+
+/*! Take the gyro temperatures now as the reference the drift check
+	measures from, e.g. once the bias has been calibrated.
+	\param pHealth points to the monitor.
+	\param pData points to the decoded IMU data.*/
+void hmSetTempReference(SensorHealth_t *pHealth, const IMUData_t *pData)
+{
+	memcpy(pHealth->TempReference, pData->GyroTempVolts, sizeof(pHealth->TempReference));
+
+}// hmSetTempReference
+
+
+/*! Name a check, as the metrics label it.
+	\param Check is the check.
+	\return Its name.*/
+const char *hmCheckName(HealthCheck_t Check)
+{
+	return (UInt32)Check < HM_CHECKS ? CheckNames[Check] : "unknown";
+
+}// hmCheckName
@@ -0,0 +1,425 @@
+/*! \file
+	\brief Raw serial capture with host timestamps.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Atomic.h"
+#include "HostTime.h"
+#include "SerialCapture.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// Writer thread idle period when the ring is empty
+#define CAP_IDLE_MS		2
+
+// stdio buffer for the capture file
+#define CAP_FILE_BUFFER	(256 * 1024)
+
+static const UInt8 Zeros[8] = { 0 };
+
+struct SerialCapture_t
+{
+	// Producer side
+	volatile UInt32 Head;			//!< Bytes written into the ring
+	UInt32 PendingDrop;				//!< Bytes dropped since the last stored chunk
+	volatile UInt64 DroppedBytes;	//!< Total bytes dropped
+	char Pad0[CACHE_LINE_BYTES];
+
+	// Consumer side
+	volatile UInt32 Tail;			//!< Bytes taken out of the ring
+	volatile UInt32 Stop;			//!< Set to ask the writer to drain and exit
+	volatile UInt64 LostBytes;		//!< Bytes a failed write left out of the file
+	char Pad1[CACHE_LINE_BYTES];
+
+	UInt32 Mask;					//!< Ring size - 1, ring size is a power of two
+	UInt8 *pRing;					//!< Ring storage
+	FILE *pFile;					//!< Capture file
+	FILE *pIndex;					//!< Index file
+	UInt64 Offset;					//!< Capture file size
+	UInt64 LastIndexNs;				//!< Time of the last index entry
+	UInt64 LastIndexOffset;			//!< Offset of the last index entry
+	BOOL Indexed;					//!< TRUE once the first entry is written
+	BOOL WriteFailed;				//!< TRUE once a capture write failed, see DrainRing()
+	BOOL IndexFailed;				//!< TRUE once an index write failed, no more are made
+
+#ifdef WIN32
+	HANDLE Thread;
+#else
+	pthread_t Thread;
+#endif
+};
+
+
+/*! Copy bytes into the ring, wrapping at the end.
+	\param pCap points to the capture.
+	\param Pos is the ring position (not masked).
+	\param pData points to the bytes to copy.
+	\param Length is the number of bytes.*/
+static void RingPut(SerialCapture_t *pCap, UInt32 Pos, const void *pData, UInt32 Length)
+{
+	UInt32 Start = Pos & pCap->Mask;
+	UInt32 First = pCap->Mask + 1 - Start;
+
+	if (First >= Length)
+		memcpy(pCap->pRing + Start, pData, Length);
+	else
+	{
+		memcpy(pCap->pRing + Start, pData, First);
+		memcpy(pCap->pRing, (const UInt8 *)pData + First, Length - First);
+	}
+
+}// RingPut
+
+
+/*! Copy bytes out of the ring, wrapping at the end.
+	\param pCap points to the capture.
+	\param Pos is the ring position (not masked).
+	\param pOut points to space to receive the bytes.
+	\param Length is the number of bytes.*/
+static void RingGet(SerialCapture_t *pCap, UInt32 Pos, void *pOut, UInt32 Length)
+{
+	UInt32 Start = Pos & pCap->Mask;
+	UInt32 First = pCap->Mask + 1 - Start;
+
+	if (First > Length)
+		First = Length;
+
+	memcpy(pOut, pCap->pRing + Start, First);
+	memcpy((UInt8 *)pOut + First, pCap->pRing, Length - First);
+
+}// RingGet
+
+
+/*! Write bytes out of the ring to a file, wrapping at the end.
+	\param pCap points to the capture.
+	\param Pos is the ring position (not masked).
+	\param pFile is the file to write to.
+	\param Length is the number of bytes.
+	\return The number of bytes written, less than Length if a write failed.*/
+static UInt32 RingWrite(SerialCapture_t *pCap, UInt32 Pos, FILE *pFile, UInt32 Length)
+{
+	UInt32 Start = Pos & pCap->Mask;
+	UInt32 First = pCap->Mask + 1 - Start;
+	UInt32 Done;
+
+	if (First > Length)
+		First = Length;
+
+	Done = (UInt32)fwrite(pCap->pRing + Start, 1, First, pFile);
+	if (Done == First && Length > First)
+		Done += (UInt32)fwrite(pCap->pRing, 1, Length - First, pFile);
+
+	return Done;
+
+}// RingWrite
+
+
+/*! Write all complete chunks in the ring to disk, adding index entries.
+	A failed write leaves a broken chunk that nothing after it can be
+	found past, so from then on chunks are only counted as lost, and the
+	index stops at the last chunk written whole.
+	\param pCap points to the capture.
+	\return The number of bytes taken out of the ring.*/
+static UInt32 DrainRing(SerialCapture_t *pCap)
+{
+	UInt32 Tail = pCap->Tail;
+	UInt32 Head = atomicLoadAcquire(&pCap->Head);
+	UInt32 Written = 0;
+
+	while (Tail != Head)
+	{
+		CaptureChunkHeader_t Chunk;
+		UInt32 Bytes, Done;
+
+		RingGet(pCap, Tail, &Chunk, sizeof(Chunk));
+		Bytes = (UInt32)CAP_CHUNK_BYTES(Chunk.Length);
+
+		// A flush can fail too, without a short write to show for it
+		if (ferror(pCap->pFile))
+			pCap->WriteFailed = TRUE;
+
+		if (pCap->WriteFailed)
+			atomicStoreRelaxed(&pCap->LostBytes, pCap->LostBytes + Bytes);
+		else
+		{
+			// Index the chunk if enough time or data has gone by
+			if (!pCap->IndexFailed &&
+				(!pCap->Indexed ||
+				 (Chunk.HostNs - pCap->LastIndexNs >= CAP_INDEX_INTERVAL_NS) ||
+				 (pCap->Offset - pCap->LastIndexOffset >= CAP_INDEX_INTERVAL_BYTES)))
+			{
+				CaptureIndexEntry_t Entry;
+
+				Entry.HostNs = Chunk.HostNs;
+				Entry.Offset = pCap->Offset;
+				if (fwrite(&Entry, sizeof(Entry), 1, pCap->pIndex) != 1)
+					pCap->IndexFailed = TRUE;
+
+				pCap->LastIndexNs = Chunk.HostNs;
+				pCap->LastIndexOffset = pCap->Offset;
+				pCap->Indexed = TRUE;
+			}
+
+			Done = RingWrite(pCap, Tail, pCap->pFile, Bytes);
+			if (Done != Bytes)
+			{
+				pCap->WriteFailed = TRUE;
+				atomicStoreRelaxed(&pCap->LostBytes, pCap->LostBytes + Bytes - Done);
+			}
+			pCap->Offset += Done;
+		}
+
+		Tail += Bytes;
+		Written += Bytes;
+		atomicStoreRelease(&pCap->Tail, Tail);
+	}
+
+	return Written;
+
+}// DrainRing
+
+
+/*! Background writer, runs until capClose() sets Stop.
+	\param pArg points to the capture.*/
+#ifdef WIN32
+static DWORD WINAPI WriterThread(LPVOID pArg)
+#else
+static void *WriterThread(void *pArg)
+#endif
+{
+	SerialCapture_t *pCap = (SerialCapture_t *)pArg;
+
+	while (!atomicLoadAcquire(&pCap->Stop))
+	{
+		if (DrainRing(pCap) == 0)
+		{
+			// Idle, make what we have visible to readers
+			fflush(pCap->pFile);
+			fflush(pCap->pIndex);
+			htSleepMs(CAP_IDLE_MS);
+		}
+	}
+
+	DrainRing(pCap);
+	fflush(pCap->pFile);
+	fflush(pCap->pIndex);
+
+	return 0;
+
+}// WriterThread
+
+
+/*! Create a capture file and its index and start the writer thread.
+	\param pPath is the name of the capture file; the index is pPath + ".idx".
+	\param RingBytes is the size of the buffer between the serial thread and
+		   the writer, rounded up to a power of two.
+	\return The capture, or NULL if it could not be created.*/
+SerialCapture_t *capOpen(const char *pPath, UInt32 RingBytes)
+{
+	SerialCapture_t *pCap;
+	CaptureFileHeader_t Header;
+	CaptureIndexHeader_t IndexHeader;
+	char *pIndexPath;
+	UInt32 Size = 4096;
+
+	while (Size < RingBytes)
+		Size <<= 1;
+
+	pCap = (SerialCapture_t *)calloc(1, sizeof(SerialCapture_t));
+	pIndexPath = (char *)malloc(strlen(pPath) + 5);
+	if ((pCap == NULL) || (pIndexPath == NULL))
+	{
+		free(pCap);
+		free(pIndexPath);
+		return NULL;
+	}
+
+	strcpy(pIndexPath, pPath);
+	strcat(pIndexPath, ".idx");
+
+	pCap->Mask = Size - 1;
+	pCap->pRing = (UInt8 *)malloc(Size);
+	pCap->pFile = fopen(pPath, "wb");
+	pCap->pIndex = fopen(pIndexPath, "wb");
+	free(pIndexPath);
+
+	if ((pCap->pRing == NULL) || (pCap->pFile == NULL) || (pCap->pIndex == NULL))
+		goto Fail;
+
+	setvbuf(pCap->pFile, NULL, _IOFBF, CAP_FILE_BUFFER);
+
+	memset(&Header, 0, sizeof(Header));
+	memcpy(Header.Magic, CAP_MAGIC, sizeof(Header.Magic));
+	Header.ByteOrder = CAP_BYTE_ORDER_MARK;
+	Header.HeaderBytes = sizeof(Header);
+	Header.StartNs = htNowNs();
+	pCap->Offset = sizeof(Header);
+
+	memset(&IndexHeader, 0, sizeof(IndexHeader));
+	memcpy(IndexHeader.Magic, CAP_INDEX_MAGIC, sizeof(IndexHeader.Magic));
+	IndexHeader.ByteOrder = CAP_BYTE_ORDER_MARK;
+	IndexHeader.EntryBytes = sizeof(CaptureIndexEntry_t);
+
+	// Files that can't take their headers can't be read back
+	if ((fwrite(&Header, sizeof(Header), 1, pCap->pFile) != 1) ||
+		(fwrite(&IndexHeader, sizeof(IndexHeader), 1, pCap->pIndex) != 1))
+		goto Fail;
+
+#ifdef WIN32
+	pCap->Thread = CreateThread(NULL, 0, WriterThread, pCap, 0, NULL);
+	if (pCap->Thread == NULL)
+		goto Fail;
+#else
+	if (pthread_create(&pCap->Thread, NULL, WriterThread, pCap) != 0)
+		goto Fail;
+#endif
+
+	return pCap;
+
+Fail:
+	if (pCap->pFile)
+		fclose(pCap->pFile);
+	if (pCap->pIndex)
+		fclose(pCap->pIndex);
+	free(pCap->pRing);
+	free(pCap);
+	return NULL;
+
+}// capOpen
+
+
+/*! Put a chunk into the ring if there is room for it.
+	\param pCap points to the capture.
+	\param pData points to the bytes.
+	\param Length is the number of bytes.
+	\param HostNs is the time stamp for the chunk.
+	\return TRUE if stored, FALSE if the ring is too full.*/
+static BOOL CapPut(SerialCapture_t *pCap, const UInt8 *pData, UInt32 Length, UInt64 HostNs)
+{
+	CaptureChunkHeader_t Chunk;
+	UInt32 Head = pCap->Head;
+	UInt32 Bytes = (UInt32)CAP_CHUNK_BYTES(Length);
+
+	if (Bytes > (pCap->Mask + 1) - (Head - atomicLoadAcquire(&pCap->Tail)))
+		return FALSE;
+
+	Chunk.HostNs = HostNs;
+	Chunk.Length = Length;
+	Chunk.Dropped = pCap->PendingDrop;
+	pCap->PendingDrop = 0;
+
+	// Header, data, then zero padding
+	RingPut(pCap, Head, &Chunk, sizeof(Chunk));
+	RingPut(pCap, Head + sizeof(Chunk), pData, Length);
+	RingPut(pCap, Head + sizeof(Chunk) + Length, Zeros, Bytes - sizeof(Chunk) - Length);
+
+	atomicStoreRelease(&pCap->Head, Head + Bytes);
+
+	return TRUE;
+
+}// CapPut
+
+
+/*! Record a chunk read from the serial port.  Only the thread reading the
+	port may call this.  Never blocks.
+	\param pCap points to the capture.
+	\param pData points to the bytes that were read.
+	\param Length is the number of bytes.
+	\return TRUE if recorded, FALSE if the ring was full and it was dropped.*/
+BOOL capWrite(SerialCapture_t *pCap, const UInt8 *pData, UInt32 Length)
+{
+	if (Length == 0)
+		return TRUE;
+
+	if (!CapPut(pCap, pData, Length, htNowNs()))
+	{
+		pCap->PendingDrop += Length;
+		atomicStoreRelaxed(&pCap->DroppedBytes, pCap->DroppedBytes + Length);
+		return FALSE;
+	}
+
+	return TRUE;
+
+}// capWrite
+
+
+/*! Record a chunk with a given time stamp, waiting for room in the ring
+	instead of dropping.  For offline producers such as the stream generator,
+	where nothing may be lost and nothing is waiting on the data.  Time stamps
+	must not decrease from one chunk to the next.
+	\param pCap points to the capture.
+	\param pData points to the bytes.
+	\param Length is the number of bytes, at most the ring size less one
+		   chunk header.
+	\param HostNs is the time stamp for the chunk.*/
+void capWriteAt(SerialCapture_t *pCap, const UInt8 *pData, UInt32 Length, UInt64 HostNs)
+{
+	if (Length == 0)
+		return;
+
+	while (!CapPut(pCap, pData, Length, HostNs))
+		htSleepMs(1);
+
+}// capWriteAt
+
+
+/*! Get the number of bytes dropped because the writer fell behind.
+	\param pCap points to the capture.
+	\return The number of bytes not recorded.*/
+UInt64 capDroppedBytes(const SerialCapture_t *pCap)
+{
+	return atomicLoadRelaxed(&pCap->DroppedBytes);
+
+}// capDroppedBytes
+
+
+/*! Get the number of bytes a failed write left out of the capture file.
+	Safe from any thread.
+	\param pCap points to the capture.
+	\return The number of bytes lost, at least; data a failed flush
+			threw away is not known.*/
+UInt64 capLostBytes(const SerialCapture_t *pCap)
+{
+	return atomicLoadRelaxed(&pCap->LostBytes);
+
+}// capLostBytes
+
+
+/*! Write out everything buffered, stop the writer and close the files.
+	\param pCap points to the capture, which is freed.
+	\return TRUE if every byte was recorded: none dropped, no write failed
+			and both files closed cleanly.*/
+BOOL capClose(SerialCapture_t *pCap)
+{
+	BOOL Ok;
+
+	if (pCap == NULL)
+		return FALSE;
+
+	atomicStoreRelease(&pCap->Stop, 1);
+
+#ifdef WIN32
+	WaitForSingleObject(pCap->Thread, INFINITE);
+	CloseHandle(pCap->Thread);
+#else
+	pthread_join(pCap->Thread, NULL);
+#endif
+
+	Ok = (pCap->DroppedBytes == 0) && !pCap->WriteFailed && !pCap->IndexFailed &&
+		 !ferror(pCap->pFile) && !ferror(pCap->pIndex);
+	if (fclose(pCap->pFile) != 0)
+		Ok = FALSE;
+	if (fclose(pCap->pIndex) != 0)
+		Ok = FALSE;
+	free(pCap->pRing);
+	free(pCap);
+
+	return Ok;
+
+}// capClose
@@ -0,0 +1,303 @@
+/*! \file
+	\brief Serial module that replays a capture file, see SerialReplay.h.
+*/
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CaptureReader.h"
+#include "HostTime.h"
+#include "SerialReplay.h"
+
+#define REPLAY_HANDLE			1
+#define REPLAY_INVALID_HANDLE	((UInt32)-1)
+
+// The one replay "port"
+static struct
+{
+	char *pPath;				//!< Capture to open
+	double Speed;				//!< Replay clock rate, REPLAY_SPEED_MAX for no pacing
+	BOOL Open;					//!< TRUE while the port is open
+	CaptureReader_t Reader;		//!< Mapped capture
+	CaptureChunk_t Chunk;		//!< Chunk being delivered
+	BOOL HaveChunk;				//!< FALSE once the capture is exhausted
+	UInt32 Pos;					//!< Bytes of Chunk already delivered
+	UInt64 FirstNs;				//!< Capture time of the first chunk
+	UInt64 OpenNs;				//!< Host time the port was opened
+	SerialCapture_t *pCapture;	//!< Capture of the replayed data, or NULL
+	ReplayStats_t Stats;		//!< Progress
+} Replay;
+
+
+/*! Choose the capture to replay and the speed.  Call before psOpenCOMM().
+	\param pPath is the name of the capture file.
+	\param Speed is the replay rate relative to real time, e.g. 1, 10 or 100,
+		   or REPLAY_SPEED_MAX to replay without pacing.
+	\return TRUE if the settings were accepted.*/
+BOOL psReplaySetup(const char *pPath, double Speed)
+{
+	char *pCopy = (char *)malloc(strlen(pPath) + 1);
+
+	// Not NaN or infinite either, the pacing multiplies by it
+	if ((pCopy == NULL) || !((Speed >= 0) && (Speed <= DBL_MAX)))
+	{
+		free(pCopy);
+		return FALSE;
+	}
+
+	strcpy(pCopy, pPath);
+	free(Replay.pPath);
+	Replay.pPath = pCopy;
+	Replay.Speed = Speed;
+
+	return TRUE;
+
+}// psReplaySetup
+
+
+/*! Determine whether the next chunk is due on the replay clock.
+	\return TRUE if the current chunk may be delivered.*/
+static BOOL ChunkIsDue(void)
+{
+	UInt64 Elapsed;
+
+	if (Replay.Speed == REPLAY_SPEED_MAX)
+		return TRUE;
+
+	Elapsed = htNowNs() - Replay.OpenNs;
+
+	return ((Replay.Chunk.HostNs - Replay.FirstNs) <= (UInt64)(Elapsed * Replay.Speed));
+
+}// ChunkIsDue
+
+
+/*! Move on to the next chunk of the capture.*/
+static void NextChunk(void)
+{
+	Replay.Stats.Chunks++;
+	Replay.Pos = 0;
+	Replay.HaveChunk = crChunkAt(&Replay.Reader, Replay.Chunk.Next, &Replay.Chunk);
+
+	if (Replay.HaveChunk)
+		Replay.Stats.Dropped += Replay.Chunk.Dropped;
+	else
+		Replay.Stats.Finished = TRUE;
+
+}// NextChunk
+
+
+/*! Initialize the serial port sub-system*/
+void psInitCOMM(void)
+{
+}// psInitCOMM
+
+
+/*! Open the replay.  The port parameters are ignored; the capture and speed
+	come from psReplaySetup() or the environment.
+	\return The handle of the replay, or -1 if the capture can't be opened.*/
+UInt32 psOpenCOMM(UInt8 chan, UInt8 dir, UInt32 baud, UInt8 parity,
+				  UInt8 data, UInt32 flow, UInt32 QSize)
+{
+	(void)chan; (void)dir; (void)baud; (void)parity; (void)data; (void)flow; (void)QSize;
+
+	if (Replay.Open)
+		return REPLAY_INVALID_HANDLE;
+
+	if (Replay.pPath == NULL)
+	{
+		const char *pPath = getenv("IMU_REPLAY_FILE");
+		const char *pSpeed = getenv("IMU_REPLAY_SPEED");
+		double Speed = 1.0;
+		char *pEnd;
+
+		// The whole value must be a number, "fast" must not become 0
+		if (pSpeed)
+		{
+			Speed = strtod(pSpeed, &pEnd);
+			if ((pEnd == pSpeed) || (*pEnd != 0) || !((Speed >= 0) && (Speed <= DBL_MAX)))
+			{
+				fprintf(stderr, "IMU_REPLAY_SPEED=%s is not a speed of 0 or more\n", pSpeed);
+				return REPLAY_INVALID_HANDLE;
+			}
+		}
+
+		if ((pPath == NULL) || !psReplaySetup(pPath, Speed))
+			return REPLAY_INVALID_HANDLE;
+	}
+
+	if (!crOpen(&Replay.Reader, Replay.pPath))
+		return REPLAY_INVALID_HANDLE;
+
+	memset(&Replay.Stats, 0, sizeof(Replay.Stats));
+	Replay.Pos = 0;
+	Replay.HaveChunk = crChunkAt(&Replay.Reader, crFirstChunk(&Replay.Reader), &Replay.Chunk);
+	Replay.FirstNs = Replay.HaveChunk ? Replay.Chunk.HostNs : 0;
+	Replay.Stats.Finished = !Replay.HaveChunk;
+	Replay.OpenNs = htNowNs();
+	Replay.Open = TRUE;
+
+	return REPLAY_HANDLE;
+
+}// psOpenCOMM
+
+
+/*! Close the replay.
+	\param Handle is the handle returned from psOpenCOMM(). */
+void psCloseCOMM(UInt32 Handle)
+{
+	if ((Handle != REPLAY_HANDLE) || !Replay.Open)
+		return;
+
+	crClose(&Replay.Reader);
+	Replay.Open = FALSE;
+
+}// psCloseCOMM
+
+
+/*! Read a byte of replayed data.  Does not block.
+	\param Handle is the handle returned from psOpenCOMM().
+	\return The next byte, or -1 if no byte is due yet.*/
+SInt16 psReadByteQuick(UInt32 Handle)
+{
+	UInt8 Data;
+
+	if (psReadBlockQuick(Handle, &Data, 1) == 1)
+		return Data;
+
+	return -1;
+
+}// psReadByteQuick
+
+
+/*! Read a block of replayed data.  Does not block; returns at most the
+	bytes that are due on the replay clock.
+	\param Handle is the handle returned from psOpenCOMM().
+	\param pData points to space to receive the bytes.
+	\param Size is the number of bytes to read.
+	\return The actual amount of data read.*/
+UInt32 psReadBlockQuick(UInt32 Handle, UInt8* pData, UInt32 Size)
+{
+	UInt32 Count = 0;
+
+	if ((Handle != REPLAY_HANDLE) || !Replay.Open)
+		return 0;
+
+	while ((Count < Size) && Replay.HaveChunk && ChunkIsDue())
+	{
+		UInt32 n = Replay.Chunk.Length - Replay.Pos;
+
+		if (n > Size - Count)
+			n = Size - Count;
+
+		memcpy(pData + Count, Replay.Chunk.pData + Replay.Pos, n);
+		Count += n;
+		Replay.Pos += n;
+
+		if (Replay.Pos == Replay.Chunk.Length)
+			NextChunk();
+	}
+
+	Replay.Stats.Bytes += Count;
+
+	if (Replay.pCapture && Count)
+		capWrite(Replay.pCapture, pData, Count);
+
+	return Count;
+
+}// psReadBlockQuick
+
+
+/*! Writes go nowhere; the recorded IMU already answered.
+	\return Size, as if everything was sent.*/
+UInt32 psWriteBlockQuick(UInt32 Handle, const UInt8* pData, UInt32 Size)
+{
+	(void)Handle; (void)pData;
+
+	return Size;
+
+}// psWriteBlockQuick
+
+
+/*! Determine if the replay is open with bytes left to deliver.  Once the
+	capture is exhausted it reads as closed, like a port whose device went
+	away, so the application can stop.
+	\param Handle is the handle returned from psOpenCOMM().
+	\return TRUE if the replay is open and not finished, else FALSE.*/
+BOOL psIsCOMMOpen(UInt32 Handle)
+{
+	return (Handle == REPLAY_HANDLE) && Replay.Open && Replay.HaveChunk;
+
+}// psIsCOMMOpen
+
+
+/*! Return the number of bytes due on the replay clock but not yet read.
+	\param Handle is the handle returned from psOpenCOMM().
+	\return The amount of data in the "receive queue".*/
+UInt32 psRxQHolding(UInt32 Handle)
+{
+	UInt32 Holding = 0;
+	CaptureChunk_t Chunk;
+	UInt32 Pos = Replay.Pos;
+
+	if ((Handle != REPLAY_HANDLE) || !Replay.Open || !Replay.HaveChunk)
+		return 0;
+
+	if (Replay.Speed == REPLAY_SPEED_MAX)
+		return Replay.Chunk.Length - Pos;
+
+	// Add up the due chunks, starting with the partly read one
+	Chunk = Replay.Chunk;
+	do
+	{
+		UInt64 Elapsed = htNowNs() - Replay.OpenNs;
+
+		if ((Chunk.HostNs - Replay.FirstNs) > (UInt64)(Elapsed * Replay.Speed))
+			break;
+
+		Holding += Chunk.Length - Pos;
+		Pos = 0;
+
+	} while (crChunkAt(&Replay.Reader, Chunk.Next, &Chunk));
+
+	return Holding;
+
+}// psRxQHolding
+
+
+/*! Record the replayed data into another capture.
+	\param Handle is the handle returned from psOpenCOMM().
+	\param pCapture is the capture to record into, or NULL to stop.*/
+void psSetCapture(UInt32 Handle, SerialCapture_t *pCapture)
+{
+	(void)Handle;
+
+	Replay.pCapture = pCapture;
+
+}// psSetCapture
+
+
+/*! Get the replay progress.
+	\param Handle is the handle returned from psOpenCOMM().
+	\param pStats points to space to receive the progress.*/
+void psReplayGetStats(UInt32 Handle, ReplayStats_t *pStats)
+{
+	(void)Handle;
+
+	*pStats = Replay.Stats;
+	pStats->ElapsedNs = Replay.Open ? htNowNs() - Replay.OpenNs : 0;
+
+}// psReplayGetStats
+
+
+// The remaining port controls have no meaning for a replay
+void psChangeBaud(UInt32 Handle, UInt32 baud) { (void)Handle; (void)baud; }
+BOOL psIsCarrierDetectActive(UInt32 Handle) { return psIsCOMMOpen(Handle); }
+void psSetDTRActive(UInt32 Handle) { (void)Handle; }
+void psSetDTRInactive(UInt32 Handle) { (void)Handle; }
+void psAssertBreak(UInt32 Handle) { (void)Handle; }
+void psClearBreak(UInt32 Handle) { (void)Handle; }
+void psPurgeRxQ(UInt32 Handle) { (void)Handle; }
+void psPurgeTxQ(UInt32 Handle) { (void)Handle; }
+BOOL psCheckForResponse(UInt32 Handle, const char *pString) { (void)Handle; (void)pString; return FALSE; }
+BOOL psCheckForMultipleResponse(UInt32 Handle, const char *pString, UInt32 NumResponse) { (void)Handle; (void)pString; (void)NumResponse; return FALSE; }
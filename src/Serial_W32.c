@@ -30,6 +30,9 @@
 
 static UInt32 OpenWin32Serial(UInt8 chan, UInt32 baud, UInt8 parity, UInt8 data, UInt32 QSize);
 
+// Capture receiving a copy of all received data, or NULL
+static SerialCapture_t *pRxCapture = NULL;
+
 /*! Initialize the serial port sub-system*/
 void psInitCOMM(void)
 {
@@ -78,7 +81,11 @@ SInt16 psReadByteQuick(UInt32 Handle)
 	{
 		ReadFile((HANDLE)Handle, &Data, 1, &Count, NULL);
 		if(Count == 1)
+		{
+			if(pRxCapture)
+				capWrite(pRxCapture, &Data, 1);
 			return Data;
+		}
 	}// If port has been opened
 
 	return -1;
@@ -99,6 +106,9 @@ UInt32 psReadBlockQuick(UInt32 Handle, UInt8* pData, UInt32 Size)
 	if(((HANDLE)Handle) != INVALID_HANDLE_VALUE)
 		ReadFile((HANDLE)Handle, pData, Size, &Count, NULL);
 
+	if(pRxCapture && Count)
+		capWrite(pRxCapture, pData, Count);
+
 	return Count;
 
 }// psReadBlockQuick
@@ -128,6 +138,21 @@ UInt32 psWriteBlockQuick(UInt32 Handle, const UInt8* pData, UInt32 Size)
 }// psWriteBlockQuick
 
 
+/*! Record all data received from now on.  Reading one byte at a time with
+	psReadByteQuick() records one chunk per byte, so prefer psReadBlockQuick()
+	while capturing.
+	\param Handle is the serial port handle returned from psOpenCOMM().
+	\param pCapture is the capture to record into, or NULL to stop recording.*/
+void psSetCapture(UInt32 Handle, SerialCapture_t *pCapture)
+{
+	// Warning pacifier
+	Handle;
+
+	pRxCapture = pCapture;
+
+}// psSetCapture
+
+
 /*! Determine if the platform specific serial channel is open.
 	\param Handle is the serial port handle returned from psOpenCOMM().
 	\return TRUE if the channel is open, else FALSE.*/
@@ -0,0 +1,481 @@
+/*! \file
+	\brief Shared memory ring publishing IMU samples to other processes.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "SharedRing.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+struct SharedRingWriter_t
+{
+	SharedRingHeader_t *pHeader;
+	UInt8 *pSlots;
+	UInt32 SlotBytes;
+	UInt32 Mask;
+	UInt64 Head;							//!< Samples published, the writer's copy
+	size_t Bytes;
+	char *pName;
+#ifdef WIN32
+	HANDLE Mapping;
+#endif
+};
+
+struct SharedRingReader_t
+{
+	const SharedRingHeader_t *pHeader;
+	const UInt8 *pSlots;
+	UInt32 SlotBytes;
+	UInt32 Mask;
+	size_t Bytes;
+#ifdef WIN32
+	HANDLE Mapping;
+#endif
+};
+
+
+/*! Map a shared object.
+	\param pName is the object name.
+	\param Bytes is its size, 0 to take it from the object when opening.
+	\param Create is TRUE to create it, read-write, FALSE to open it read-only.
+	\param pBytes receives the mapped size.
+	\param pMapping receives the mapping handle on Windows.
+	\return The mapping, or NULL.*/
+static void *MapObject(const char *pName, size_t Bytes, BOOL Create, size_t *pBytes, void *pMapping)
+{
+#ifdef WIN32
+	HANDLE Mapping;
+	void *pBase;
+
+	if (Create)
+		Mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+									 (DWORD)((UInt64)Bytes >> 32), (DWORD)Bytes, pName);
+	else
+		Mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, pName);
+
+	if (Mapping == NULL)
+		return NULL;
+
+	pBase = MapViewOfFile(Mapping, Create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, Bytes);
+	if (pBase == NULL)
+	{
+		CloseHandle(Mapping);
+		return NULL;
+	}
+
+	if (Bytes == 0)
+	{
+		MEMORY_BASIC_INFORMATION Info;
+
+		VirtualQuery(pBase, &Info, sizeof(Info));
+		Bytes = Info.RegionSize;
+	}
+
+	*(HANDLE *)pMapping = Mapping;
+	*pBytes = Bytes;
+
+	return pBase;
+#else
+	struct stat Stat;
+	void *pBase;
+	int Fd;
+
+	(void)pMapping;
+
+	if (Create)
+	{
+		// A ring left by a writer that died goes, its readers keep their mapping
+		shm_unlink(pName);
+		Fd = shm_open(pName, O_RDWR | O_CREAT | O_EXCL, 0644);
+		if (Fd < 0)
+			return NULL;
+
+		if (ftruncate(Fd, (off_t)Bytes) != 0)
+		{
+			close(Fd);
+			shm_unlink(pName);
+			return NULL;
+		}
+	}
+	else
+	{
+		Fd = shm_open(pName, O_RDONLY, 0);
+		if (Fd < 0)
+			return NULL;
+
+		if (fstat(Fd, &Stat) != 0 || (size_t)Stat.st_size < sizeof(SharedRingHeader_t))
+		{
+			close(Fd);
+			return NULL;
+		}
+		Bytes = (size_t)Stat.st_size;
+	}
+
+	pBase = mmap(NULL, Bytes, Create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, Fd, 0);
+	close(Fd);
+
+	if (pBase == MAP_FAILED)
+	{
+		if (Create)
+			shm_unlink(pName);
+		return NULL;
+	}
+
+	*pBytes = Bytes;
+
+	return pBase;
+#endif
+
+}// MapObject
+
+
+/*! Unmap a shared object.
+	\param pBase is the mapping.
+	\param Bytes is its size.
+	\param Mapping is the mapping handle on Windows.*/
+#ifdef WIN32
+static void UnmapObject(const void *pBase, size_t Bytes, HANDLE Mapping)
+{
+	(void)Bytes;
+
+	UnmapViewOfFile(pBase);
+	CloseHandle(Mapping);
+
+}// UnmapObject
+#else
+static void UnmapObject(const void *pBase, size_t Bytes)
+{
+	munmap((void *)pBase, Bytes);
+
+}// UnmapObject
+#endif
+
+
+/*! Create a ring, replacing any left under the same name.
+	\param pName is the object name, "/name" on POSIX hosts.
+	\param Slots is the number of samples held, rounded up to a power of two.
+	\return The writer, or NULL if the object couldn't be created.*/
+SharedRingWriter_t *shCreate(const char *pName, UInt32 Slots)
+{
+	SharedRingWriter_t *pWriter;
+	SharedRingHeader_t *pHeader;
+	UInt32 Size = 1, SlotBytes;
+
+	while (Size < Slots)
+		Size <<= 1;
+
+	// Each slot on its own cache lines, so the writer filling one doesn't disturb readers of the last
+	SlotBytes = (UInt32)((sizeof(SharedSlot_t) + CACHE_LINE_BYTES - 1) & ~(size_t)(CACHE_LINE_BYTES - 1));
+
+	pWriter = (SharedRingWriter_t *)calloc(1, sizeof(SharedRingWriter_t));
+	if (pWriter == NULL)
+		return NULL;
+
+	pWriter->pName = (char *)malloc(strlen(pName) + 1);
+	if (pWriter->pName == NULL)
+	{
+		free(pWriter);
+		return NULL;
+	}
+	strcpy(pWriter->pName, pName);
+
+#ifdef WIN32
+	pHeader = (SharedRingHeader_t *)MapObject(pName, sizeof(SharedRingHeader_t) + (size_t)Size * SlotBytes,
+											  TRUE, &pWriter->Bytes, &pWriter->Mapping);
+#else
+	pHeader = (SharedRingHeader_t *)MapObject(pName, sizeof(SharedRingHeader_t) + (size_t)Size * SlotBytes,
+											  TRUE, &pWriter->Bytes, NULL);
+#endif
+	if (pHeader == NULL)
+	{
+		free(pWriter->pName);
+		free(pWriter);
+		return NULL;
+	}
+
+	// New objects read as zeros, so no slot looks complete until written
+	pHeader->HeaderBytes = sizeof(SharedRingHeader_t);
+	pHeader->SlotBytes = SlotBytes;
+	pHeader->SampleBytes = sizeof(SharedSample_t);
+	pHeader->Slots = Size;
+	pHeader->Head = 0;
+	pHeader->Open = 1;
+
+	// Readers check the magic last
+	atomicFence();
+	memcpy(pHeader->Magic, SH_MAGIC, sizeof(pHeader->Magic));
+
+	pWriter->pHeader = pHeader;
+	pWriter->pSlots = (UInt8 *)pHeader + sizeof(SharedRingHeader_t);
+	pWriter->SlotBytes = SlotBytes;
+	pWriter->Mask = Size - 1;
+
+	return pWriter;
+
+}// shCreate
+
+
+/*! Publish a sample.  Never blocks; only one thread may publish to a ring.
+	\param pWriter is the writer.
+	\param pData is the decoded IMU data.
+	\param HostNs is the host arrival time of the sample.
+	\param Angle is the filtered angle.
+	\param Rate is the bias corrected rate.
+	\param Bias is the estimated gyro bias.*/
+void shPublish(SharedRingWriter_t *pWriter, const IMUData_t *pData, UInt64 HostNs,
+			   float Angle, float Rate, float Bias)
+{
+	UInt64 Index = pWriter->Head;
+	SharedSlot_t *pSlot = (SharedSlot_t *)(pWriter->pSlots + (size_t)(Index & pWriter->Mask) * pWriter->SlotBytes);
+
+	// Odd tells readers the slot is being replaced
+	atomicStoreRelaxed(&pSlot->Sequence, 2 * Index + 1);
+	atomicFence();
+
+	pSlot->Sample.Index = Index;
+	pSlot->Sample.HostNs = HostNs;
+	pSlot->Sample.Data = *pData;
+	pSlot->Sample.Angle = Angle;
+	pSlot->Sample.Rate = Rate;
+	pSlot->Sample.Bias = Bias;
+
+	atomicStoreRelease(&pSlot->Sequence, 2 * Index + 2);
+
+	pWriter->Head = Index + 1;
+	atomicStoreRelease(&pWriter->pHeader->Head, Index + 1);
+
+}// shPublish
+
+
+/*! Mark the ring closed for its readers, unmap and remove it.  Readers
+	still mapping it keep what's there.
+	\param pWriter is the writer, which is freed.*/
+void shClose(SharedRingWriter_t *pWriter)
+{
+	if (pWriter == NULL)
+		return;
+
+	atomicStoreRelease(&pWriter->pHeader->Open, 0);
+
+#ifdef WIN32
+	UnmapObject(pWriter->pHeader, pWriter->Bytes, pWriter->Mapping);
+#else
+	UnmapObject(pWriter->pHeader, pWriter->Bytes);
+	shm_unlink(pWriter->pName);
+#endif
+
+	free(pWriter->pName);
+	free(pWriter);
+
+}// shClose
+
+
+/*! Map a ring read-only.
+	\param pName is the object name given to shCreate().
+	\return The reader, or NULL if there's no ring of this build's layout.*/
+SharedRingReader_t *shOpen(const char *pName)
+{
+	SharedRingReader_t *pReader = (SharedRingReader_t *)calloc(1, sizeof(SharedRingReader_t));
+	const SharedRingHeader_t *pHeader;
+
+	if (pReader == NULL)
+		return NULL;
+
+#ifdef WIN32
+	pHeader = (const SharedRingHeader_t *)MapObject(pName, 0, FALSE, &pReader->Bytes, &pReader->Mapping);
+#else
+	pHeader = (const SharedRingHeader_t *)MapObject(pName, 0, FALSE, &pReader->Bytes, NULL);
+#endif
+	if (pHeader == NULL)
+	{
+		free(pReader);
+		return NULL;
+	}
+
+	if (memcmp(pHeader->Magic, SH_MAGIC, sizeof(pHeader->Magic)) != 0 ||
+		pHeader->SampleBytes != sizeof(SharedSample_t) ||
+		pHeader->SlotBytes < sizeof(SharedSlot_t) ||
+		pHeader->Slots == 0 || (pHeader->Slots & (pHeader->Slots - 1)) != 0 ||
+		pHeader->HeaderBytes + (size_t)pHeader->Slots * pHeader->SlotBytes > pReader->Bytes)
+	{
+#ifdef WIN32
+		UnmapObject(pHeader, pReader->Bytes, pReader->Mapping);
+#else
+		UnmapObject(pHeader, pReader->Bytes);
+#endif
+		free(pReader);
+		return NULL;
+	}
+
+	pReader->pHeader = pHeader;
+	pReader->pSlots = (const UInt8 *)pHeader + pHeader->HeaderBytes;
+	pReader->SlotBytes = pHeader->SlotBytes;
+	pReader->Mask = pHeader->Slots - 1;
+
+	return pReader;
+
+}// shOpen
+
+
+/*! Get the number of samples published.
+	\param pReader is the reader.
+	\return The index of the next sample to come.*/
+UInt64 shHead(const SharedRingReader_t *pReader)
+{
+	return atomicLoadAcquire(&pReader->pHeader->Head);
+
+}// shHead
+
+
+/*! Find out if the writer still runs.
+	\param pReader is the reader.
+	\return FALSE once the writer closed the ring.*/
+BOOL shWriterOpen(const SharedRingReader_t *pReader)
+{
+	return atomicLoadAcquire(&pReader->pHeader->Open) != 0;
+
+}// shWriterOpen
+
+
+/*! Get the size of the ring.
+	\param pReader is the reader.
+	\return The number of samples it holds.*/
+UInt32 shSlots(const SharedRingReader_t *pReader)
+{
+	return pReader->Mask + 1;
+
+}// shSlots
+
+
+/*! Find the slot a sample goes in.
+	\param pReader is the reader.
+	\param Index is the sample number.
+	\return The slot.*/
+static const SharedSlot_t *Slot(const SharedRingReader_t *pReader, UInt64 Index)
+{
+	return (const SharedSlot_t *)(pReader->pSlots + (size_t)(Index & pReader->Mask) * pReader->SlotBytes);
+
+}// Slot
+
+
+/*! Get a sample to use in place, without copying it.  Check it with
+	shIntact() after using it; the writer may have replaced it meanwhile.
+	\param pReader is the reader.
+	\param Index is the sample number.
+	\return The sample, or NULL if it isn't published yet or is gone.*/
+const SharedSample_t *shPeek(const SharedRingReader_t *pReader, UInt64 Index)
+{
+	const SharedSlot_t *pSlot = Slot(pReader, Index);
+
+	if (atomicLoadAcquire(&pSlot->Sequence) != 2 * Index + 2)
+		return NULL;
+
+	return &pSlot->Sample;
+
+}// shPeek
+
+
+/*! Check a sample got from shPeek() is still there, after using it.
+	\param pReader is the reader.
+	\param Index is the sample number.
+	\return TRUE if what was read of it is consistent.*/
+BOOL shIntact(const SharedRingReader_t *pReader, UInt64 Index)
+{
+	// Reads of the sample must be done before the sequence is checked again
+	atomicFence();
+
+	return atomicLoadRelaxed(&Slot(pReader, Index)->Sequence) == 2 * Index + 2;
+
+}// shIntact
+
+
+/*! Copy a sample.
+	\param pReader is the reader.
+	\param Index is the sample number.
+	\param pSample receives the sample.
+	\return SH_OK, SH_NOT_YET or SH_OVERWRITTEN.*/
+SharedStatus_t shRead(const SharedRingReader_t *pReader, UInt64 Index, SharedSample_t *pSample)
+{
+	const SharedSample_t *pShared;
+
+	if (Index >= shHead(pReader))
+		return SH_NOT_YET;
+
+	pShared = shPeek(pReader, Index);
+	if (pShared == NULL)
+		return SH_OVERWRITTEN;
+
+	*pSample = *pShared;
+
+	return shIntact(pReader, Index) ? SH_OK : SH_OVERWRITTEN;
+
+}// shRead
+
+
+/*! Copy the next sample, skipping ahead to the oldest one held if the
+	writer lapped the reader.
+	\param pReader is the reader.
+	\param pCursor is the next sample number wanted, moved past the one
+		   copied.  Start it at shHead() for new samples only, or 0 for all
+		   those still held.
+	\param pSample receives the sample.
+	\param pLost has the number of samples skipped added, may be NULL.
+	\return SH_OK, or SH_NOT_YET if the reader is up to date.*/
+SharedStatus_t shNext(const SharedRingReader_t *pReader, UInt64 *pCursor, SharedSample_t *pSample, UInt64 *pLost)
+{
+	UInt64 Head = shHead(pReader), Oldest;
+
+	for (;;)
+	{
+		if (*pCursor >= Head)
+			return SH_NOT_YET;
+
+		// Half a ring of margin so the writer doesn't lap the skip itself
+		Oldest = (Head > pReader->Mask + 1) ? Head - (pReader->Mask + 1) / 2 : 0;
+		if (*pCursor < Oldest && shPeek(pReader, *pCursor) == NULL)
+		{
+			if (pLost)
+				*pLost += Oldest - *pCursor;
+			*pCursor = Oldest;
+		}
+
+		if (shRead(pReader, *pCursor, pSample) == SH_OK)
+		{
+			(*pCursor)++;
+			return SH_OK;
+		}
+
+		// Lapped while copying
+		Head = shHead(pReader);
+		if (pLost)
+			(*pLost)++;
+		(*pCursor)++;
+	}
+
+}// shNext
+
+
+/*! Unmap a ring.
+	\param pReader is the reader, which is freed.*/
+void shCloseReader(SharedRingReader_t *pReader)
+{
+	if (pReader == NULL)
+		return;
+
+#ifdef WIN32
+	UnmapObject(pReader->pHeader, pReader->Bytes, pReader->Mapping);
+#else
+	UnmapObject(pReader->pHeader, pReader->Bytes);
+#endif
+
+	free(pReader);
+
+}// shCloseReader
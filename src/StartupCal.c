@@ -0,0 +1,316 @@
+/*! \file
+	\brief Startup gyro bias calibration and filter warm start.
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include "StartupCal.h"
+
+#define CAL_GRAVITY			9.81f
+
+// Default stationarity thresholds, generous enough for sensor noise
+#define CAL_RATE_TOL		2.0f	// deg/s
+#define CAL_ACCEL_TOL		0.5f	// m/s/s
+
+// Smallest variance seeded into the covariance, keeps the gain alive
+#define CAL_MIN_VARIANCE	1.0e-6f
+
+// The same in fixed point
+#define CAL_GRAVITY_Q		FLOAT_TO_Q16(CAL_GRAVITY)
+#define CAL_MIN_VARIANCE_Q	FLOAT_TO_Q24(CAL_MIN_VARIANCE)
+
+
+/*! Initialize a startup calibration.
+	\param pCal points to the calibration to initialize.
+	\param Samples is the number of consecutive stationary samples to average.*/
+void calInit(StartupCal_t *pCal, UInt32 Samples)
+{
+	pCal->Needed = Samples ? Samples : 1;
+	pCal->RateTol = CAL_RATE_TOL;
+	pCal->AccelTol = CAL_ACCEL_TOL;
+
+	pCal->Count = 0;
+	pCal->Restarts = 0;
+	pCal->SumRate = 0;
+	pCal->SumSqRate = 0;
+	pCal->SumTilt = 0;
+	pCal->SumSqTilt = 0;
+
+}// calInit
+
+
+/*! Add a sample to the startup average.  A sample is stationary if the
+	acceleration magnitude is close to 1 g and the rate is close to the mean
+	of the samples accumulated so far; otherwise the average restarts.
+	\param pCal points to the calibration.
+	\param Tilt is the accelerometer tilt of the filtered axis, in degrees.
+	\param Rate is the raw gyro rate of the filtered axis, in deg/s.
+	\param Accel holds the X, Y and Z accelerations in m/s/s.
+	\return TRUE once enough stationary samples have been averaged.*/
+BOOL calAddSample(StartupCal_t *pCal, float Tilt, float Rate, const float Accel[3])
+{
+	float Norm = sqrtf(Accel[0] * Accel[0] + Accel[1] * Accel[1] + Accel[2] * Accel[2]);
+	BOOL Moving = (fabsf(Norm - CAL_GRAVITY) > pCal->AccelTol);
+
+	if (pCal->Count > 0)
+	{
+		float MeanRate = (float)(pCal->SumRate / pCal->Count);
+
+		if (fabsf(Rate - MeanRate) > pCal->RateTol)
+			Moving = TRUE;
+	}
+
+	if (Moving)
+	{
+		if (pCal->Count > 0)
+			pCal->Restarts++;
+
+		pCal->Count = 0;
+		pCal->SumRate = 0;
+		pCal->SumSqRate = 0;
+		pCal->SumTilt = 0;
+		pCal->SumSqTilt = 0;
+
+		return FALSE;
+	}
+
+	pCal->Count++;
+	pCal->SumRate += Rate;
+	pCal->SumSqRate += (double)Rate * Rate;
+	pCal->SumTilt += Tilt;
+	pCal->SumSqTilt += (double)Tilt * Tilt;
+
+	return (pCal->Count >= pCal->Needed);
+
+}// calAddSample
+
+
+/*! Seed a filter with the result of the startup average.  The angle and bias
+	become the sample means and the covariance the variance of those means.
+	\param pCal points to a calibration for which calAddSample() returned TRUE.
+	\param pKF points to the filter to seed.*/
+void calApply(const StartupCal_t *pCal, KFilter_t *pKF)
+{
+	double N = pCal->Count;
+	double MeanRate, MeanTilt, VarRate, VarTilt;
+
+	if (pCal->Count == 0)
+		return;
+
+	MeanRate = calGetBias(pCal);
+	MeanTilt = calGetTilt(pCal);
+	VarRate = pCal->SumSqRate / N - MeanRate * MeanRate;
+	VarTilt = pCal->SumSqTilt / N - MeanTilt * MeanTilt;
+
+	pKF->angle = (float)MeanTilt;
+	pKF->bias = (float)MeanRate;
+	pKF->rate = 0;
+
+	// Uncertainty of the means, not of single samples
+	pKF->P[0][0] = (float)(VarTilt / N);
+	pKF->P[0][1] = 0;
+	pKF->P[1][0] = 0;
+	pKF->P[1][1] = (float)(VarRate / N);
+
+	if (pKF->P[0][0] < CAL_MIN_VARIANCE)
+		pKF->P[0][0] = CAL_MIN_VARIANCE;
+	if (pKF->P[1][1] < CAL_MIN_VARIANCE)
+		pKF->P[1][1] = CAL_MIN_VARIANCE;
+
+}// calApply
+
+
+/*! Get the average tilt of the stationary samples.
+	\param pCal points to the calibration.
+	\return The mean tilt in degrees, or 0 if no samples were averaged.*/
+float calGetTilt(const StartupCal_t *pCal)
+{
+	return pCal->Count ? (float)(pCal->SumTilt / pCal->Count) : 0.0f;
+
+}// calGetTilt
+
+
+/*! Get the average rate of the stationary samples, i.e. the gyro bias.
+	\param pCal points to the calibration.
+	\return The mean rate in deg/s, or 0 if no samples were averaged.*/
+float calGetBias(const StartupCal_t *pCal)
+{
+	return pCal->Count ? (float)(pCal->SumRate / pCal->Count) : 0.0f;
+
+}// calGetBias
+
+
+/*! Initialize a fixed point startup calibration, see calInit().
+	\param pCal points to the calibration to initialize.
+	\param Samples is the number of consecutive stationary samples to average.*/
+void calInitQ(StartupCalQ_t *pCal, UInt32 Samples)
+{
+	pCal->Needed = Samples ? Samples : 1;
+	pCal->RateTol = FLOAT_TO_Q16(CAL_RATE_TOL);
+	pCal->AccelTol = FLOAT_TO_Q16(CAL_ACCEL_TOL);
+
+	pCal->Count = 0;
+	pCal->Restarts = 0;
+	pCal->SumRate = 0;
+	pCal->SumSqRate = 0;
+	pCal->SumTilt = 0;
+	pCal->SumSqTilt = 0;
+
+}// calInitQ
+
+
+/*! Add a fixed point sample to the startup average, see calAddSample().
+	The magnitude is compared squared, so no square root is needed.
+	\param pCal points to the calibration.
+	\param Tilt is the accelerometer tilt of the filtered axis, Q16.16 degrees.
+	\param Rate is the raw gyro rate of the filtered axis, Q16.16 deg/s.
+	\param Accel holds the X, Y and Z accelerations in Q16.16 m/s/s.
+	\return TRUE once enough stationary samples have been averaged.*/
+BOOL calAddSampleQ(StartupCalQ_t *pCal, Q16_t Tilt, Q16_t Rate, const Q16_t Accel[3])
+{
+	SInt64 Norm2 = (SInt64)Accel[0] * Accel[0] + (SInt64)Accel[1] * Accel[1] + (SInt64)Accel[2] * Accel[2];
+	SInt64 Low = CAL_GRAVITY_Q - pCal->AccelTol, High = CAL_GRAVITY_Q + pCal->AccelTol;
+	BOOL Moving = (Norm2 < Low * Low) || (Norm2 > High * High);
+
+	if (pCal->Count > 0)
+	{
+		SInt64 Deviation = Rate - pCal->SumRate / (SInt64)pCal->Count;
+
+		if (Deviation > pCal->RateTol || -Deviation > pCal->RateTol)
+			Moving = TRUE;
+	}
+
+	if (Moving)
+	{
+		if (pCal->Count > 0)
+			pCal->Restarts++;
+
+		pCal->Count = 0;
+		pCal->SumRate = 0;
+		pCal->SumSqRate = 0;
+		pCal->SumTilt = 0;
+		pCal->SumSqTilt = 0;
+
+		return FALSE;
+	}
+
+	pCal->Count++;
+	pCal->SumRate += Rate;
+	pCal->SumSqRate += (SInt64)Rate * Rate;
+	pCal->SumTilt += Tilt;
+	pCal->SumSqTilt += (SInt64)Tilt * Tilt;
+
+	return (pCal->Count >= pCal->Needed);
+
+}// calAddSampleQ
+
+
+/*! Variance of the mean of a run of samples.
+	\param Sum is the sum of the samples, Q16.16.
+	\param SumSq is the sum of their squares, Q32.32.
+	\param N is the number of samples.
+	\return The variance of their mean, Q8.24, at least CAL_MIN_VARIANCE.*/
+static Q24_t MeanVarianceQ(SInt64 Sum, SInt64 SumSq, SInt64 N)
+{
+	SInt64 Mean = Sum / N;
+	SInt64 Var = (SumSq / N - Mean * Mean) / N;
+
+	// Q32.32 to Q8.24
+	Var >>= 8;
+	if (Var < CAL_MIN_VARIANCE_Q)
+		Var = CAL_MIN_VARIANCE_Q;
+	if (Var > 0x7FFFFFFF)
+		Var = 0x7FFFFFFF;
+
+	return (Q24_t)Var;
+
+}// MeanVarianceQ
+
+
+/*! Seed a fixed point filter with the result of the startup average, see
+	calApply().
+	\param pCal points to a calibration for which calAddSampleQ() returned TRUE.
+	\param pKF points to the filter to seed.*/
+void calApplyQ(const StartupCalQ_t *pCal, KFilterQ_t *pKF)
+{
+	SInt64 N = pCal->Count;
+
+	if (pCal->Count == 0)
+		return;
+
+	pKF->angle = calGetTiltQ(pCal);
+	pKF->bias = (Q16_t)(pCal->SumRate / N);
+	pKF->rate = 0;
+
+	pKF->P[0][0] = MeanVarianceQ(pCal->SumTilt, pCal->SumSqTilt, N);
+	pKF->P[0][1] = 0;
+	pKF->P[1][0] = 0;
+	pKF->P[1][1] = MeanVarianceQ(pCal->SumRate, pCal->SumSqRate, N);
+
+}// calApplyQ
+
+
+/*! Get the average tilt of the stationary fixed point samples.
+	\param pCal points to the calibration.
+	\return The mean tilt in Q16.16 degrees, or 0 if no samples were averaged.*/
+Q16_t calGetTiltQ(const StartupCalQ_t *pCal)
+{
+	return pCal->Count ? (Q16_t)(pCal->SumTilt / (SInt64)pCal->Count) : 0;
+
+}// calGetTiltQ
+
+
+/*! Save the converged bias and covariance of a filter.
+	\param pKF points to the filter to save.
+	\param pPath is the name of the file to write.
+	\return TRUE if the file was written.*/
+BOOL calSaveState(const KFilter_t *pKF, const char *pPath)
+{
+	FILE *pFile = fopen(pPath, "w");
+	BOOL Ok;
+
+	if (pFile == NULL)
+		return FALSE;
+
+	Ok = fprintf(pFile, "%.9g %.9g %.9g %.9g %.9g\n", pKF->bias,
+				 pKF->P[0][0], pKF->P[0][1], pKF->P[1][0], pKF->P[1][1]) > 0;
+
+	if (fclose(pFile) != 0)
+		Ok = FALSE;
+
+	return Ok;
+
+}// calSaveState
+
+
+/*! Load a bias and covariance saved by calSaveState() into a filter.  The
+	angle is left alone; seed it from the accelerometers.
+	\param pKF points to the filter to load.
+	\param pPath is the name of the file to read.
+	\return TRUE if the file held a valid state, otherwise the filter is
+			unchanged and FALSE is returned.*/
+BOOL calLoadState(KFilter_t *pKF, const char *pPath)
+{
+	FILE *pFile = fopen(pPath, "r");
+	float Bias, P00, P01, P10, P11;
+	int Fields;
+
+	if (pFile == NULL)
+		return FALSE;
+
+	Fields = fscanf(pFile, "%f %f %f %f %f", &Bias, &P00, &P01, &P10, &P11);
+	fclose(pFile);
+
+	// Reject short files and anything that isn't a covariance
+	if ((Fields != 5) || !(P00 >= 0) || !(P11 >= 0) || (Bias != Bias))
+		return FALSE;
+
+	pKF->bias = Bias;
+	pKF->P[0][0] = P00;
+	pKF->P[0][1] = P01;
+	pKF->P[1][0] = P10;
+	pKF->P[1][1] = P11;
+
+	return TRUE;
+
+}// calLoadState
@@ -0,0 +1,420 @@
+/*! \file
+	\brief Asynchronous binary telemetry logger.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "Atomic.h"
+#include "HostTime.h"
+#include "TelemetryLog.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// Largest number of records handed to one fwrite()
+#define TLM_BATCH_RECORDS	256
+
+// Writer thread idle period when the queue is empty
+#define TLM_IDLE_MS			2
+
+struct TelemetryLog_t
+{
+	// Producer side
+	volatile UInt32 Head;					//!< Records pushed
+	UInt32 Produced;						//!< Records offered, including dropped ones
+	volatile UInt32 Dropped;				//!< Records dropped because the queue was full
+	char Pad0[CACHE_LINE_BYTES];
+
+	// Consumer side
+	volatile UInt32 Tail;					//!< Records written
+	volatile UInt32 Lost;					//!< Records a failed write left out of the file
+	volatile UInt32 Stop;					//!< Set to ask the writer to drain and exit
+	char Pad1[CACHE_LINE_BYTES];
+
+	// Job handed over by tlDefer()
+	volatile UInt32 JobPending;				//!< Set once pJob and pJobArg are filled in
+	TelemetryJob_t pJob;
+	void *pJobArg;
+	char Pad2[CACHE_LINE_BYTES];
+
+	UInt32 Mask;							//!< Capacity - 1, capacity is a power of two
+	TelemetryRecord_t *pRing;				//!< Queue storage
+	FILE *pFile;							//!< Output file
+
+#ifdef WIN32
+	HANDLE Thread;
+#else
+	pthread_t Thread;
+#endif
+};
+
+// Schema written into every file
+#define TLM_FIELD(name, type, count) \
+	{ #name, type, count, (uint16_t)offsetof(TelemetryRecord_t, name) }
+
+static const TelemetryField_t TelemetrySchema[] =
+{
+	TLM_FIELD(HostNs,         TLM_TYPE_U64, 1),
+	TLM_FIELD(Index,          TLM_TYPE_U32, 1),
+	TLM_FIELD(TimeSincePPS,   TLM_TYPE_F32, 1),
+	TLM_FIELD(Sensors,        TLM_TYPE_F32, N_SENSOR_IDX),
+	TLM_FIELD(Angle,          TLM_TYPE_F32, 1),
+	TLM_FIELD(Bias,           TLM_TYPE_F32, 1),
+	TLM_FIELD(SequenceNumber, TLM_TYPE_U8,  1),
+	TLM_FIELD(PPSCount,       TLM_TYPE_U8,  1),
+};
+
+#define TLM_FIELD_COUNT (sizeof(TelemetrySchema) / sizeof(TelemetrySchema[0]))
+
+
+/*! Write all queued records to the file, counting those a failed write
+	left out.
+	\param pLog points to the logger.
+	\return The number of records taken off the queue.*/
+static UInt32 DrainQueue(TelemetryLog_t *pLog)
+{
+	UInt32 Tail = pLog->Tail;
+	UInt32 Head = atomicLoadAcquire(&pLog->Head);
+	UInt32 Written = 0, Done;
+
+	while (Tail != Head)
+	{
+		UInt32 Start = Tail & pLog->Mask;
+		UInt32 Count = Head - Tail;
+
+		// Don't run past the end of the ring or the batch limit
+		if (Count > pLog->Mask + 1 - Start)
+			Count = pLog->Mask + 1 - Start;
+		if (Count > TLM_BATCH_RECORDS)
+			Count = TLM_BATCH_RECORDS;
+
+		Done = (UInt32)fwrite(&pLog->pRing[Start], sizeof(TelemetryRecord_t), Count, pLog->pFile);
+		if (Done != Count)
+			atomicStoreRelaxed(&pLog->Lost, pLog->Lost + Count - Done);
+
+		Tail += Count;
+		Written += Count;
+		atomicStoreRelease(&pLog->Tail, Tail);
+	}
+
+	return Written;
+
+}// DrainQueue
+
+
+/*! Run the job handed over by tlDefer(), if there is one.
+	\param pLog points to the logger.
+	\return TRUE if a job was run.*/
+static BOOL RunJob(TelemetryLog_t *pLog)
+{
+	if (!atomicLoadAcquire(&pLog->JobPending))
+		return FALSE;
+
+	pLog->pJob(pLog->pJobArg);
+	atomicStoreRelease(&pLog->JobPending, 0);
+
+	return TRUE;
+
+}// RunJob
+
+
+/*! Background writer, runs until tlClose() sets Stop.
+	\param pArg points to the logger.*/
+#ifdef WIN32
+static DWORD WINAPI WriterThread(LPVOID pArg)
+#else
+static void *WriterThread(void *pArg)
+#endif
+{
+	TelemetryLog_t *pLog = (TelemetryLog_t *)pArg;
+
+	while (!atomicLoadAcquire(&pLog->Stop))
+	{
+		if (DrainQueue(pLog) == 0 && !RunJob(pLog))
+			htSleepMs(TLM_IDLE_MS);
+	}
+
+	// Get whatever arrived before the stop request
+	DrainQueue(pLog);
+	RunJob(pLog);
+
+	return 0;
+
+}// WriterThread
+
+
+/*! Create a log file and start its writer thread.
+	\param pPath is the name of the file to create.
+	\param Capacity is the number of records the queue can hold, rounded up
+		   to a power of two.  Size it for the longest expected disk stall.
+	\return The logger, or NULL if it could not be created.*/
+TelemetryLog_t *tlOpen(const char *pPath, UInt32 Capacity)
+{
+	TelemetryLog_t *pLog;
+	TelemetryFileHeader_t Header;
+	UInt32 Size = 1;
+
+	while (Size < Capacity)
+		Size <<= 1;
+
+	pLog = (TelemetryLog_t *)calloc(1, sizeof(TelemetryLog_t));
+	if (pLog == NULL)
+		return NULL;
+
+	pLog->Mask = Size - 1;
+	pLog->pRing = (TelemetryRecord_t *)calloc(Size, sizeof(TelemetryRecord_t));
+	pLog->pFile = fopen(pPath, "wb");
+
+	if ((pLog->pRing == NULL) || (pLog->pFile == NULL))
+	{
+		if (pLog->pFile)
+			fclose(pLog->pFile);
+		free(pLog->pRing);
+		free(pLog);
+		return NULL;
+	}
+
+	// Header and schema
+	memset(&Header, 0, sizeof(Header));
+	memcpy(Header.Magic, TLM_MAGIC, sizeof(Header.Magic));
+	Header.ByteOrder = TLM_BYTE_ORDER_MARK;
+	Header.HeaderBytes = (uint16_t)(sizeof(Header) + sizeof(TelemetrySchema));
+	Header.RecordBytes = (uint16_t)sizeof(TelemetryRecord_t);
+	Header.FieldCount = (uint16_t)TLM_FIELD_COUNT;
+
+	// A log that can't take its header can't be read back
+	if ((fwrite(&Header, sizeof(Header), 1, pLog->pFile) != 1) ||
+		(fwrite(TelemetrySchema, sizeof(TelemetrySchema), 1, pLog->pFile) != 1) ||
+#ifdef WIN32
+		((pLog->Thread = CreateThread(NULL, 0, WriterThread, pLog, 0, NULL)) == NULL))
+#else
+		(pthread_create(&pLog->Thread, NULL, WriterThread, pLog) != 0))
+#endif
+	{
+		fclose(pLog->pFile);
+		free(pLog->pRing);
+		free(pLog);
+		return NULL;
+	}
+
+	return pLog;
+
+}// tlOpen
+
+
+/*! Queue a record for writing.  Never blocks; only the thread that owns the
+	serial port may call this.
+	\param pLog points to the logger.
+	\param pRecord points to the record to copy.  Its Index is assigned here.
+	\return TRUE if queued, FALSE if the queue was full and it was dropped.*/
+BOOL tlPush(TelemetryLog_t *pLog, const TelemetryRecord_t *pRecord)
+{
+	UInt32 Head = pLog->Head;
+	TelemetryRecord_t *pSlot;
+
+	if (Head - atomicLoadAcquire(&pLog->Tail) > pLog->Mask)
+	{
+		pLog->Produced++;
+		atomicStoreRelaxed(&pLog->Dropped, pLog->Dropped + 1);
+		return FALSE;
+	}
+
+	pSlot = &pLog->pRing[Head & pLog->Mask];
+	*pSlot = *pRecord;
+	pSlot->Index = pLog->Produced++;
+
+	atomicStoreRelease(&pLog->Head, Head + 1);
+
+	return TRUE;
+
+}// tlPush
+
+
+/*! Hand a job to the writer thread, which runs it once between batches.
+	Never blocks; only one job can wait at a time.
+	\param pLog points to the logger.
+	\param pJob is the job, e.g. one writing a file.
+	\param pArg is passed to the job, and must stay valid until it has run.
+	\return TRUE if handed over, FALSE if the last job hasn't run yet.*/
+BOOL tlDefer(TelemetryLog_t *pLog, TelemetryJob_t pJob, void *pArg)
+{
+	if (atomicLoadAcquire(&pLog->JobPending))
+		return FALSE;
+
+	pLog->pJob = pJob;
+	pLog->pJobArg = pArg;
+	atomicStoreRelease(&pLog->JobPending, 1);
+
+	return TRUE;
+
+}// tlDefer
+
+
+/*! Fill a record from decoded IMU data and the filter output.
+	\param pRecord points to the record to fill.
+	\param pData points to the IMU data of the sample.
+	\param HostNs is the host arrival time of the sample.
+	\param Angle is the filtered angle.
+	\param Bias is the estimated gyro bias.*/
+void tlFillRecord(TelemetryRecord_t *pRecord, const IMUData_t *pData, UInt64 HostNs,
+				  float Angle, float Bias)
+{
+	int i;
+
+	pRecord->HostNs = HostNs;
+	pRecord->Index = 0;
+	pRecord->TimeSincePPS = pData->TimeSincePPS;
+	for (i = 0; i < N_SENSOR_IDX; i++)
+		pRecord->Sensors[i] = pData->SensorsConverted[i];
+	pRecord->Angle = Angle;
+	pRecord->Bias = Bias;
+	pRecord->SequenceNumber = pData->SequenceNumber;
+	pRecord->PPSCount = pData->PPSCount;
+	memset(pRecord->Reserved, 0, sizeof(pRecord->Reserved));
+
+}// tlFillRecord
+
+
+/*! Get the number of records dropped because the queue was full.
+	\param pLog points to the logger.
+	\return The number of dropped records.*/
+UInt32 tlDropped(const TelemetryLog_t *pLog)
+{
+	return atomicLoadRelaxed(&pLog->Dropped);
+
+}// tlDropped
+
+
+/*! Get the number of records a failed write left out of the file.  Safe
+	from any thread.
+	\param pLog points to the logger.
+	\return The number of lost records.*/
+UInt32 tlLost(const TelemetryLog_t *pLog)
+{
+	return atomicLoadRelaxed(&pLog->Lost);
+
+}// tlLost
+
+
+/*! Get the number of records waiting to be written.  Safe from any thread.
+	\param pLog points to the logger.
+	\return The queue depth.*/
+UInt32 tlDepth(const TelemetryLog_t *pLog)
+{
+	// Tail first, so it can't have passed the Head read
+	UInt32 Tail = atomicLoadAcquire(&pLog->Tail);
+
+	return atomicLoadAcquire(&pLog->Head) - Tail;
+
+}// tlDepth
+
+
+/*! Write out everything queued, stop the writer thread and close the file.
+	\param pLog points to the logger, which is freed.
+	\return FALSE if any record was dropped or could not be written, or the
+			file could not be closed.*/
+BOOL tlClose(TelemetryLog_t *pLog)
+{
+	BOOL Ok;
+
+	if (pLog == NULL)
+		return FALSE;
+
+	atomicStoreRelease(&pLog->Stop, 1);
+
+#ifdef WIN32
+	WaitForSingleObject(pLog->Thread, INFINITE);
+	CloseHandle(pLog->Thread);
+#else
+	pthread_join(pLog->Thread, NULL);
+#endif
+
+	Ok = (pLog->Dropped == 0) && (pLog->Lost == 0);
+	if (fclose(pLog->pFile) != 0)
+		Ok = FALSE;
+	free(pLog->pRing);
+	free(pLog);
+
+	return Ok;
+
+}// tlClose
+
+
+#ifdef TELEMETRYLOG_TEST
+
+#define TLM_TEST_FILE	"tlmtest.tlm"
+
+/*! Measure the cost of tlPush() on the producer thread, check every record
+	queued reaches the file, and on Linux that writes to a full disk are
+	counted as lost.
+	\return TRUE if the records in the file and the counts agree.*/
+BOOL TestTelemetryLog(void)
+{
+	TelemetryLog_t *pLog = tlOpen(TLM_TEST_FILE, 1 << 20);
+	TelemetryRecord_t Record;
+	IMUData_t Data;
+	UInt64 Start, Stop;
+	UInt32 i, N = 1000000, Dropped;
+	BOOL Closed, Ok;
+	FILE *pFile;
+	long Bytes = -1;
+
+	if (pLog == NULL)
+		return FALSE;
+
+	memset(&Data, 0, sizeof(Data));
+
+	Start = htNowNs();
+	for (i = 0; i < N; i++)
+	{
+		Data.SensorsConverted[GYROX_IDX] = (float)i;
+		tlFillRecord(&Record, &Data, Start, 0.0f, 0.0f);
+		tlPush(pLog, &Record);
+	}
+	Stop = htNowNs();
+
+	Dropped = tlDropped(pLog);
+	printf("tlFillRecord + tlPush: %.1f ns/record, %lu of %lu dropped\n",
+		   (double)(Stop - Start) / N, (unsigned long)Dropped, (unsigned long)N);
+
+	Closed = tlClose(pLog);
+
+	if ((pFile = fopen(TLM_TEST_FILE, "rb")) != NULL)
+	{
+		fseek(pFile, 0, SEEK_END);
+		Bytes = ftell(pFile);
+		fclose(pFile);
+	}
+	remove(TLM_TEST_FILE);
+
+	Ok = (Bytes == (long)(sizeof(TelemetryFileHeader_t) + sizeof(TelemetrySchema) +
+						  (N - Dropped) * sizeof(TelemetryRecord_t))) &&
+		 (Closed == (Dropped == 0));
+
+#ifdef __linux__
+	// Every write to /dev/full fails, once past the stdio buffer
+	if ((pLog = tlOpen("/dev/full", 1 << 10)) != NULL)
+	{
+		for (i = 0; i < 1000; i++)
+		{
+			while (!tlPush(pLog, &Record))
+				htSleepMs(1);
+		}
+		while (tlDepth(pLog))
+			htSleepMs(1);
+
+		printf("/dev/full: %lu of 1000 records lost\n", (unsigned long)tlLost(pLog));
+		Ok = Ok && (tlLost(pLog) > 0) && !tlClose(pLog);
+	}
+#endif
+
+	return Ok;
+
+}// TestTelemetryLog
+
+#endif
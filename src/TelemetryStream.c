@@ -0,0 +1,865 @@
+/*! \file
+	\brief Batched telemetry streaming over UDP or Unix datagram sockets.
+*/
+
+#ifndef WIN32
+#define _GNU_SOURCE							// sendmmsg() and recvmmsg()
+#endif
+
+#ifdef WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Atomic.h"
+#include "HostTime.h"
+#include "TelemetryStream.h"
+
+// Datagrams handed to one sendmmsg() or taken by one recvmmsg()
+#define TS_BATCH			32
+
+// Longest the sender thread sleeps when the queue is empty
+#define TS_IDLE_NS			1000000
+
+// Sample times are 32 bit offsets, so no datagram may span more than this
+#define TS_MAX_DELAY_US		1000000
+
+#ifdef WIN32
+typedef SOCKET Socket_t;
+typedef int socklen_t;
+#else
+typedef int Socket_t;
+#define INVALID_SOCKET		(-1)
+#define closesocket			close
+#endif
+
+//! A parsed destination or local name
+typedef struct
+{
+	struct sockaddr_storage Addr;
+	socklen_t Bytes;
+	int Family;
+} Address_t;
+
+struct TelemetryStream_t
+{
+	// Producer side
+	volatile UInt32 Head;					//!< Records pushed
+	UInt32 Produced;						//!< Records offered, including dropped ones
+	volatile UInt32 Dropped;				//!< Records dropped because the queue was full
+	char Pad0[CACHE_LINE_BYTES];
+
+	// Consumer side
+	volatile UInt32 Tail;					//!< Records packed
+	volatile UInt32 Stop;					//!< Set to ask the sender to drain and exit
+	char Pad1[CACHE_LINE_BYTES];
+
+	UInt32 Mask;							//!< Capacity - 1, capacity is a power of two
+	TelemetryRecord_t *pRing;				//!< Queue storage
+	TelemetryStreamConfig_t Config;
+	Socket_t Socket;
+	Address_t Dest;
+
+	// Sender thread only
+	UInt8 (*pDatagrams)[TS_MAX_DATAGRAM];	//!< TS_BATCH datagrams
+	UInt32 Ready;							//!< Datagrams complete, the next one is being filled
+	UInt32 Sequence;						//!< Number of the next datagram
+	UInt32 NextIndex;						//!< Index expected of the next record
+	UInt32 Skipped;							//!< Samples dropped so far, for the headers
+	UInt64 PeriodNs;						//!< Time between samples at MaxRateHz, 0 for no limit
+	UInt64 LastNs;							//!< Time of the last record, for the rate limit
+	UInt64 CreditNs;						//!< Sample time the rate limit has to spend
+	BOOL Started;							//!< TRUE once a record was packed
+	TelemetryStreamStats_t Stats;
+
+#ifdef WIN32
+	HANDLE Thread;
+#else
+	pthread_t Thread;
+#endif
+};
+
+struct TelemetryReceiver_t
+{
+	Socket_t Socket;
+	Address_t Local;
+	UInt8 (*pDatagrams)[TS_MAX_DATAGRAM];	//!< TS_BATCH datagrams
+	BOOL Started;							//!< TRUE once a datagram was taken
+	UInt32 NextSequence;					//!< Sequence expected of the next datagram
+	UInt32 NextIndex;						//!< Index expected of the next sample
+	UInt32 LastDropped;						//!< Dropped of the last datagram
+	TelemetryReceiverStats_t Stats;
+};
+
+
+/*! Parse a destination or local name.
+	\param pName is "udp:host:port" or "unix:path".
+	\param Passive is TRUE for a name to bind to, where host may be empty.
+	\param pAddress receives the address.
+	\return TRUE if it could be parsed and resolved.*/
+static BOOL ParseAddress(const char *pName, BOOL Passive, Address_t *pAddress)
+{
+	memset(pAddress, 0, sizeof(*pAddress));
+
+	if (strncmp(pName, "udp:", 4) == 0)
+	{
+		struct addrinfo Hints, *pInfo;
+		const char *pPort = strrchr(pName + 4, ':');
+		char Host[TS_NAME_BYTES];
+		size_t Length;
+
+		if (pPort == NULL)
+			return FALSE;
+
+		// IPv6 hosts come in brackets, to tell their colons from the port's
+		Length = (size_t)(pPort - (pName + 4));
+		if (Length >= sizeof(Host))
+			return FALSE;
+		memcpy(Host, pName + 4, Length);
+		Host[Length] = 0;
+		if (Length >= 2 && Host[0] == '[' && Host[Length - 1] == ']')
+		{
+			memmove(Host, Host + 1, Length - 2);
+			Host[Length - 2] = 0;
+		}
+
+		memset(&Hints, 0, sizeof(Hints));
+		Hints.ai_family = AF_UNSPEC;
+		Hints.ai_socktype = SOCK_DGRAM;
+		Hints.ai_flags = AI_NUMERICSERV | (Passive ? AI_PASSIVE : 0);
+
+		if (getaddrinfo(Host[0] ? Host : NULL, pPort + 1, &Hints, &pInfo) != 0)
+			return FALSE;
+
+		memcpy(&pAddress->Addr, pInfo->ai_addr, pInfo->ai_addrlen);
+		pAddress->Bytes = (socklen_t)pInfo->ai_addrlen;
+		pAddress->Family = pInfo->ai_family;
+		freeaddrinfo(pInfo);
+
+		return TRUE;
+	}
+
+#ifndef WIN32
+	if (strncmp(pName, "unix:", 5) == 0)
+	{
+		struct sockaddr_un *pUnix = (struct sockaddr_un *)&pAddress->Addr;
+
+		if (pName[5] == 0 || strlen(pName + 5) >= sizeof(pUnix->sun_path))
+			return FALSE;
+
+		pUnix->sun_family = AF_UNIX;
+		strcpy(pUnix->sun_path, pName + 5);
+		pAddress->Bytes = (socklen_t)sizeof(struct sockaddr_un);
+		pAddress->Family = AF_UNIX;
+
+		return TRUE;
+	}
+#endif
+
+	return FALSE;
+
+}// ParseAddress
+
+
+/*! Make a datagram socket.
+	\param Family is the address family.
+	\return The socket, or INVALID_SOCKET.*/
+static Socket_t OpenSocket(int Family)
+{
+#ifdef WIN32
+	WSADATA Data;
+
+	if (WSAStartup(MAKEWORD(2, 2), &Data) != 0)
+		return INVALID_SOCKET;
+
+	{
+		Socket_t Socket = socket(Family, SOCK_DGRAM, 0);
+
+		if (Socket == INVALID_SOCKET)
+			WSACleanup();
+
+		return Socket;
+	}
+#else
+	return socket(Family, SOCK_DGRAM, 0);
+#endif
+
+}// OpenSocket
+
+
+/*! Close a socket made by OpenSocket().
+	\param Socket is the socket.*/
+static void CloseSocket(Socket_t Socket)
+{
+	closesocket(Socket);
+#ifdef WIN32
+	WSACleanup();
+#endif
+
+}// CloseSocket
+
+
+/*! Send the complete datagrams, moving the one being filled to the first.
+	\param pStream is the stream.*/
+static void SendReady(TelemetryStream_t *pStream)
+{
+	TelemetryStreamStats_t *pStats = &pStream->Stats;
+	UInt32 i;
+
+#ifdef WIN32
+	for (i = 0; i < pStream->Ready; i++)
+	{
+		const TelemetryDatagramHeader_t *pHeader = (const TelemetryDatagramHeader_t *)pStream->pDatagrams[i];
+		int Bytes = (int)(sizeof(*pHeader) + pHeader->Count * sizeof(TelemetrySample_t));
+
+		pStats->Calls++;
+		if (sendto(pStream->Socket, (const char *)pHeader, Bytes, 0,
+				   (const struct sockaddr *)&pStream->Dest.Addr, pStream->Dest.Bytes) == Bytes)
+		{
+			pStats->Datagrams++;
+			pStats->Samples += pHeader->Count;
+		}
+		else
+			pStats->SendErrors++;
+	}
+#else
+	struct mmsghdr Msgs[TS_BATCH];
+	struct iovec Iov[TS_BATCH];
+	UInt32 Sent = 0;
+	int Count;
+
+	memset(Msgs, 0, pStream->Ready * sizeof(Msgs[0]));
+
+	for (i = 0; i < pStream->Ready; i++)
+	{
+		const TelemetryDatagramHeader_t *pHeader = (const TelemetryDatagramHeader_t *)pStream->pDatagrams[i];
+
+		Iov[i].iov_base = pStream->pDatagrams[i];
+		Iov[i].iov_len = sizeof(*pHeader) + pHeader->Count * sizeof(TelemetrySample_t);
+		Msgs[i].msg_hdr.msg_name = &pStream->Dest.Addr;
+		Msgs[i].msg_hdr.msg_namelen = pStream->Dest.Bytes;
+		Msgs[i].msg_hdr.msg_iov = &Iov[i];
+		Msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	// A full socket buffer drops datagrams rather than stalling the queue
+	while (Sent < pStream->Ready)
+	{
+		pStats->Calls++;
+		Count = sendmmsg(pStream->Socket, &Msgs[Sent], pStream->Ready - Sent, MSG_DONTWAIT);
+
+		if (Count < 0 && errno == EINTR)
+			continue;
+
+		if (Count <= 0)
+		{
+			pStats->SendErrors++;
+			Sent++;
+			continue;
+		}
+
+		for (i = Sent; i < Sent + (UInt32)Count; i++)
+			pStats->Samples += ((const TelemetryDatagramHeader_t *)pStream->pDatagrams[i])->Count;
+		pStats->Datagrams += (UInt32)Count;
+		Sent += (UInt32)Count;
+	}
+#endif
+
+	// The datagram being filled carries on from the first
+	if (pStream->Ready < TS_BATCH)
+	{
+		const TelemetryDatagramHeader_t *pFilling = (const TelemetryDatagramHeader_t *)pStream->pDatagrams[pStream->Ready];
+
+		memcpy(pStream->pDatagrams[0], pFilling, sizeof(*pFilling) + pFilling->Count * sizeof(TelemetrySample_t));
+	}
+	else
+		((TelemetryDatagramHeader_t *)pStream->pDatagrams[0])->Count = 0;
+
+	pStream->Ready = 0;
+
+}// SendReady
+
+
+/*! Complete the datagram being filled, sending the batch once it's full.
+	\param pStream is the stream.*/
+static void CloseDatagram(TelemetryStream_t *pStream)
+{
+	TelemetryDatagramHeader_t *pHeader = (TelemetryDatagramHeader_t *)pStream->pDatagrams[pStream->Ready];
+
+	if (pHeader->Count == 0)
+		return;
+
+	pHeader->Sequence = pStream->Sequence++;
+
+	if (++pStream->Ready == TS_BATCH)
+		SendReady(pStream);
+	else
+		((TelemetryDatagramHeader_t *)pStream->pDatagrams[pStream->Ready])->Count = 0;
+
+}// CloseDatagram
+
+
+/*! Add a record to the datagram being filled, unless over the rate limit.
+	\param pStream is the stream.
+	\param pRecord is the record.*/
+static void PackRecord(TelemetryStream_t *pStream, const TelemetryRecord_t *pRecord)
+{
+	TelemetryDatagramHeader_t *pHeader = (TelemetryDatagramHeader_t *)pStream->pDatagrams[pStream->Ready];
+	TelemetrySample_t *pSample;
+	int i;
+
+	// Records the queue had no room for left a gap in the indices
+	if (pStream->Started)
+		pStream->Skipped += pRecord->Index - pStream->NextIndex;
+	pStream->NextIndex = pRecord->Index + 1;
+
+	// The bucket refills by sample time, spreading what's sent evenly; it holds
+	// two samples so arrival jitter doesn't cost rate
+	if (pStream->PeriodNs)
+	{
+		if (pStream->Started)
+			pStream->CreditNs += pRecord->HostNs - pStream->LastNs;
+		else
+			pStream->CreditNs = pStream->PeriodNs;
+		if (pStream->CreditNs > 2 * pStream->PeriodNs)
+			pStream->CreditNs = 2 * pStream->PeriodNs;
+		pStream->LastNs = pRecord->HostNs;
+	}
+	pStream->Started = TRUE;
+
+	if (pStream->PeriodNs)
+	{
+		if (pStream->CreditNs < pStream->PeriodNs)
+		{
+			pStream->Stats.RateLimited++;
+			pStream->Skipped++;
+			return;
+		}
+		pStream->CreditNs -= pStream->PeriodNs;
+	}
+
+	if (pHeader->Count == 0)
+	{
+		memcpy(pHeader->Magic, TS_MAGIC, sizeof(pHeader->Magic));
+		pHeader->ByteOrder = TLM_BYTE_ORDER_MARK;
+		pHeader->SampleBytes = (uint16_t)sizeof(TelemetrySample_t);
+		pHeader->BaseNs = pRecord->HostNs;
+		pHeader->Reserved = 0;
+	}
+
+	pSample = (TelemetrySample_t *)(pHeader + 1) + pHeader->Count;
+	pSample->Index = pRecord->Index;
+	pSample->OffsetNs = (uint32_t)(pRecord->HostNs - pHeader->BaseNs);
+	pSample->TimeSincePPS = pRecord->TimeSincePPS;
+	for (i = 0; i < N_SENSOR_IDX; i++)
+		pSample->Sensors[i] = pRecord->Sensors[i];
+	pSample->Angle = pRecord->Angle;
+	pSample->Bias = pRecord->Bias;
+	pSample->SequenceNumber = pRecord->SequenceNumber;
+	pSample->PPSCount = pRecord->PPSCount;
+	pSample->Reserved[0] = pSample->Reserved[1] = 0;
+
+	pHeader->Dropped = pStream->Skipped;
+
+	if (++pHeader->Count == pStream->Config.MaxSamples)
+		CloseDatagram(pStream);
+
+}// PackRecord
+
+
+/*! Pack all queued records into datagrams.
+	\param pStream is the stream.
+	\return The number of records taken from the queue.*/
+static UInt32 DrainQueue(TelemetryStream_t *pStream)
+{
+	UInt32 Tail = pStream->Tail;
+	UInt32 Head = atomicLoadAcquire(&pStream->Head);
+	UInt32 Packed = Head - Tail;
+
+	while (Tail != Head)
+	{
+		PackRecord(pStream, &pStream->pRing[Tail & pStream->Mask]);
+		atomicStoreRelease(&pStream->Tail, ++Tail);
+	}
+
+	return Packed;
+
+}// DrainQueue
+
+
+/*! Sleep for a while.
+	\param Ns is the time to sleep.*/
+static void SleepNs(UInt64 Ns)
+{
+#ifdef WIN32
+	Sleep((DWORD)((Ns + 999999) / 1000000));
+#else
+	struct timespec Ts;
+
+	Ts.tv_sec = (time_t)(Ns / 1000000000ULL);
+	Ts.tv_nsec = (long)(Ns % 1000000000ULL);
+	nanosleep(&Ts, NULL);
+#endif
+
+}// SleepNs
+
+
+/*! Background sender, runs until tsClose() sets Stop.
+	\param pArg points to the stream.*/
+#ifdef WIN32
+static DWORD WINAPI SenderThread(LPVOID pArg)
+#else
+static void *SenderThread(void *pArg)
+#endif
+{
+	TelemetryStream_t *pStream = (TelemetryStream_t *)pArg;
+	UInt64 MaxDelayNs = (UInt64)pStream->Config.MaxDelayUs * 1000;
+
+	while (!atomicLoadAcquire(&pStream->Stop))
+	{
+		const TelemetryDatagramHeader_t *pFilling;
+		UInt64 Now, Idle = TS_IDLE_NS;
+
+		DrainQueue(pStream);
+
+		// A datagram whose oldest sample waited long enough goes as it is
+		pFilling = (const TelemetryDatagramHeader_t *)pStream->pDatagrams[pStream->Ready];
+		if (pFilling->Count)
+		{
+			Now = htNowNs();
+			if (Now - pFilling->BaseNs >= MaxDelayNs)
+				CloseDatagram(pStream);
+			else if (pFilling->BaseNs + MaxDelayNs - Now < Idle)
+				Idle = pFilling->BaseNs + MaxDelayNs - Now;
+		}
+
+		if (pStream->Ready)
+			SendReady(pStream);
+
+		SleepNs(Idle);
+	}
+
+	// Send whatever arrived before the stop request
+	DrainQueue(pStream);
+	CloseDatagram(pStream);
+	if (pStream->Ready)
+		SendReady(pStream);
+
+	return 0;
+
+}// SenderThread
+
+
+/*! Get the default sender settings: a 4096 record queue and full
+	datagrams, sent at least every 5 ms, without a rate limit.
+	\param pConfig receives the settings.*/
+void tsDefaultConfig(TelemetryStreamConfig_t *pConfig)
+{
+	pConfig->Capacity = 4096;
+	pConfig->MaxSamples = (UInt32)TS_MAX_SAMPLES;
+	pConfig->MaxDelayUs = 5000;
+	pConfig->MaxRateHz = 0;
+
+}// tsDefaultConfig
+
+
+/*! Open a socket to a receiver and start the sender thread.
+	\param pDest is "udp:host:port" or "unix:path".
+	\param pConfig is the settings, NULL for the defaults.
+	\return The stream, or NULL if it could not be opened.*/
+TelemetryStream_t *tsOpen(const char *pDest, const TelemetryStreamConfig_t *pConfig)
+{
+	TelemetryStream_t *pStream;
+	UInt32 Size = 1;
+
+	pStream = (TelemetryStream_t *)calloc(1, sizeof(TelemetryStream_t));
+	if (pStream == NULL)
+		return NULL;
+
+	if (pConfig)
+		pStream->Config = *pConfig;
+	else
+		tsDefaultConfig(&pStream->Config);
+
+	if (pStream->Config.MaxSamples == 0 || pStream->Config.MaxSamples > TS_MAX_SAMPLES)
+		pStream->Config.MaxSamples = (UInt32)TS_MAX_SAMPLES;
+	if (pStream->Config.MaxDelayUs > TS_MAX_DELAY_US)
+		pStream->Config.MaxDelayUs = TS_MAX_DELAY_US;
+
+	if (pStream->Config.MaxRateHz > 0)
+		pStream->PeriodNs = (UInt64)(1.0e9 / pStream->Config.MaxRateHz + 0.5);
+
+	while (Size < pStream->Config.Capacity)
+		Size <<= 1;
+
+	pStream->Mask = Size - 1;
+	pStream->pRing = (TelemetryRecord_t *)calloc(Size, sizeof(TelemetryRecord_t));
+	pStream->pDatagrams = (UInt8 (*)[TS_MAX_DATAGRAM])calloc(TS_BATCH, TS_MAX_DATAGRAM);
+	pStream->Socket = INVALID_SOCKET;
+
+	if (pStream->pRing == NULL || pStream->pDatagrams == NULL || !ParseAddress(pDest, FALSE, &pStream->Dest) ||
+		(pStream->Socket = OpenSocket(pStream->Dest.Family)) == INVALID_SOCKET)
+	{
+		free(pStream->pDatagrams);
+		free(pStream->pRing);
+		free(pStream);
+		return NULL;
+	}
+
+#ifdef WIN32
+	pStream->Thread = CreateThread(NULL, 0, SenderThread, pStream, 0, NULL);
+	if (pStream->Thread == NULL)
+#else
+	if (pthread_create(&pStream->Thread, NULL, SenderThread, pStream) != 0)
+#endif
+	{
+		CloseSocket(pStream->Socket);
+		free(pStream->pDatagrams);
+		free(pStream->pRing);
+		free(pStream);
+		return NULL;
+	}
+
+	return pStream;
+
+}// tsOpen
+
+
+/*! Queue a record for sending.  Never blocks; only one thread may call
+	this.  The record's HostNs must be on the htNowNs() clock, it times the
+	batching.
+	\param pStream is the stream.
+	\param pRecord points to the record to copy.  Its Index is assigned here.
+	\return TRUE if queued, FALSE if the queue was full and it was dropped.*/
+BOOL tsPush(TelemetryStream_t *pStream, const TelemetryRecord_t *pRecord)
+{
+	UInt32 Head = pStream->Head;
+	TelemetryRecord_t *pSlot;
+
+	if (Head - atomicLoadAcquire(&pStream->Tail) > pStream->Mask)
+	{
+		pStream->Produced++;
+		atomicStoreRelaxed(&pStream->Dropped, pStream->Dropped + 1);
+		return FALSE;
+	}
+
+	pSlot = &pStream->pRing[Head & pStream->Mask];
+	*pSlot = *pRecord;
+	pSlot->Index = pStream->Produced++;
+
+	atomicStoreRelease(&pStream->Head, Head + 1);
+
+	return TRUE;
+
+}// tsPush
+
+
+/*! Get the number of records waiting to be packed.  Safe from any thread.
+	\param pStream is the stream.
+	\return The queue depth.*/
+UInt32 tsDepth(const TelemetryStream_t *pStream)
+{
+	// Tail first, so it can't have passed the Head read
+	UInt32 Tail = atomicLoadAcquire(&pStream->Tail);
+
+	return atomicLoadAcquire(&pStream->Head) - Tail;
+
+}// tsDepth
+
+
+/*! Copy the sender's counters.  While it runs they can be off by the batch
+	in progress.
+	\param pStream is the stream.
+	\param pStats receives the counters.*/
+void tsGetStats(const TelemetryStream_t *pStream, TelemetryStreamStats_t *pStats)
+{
+	*pStats = pStream->Stats;
+	pStats->QueueDropped = atomicLoadRelaxed(&pStream->Dropped);
+
+#ifdef WIN32
+	{
+		FILETIME Created, Exited, Kernel, User;
+
+		if (GetThreadTimes(pStream->Thread, &Created, &Exited, &Kernel, &User))
+			pStats->CpuNs = ((((UInt64)Kernel.dwHighDateTime << 32) | Kernel.dwLowDateTime) +
+							 (((UInt64)User.dwHighDateTime << 32) | User.dwLowDateTime)) * 100;
+	}
+#else
+	{
+		clockid_t Clock;
+		struct timespec Ts;
+
+		if (pthread_getcpuclockid(pStream->Thread, &Clock) == 0 && clock_gettime(Clock, &Ts) == 0)
+			pStats->CpuNs = (UInt64)Ts.tv_sec * 1000000000ULL + (UInt64)Ts.tv_nsec;
+	}
+#endif
+
+}// tsGetStats
+
+
+/*! Send everything queued, stop the sender thread and close the socket.
+	\param pStream is the stream, which is freed.*/
+void tsClose(TelemetryStream_t *pStream)
+{
+	if (pStream == NULL)
+		return;
+
+	atomicStoreRelease(&pStream->Stop, 1);
+
+#ifdef WIN32
+	WaitForSingleObject(pStream->Thread, INFINITE);
+	CloseHandle(pStream->Thread);
+#else
+	pthread_join(pStream->Thread, NULL);
+#endif
+
+	CloseSocket(pStream->Socket);
+	free(pStream->pDatagrams);
+	free(pStream->pRing);
+	free(pStream);
+
+}// tsClose
+
+
+/*! Bind a socket to receive a stream on.
+	\param pName is "udp:host:port", host may be empty for any, port 0 for
+		   any free one, or "unix:path", which is replaced if it exists.
+	\return The receiver, or NULL if the name couldn't be bound.*/
+TelemetryReceiver_t *tsListen(const char *pName)
+{
+	TelemetryReceiver_t *pReceiver = (TelemetryReceiver_t *)calloc(1, sizeof(TelemetryReceiver_t));
+
+	if (pReceiver == NULL)
+		return NULL;
+
+	pReceiver->pDatagrams = (UInt8 (*)[TS_MAX_DATAGRAM])malloc(TS_BATCH * TS_MAX_DATAGRAM);
+	pReceiver->Socket = INVALID_SOCKET;
+
+	if (pReceiver->pDatagrams == NULL || !ParseAddress(pName, TRUE, &pReceiver->Local) ||
+		(pReceiver->Socket = OpenSocket(pReceiver->Local.Family)) == INVALID_SOCKET)
+	{
+		free(pReceiver->pDatagrams);
+		free(pReceiver);
+		return NULL;
+	}
+
+#ifndef WIN32
+	if (pReceiver->Local.Family == AF_UNIX)
+		unlink(((struct sockaddr_un *)&pReceiver->Local.Addr)->sun_path);
+#endif
+
+	if (bind(pReceiver->Socket, (const struct sockaddr *)&pReceiver->Local.Addr, pReceiver->Local.Bytes) != 0)
+	{
+		CloseSocket(pReceiver->Socket);
+		free(pReceiver->pDatagrams);
+		free(pReceiver);
+		return NULL;
+	}
+
+	// A bound port 0 became a real one
+	pReceiver->Local.Bytes = (socklen_t)sizeof(pReceiver->Local.Addr);
+	getsockname(pReceiver->Socket, (struct sockaddr *)&pReceiver->Local.Addr, &pReceiver->Local.Bytes);
+
+	return pReceiver;
+
+}// tsListen
+
+
+/*! Get the name a sender should be given to reach a receiver.
+	\param pReceiver is the receiver.
+	\param pName receives the name, TS_NAME_BYTES long.
+	\return pName.*/
+const char *tsReceiverName(const TelemetryReceiver_t *pReceiver, char *pName)
+{
+	char Host[TS_NAME_BYTES / 2], Port[16];
+
+#ifndef WIN32
+	if (pReceiver->Local.Family == AF_UNIX)
+	{
+		snprintf(pName, TS_NAME_BYTES, "unix:%s", ((const struct sockaddr_un *)&pReceiver->Local.Addr)->sun_path);
+		return pName;
+	}
+#endif
+
+	if (getnameinfo((const struct sockaddr *)&pReceiver->Local.Addr, pReceiver->Local.Bytes, Host, sizeof(Host),
+					Port, sizeof(Port), NI_NUMERICHOST | NI_NUMERICSERV | NI_DGRAM) != 0)
+		pName[0] = 0;
+	else if (pReceiver->Local.Family == AF_INET6)
+		snprintf(pName, TS_NAME_BYTES, "udp:[%s]:%s", Host, Port);
+	else
+		snprintf(pName, TS_NAME_BYTES, "udp:%s:%s", Host, Port);
+
+	return pName;
+
+}// tsReceiverName
+
+
+/*! Check a datagram, count what was lost before it and hand over its samples.
+	\param pReceiver is the receiver.
+	\param pDatagram is the datagram.
+	\param Bytes is its length.
+	\param pCallback is called for each sample, may be NULL.
+	\param pArg is passed to the callback.*/
+static void TakeDatagram(TelemetryReceiver_t *pReceiver, const UInt8 *pDatagram, UInt32 Bytes,
+						 TelemetrySampleCallback_t pCallback, void *pArg)
+{
+	const TelemetryDatagramHeader_t *pHeader = (const TelemetryDatagramHeader_t *)pDatagram;
+	const TelemetrySample_t *pSamples = (const TelemetrySample_t *)(pHeader + 1);
+	TelemetryReceiverStats_t *pStats = &pReceiver->Stats;
+	UInt32 Gaps = 0, Within = 0, SenderDropped, i;
+
+	if (Bytes < sizeof(*pHeader) || memcmp(pHeader->Magic, TS_MAGIC, sizeof(pHeader->Magic)) != 0 ||
+		pHeader->ByteOrder != TLM_BYTE_ORDER_MARK || pHeader->SampleBytes != sizeof(TelemetrySample_t) ||
+		pHeader->Count == 0 || Bytes < sizeof(*pHeader) + pHeader->Count * sizeof(TelemetrySample_t))
+	{
+		pStats->Malformed++;
+		return;
+	}
+
+	if (pReceiver->Started && (int32_t)(pHeader->Sequence - pReceiver->NextSequence) < 0)
+	{
+		pStats->Reordered++;
+		return;
+	}
+
+	// Gaps inside a datagram were all made by the sender
+	for (i = 1; i < pHeader->Count; i++)
+		Within += pSamples[i].Index - pSamples[i - 1].Index - 1;
+
+	if (pReceiver->Started)
+	{
+		pStats->DatagramsLost += pHeader->Sequence - pReceiver->NextSequence;
+		Gaps = pSamples[0].Index - pReceiver->NextIndex + Within;
+	}
+	else
+	{
+		// Whatever went before the first datagram isn't counted
+		pReceiver->LastDropped = pHeader->Dropped - Within;
+		pReceiver->Started = TRUE;
+		Gaps = Within;
+	}
+
+	// The rest of the gaps are samples lost on the way
+	SenderDropped = pHeader->Dropped - pReceiver->LastDropped;
+	pStats->SenderDropped += SenderDropped;
+	if (Gaps > SenderDropped)
+		pStats->SamplesLost += Gaps - SenderDropped;
+
+	pStats->Datagrams++;
+	pStats->Samples += pHeader->Count;
+	pReceiver->NextSequence = pHeader->Sequence + 1;
+	pReceiver->NextIndex = pSamples[pHeader->Count - 1].Index + 1;
+	pReceiver->LastDropped = pHeader->Dropped;
+
+	if (pCallback)
+		for (i = 0; i < pHeader->Count; i++)
+			pCallback(pArg, pHeader, &pSamples[i]);
+
+}// TakeDatagram
+
+
+/*! Take the datagrams waiting, waiting for one if there are none.
+	\param pReceiver is the receiver.
+	\param TimeoutMs is the longest to wait.
+	\param pCallback is called for each sample, may be NULL.
+	\param pArg is passed to the callback.
+	\return The number of datagrams taken, 0 on a timeout.*/
+UInt32 tsReceive(TelemetryReceiver_t *pReceiver, UInt32 TimeoutMs,
+				 TelemetrySampleCallback_t pCallback, void *pArg)
+{
+#ifdef WIN32
+	struct timeval Timeout;
+	fd_set Readable;
+	int Bytes;
+
+	FD_ZERO(&Readable);
+	FD_SET(pReceiver->Socket, &Readable);
+	Timeout.tv_sec = (long)(TimeoutMs / 1000);
+	Timeout.tv_usec = (long)(TimeoutMs % 1000) * 1000;
+
+	if (select(0, &Readable, NULL, NULL, &Timeout) <= 0)
+		return 0;
+
+	pReceiver->Stats.Calls++;
+	Bytes = recvfrom(pReceiver->Socket, (char *)pReceiver->pDatagrams[0], TS_MAX_DATAGRAM, 0, NULL, NULL);
+	if (Bytes < 0)
+		return 0;
+
+	TakeDatagram(pReceiver, pReceiver->pDatagrams[0], (UInt32)Bytes, pCallback, pArg);
+
+	return 1;
+#else
+	struct mmsghdr Msgs[TS_BATCH];
+	struct iovec Iov[TS_BATCH];
+	struct pollfd Poll;
+	int Count, i;
+
+	Poll.fd = pReceiver->Socket;
+	Poll.events = POLLIN;
+
+	if (poll(&Poll, 1, (int)TimeoutMs) <= 0)
+		return 0;
+
+	memset(Msgs, 0, sizeof(Msgs));
+	for (i = 0; i < TS_BATCH; i++)
+	{
+		Iov[i].iov_base = pReceiver->pDatagrams[i];
+		Iov[i].iov_len = TS_MAX_DATAGRAM;
+		Msgs[i].msg_hdr.msg_iov = &Iov[i];
+		Msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	pReceiver->Stats.Calls++;
+	Count = recvmmsg(pReceiver->Socket, Msgs, TS_BATCH, MSG_DONTWAIT, NULL);
+	if (Count <= 0)
+		return 0;
+
+	for (i = 0; i < Count; i++)
+		TakeDatagram(pReceiver, pReceiver->pDatagrams[i], Msgs[i].msg_len, pCallback, pArg);
+
+	return (UInt32)Count;
+#endif
+
+}// tsReceive
+
+
+/*! Copy the receiver's counters.
+	\param pReceiver is the receiver.
+	\param pStats receives the counters.*/
+void tsGetReceiverStats(const TelemetryReceiver_t *pReceiver, TelemetryReceiverStats_t *pStats)
+{
+	*pStats = pReceiver->Stats;
+
+}// tsGetReceiverStats
+
+
+/*! Close a receiver's socket, removing a Unix socket's name.
+	\param pReceiver is the receiver, which is freed.*/
+void tsCloseReceiver(TelemetryReceiver_t *pReceiver)
+{
+	if (pReceiver == NULL)
+		return;
+
+	CloseSocket(pReceiver->Socket);
+#ifndef WIN32
+	if (pReceiver->Local.Family == AF_UNIX)
+		unlink(((struct sockaddr_un *)&pReceiver->Local.Addr)->sun_path);
+#endif
+
+	free(pReceiver->pDatagrams);
+	free(pReceiver);
+
+}// tsCloseReceiver
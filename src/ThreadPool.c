@@ -0,0 +1,428 @@
+/*! \file
+	\brief Fixed size pool of worker threads for offline batch work.
+*/
+
+#include <stdlib.h>
+#include "Atomic.h"
+#include "ThreadPool.h"
+
+#ifdef WIN32
+#include <windows.h>
+typedef CRITICAL_SECTION	Mutex_t;
+typedef CONDITION_VARIABLE	Cond_t;
+typedef HANDLE				Thread_t;
+#define MutexInit(m)		InitializeCriticalSection(m)
+#define MutexDestroy(m)		DeleteCriticalSection(m)
+#define MutexLock(m)		EnterCriticalSection(m)
+#define MutexUnlock(m)		LeaveCriticalSection(m)
+#define CondInit(c)			InitializeConditionVariable(c)
+#define CondDestroy(c)
+#define CondWait(c, m)		SleepConditionVariableCS(c, m, INFINITE)
+#define CondSignal(c)		WakeConditionVariable(c)
+#define CondBroadcast(c)	WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+#include <unistd.h>
+typedef pthread_mutex_t		Mutex_t;
+typedef pthread_cond_t		Cond_t;
+typedef pthread_t			Thread_t;
+#define MutexInit(m)		pthread_mutex_init(m, NULL)
+#define MutexDestroy(m)		pthread_mutex_destroy(m)
+#define MutexLock(m)		pthread_mutex_lock(m)
+#define MutexUnlock(m)		pthread_mutex_unlock(m)
+#define CondInit(c)			pthread_cond_init(c, NULL)
+#define CondDestroy(c)		pthread_cond_destroy(c)
+#define CondWait(c, m)		pthread_cond_wait(c, m)
+#define CondSignal(c)		pthread_cond_signal(c)
+#define CondBroadcast(c)	pthread_cond_broadcast(c)
+#endif
+
+typedef struct
+{
+	ThreadJob_t pJob;
+	void *pArg;
+} Job_t;
+
+//! A slice of a tpForEach() range, [Begin, End) packed as Begin << 32 | End
+typedef struct
+{
+	volatile UInt64 Range;
+	char Pad[CACHE_LINE_BYTES - sizeof(UInt64)];
+} Slice_t;
+
+//! State shared by the workers of one tpForEach()
+typedef struct
+{
+	ThreadIndexJob_t pJob;
+	void *pArg;
+	Slice_t *pSlices;
+	UInt32 Slices;
+} ForEach_t;
+
+//! One worker's part in a tpForEach()
+typedef struct
+{
+	ForEach_t *pForEach;
+	UInt32 Slice;							//!< The slice this worker owns
+} ForEachWorker_t;
+
+#define SLICE(Begin, End)	(((UInt64)(Begin) << 32) | (UInt32)(End))
+#define SLICE_BEGIN(r)		((UInt32)((r) >> 32))
+#define SLICE_END(r)		((UInt32)((r) & 0xFFFFFFFFu))
+
+struct ThreadPool_t
+{
+	Mutex_t Lock;
+	Cond_t Work;				//!< Signalled when a job is queued or on shutdown
+	Cond_t Idle;				//!< Signalled when the last pending job finishes
+	Job_t *pQueue;				//!< Ring of queued jobs
+	UInt32 Capacity;			//!< Size of the ring
+	UInt32 Head;				//!< Next job to take
+	UInt32 Count;				//!< Jobs queued
+	UInt32 Pending;				//!< Jobs queued or running
+	BOOL Stop;
+	UInt32 Threads;
+	Thread_t *pThreads;
+};
+
+
+/*! Worker loop, takes jobs until the pool is destroyed.
+	\param pArg points to the pool.*/
+#ifdef WIN32
+static DWORD WINAPI Worker(LPVOID pArg)
+#else
+static void *Worker(void *pArg)
+#endif
+{
+	ThreadPool_t *pPool = (ThreadPool_t *)pArg;
+	Job_t Job;
+
+	MutexLock(&pPool->Lock);
+
+	for (;;)
+	{
+		while ((pPool->Count == 0) && !pPool->Stop)
+			CondWait(&pPool->Work, &pPool->Lock);
+
+		if (pPool->Count == 0)
+			break;
+
+		Job = pPool->pQueue[pPool->Head];
+		pPool->Head = (pPool->Head + 1) % pPool->Capacity;
+		pPool->Count--;
+
+		MutexUnlock(&pPool->Lock);
+		Job.pJob(Job.pArg);
+		MutexLock(&pPool->Lock);
+
+		if (--pPool->Pending == 0)
+			CondBroadcast(&pPool->Idle);
+	}
+
+	MutexUnlock(&pPool->Lock);
+
+	return 0;
+
+}// Worker
+
+
+/*! Start a pool of worker threads.
+	\param Threads is the number of workers, 0 for one per CPU.
+	\return The pool, or NULL if it could not be started.*/
+ThreadPool_t *tpCreate(UInt32 Threads)
+{
+	ThreadPool_t *pPool = (ThreadPool_t *)calloc(1, sizeof(ThreadPool_t));
+	UInt32 i;
+
+	if (pPool == NULL)
+		return NULL;
+
+	if (Threads == 0)
+		Threads = tpCpuCount();
+
+	pPool->Capacity = 64;
+	pPool->pQueue = (Job_t *)malloc(pPool->Capacity * sizeof(Job_t));
+	pPool->pThreads = (Thread_t *)calloc(Threads, sizeof(Thread_t));
+	if ((pPool->pQueue == NULL) || (pPool->pThreads == NULL))
+	{
+		free(pPool->pQueue);
+		free(pPool->pThreads);
+		free(pPool);
+		return NULL;
+	}
+
+	MutexInit(&pPool->Lock);
+	CondInit(&pPool->Work);
+	CondInit(&pPool->Idle);
+
+	for (i = 0; i < Threads; i++)
+	{
+#ifdef WIN32
+		pPool->pThreads[i] = CreateThread(NULL, 0, Worker, pPool, 0, NULL);
+		if (pPool->pThreads[i] == NULL)
+			break;
+#else
+		if (pthread_create(&pPool->pThreads[i], NULL, Worker, pPool) != 0)
+			break;
+#endif
+		pPool->Threads++;
+	}
+
+	if (pPool->Threads == 0)
+	{
+		tpDestroy(pPool);
+		return NULL;
+	}
+
+	return pPool;
+
+}// tpCreate
+
+
+/*! Queue a job.
+	\param pPool points to the pool.
+	\param pJob is the function to run on a worker.
+	\param pArg is passed to the function.
+	\return TRUE if queued, FALSE if out of memory.*/
+BOOL tpSubmit(ThreadPool_t *pPool, ThreadJob_t pJob, void *pArg)
+{
+	Job_t *pQueue;
+	UInt32 i;
+
+	MutexLock(&pPool->Lock);
+
+	// Grow the ring, unwrapping it into the new storage
+	if (pPool->Count == pPool->Capacity)
+	{
+		pQueue = (Job_t *)malloc(2 * pPool->Capacity * sizeof(Job_t));
+		if (pQueue == NULL)
+		{
+			MutexUnlock(&pPool->Lock);
+			return FALSE;
+		}
+
+		for (i = 0; i < pPool->Count; i++)
+			pQueue[i] = pPool->pQueue[(pPool->Head + i) % pPool->Capacity];
+
+		free(pPool->pQueue);
+		pPool->pQueue = pQueue;
+		pPool->Head = 0;
+		pPool->Capacity *= 2;
+	}
+
+	pPool->pQueue[(pPool->Head + pPool->Count) % pPool->Capacity].pJob = pJob;
+	pPool->pQueue[(pPool->Head + pPool->Count) % pPool->Capacity].pArg = pArg;
+	pPool->Count++;
+	pPool->Pending++;
+
+	CondSignal(&pPool->Work);
+	MutexUnlock(&pPool->Lock);
+
+	return TRUE;
+
+}// tpSubmit
+
+
+/*! Wait until every submitted job has finished.
+	\param pPool points to the pool.*/
+void tpWait(ThreadPool_t *pPool)
+{
+	MutexLock(&pPool->Lock);
+
+	while (pPool->Pending)
+		CondWait(&pPool->Idle, &pPool->Lock);
+
+	MutexUnlock(&pPool->Lock);
+
+}// tpWait
+
+
+/*! Take the first item of a slice.
+	\param pSlice points to the slice.
+	\param pIndex points to space to receive the item.
+	\return FALSE if the slice is empty.*/
+static BOOL TakeFront(Slice_t *pSlice, UInt32 *pIndex)
+{
+	UInt64 r;
+
+	do
+	{
+		r = atomicLoadAcquire(&pSlice->Range);
+		if (SLICE_BEGIN(r) >= SLICE_END(r))
+			return FALSE;
+	} while (!atomicCas64(&pSlice->Range, r, SLICE(SLICE_BEGIN(r) + 1, SLICE_END(r))));
+
+	*pIndex = SLICE_BEGIN(r);
+
+	return TRUE;
+
+}// TakeFront
+
+
+/*! Steal the back half of the fullest other slice into an empty one.
+	\param pForEach points to the shared state.
+	\param Own is the thief's slice.
+	\return FALSE if there was nothing left to steal.*/
+static BOOL Steal(ForEach_t *pForEach, UInt32 Own)
+{
+	UInt32 i, Victim, Left, Most, Take;
+	UInt64 r;
+
+	for (;;)
+	{
+		// Pick the slice with the most left, the range only ever shrinks
+		//   so an empty scan means the work is all taken
+		for (Most = 0, Victim = Own, i = 0; i < pForEach->Slices; i++)
+		{
+			r = atomicLoadAcquire(&pForEach->pSlices[i].Range);
+			Left = (SLICE_END(r) > SLICE_BEGIN(r)) ? SLICE_END(r) - SLICE_BEGIN(r) : 0;
+			if ((i != Own) && (Left > Most))
+			{
+				Most = Left;
+				Victim = i;
+			}
+		}
+
+		if (Most == 0)
+			return FALSE;
+
+		r = atomicLoadAcquire(&pForEach->pSlices[Victim].Range);
+		if (SLICE_END(r) <= SLICE_BEGIN(r))
+			continue;
+
+		Take = (SLICE_END(r) - SLICE_BEGIN(r) + 1) / 2;
+		if (atomicCas64(&pForEach->pSlices[Victim].Range, r, SLICE(SLICE_BEGIN(r), SLICE_END(r) - Take)))
+		{
+			// Only the owner adds to an empty slice, thieves pass it over
+			atomicStoreRelease(&pForEach->pSlices[Own].Range, SLICE(SLICE_END(r) - Take, SLICE_END(r)));
+			return TRUE;
+		}
+	}
+
+}// Steal
+
+
+/*! Run the items of one worker's slice, then steal until all are done.
+	\param pArg points to the ForEachWorker_t.*/
+static void ForEachWorker(void *pArg)
+{
+	ForEachWorker_t *pWorker = (ForEachWorker_t *)pArg;
+	ForEach_t *pForEach = pWorker->pForEach;
+	Slice_t *pOwn = &pForEach->pSlices[pWorker->Slice];
+	UInt32 Index;
+
+	do
+	{
+		while (TakeFront(pOwn, &Index))
+			pForEach->pJob(pForEach->pArg, Index);
+
+	} while (Steal(pForEach, pWorker->Slice));
+
+}// ForEachWorker
+
+
+/*! Run a job once for each index of a range and wait for them all.
+	\param pPool points to the pool.
+	\param Count is the number of indexes, the job gets 0 to Count - 1.
+	\param pJob is the function to run.
+	\param pArg is passed to the function.
+	\return FALSE if out of memory, nothing has been run then.*/
+BOOL tpForEach(ThreadPool_t *pPool, UInt32 Count, ThreadIndexJob_t pJob, void *pArg)
+{
+	ForEach_t ForEach;
+	ForEachWorker_t *pWorkers;
+	UInt32 i;
+
+	ForEach.pJob = pJob;
+	ForEach.pArg = pArg;
+	ForEach.Slices = pPool->Threads;
+	ForEach.pSlices = (Slice_t *)calloc(ForEach.Slices, sizeof(Slice_t));
+	pWorkers = (ForEachWorker_t *)malloc(ForEach.Slices * sizeof(ForEachWorker_t));
+	if ((ForEach.pSlices == NULL) || (pWorkers == NULL))
+	{
+		free(ForEach.pSlices);
+		free(pWorkers);
+		return FALSE;
+	}
+
+	for (i = 0; i < ForEach.Slices; i++)
+	{
+		ForEach.pSlices[i].Range = SLICE((UInt64)Count * i / ForEach.Slices, (UInt64)Count * (i + 1) / ForEach.Slices);
+		pWorkers[i].pForEach = &ForEach;
+		pWorkers[i].Slice = i;
+	}
+
+	// A slice has one owner, so one that can't be queued is run here
+	for (i = 0; i < ForEach.Slices; i++)
+		if (!tpSubmit(pPool, ForEachWorker, &pWorkers[i]))
+			ForEachWorker(&pWorkers[i]);
+	tpWait(pPool);
+
+	free(ForEach.pSlices);
+	free(pWorkers);
+
+	return TRUE;
+
+}// tpForEach
+
+
+/*! Get the number of workers.
+	\param pPool points to the pool.
+	\return The number of worker threads running.*/
+UInt32 tpThreads(const ThreadPool_t *pPool)
+{
+	return pPool->Threads;
+
+}// tpThreads
+
+
+/*! Finish the queued jobs, stop the workers and free the pool.
+	\param pPool points to the pool.*/
+void tpDestroy(ThreadPool_t *pPool)
+{
+	UInt32 i;
+
+	if (pPool == NULL)
+		return;
+
+	MutexLock(&pPool->Lock);
+	pPool->Stop = TRUE;
+	CondBroadcast(&pPool->Work);
+	MutexUnlock(&pPool->Lock);
+
+	for (i = 0; i < pPool->Threads; i++)
+	{
+#ifdef WIN32
+		WaitForSingleObject(pPool->pThreads[i], INFINITE);
+		CloseHandle(pPool->pThreads[i]);
+#else
+		pthread_join(pPool->pThreads[i], NULL);
+#endif
+	}
+
+	CondDestroy(&pPool->Work);
+	CondDestroy(&pPool->Idle);
+	MutexDestroy(&pPool->Lock);
+	free(pPool->pQueue);
+	free(pPool->pThreads);
+	free(pPool);
+
+}// tpDestroy
+
+
+/*! Get the number of CPUs available to the process.
+	\return The number of online CPUs, at least 1.*/
+UInt32 tpCpuCount(void)
+{
+#ifdef WIN32
+	SYSTEM_INFO Info;
+
+	GetSystemInfo(&Info);
+	return Info.dwNumberOfProcessors ? (UInt32)Info.dwNumberOfProcessors : 1;
+#else
+	long Count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (Count > 0) ? (UInt32)Count : 1;
+#endif
+
+}// tpCpuCount
@@ -0,0 +1,204 @@
+/*! \file
+	\brief Accelerometer tilt computation using a fast atan2 approximation.
+*/
+
+#include <math.h>
+#include "Tilt.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define TILT_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#define TILT_PI			3.14159265358979f
+#define TILT_PI_2		1.57079632679490f
+#define TILT_RAD_TO_DEG	57.2957795130823f
+
+// Minimax coefficients for atan(a), 0 <= a <= 1, odd powers 1 through 11
+#define ATAN_C1		( 0.99997726f)
+#define ATAN_C3		(-0.33262347f)
+#define ATAN_C5		( 0.19354346f)
+#define ATAN_C7		(-0.11643287f)
+#define ATAN_C9		( 0.05265332f)
+#define ATAN_C11	(-0.01172120f)
+
+// Smallest denominator used, keeps atan2(0, 0) from dividing by zero
+#define ATAN_TINY	(1.0e-30f)
+
+static TiltMounting_t CurrentMounting = TILT_Z_UP;
+static float MountSign = 1.0f;				// Multiplies ay and az for the roll
+
+
+/*! Compute an approximation of atan2(y, x) without calling libm.
+	\param y is the ordinate.
+	\param x is the abscissa.
+	\return The angle of (x, y) in radians, in the range [-pi, pi].  The error
+			is at most FAST_ATAN2_MAX_ERROR_RAD.  Returns 0 for (0, 0).*/
+float FastAtan2f(float y, float x)
+{
+	float ax = fabsf(x);
+	float ay = fabsf(y);
+	float Max = (ax > ay) ? ax : ay;
+	float Min = (ax > ay) ? ay : ax;
+	float a, s, r;
+
+	if (Max < ATAN_TINY)
+		Max = ATAN_TINY;
+
+	// Reduce to the first octant, then evaluate the polynomial
+	a = Min / Max;
+	s = a * a;
+	r = ((((ATAN_C11 * s + ATAN_C9) * s + ATAN_C7) * s + ATAN_C5) * s + ATAN_C3) * s + ATAN_C1;
+	r *= a;
+
+	// Unfold the octant and quadrant
+	if (ay > ax)
+		r = TILT_PI_2 - r;
+	if (x < 0)
+		r = TILT_PI - r;
+	if (y < 0)
+		r = -r;
+
+	return r;
+
+}// FastAtan2f
+
+
+/*! Compute FastAtan2f() over arrays of inputs.  On SSE2 targets four values
+	are computed per iteration; results match FastAtan2f() exactly.
+	\param pY points to the array of ordinates.
+	\param pX points to the array of abscissas.
+	\param pOut points to space to receive the angles in radians.
+	\param Count is the number of elements in each array.*/
+void FastAtan2fBatch(const float *pY, const float *pX, float *pOut, UInt32 Count)
+{
+	UInt32 i = 0;
+
+#ifdef TILT_USE_SSE2
+	const __m128 SignMask = _mm_set1_ps(-0.0f);
+	const __m128 Tiny = _mm_set1_ps(ATAN_TINY);
+	const __m128 Zero = _mm_setzero_ps();
+
+	for (; i + 4 <= Count; i += 4)
+	{
+		__m128 x  = _mm_loadu_ps(&pX[i]);
+		__m128 y  = _mm_loadu_ps(&pY[i]);
+		__m128 ax = _mm_andnot_ps(SignMask, x);
+		__m128 ay = _mm_andnot_ps(SignMask, y);
+		__m128 Max = _mm_max_ps(_mm_max_ps(ax, ay), Tiny);
+		__m128 Min = _mm_min_ps(ax, ay);
+		__m128 a = _mm_div_ps(Min, Max);
+		__m128 s = _mm_mul_ps(a, a);
+		__m128 r, Mask;
+
+		r = _mm_set1_ps(ATAN_C11);
+		r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C9));
+		r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C7));
+		r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C5));
+		r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C3));
+		r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_C1));
+		r = _mm_mul_ps(r, a);
+
+		// if (ay > ax) r = pi/2 - r
+		Mask = _mm_cmpgt_ps(ay, ax);
+		r = _mm_or_ps(_mm_and_ps(Mask, _mm_sub_ps(_mm_set1_ps(TILT_PI_2), r)),
+					  _mm_andnot_ps(Mask, r));
+
+		// if (x < 0) r = pi - r
+		Mask = _mm_cmplt_ps(x, Zero);
+		r = _mm_or_ps(_mm_and_ps(Mask, _mm_sub_ps(_mm_set1_ps(TILT_PI), r)),
+					  _mm_andnot_ps(Mask, r));
+
+		// if (y < 0) r = -r
+		Mask = _mm_cmplt_ps(y, Zero);
+		r = _mm_xor_ps(r, _mm_and_ps(Mask, SignMask));
+
+		_mm_storeu_ps(&pOut[i], r);
+	}
+#endif
+
+	// Remainder (or everything on targets without SSE2)
+	for (; i < Count; i++)
+		pOut[i] = FastAtan2f(pY[i], pX[i]);
+
+}// FastAtan2fBatch
+
+
+/*! Set how the IMU is mounted, for every roll taken from now on.
+	\param Mounting is which way its Z axis points with the robot upright.*/
+void TiltSetMounting(TiltMounting_t Mounting)
+{
+	CurrentMounting = Mounting;
+	MountSign = (Mounting == TILT_Z_DOWN) ? -1.0f : 1.0f;
+
+}// TiltSetMounting
+
+
+/*! Get how the IMU is mounted.
+	\return The mounting last set, TILT_Z_UP by default.*/
+TiltMounting_t TiltGetMounting(void)
+{
+	return CurrentMounting;
+
+}// TiltGetMounting
+
+
+/*! Compute the roll angle (rotation about the X axis) from the accelerometers.
+	\param pData points to the IMU data holding converted accelerations.
+	\return The roll angle in degrees, 0 upright for either mounting.*/
+float TiltRollDeg(const IMUData_t *pData)
+{
+	return FastAtan2f(MountSign * pData->SensorsConverted[ACCELY_IDX],
+					  MountSign * pData->SensorsConverted[ACCELZ_IDX]) * TILT_RAD_TO_DEG;
+
+}// TiltRollDeg
+
+
+/*! Compute the pitch angle (rotation about the Y axis) from the accelerometers.
+	\param pData points to the IMU data holding converted accelerations.
+	\return The pitch angle in degrees.*/
+float TiltPitchDeg(const IMUData_t *pData)
+{
+	float ay = pData->SensorsConverted[ACCELY_IDX];
+	float az = pData->SensorsConverted[ACCELZ_IDX];
+
+	return FastAtan2f(-pData->SensorsConverted[ACCELX_IDX],
+					  sqrtf(ay * ay + az * az)) * TILT_RAD_TO_DEG;
+
+}// TiltPitchDeg
+
+
+/*! Compute roll and pitch for arrays of accelerometer samples.
+	\param pAccelX points to the X accelerations.
+	\param pAccelY points to the Y accelerations.
+	\param pAccelZ points to the Z accelerations.
+	\param pRoll points to space to receive the roll angles in degrees.
+	\param pPitch points to space to receive the pitch angles in degrees.
+	\param Count is the number of samples.*/
+void TiltBatchDeg(const float *pAccelX, const float *pAccelY, const float *pAccelZ,
+				  float *pRoll, float *pPitch, UInt32 Count)
+{
+	UInt32 i;
+
+	FastAtan2fBatch(pAccelY, pAccelZ, pRoll, Count);
+
+	// Half a turn about X for TILT_Z_DOWN, atan2(-y, -x) = atan2(y, x) -+ pi
+	if (CurrentMounting == TILT_Z_DOWN)
+		for (i = 0; i < Count; i++)
+			pRoll[i] += (pRoll[i] > 0.0f) ? -TILT_PI : TILT_PI;
+
+	// Use the pitch output for the horizontal magnitude, then compute
+	//   atan2(ax, h) in place; pitch is its negative
+	for (i = 0; i < Count; i++)
+		pPitch[i] = sqrtf(pAccelY[i] * pAccelY[i] + pAccelZ[i] * pAccelZ[i]);
+
+	FastAtan2fBatch(pAccelX, pPitch, pPitch, Count);
+
+	for (i = 0; i < Count; i++)
+	{
+		pRoll[i] *= TILT_RAD_TO_DEG;
+		pPitch[i] *= -TILT_RAD_TO_DEG;
+	}
+
+}// TiltBatchDeg
+
@@ -0,0 +1,67 @@
+/*! \file
+	\brief Overlapping Allan deviation of the six sensor channels.
+
+	Samples are folded into one running sum per channel as they arrive, so
+	a recording is never held as readings, only as the integrated series
+	theta[k], the sum of the first k readings.  The overlapping Allan
+	variance at an averaging time of m samples, m tau0, is then
+
+	    AVAR = sum over k of (theta[k+2m] - 2 theta[k+m] + theta[k])^2
+	           / (2 m^2 (N - 2m))
+
+	over the N points of theta, one sequential sweep over three streams of
+	the series per averaging time.  tau0 cancels; it only labels the curve.
+	Every (channel, averaging time) pair is an independent
+	job on a thread pool.  The first reading of each channel is taken off
+	before summing; a constant drops out of the second difference and the
+	running sums stay small enough for double precision over days of data.
+
+	avFitNoise() reads the classic noise terms off a deviation curve:
+
+	- White noise, the -1/2 slope.  N = ADEV(tau) sqrt(tau), angle random
+	  walk for a gyro (deg/sqrt(s)), velocity random walk for an
+	  accelerometer.
+	- Bias instability, the flat bottom.  B = min ADEV / 0.664.
+	- Rate random walk, the +1/2 slope.  K = ADEV(tau) sqrt(3 / tau).
+
+	A term is only reported when the curve has a stretch close to its
+	slope, so short recordings don't report a made up rate random walk.
+*/
+
+#ifndef ALLANVARIANCE_H
+#define ALLANVARIANCE_H
+
+#include "IMUExternalTypes.h"
+
+#define AV_TAUS_PER_DECADE	10				//!< Default averaging time density
+#define AV_MIN_TERMS_DIV	4				//!< Largest m is N / AV_MIN_TERMS_DIV
+#define AV_SLOPE_TOLERANCE	0.15			//!< How close a slope must be to count
+
+typedef struct AllanSeries_t AllanSeries_t;
+
+//! Noise terms of one channel, in the channel's units
+typedef struct
+{
+	BOOL HaveWhite;
+	double White;							//!< N, units per root second
+	double WhiteTau;						//!< Where it was read, seconds
+	BOOL HaveInstability;
+	double Instability;						//!< B, units
+	double InstabilityTau;
+	BOOL HaveRateWalk;
+	double RateWalk;						//!< K, units per root second cubed
+	double RateWalkTau;
+	double SampleDev;						//!< ADEV at tau0, the per sample noise for white noise
+} AllanNoise_t;
+
+AllanSeries_t *avCreate(void);
+BOOL avAdd(AllanSeries_t *pSeries, const float Sample[N_SENSOR_IDX]);
+UInt64 avCount(const AllanSeries_t *pSeries);
+double avMean(const AllanSeries_t *pSeries, UInt32 Channel);
+void avDestroy(AllanSeries_t *pSeries);
+
+UInt32 avTaus(UInt64 Count, UInt32 PerDecade, UInt32 *pM, UInt32 Max);
+BOOL avCompute(const AllanSeries_t *pSeries, const UInt32 *pM, UInt32 TauCount, UInt32 Threads, double *pAdev);
+void avFitNoise(const double *pTau, const double *pAdev, UInt32 Count, AllanNoise_t *pNoise);
+
+#endif // ALLANVARIANCE_H
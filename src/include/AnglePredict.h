@@ -0,0 +1,43 @@
+/*! \file
+	\brief Latency compensated forward prediction of the filtered angle.
+
+	The filter output describes the instant the IMU sampled, which is several
+	milliseconds before the output is used.  The predictor estimates, for each
+	packet, the host time at which the sample was taken and extrapolates the
+	filtered angle with the bias corrected rate to any requested host time.
+
+	The sample time is estimated from the packet arrival timestamps.  The
+	difference between the host arrival time and the IMU time of a packet is
+	the clock offset plus a variable delay (serial transfer, OS buffering,
+	polling).  The smallest difference seen corresponds to the least delayed
+	packet, whose delay is the wire transfer time of one packet.  Every
+	packet's delay is measured against that floor.  The floor slowly leaks
+	upward so the estimate follows drift between the two clocks.
+*/
+
+#ifndef ANGLEPREDICT_H
+#define ANGLEPREDICT_H
+
+#include "CalcAngle.h"
+
+typedef struct
+{
+	float  TransferMs;       //!< Wire transfer time of one packet in milliseconds
+	double DeviceMs;         //!< Unwrapped IMU time of the last packet in milliseconds
+	float  LastPPSMs;        //!< Last raw TimeSincePPS value, to detect wraps
+	UInt64 LastArrivalNs;    //!< Host arrival time of the last packet
+	double MinOffsetMs;      //!< Floor of (host arrival - IMU time)
+	float  LatencyMs;        //!< Smoothed sample-to-arrival latency
+	float  MaxLatencyMs;     //!< Largest single packet latency seen
+	UInt64 SampleNs;         //!< Estimated host time of the last sample
+	float  Angle;            //!< Filtered angle at SampleNs
+	float  Rate;             //!< Bias corrected rate at SampleNs
+	UInt32 Count;            //!< Number of packets seen
+} AnglePredictor_t;
+
+void apInit(AnglePredictor_t *pAP, float TransferMs);
+void apUpdate(AnglePredictor_t *pAP, const KFilter_t *pKF, float TimeSincePPS, UInt64 ArrivalNs);
+float apPredict(const AnglePredictor_t *pAP, UInt64 TargetNs);
+float apGetLatencyMs(const AnglePredictor_t *pAP);
+
+#endif // ANGLEPREDICT_H
@@ -0,0 +1,43 @@
+/*! \file
+	\brief Minimal atomic operations for lock-free structures shared between
+	threads.  Loads acquire and stores release so a consumer that sees an
+	index also sees the data written before it.  Shared fields must be
+	declared volatile for the Visual C++ versions to be correct.
+*/
+
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+#if defined(_MSC_VER)
+
+#include <windows.h>
+
+// Visual C++ gives volatile accesses acquire/release semantics on x86/x64
+#define atomicLoadAcquire(p)		(*(p))
+#define atomicStoreRelease(p, v)	(*(p) = (v))
+#define atomicLoadRelaxed(p)		(*(p))
+#define atomicStoreRelaxed(p, v)	(*(p) = (v))
+#define atomicAddRelaxed(p, v)		InterlockedExchangeAdd((volatile LONG *)(p), (LONG)(v))
+#define atomicFence()				MemoryBarrier()
+#define atomicCas64(p, e, v)		(InterlockedCompareExchange64((volatile LONG64 *)(p), (LONG64)(v), (LONG64)(e)) == (LONG64)(e))
+#define atomicCasPtr(p, e, v)		(InterlockedCompareExchangePointer((PVOID volatile *)(p), (PVOID)(v), (PVOID)(e)) == (PVOID)(e))
+
+#else
+
+#define atomicLoadAcquire(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define atomicStoreRelease(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define atomicLoadRelaxed(p)		__atomic_load_n((p), __ATOMIC_RELAXED)
+#define atomicStoreRelaxed(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define atomicAddRelaxed(p, v)		__atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#define atomicFence()				__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define atomicCas64(p, e, v)		__extension__ ({ __typeof__(+*(p)) _e = (e); \
+									 __atomic_compare_exchange_n((p), &_e, (v), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE); })
+#define atomicCasPtr(p, e, v)		__extension__ ({ __typeof__(e) _e = (e); \
+									 __atomic_compare_exchange_n((p), &_e, (v), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE); })
+
+#endif
+
+//! Size used to keep producer and consumer fields on separate cache lines
+#define CACHE_LINE_BYTES	64
+
+#endif // ATOMIC_H
@@ -1,3 +1,27 @@
+#ifndef CALCANGLE_H
+#define CALCANGLE_H
+
+#include "Types.h"
+
+/* Kalman filter state, one per filtered axis */
+typedef struct
+{
+	float Q_angle; // Process noise variance for the accelerometer
+	float Q_bias; // Process noise variance for the gyro bias
+	float R_measure; // Measurement noise variance - this is actually the variance of the measurement noise
+
+	float angle; // The angle calculated by the Kalman filter - part of the 2x1 state vector
+	float bias; // The gyro bias calculated by the Kalman filter - part of the 2x1 state vector
+	float rate; // Unbiased rate calculated from the rate and the calculated bias - you have to call getAngle to update the rate
+
+	float P[2][2]; // Error covariance matrix - This is a 2x2 matrix
+} KFilter_t;
+
+/* Reentrant interface */
+void kfInit(KFilter_t *pKF);
+float kfGetAngle(KFilter_t *pKF, float newAngle, float newRate, float dt);
+
+/* Single filter interface, operates on the instance returned by getKFilter() */
 void initKFilter();
 
 float getAngle(float newAngle, float newRate, float dt);
@@ -12,3 +36,7 @@ void setRmeasure(float newR_measure);
 float getQangle();
 float getQbias();
 float getRmeasure();
+
+KFilter_t *getKFilter();
+
+#endif // CALCANGLE_H
@@ -0,0 +1,35 @@
+/*! \file
+	\brief Fixed point version of the angle Kalman filter.
+
+	Same two state model and equations as CalcAngle.c.  Angle, bias and rate
+	are Q16.16 (degrees, deg/s), the covariance and noise terms are Q8.24 so
+	the small per-step increments keep their precision, and the gains are
+	Q2.30.  Products are formed in 64 bits.
+*/
+
+#ifndef CALCANGLEFIXED_H
+#define CALCANGLEFIXED_H
+
+#include "CalcAngle.h"
+#include "IMUFixed.h"
+
+typedef struct
+{
+	Q24_t Q_angle;		//!< Process noise variance for the accelerometer
+	Q24_t Q_bias;		//!< Process noise variance for the gyro bias
+	Q24_t R_measure;	//!< Measurement noise variance
+
+	Q16_t angle;		//!< Filtered angle
+	Q16_t bias;			//!< Estimated gyro bias
+	Q16_t rate;			//!< Unbiased rate from the last update
+
+	Q24_t P[2][2];		//!< Error covariance matrix
+} KFilterQ_t;
+
+void kfqInit(KFilterQ_t *pKF);
+Q16_t kfqGetAngle(KFilterQ_t *pKF, Q16_t newAngle, Q16_t newRate, Q16_t dt);
+
+void kfqFromFloat(KFilterQ_t *pKF, const KFilter_t *pFloat);
+void kfqToFloat(const KFilterQ_t *pKF, KFilter_t *pFloat);
+
+#endif // CALCANGLEFIXED_H
@@ -0,0 +1,44 @@
+/*! \file
+	\brief Memory mapped reader for serial capture files.
+
+	The capture and its index are mapped read-only, so a multi-gigabyte
+	capture costs no reading up front.  crSeekTime() binary searches the
+	sparse index and then walks at most one index interval of chunks.  If the
+	index is missing the walk starts at the first chunk.
+*/
+
+#ifndef CAPTUREREADER_H
+#define CAPTUREREADER_H
+
+#include <stddef.h>
+#include "SerialCapture.h"
+
+typedef struct
+{
+	const UInt8 *pBase;					//!< Mapped capture file
+	size_t Size;						//!< Capture file size
+	const CaptureIndexEntry_t *pIndex;	//!< Mapped index entries, or NULL
+	size_t IndexCount;					//!< Number of index entries
+	const void *pIndexMap;				//!< Mapped index file
+	size_t IndexMapSize;				//!< Index file size
+	UInt64 StartNs;						//!< Host time the capture was opened
+} CaptureReader_t;
+
+//! One captured chunk, pointing into the mapping
+typedef struct
+{
+	UInt64 HostNs;						//!< Host time the chunk was read
+	const UInt8 *pData;					//!< Chunk bytes
+	UInt32 Length;						//!< Number of bytes
+	UInt32 Dropped;						//!< Bytes lost just before this chunk
+	UInt64 Offset;						//!< File offset of this chunk
+	UInt64 Next;						//!< File offset of the following chunk
+} CaptureChunk_t;
+
+BOOL crOpen(CaptureReader_t *pReader, const char *pPath);
+void crClose(CaptureReader_t *pReader);
+UInt64 crFirstChunk(const CaptureReader_t *pReader);
+BOOL crChunkAt(const CaptureReader_t *pReader, UInt64 Offset, CaptureChunk_t *pChunk);
+UInt64 crSeekTime(const CaptureReader_t *pReader, UInt64 HostNs);
+
+#endif // CAPTUREREADER_H
@@ -0,0 +1,85 @@
+/*! \file
+	\brief Columnar export of decoded high speed samples.
+
+	A column file holds one contiguous array per field, so analysis tools
+	can map a column straight into memory with no parsing.  The columns
+	are listed in ColumnExportColumns and are always written in this order:
+
+	host_ns (u8), time_since_pps (f4, ms), pps_count (u1), seq (u1),
+	gyro_x, gyro_y, gyro_z (f4, deg/s), accel_x, accel_y, accel_z (f4,
+	m/s^2), angle (f4, deg), bias (f4, deg/s)
+
+	File:   ColumnFileHeader_t, then ColumnCount ColumnDesc_t, then the
+	        columns, each starting on a CE_ALIGN_BYTES boundary.
+	Unlike the other logs every value, header included, is little-endian
+	whatever the host, so the file can be read on any machine.  Each
+	descriptor carries a numpy dtype string; with numpy a column is
+
+	    np.memmap(path, dtype=desc.dtype, mode='r', offset=desc.offset,
+	              shape=(header.rows,))
+
+	The writer is fed one sample at a time and buffers CE_CHUNK_ROWS rows
+	per column, spilling full chunks to one temporary file per column.
+	Closing writes the header and copies the columns into place, so memory
+	stays bounded however long the capture is.
+*/
+
+#ifndef COLUMNEXPORT_H
+#define COLUMNEXPORT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "IMUExternalTypes.h"
+
+#define CE_MAGIC			"CIMUCOL1"
+#define CE_ALIGN_BYTES		64				//!< Column alignment, a cache line
+#define CE_CHUNK_ROWS		65536			//!< Rows buffered per column before spilling
+#define CE_NAME_LEN			16
+#define CE_COLUMNS			12
+
+//! File header, followed by ColumnCount ColumnDesc_t
+typedef struct
+{
+	char     Magic[8];						//!< CE_MAGIC
+	uint32_t HeaderBytes;					//!< Size of this header plus the column table
+	uint32_t ColumnCount;
+	uint64_t Rows;							//!< Elements in every column
+	uint32_t Align;							//!< CE_ALIGN_BYTES
+	uint32_t Reserved;
+} ColumnFileHeader_t;
+
+//! Describes one column
+typedef struct
+{
+	char     Name[CE_NAME_LEN];				//!< NULL padded column name
+	char     DType[4];						//!< NULL padded numpy dtype, "<f4", "<u8" or "|u1"
+	uint32_t ElementBytes;
+	uint64_t Offset;						//!< File offset of the first element
+} ColumnDesc_t;
+
+//! One row of the export
+typedef struct
+{
+	UInt64 HostNs;							//!< Host arrival time in nanoseconds
+	float TimeSincePPS;						//!< IMU time in milliseconds
+	UInt8 PPSCount;
+	UInt8 SequenceNumber;
+	float Sensors[N_SENSOR_IDX];			//!< Converted gyro and accelerometer readings
+	float Angle;							//!< Filtered angle in degrees
+	float Bias;								//!< Estimated gyro bias in deg/s
+} ColumnRow_t;
+
+typedef struct ColumnWriter_t ColumnWriter_t;
+
+extern const ColumnDesc_t ColumnExportColumns[CE_COLUMNS];
+
+void ceFillRow(ColumnRow_t *pRow, const IMUData_t *pData, UInt64 HostNs, float Angle, float Bias);
+
+ColumnWriter_t *ceOpen(const char *pPath);
+BOOL cePut(ColumnWriter_t *pWriter, const ColumnRow_t *pRow);
+UInt64 ceRows(const ColumnWriter_t *pWriter);
+BOOL ceClose(ColumnWriter_t *pWriter);
+
+BOOL ceReadHeader(FILE *pFile, ColumnFileHeader_t *pHeader, ColumnDesc_t *pColumns, UInt32 MaxColumns);
+
+#endif // COLUMNEXPORT_H
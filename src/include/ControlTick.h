@@ -0,0 +1,97 @@
+/*! \file
+	\brief Fixed rate control tick, decoupled from IMU packet arrival.
+
+	The serial loop runs whenever bytes arrive, so anything driven from it
+	runs at the UART's rate and phase.  The control tick runs a callback
+	from its own thread at a fixed rate instead, every period from an
+	absolute deadline so the phase never drifts, whatever the callback or
+	the scheduler cost.
+
+	The serial thread hands each filtered sample over with ctPublish(),
+	which copies its AnglePredictor_t into a ControlSnapshot_t under a
+	sequence lock: the writer never waits and the tick reads a consistent
+	copy without a lock, retrying in the rare case it overlapped a write.
+	A reader that keeps overlapping, such as a real-time tick spinning on
+	the core of a preempted writer, gives up and keeps its last copy.
+	The tick then predicts the angle for its own deadline plus a lead, the
+	time a command takes to act, so the controller sees the angle at the
+	moment its output matters rather than when the IMU last sampled.
+
+	If the thread wakes a whole period or more late, the deadlines it
+	slept through are counted as missed and skipped rather than run back
+	to back, keeping the phase.  A callback that ends after the next
+	deadline counts as an overrun.  Wake up jitter, from the deadline to
+	the callback starting, and the callback run time go into histograms,
+	see ctGetStats() and ctPrintStats().
+
+	Deadlines are on the htNowNs() clock.  Off Windows the thread sleeps
+	with clock_nanosleep() on an absolute CLOCK_MONOTONIC time, on Windows
+	with a high resolution waitable timer.
+*/
+
+#ifndef CONTROLTICK_H
+#define CONTROLTICK_H
+
+#include <stdio.h>
+#include "AnglePredict.h"
+#include "LatencyHistogram.h"
+#include "RealTime.h"
+
+//! Latest filtered sample, written by the serial thread, read by the tick
+typedef struct
+{
+	volatile UInt32 Sequence;				//!< Odd while a write is in progress
+	UInt32 Published;						//!< Samples published
+	AnglePredictor_t Predictor;
+} ControlSnapshot_t;
+
+//! What the callback is given each tick
+typedef struct
+{
+	UInt64 Tick;							//!< Deadlines since the start, missed ones included
+	UInt64 DeadlineNs;						//!< When this tick was due
+	UInt64 WakeNs;							//!< When it started
+	float Angle;							//!< Angle predicted for DeadlineNs plus the lead
+	float Rate;								//!< Bias corrected rate
+	float SampleAngle;						//!< Filtered angle of the newest sample, not predicted
+	float SampleAgeMs;						//!< Age of the newest sample at the deadline
+	UInt32 Samples;							//!< Samples published, unchanged since the last tick means no new data
+} ControlTickInfo_t;
+
+typedef void (*ControlCallback_t)(void *pArg, const ControlTickInfo_t *pTick);
+
+//! Tick settings
+typedef struct
+{
+	double RateHz;
+	UInt64 LeadNs;							//!< How far past the deadline to predict
+	ControlCallback_t pCallback;
+	void *pArg;								//!< Passed to the callback
+	const ControlSnapshot_t *pSnapshot;		//!< Where the samples come from
+	const RealTimeConfig_t *pRealTime;		//!< Applied to the tick thread, NULL for none
+} ControlTickConfig_t;
+
+//! Tick counters and distributions
+typedef struct
+{
+	UInt64 Ticks;							//!< Callbacks run
+	UInt64 Missed;							//!< Deadlines skipped
+	UInt64 Overruns;						//!< Callbacks that ended past the next deadline
+	UInt64 Stale;							//!< Ticks without a new sample since the last one
+	UInt32 RealTime;						//!< RT_ flags applied to the tick thread
+	LatencyHistogram_t Jitter;				//!< Deadline to callback start
+	LatencyHistogram_t Run;					//!< Callback run time
+} ControlTickStats_t;
+
+typedef struct ControlTick_t ControlTick_t;
+
+void ctInitSnapshot(ControlSnapshot_t *pSnapshot);
+void ctPublish(ControlSnapshot_t *pSnapshot, const AnglePredictor_t *pPredictor);
+BOOL ctRead(const ControlSnapshot_t *pSnapshot, AnglePredictor_t *pPredictor, UInt32 *pPublished);
+
+ControlTick_t *ctStart(const ControlTickConfig_t *pConfig);
+void ctGetStats(const ControlTick_t *pTick, ControlTickStats_t *pStats);
+void ctPrintStats(const ControlTick_t *pTick, FILE *pFile);
+void ctStop(ControlTick_t *pTick);
+
+#endif // CONTROLTICK_H
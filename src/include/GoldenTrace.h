@@ -0,0 +1,93 @@
+/*! \file
+	\brief Golden traces of the decode and filter pipeline.
+
+	gtRun() feeds a byte stream through the path main.c runs on the robot,
+	LookForIMUPacketInByte(), DecodeIMUPacket(), TiltRollDeg() and
+	kfGetAngle() with the kfInit() parameters, and records what came out:
+
+	- the number of packets of each type and the HS samples seen before
+	  the first resolution packet, which can't be converted,
+	- for every HS sample after it, or every TraceEvery-th, the time, PPS
+	  count and sequence number, the six converted channels, and the
+	  filter angle and bias,
+	- the mean of each of those fields over all the samples, so samples
+	  left out of a thinned trace still count.
+
+	The filter step comes from the IMU clock, see recClockStep(), so a
+	trace means the same at any sample rate.
+
+	gtWrite() stores a trace as text with every float to full precision,
+	and gtRead() reads it back.  gtCompare() checks a new trace against a
+	stored one: packet counts, sample counts, PPS counts and sequence
+	numbers must match exactly, and every float must be within the
+	tolerance of its field.  The tolerances leave room for a different
+	compiler or FPU, not for a change of behaviour.  Each golden file also
+	holds the pipeline throughput when it was recorded, so a run can
+	report performance against it.
+*/
+
+#ifndef GOLDENTRACE_H
+#define GOLDENTRACE_H
+
+#include <stdio.h>
+#include "IMUExternalTypes.h"
+
+#define GT_TOL_TIME			1.0e-4			//!< TimeSincePPS, ms
+#define GT_TOL_GYRO			1.0e-4			//!< deg/s
+#define GT_TOL_ACCEL		1.0e-5			//!< m/s^2
+#define GT_TOL_ANGLE		1.0e-3			//!< deg
+#define GT_TOL_BIAS			1.0e-4			//!< deg/s
+#define GT_MAX_REPORTS		5				//!< Mismatches printed per field
+
+//! Floats of a sample, the order of the columns in a golden file
+typedef enum
+{
+	GT_TIME,
+	GT_GYROX, GT_GYROY, GT_GYROZ,
+	GT_ACCELX, GT_ACCELY, GT_ACCELZ,
+	GT_ANGLE,
+	GT_BIAS,
+	GT_FIELDS
+} GoldenField_t;
+
+//! One traced sample
+typedef struct
+{
+	UInt8 PPSCount;
+	UInt8 SequenceNumber;
+	float Value[GT_FIELDS];
+} GoldenSample_t;
+
+//! What the pipeline made of a stream
+typedef struct
+{
+	UInt64 Bytes;							//!< Stream length
+	UInt64 Packets;							//!< Valid packets of any type
+	UInt64 TypeCount[256];					//!< Valid packets of each type
+	UInt64 Skipped;							//!< HS samples before the resolution packet
+	UInt64 Samples;							//!< HS samples filtered
+	UInt32 TraceEvery;						//!< Every how many samples one is traced
+	GoldenSample_t *pTrace;
+	UInt32 TraceCount;
+	UInt32 TraceCapacity;
+	double Mean[GT_FIELDS];					//!< Over all the samples filtered
+	double SamplesPerSec;					//!< Throughput when recorded, 0 if unknown
+} GoldenTrace_t;
+
+//! Largest difference allowed in each field
+typedef struct
+{
+	double Field[GT_FIELDS];
+} GoldenTolerance_t;
+
+void gtDefaultTolerance(GoldenTolerance_t *pTol);
+BOOL gtRun(const UInt8 *pBytes, UInt64 Count, UInt32 TraceEvery, GoldenTrace_t *pTrace);
+void gtFree(GoldenTrace_t *pTrace);
+BOOL gtWrite(const char *pPath, const char *pName, const GoldenTrace_t *pTrace);
+BOOL gtRead(const char *pPath, GoldenTrace_t *pTrace);
+UInt64 gtCompare(const GoldenTrace_t *pGolden, const GoldenTrace_t *pTrace, const GoldenTolerance_t *pTol,
+				 FILE *pReport);
+
+extern const char *const GoldenFieldNames[GT_FIELDS];
+
+#endif // GOLDENTRACE_H
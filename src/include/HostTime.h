@@ -0,0 +1,22 @@
+/*! \file
+	\brief Monotonic host clock used to timestamp serial data and pipeline
+	stages.  The clock never jumps with wall-clock adjustments.
+*/
+
+#ifndef HOSTTIME_H
+#define HOSTTIME_H
+
+#include "Types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+UInt64 htNowNs(void);
+void htSleepMs(UInt32 Ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOSTTIME_H
@@ -0,0 +1,55 @@
+/*! \file
+	\brief Fixed point decode path for targets without an FPU.
+
+	The high speed converted packet carries each sensor as a signed 16-bit
+	count scaled by the sensor range.  Instead of converting to float, the
+	counts are scaled straight to Q16.16 engineering units with a 32-bit
+	multiplier computed once from GyroRange and AccelRange.  Tilt is computed
+	with an integer atan2.  Angles and rates are in degrees and deg/s,
+	accelerations in m/s/s, just like the float path.  IMUDataFromQ() gives
+	the float view of a sample for whatever consumes one, such as the
+	telemetry log, at the edge of the fixed point pipeline.
+*/
+
+#ifndef IMUFIXED_H
+#define IMUFIXED_H
+
+#include <stdint.h>
+#include "IMUPacket.h"
+
+// Exact width types; SInt32 is 64 bits on LP64 hosts, which would hide
+//   overflows when the fixed point path is checked on a PC
+typedef int32_t Q16_t;	//!< Signed Q16.16 fixed point
+typedef int32_t Q24_t;	//!< Signed Q8.24 fixed point
+
+#define Q16_ONE				(1L << 16)
+#define FLOAT_TO_Q16(x)		((Q16_t)((x) * 65536.0 + (((x) >= 0) ? 0.5 : -0.5)))
+#define Q16_TO_FLOAT(x)		((float)(x) * (1.0f / 65536.0f))
+#define FLOAT_TO_Q24(x)		((Q24_t)((x) * 16777216.0 + (((x) >= 0) ? 0.5 : -0.5)))
+#define Q24_TO_FLOAT(x)		((float)(x) * (1.0f / 16777216.0f))
+
+//! Count to engineering unit multipliers, derived from the sensor ranges
+typedef struct
+{
+	UInt32 GyroMul;		//!< deg/s per count, scaled by 2^32
+	UInt32 AccelMul;	//!< m/s/s per count, scaled by 2^32
+} IMUFixedScale_t;
+
+//! Fixed point counterpart of the high speed fields of IMUData_t
+typedef struct
+{
+	SInt16 Raw[N_SENSOR_IDX];			//!< Sensor counts as received
+	Q16_t  Converted[N_SENSOR_IDX];		//!< Sensor readings in engineering units
+	UInt32 PPSTicks;					//!< Time since PPS in 0.1 microsecond ticks
+	UInt8  PPSCount;					//!< Number of PPS signals captured
+	UInt8  SequenceNumber;				//!< Packet sequence number
+} IMUDataQ_t;
+
+void SetFixedScale(IMUFixedScale_t *pScale, const IMUData_t *pData);
+void DecodeHighSpeedDataPacketQ(const IMUPacket_t *pPkt, const IMUFixedScale_t *pScale, IMUDataQ_t *pData);
+void IMUDataFromQ(IMUData_t *pData, const IMUDataQ_t *pDataQ);
+
+Q16_t FixedAtan2Deg(SInt32 y, SInt32 x);
+Q16_t TiltRollQ(const IMUDataQ_t *pData);
+
+#endif // IMUFIXED_H
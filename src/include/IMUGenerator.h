@@ -0,0 +1,107 @@
+/*! \file
+	\brief Synthetic IMU byte stream generator.
+
+	Produces the byte stream an IMU would send, using the same packet
+	encoders the protocol code uses, so the parser, decoder and filter can be
+	exercised without hardware and at any rate.
+
+	The motion is a roll angle about the X axis, scripted as a list of
+	segments.  For every sample the generator computes the true angle and
+	rate, adds gyro bias (a random walk) and white noise, and emits a
+	HS_SERIAL_IMU_MSG packet, optionally followed by HS_RAW_IMU_MSG and
+	TIMING_IMU_MSG packets.  The configuration responses the host asks for at
+	startup are available from genConfigResponse().
+
+	Profile scripts are text, one segment per line, '#' starts a comment:
+		hold <seconds> <degrees>			step to an angle and hold it
+		ramp <seconds> <degrees>			move linearly to an angle
+		sine <seconds> <degrees> <Hz>		oscillate about the current angle
+*/
+
+#ifndef IMUGENERATOR_H
+#define IMUGENERATOR_H
+
+#include <stdint.h>
+#include "IMUPacket.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Most bytes genStep() can produce for one sample
+#define GEN_MAX_STEP_BYTES		(3 * (MAX_PAYLOAD_BYTES + 6))
+
+//! Most bytes genConfigResponse() can produce
+#define GEN_MAX_CONFIG_BYTES	(5 * (MAX_PAYLOAD_BYTES + 6))
+
+typedef enum
+{
+	GEN_HOLD,								//!< Step to Angle and hold it
+	GEN_RAMP,								//!< Move linearly to Angle
+	GEN_SINE								//!< Oscillate Angle about the start angle at FreqHz
+} GenMotion_t;
+
+//! One segment of a motion profile
+typedef struct
+{
+	GenMotion_t Motion;
+	double Duration;						//!< Seconds
+	double Angle;							//!< Degrees, target or amplitude
+	double FreqHz;							//!< GEN_SINE only
+} GenSegment_t;
+
+//! Generator settings, see genDefaultConfig()
+typedef struct
+{
+	double RateHz;							//!< High speed sample rate
+	float  GyroRange;						//!< Degrees per second
+	float  AccelRange;						//!< g
+	double GyroNoise;						//!< Gyro white noise, deg/s RMS per sample
+	double AccelNoise;						//!< Accel white noise, m/s^2 RMS per sample
+	double GyroBias;						//!< Initial gyro bias, deg/s
+	double BiasWalk;						//!< Gyro bias random walk, deg/s per root second
+	UInt32 RawEvery;						//!< Add a HS_RAW_IMU_MSG every N samples, 0 for never
+	UInt32 TimingEvery;						//!< Add a TIMING_IMU_MSG every N samples, 0 for never
+	UInt32 Seed;							//!< Noise seed, equal seeds give equal streams
+	const GenSegment_t *pProfile;			//!< Motion segments, not copied
+	UInt32 ProfileCount;					//!< Number of segments
+} GenConfig_t;
+
+//! True state at one sample
+typedef struct
+{
+	double Time;							//!< Seconds since the start
+	float  Angle;							//!< Roll angle, degrees
+	float  Rate;							//!< Roll rate, deg/s
+	float  Bias;							//!< X gyro bias, deg/s
+	UInt8  SequenceNumber;					//!< Sequence number of the sample
+} GenTruth_t;
+
+typedef struct
+{
+	GenConfig_t Config;
+	IMUData_t Data;							//!< Values being encoded
+	UInt64 Sample;							//!< Samples produced
+	UInt32 Segment;							//!< Current profile segment
+	double SegmentStart;					//!< Time the segment started
+	double StartAngle;						//!< Angle when the segment started
+	double Angle;							//!< Current true angle
+	double Bias[3];							//!< Gyro biases
+	uint32_t Rng;							//!< Noise generator state, 32 bits on every host
+	double Spare;							//!< Second normal deviate
+	BOOL HaveSpare;
+} IMUGenerator_t;
+
+void genDefaultConfig(GenConfig_t *pConfig);
+void genInit(IMUGenerator_t *pGen, const GenConfig_t *pConfig);
+double genDuration(const GenConfig_t *pConfig);
+UInt32 genConfigResponse(IMUGenerator_t *pGen, UInt8 *pOut);
+UInt32 genStep(IMUGenerator_t *pGen, UInt8 *pOut, GenTruth_t *pTruth);
+UInt32 genFill(IMUGenerator_t *pGen, UInt8 *pBuf, UInt32 Size, UInt32 *pSamples);
+int genLoadProfile(const char *pPath, GenSegment_t *pSegments, UInt32 Max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IMUGENERATOR_H
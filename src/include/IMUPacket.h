@@ -94,6 +94,22 @@ typedef struct
 
 void DecodeIMUPacket(const IMUPacket_t *pPkt, IMUData_t *pData);
 
+// Packet header and CRC, and serialization to the wire format
+void MakeIMUPacket(IMUPacket_t *pPkt, UInt8 Type, UInt8 Len);
+UInt32 IMUPacketToBytes(const IMUPacket_t *pPkt, UInt8 *pBytes);
+
+// Telemetry packets, as sent by the IMU
+void FormHighSpeedDataPacket(IMUPacket_t *pPkt, const IMUData_t *pData);
+void FormHighSpeedRawDataPacket(IMUPacket_t *pPkt, const IMUData_t *pData);
+void FormTimingPacket(IMUPacket_t *pPkt, const IMUData_t *pData);
+
+// Configuration packets, as sent by the IMU
+void FormResolutionPacket(IMUPacket_t *pPkt, const IMUData_t *pData);
+void FormSettingsReplyPacket(IMUPacket_t *pPkt, const IMUData_t *pData);
+void FormSoftwareVersionPacket(IMUPacket_t *pPkt, const IMUData_t *pData);
+void FormHardwareConfigPacket(IMUPacket_t *pPkt, const IMUData_t *pData);
+void FormDatesPacket(IMUPacket_t *pPkt, const IMUData_t *pData);
+
 // System settings packets
 void FormSettingsPacket(IMUPacket_t *pPkt, const IMUData_t *pData);
 void FormConfigurationRequestPacket(IMUPacket_t *pPkt, const IMUData_t *pData);
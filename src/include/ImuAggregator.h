@@ -0,0 +1,101 @@
+/*! \file
+	\brief Several IMUs read by one thread, with time aligned sample sets.
+
+	Each port added with agAddPort() or agOpenPort() gets its own packet
+	parser, IMUData_t and Kalman filter, exactly the state the main loop
+	keeps for its one IMU, and the whole lot is serviced by agPoll(): one
+	epoll_wait() for every port, then a read() of whatever each ready port
+	has.  No thread per port, no locks; eight ports at full rate are a few
+	percent of one core, see src/tools/aggbench.c.
+
+	Every sample is stamped on the common host clock, htNowNs(), when the
+	byte completing its packet arrived.  A read() hands over everything the
+	driver had, so the stamp is the read time less the time the bytes after
+	the packet took on the wire at the port's baud rate.  Each port keeps
+	its last AG_HISTORY samples.
+
+	IMUs aren't sampled together, so their newest samples are from
+	different times.  agAlign() gives every port's sample at one time,
+	interpolated between the two samples either side of it.  After each
+	agPoll() the set callback gets the set at the newest time every live
+	port has a sample for: a port that has said nothing for MaxSilenceNs is
+	left out, so a dead IMU doesn't stop the others.  A set comes whenever
+	the port furthest behind catches up, so staggered ports give up to one
+	per sample of any port, each at most a sample period old.
+
+	Ports start by asking the IMU for its configuration, as the main loop
+	does, and only filter once the sensor ranges have arrived.
+
+	Linux only; epoll() has no counterpart the rest of the code could use
+	on Windows.
+*/
+
+#ifndef IMUAGGREGATOR_H
+#define IMUAGGREGATOR_H
+
+#include "IMUPacket.h"
+
+#define AG_MAX_PORTS		16				//!< Most ports one aggregator serves
+#define AG_HISTORY			32				//!< Samples kept per port, a power of two
+#define AG_NAME_BYTES		32				//!< Longest port name, with its terminator
+
+//! One filtered sample
+typedef struct
+{
+	UInt64 HostNs;							//!< Arrival on the common clock
+	float  Sensors[N_SENSOR_IDX];			//!< Converted gyro and accelerometer readings
+	float  Angle;							//!< Filtered roll angle, degrees
+	float  Rate;							//!< Bias corrected roll rate, deg/s
+	float  Bias;							//!< Estimated gyro bias, deg/s
+	float  AngleVar;						//!< Filter's angle variance, deg^2
+	UInt8  SequenceNumber;					//!< IMU packet sequence number
+	UInt8  Missed;							//!< Samples missing just before this one by sequence number
+} AggSample_t;
+
+//! One port's part of a set
+typedef struct
+{
+	BOOL   Valid;							//!< FALSE if the port has no samples either side of the time
+	UInt64 GapNs;							//!< Time between the samples interpolated, 0 if exact
+	float  GyroRange;						//!< Port's gyro range, deg/s, 0 until configured
+	float  AccelRange;						//!< Port's accelerometer range, g, 0 until configured
+	AggSample_t Sample;						//!< The sample at the set's time, Missed that of the later one
+} AggPortSample_t;
+
+//! Every port's sample at one time
+typedef struct
+{
+	UInt64 TimeNs;							//!< Common clock time of the set
+	UInt32 Ports;							//!< Ports in Port[]
+	UInt32 ValidPorts;						//!< Of them, with a Valid sample
+	AggPortSample_t Port[AG_MAX_PORTS];
+} AggSet_t;
+
+//! Port counters
+typedef struct
+{
+	UInt64 Bytes;							//!< Bytes read
+	UInt64 Reads;							//!< read() calls returning data
+	UInt64 Packets;							//!< Packets with a good CRC
+	UInt64 Samples;							//!< Samples through the filter
+	UInt64 SequenceGaps;					//!< Samples missing by their sequence numbers
+	UInt64 ConfigRequests;					//!< Configuration requests sent
+} AggPortStats_t;
+
+//! Called from agPoll() with each new set
+typedef void (*AggSetCallback_t)(void *pArg, const AggSet_t *pSet);
+
+typedef struct Aggregator_t Aggregator_t;
+
+Aggregator_t *agCreate(UInt64 MaxSilenceNs, AggSetCallback_t pCallback, void *pArg);
+int agAddPort(Aggregator_t *pAgg, int Fd, const char *pName, UInt32 Baud, double SampleHz);
+int agOpenPort(Aggregator_t *pAgg, const char *pDevice, UInt32 Baud, double SampleHz);
+UInt32 agPoll(Aggregator_t *pAgg, int TimeoutMs);
+BOOL agAlign(const Aggregator_t *pAgg, UInt64 TimeNs, AggSet_t *pSet);
+BOOL agNewest(const Aggregator_t *pAgg, UInt32 Port, AggSample_t *pSample);
+UInt32 agPorts(const Aggregator_t *pAgg);
+const char *agPortName(const Aggregator_t *pAgg, UInt32 Port);
+void agGetPortStats(const Aggregator_t *pAgg, UInt32 Port, AggPortStats_t *pStats);
+void agDestroy(Aggregator_t *pAgg);
+
+#endif // IMUAGGREGATOR_H
@@ -0,0 +1,58 @@
+/*! \file
+	\brief Offline search for the Kalman filter noise parameters.
+
+	A candidate (Q_angle, Q_bias, R_measure) is scored by replaying
+	recorded runs through the angle filter and taking the RMS error of its
+	angle against a reference angle, leaving out the first samples of each
+	run while the filter settles.
+
+	The filter is run KT_LANES candidates at a time.  The candidates of a
+	batch share the inputs and differ only in their parameters, so each
+	step of kfGetAngle() becomes one pass over KT_LANES wide arrays that
+	the compiler turns into SIMD instructions, with the same float
+	operations in the same order as kfGetAngle().  Batches and runs are
+	spread over a thread pool with tpForEach(), which steals work so long
+	and short runs balance.
+
+	The search is a log spaced grid, followed by Nelder-Mead on the
+	logarithms of the parameters started from the best grid point.  Each
+	Nelder-Mead step scores its reflection, expansion and both
+	contractions together as one batch instead of one after another.
+*/
+
+#ifndef KALMANTUNE_H
+#define KALMANTUNE_H
+
+#include "IMUExternalTypes.h"
+#include "ThreadPool.h"
+
+#define KT_LANES			8				//!< Candidates filtered together
+
+//! One candidate
+typedef struct
+{
+	float Q_angle;
+	float Q_bias;
+	float R_measure;
+} KalmanParams_t;
+
+//! One recorded run, one entry per sample in each array
+typedef struct
+{
+	const float *pTilt;						//!< Accelerometer angle, deg
+	const float *pRate;						//!< Gyro rate, deg/s
+	const float *pStep;						//!< Filter step, s
+	const float *pReference;				//!< Reference angle, deg
+	UInt32 Count;
+	UInt32 Skip;							//!< Samples left out of the score
+} TuneRun_t;
+
+void ktScoreBatch(const TuneRun_t *pRun, const KalmanParams_t *pParams, UInt32 Count,
+				  double *pSumSquares, UInt64 *pScored);
+BOOL ktScore(const TuneRun_t *pRuns, UInt32 Runs, const KalmanParams_t *pParams, UInt32 Count,
+			 ThreadPool_t *pPool, double *pScores);
+UInt32 ktGrid(const KalmanParams_t *pLo, const KalmanParams_t *pHi, UInt32 Steps, KalmanParams_t *pOut);
+double ktNelderMead(const TuneRun_t *pRuns, UInt32 Runs, ThreadPool_t *pPool, KalmanParams_t *pBest,
+					double Spread, UInt32 MaxSteps, UInt32 *pSteps);
+
+#endif // KALMANTUNE_H
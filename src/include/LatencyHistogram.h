@@ -0,0 +1,39 @@
+/*! \file
+	\brief Fixed size latency histogram with log-linear buckets.
+
+	Latencies from nanoseconds to centuries go into LH_BUCKETS buckets,
+	four per power of two, so adding one is a few instructions, takes no
+	memory and percentiles read from it are good to 25%.  The exact count,
+	minimum, maximum and mean are kept alongside.
+
+	A histogram isn't synchronised; one thread adds to it and others only
+	read it for reports, which may then be off by the samples in flight.
+*/
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <stdio.h>
+#include "IMUExternalTypes.h"
+
+#define LH_SUB_BITS		2					//!< log2 of the buckets per power of two
+#define LH_BUCKETS		(((64 - LH_SUB_BITS) << LH_SUB_BITS) + (1 << LH_SUB_BITS))
+#define LH_TEXT_BYTES	16					//!< Space lhFormatNs() needs
+
+typedef struct
+{
+	UInt64 Buckets[LH_BUCKETS];
+	UInt64 Count;
+	UInt64 Min;
+	UInt64 Max;
+	double Sum;
+} LatencyHistogram_t;
+
+void lhReset(LatencyHistogram_t *pHist);
+void lhAdd(LatencyHistogram_t *pHist, UInt64 Ns);
+UInt64 lhPercentile(const LatencyHistogram_t *pHist, double Fraction);
+const char *lhFormatNs(double Ns, char *pText);
+void lhPrint(FILE *pFile, const char *pName, const LatencyHistogram_t *pHist);
+void lhPrintSummary(FILE *pFile, const char *pName, const LatencyHistogram_t *pHist);
+
+#endif // LATENCYHISTOGRAM_H
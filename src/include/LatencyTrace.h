@@ -0,0 +1,173 @@
+/*! \file
+	\brief Stage timestamps from serial read to filtered angle.
+
+	Built with IMU_LATENCY_TRACE defined, the pipeline stamps each packet
+	as it goes through four stages:
+
+	- LT_SERIAL_READ, the read that returned the packet's last byte,
+	- LT_FRAME_COMPLETE, LookForIMUPacketInByte() returning TRUE,
+	- LT_DECODE_DONE, DecodeIMUPacket() done,
+	- LT_FILTER_DONE, the new angle available, HS packets only.
+
+	The time of each read is kept with LT_READ() and only used when a
+	packet completes, so reads that complete nothing cost one clock read.
+	LT_FRAME() starts a packet's record, LT_STAGE() stamps the later stages
+	and LT_END() commits it to the calling thread's ring.  Each thread has
+	its own ring of the last LT_RING_RECORDS records, made on its first
+	stamp, so stamping takes no lock and touches no shared cache line.
+	Rings are never freed and are read by ltPrintHistograms(),
+	ltPrintSummary() and ltWriteChromeTrace(), best while the stamping
+	threads are quiet, as records being overwritten can be read torn.
+
+	Stamps are CLOCK_MONOTONIC_RAW, which no time adjustment slews, or with
+	IMU_LATENCY_TSC on x86 the time stamp counter, about a quarter of the
+	cost, converted to nanoseconds on export against CLOCK_MONOTONIC_RAW.
+
+	The histograms have four buckets per power of two, so percentiles are
+	good to 25%.  The Chrome trace is JSON that chrome://tracing and
+	Perfetto open, with one track per thread and a slice per stage of each
+	packet.
+
+	Without IMU_LATENCY_TRACE every macro is empty and LatencyTrace.c
+	compiles to nothing.
+*/
+
+#ifndef LATENCYTRACE_H
+#define LATENCYTRACE_H
+
+#include <stdio.h>
+#include "IMUExternalTypes.h"
+
+//! Pipeline stages, in order
+typedef enum
+{
+	LT_SERIAL_READ,
+	LT_FRAME_COMPLETE,
+	LT_DECODE_DONE,
+	LT_FILTER_DONE,
+	LT_STAGES
+} LatencyStage_t;
+
+#ifdef IMU_LATENCY_TRACE
+
+#include "Atomic.h"
+
+#ifdef WIN32
+#define LT_THREAD_LOCAL		__declspec(thread)
+#include "HostTime.h"
+#else
+#define LT_THREAD_LOCAL		__thread
+#include <time.h>
+#endif
+
+#if defined(IMU_LATENCY_TSC) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define LT_USE_TSC
+#endif
+
+#define LT_RING_RECORDS		65536			//!< Records kept per thread, a power of two
+
+//! Stamps of one packet, 0 for a stage it didn't reach
+typedef struct
+{
+	UInt64 Stamp[LT_STAGES];
+	UInt32 Packet;							//!< Packet number in its thread
+	UInt8 Type;								//!< Packet type
+} LatencyRecord_t;
+
+typedef struct LatencyRing_t
+{
+	LatencyRecord_t Current;				//!< Packet being stamped
+	UInt64 ReadStamp;						//!< Time of the last read
+	UInt32 Thread;							//!< Thread number, in order of first stamp
+	struct LatencyRing_t *pNext;			//!< Next ring of the list of all of them
+	volatile UInt64 Head;					//!< Records committed
+	LatencyRecord_t Records[LT_RING_RECORDS];
+} LatencyRing_t;
+
+extern LT_THREAD_LOCAL LatencyRing_t *pLatencyRing;
+
+LatencyRing_t *ltMakeRing(void);
+void ltPrintHistograms(FILE *pFile);
+void ltPrintSummary(FILE *pFile);
+BOOL ltWriteChromeTrace(const char *pPath);
+
+
+/*! Read the stamp clock.
+	\return Clock ticks, nanoseconds unless LT_USE_TSC.*/
+static inline UInt64 ltNow(void)
+{
+#if defined(LT_USE_TSC)
+	return __rdtsc();
+#elif defined(WIN32)
+	return htNowNs();
+#else
+	struct timespec Ts;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &Ts);
+	return (UInt64)Ts.tv_sec * 1000000000ULL + (UInt64)Ts.tv_nsec;
+#endif
+
+}// ltNow
+
+
+static inline LatencyRing_t *ltRing(void)
+{
+	return pLatencyRing ? pLatencyRing : ltMakeRing();
+
+}// ltRing
+
+
+static inline void ltRead(void)
+{
+	ltRing()->ReadStamp = ltNow();
+
+}// ltRead
+
+
+static inline void ltFrame(UInt8 Type)
+{
+	LatencyRing_t *pRing = ltRing();
+
+	pRing->Current.Stamp[LT_FRAME_COMPLETE] = ltNow();
+	pRing->Current.Stamp[LT_SERIAL_READ] = pRing->ReadStamp;
+	pRing->Current.Stamp[LT_DECODE_DONE] = 0;
+	pRing->Current.Stamp[LT_FILTER_DONE] = 0;
+	pRing->Current.Type = Type;
+
+}// ltFrame
+
+
+static inline void ltStage(LatencyStage_t Stage)
+{
+	ltRing()->Current.Stamp[Stage] = ltNow();
+
+}// ltStage
+
+
+static inline void ltEnd(void)
+{
+	LatencyRing_t *pRing = ltRing();
+	UInt64 Head = pRing->Head;
+
+	pRing->Records[Head & (LT_RING_RECORDS - 1)] = pRing->Current;
+	pRing->Current.Packet++;
+	atomicStoreRelease(&pRing->Head, Head + 1);
+
+}// ltEnd
+
+#define LT_READ()			ltRead()
+#define LT_FRAME(Type)		ltFrame(Type)
+#define LT_STAGE(Stage)		ltStage(Stage)
+#define LT_END()			ltEnd()
+
+#else
+
+#define LT_READ()			((void)0)
+#define LT_FRAME(Type)		((void)0)
+#define LT_STAGE(Stage)		((void)0)
+#define LT_END()			((void)0)
+
+#endif // IMU_LATENCY_TRACE
+
+#endif // LATENCYTRACE_H
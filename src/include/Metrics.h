@@ -0,0 +1,135 @@
+/*! \file
+	\brief Pipeline health metrics in the Prometheus text format.
+
+	Each thread that counts something gets its own MetricsBlock_t, found
+	through a thread local pointer, and is the only one writing it: a
+	counter is bumped with a plain relaxed store, no locked instruction,
+	and never shares a cache line with another thread's.  mtRegister()
+	makes the calling thread's block and names it; until a thread registers,
+	mtCount(), mtGauge() and mtLatency() do nothing, so code shared with the
+	tools, the parser for one, can count unconditionally.
+
+	mtRender() reads every block without stopping its writer and formats
+	the Prometheus exposition text, one sample per metric and thread with
+	a thread label.  Counters and gauges are read whole; a latency summary
+	may be a sample or so behind its count, which a scrape can't tell.
+
+	mtStart() serves the text from a background thread, either over HTTP,
+	"http:[host:]port", answering GET /metrics, e.g.
+
+	    curl http://localhost:9464/metrics
+
+	or by rewriting a file every MT_FILE_PERIOD_MS, "file:path", for the
+	node exporter's textfile collector.  The file is written beside and
+	renamed over, so it is never seen half written.
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include "Atomic.h"
+#include "LatencyHistogram.h"
+
+#ifdef WIN32
+#define MT_THREAD_LOCAL		__declspec(thread)
+#else
+#define MT_THREAD_LOCAL		__thread
+#endif
+
+#define MT_NAME_BYTES		16				//!< Longest thread name, with its terminator
+#define MT_FILE_PERIOD_MS	1000			//!< How often a metrics file is rewritten
+
+//! Counters, only ever increasing
+typedef enum
+{
+	MT_SERIAL_BYTES,						//!< Bytes read from the serial port
+	MT_PACKETS,								//!< Packets with a good CRC
+	MT_CRC_ERRORS,							//!< Packets with a bad CRC
+	MT_LENGTH_ERRORS,						//!< Lengths too long for any packet
+	MT_SAMPLES_FILTERED,					//!< Samples through the filter
+	MT_LOG_DROPPED,							//!< Records the telemetry log had no room for
+	MT_STREAM_DROPPED,						//!< Records the telemetry stream had no room for
+	MT_HEALTH_SATURATED,					//!< Sensor health checks raised, in HealthCheck_t order
+	MT_HEALTH_FLAT,
+	MT_HEALTH_DROPOUT,
+	MT_HEALTH_TEMP_DRIFT,
+	MT_COUNTERS
+} MetricCounter_t;
+
+//! Gauges, the latest value
+typedef enum
+{
+	MT_FILTER_ANGLE,						//!< Filtered angle, degrees
+	MT_FILTER_RATE,							//!< Bias corrected rate, deg/s
+	MT_FILTER_BIAS,							//!< Estimated gyro bias, deg/s
+	MT_LOG_DEPTH,							//!< Records queued for the telemetry log
+	MT_STREAM_DEPTH,						//!< Records queued for the telemetry stream
+	MT_LOG_LOST,							//!< Records failed writes left out of the telemetry log
+	MT_HEALTH_ACTIVE,						//!< Sensor health checks raised now
+	MT_GAUGES
+} MetricGauge_t;
+
+//! One thread's metrics
+typedef struct MetricsBlock_t
+{
+	volatile UInt64 Counters[MT_COUNTERS];
+	volatile double Gauges[MT_GAUGES];
+	UInt32 GaugesSet;						//!< Bit per gauge given a value
+	LatencyHistogram_t Latency;				//!< Frame complete to filtered
+	char Name[MT_NAME_BYTES];				//!< Thread label
+	struct MetricsBlock_t *pNext;			//!< Next block of the list of all of them
+	char Pad[CACHE_LINE_BYTES];				//!< Keeps the next allocation off the last line
+} MetricsBlock_t;
+
+extern MT_THREAD_LOCAL MetricsBlock_t *pMetricsBlock;
+
+typedef struct MetricsExporter_t MetricsExporter_t;
+
+MetricsBlock_t *mtRegister(const char *pName);
+size_t mtRender(char *pText, size_t Bytes);
+MetricsExporter_t *mtStart(const char *pWhere);
+void mtStop(MetricsExporter_t *pExporter);
+
+
+/*! Add to one of the calling thread's counters.
+	\param Counter is the counter.
+	\param Count is how much to add.*/
+static inline void mtCount(MetricCounter_t Counter, UInt64 Count)
+{
+	MetricsBlock_t *pBlock = pMetricsBlock;
+
+	if (pBlock)
+		atomicStoreRelaxed(&pBlock->Counters[Counter], pBlock->Counters[Counter] + Count);
+
+}// mtCount
+
+
+/*! Set one of the calling thread's gauges.
+	\param Gauge is the gauge.
+	\param Value is its value.*/
+static inline void mtGauge(MetricGauge_t Gauge, double Value)
+{
+	MetricsBlock_t *pBlock = pMetricsBlock;
+
+	if (pBlock)
+	{
+		pBlock->Gauges[Gauge] = Value;
+		pBlock->GaugesSet |= 1u << Gauge;
+	}
+
+}// mtGauge
+
+
+/*! Add a pipeline latency to the calling thread's summary.
+	\param Ns is the latency.*/
+static inline void mtLatency(UInt64 Ns)
+{
+	MetricsBlock_t *pBlock = pMetricsBlock;
+
+	if (pBlock)
+		lhAdd(&pBlock->Latency, Ns);
+
+}// mtLatency
+
+#endif // METRICS_H
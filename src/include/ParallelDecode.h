@@ -0,0 +1,62 @@
+/*! \file
+	\brief Parallel framing of capture files.
+
+	A capture is split into units of about PD_UNIT_BYTES at chunk
+	boundaries taken from the index.  Each unit is framed on a worker
+	thread with its own LookForIMUPacketInByte() parser, started at the
+	first sync pair in the unit whose frame passes its CRC.  A worker
+	can't know the parser state at the start of its unit, so it also
+	records the stretches of the unit over which its parser sat in
+	SERIAL_STATE_SYNC0.
+
+	The units are then stitched in order on the calling thread.  The true
+	parser state at the start of a unit is the state at the end of the one
+	before.  From there a serial parser is run over the unit until it is
+	in SERIAL_STATE_SYNC0 at a byte where the worker's parser was too.
+	From that byte on, both parsers do exactly the same thing, since in
+	that state nothing but the coming bytes decides what happens next.
+	Frames before that byte come from the serial run and the rest from
+	the worker.  On a clean stream this takes at most one or two frames.
+	On a stream that never lines up, the serial run simply covers the whole
+	unit.
+
+	The frames handed to the callback are therefore exactly the ones, in
+	the same order, that LookForIMUPacketInByte() returns TRUE for when the
+	capture is fed through it byte by byte.  Units are processed in waves
+	so memory stays bounded, and the next wave is framed while the last
+	one is stitched.
+*/
+
+#ifndef PARALLELDECODE_H
+#define PARALLELDECODE_H
+
+#include "CaptureReader.h"
+#include "IMUPacket.h"
+
+#define PD_UNIT_BYTES		(1UL << 20)		//!< Default file bytes per unit
+#define PD_UNITS_PER_THREAD	2				//!< Units per worker in a wave
+#define PD_SEARCH_BYTES		4096			//!< How far a worker looks for its first frame
+
+//! One complete frame that passed its CRC
+typedef struct
+{
+	IMUPacket_t Pkt;						//!< The frame, as the parser left it
+	UInt64 HostNs;							//!< Time of the chunk holding the last byte
+	UInt64 Position;						//!< Stream offset of the last byte
+} DecodedFrame_t;
+
+typedef void (*FrameCallback_t)(void *pUser, const DecodedFrame_t *pFrame);
+
+typedef struct
+{
+	UInt64 Bytes;							//!< Stream bytes framed
+	UInt64 Frames;							//!< Frames handed to the callback
+	UInt64 Units;							//!< Units the capture was split into
+	UInt64 FixupBytes;						//!< Bytes parsed again while stitching
+	UInt64 ElapsedNs;						//!< Wall time
+} ParallelDecodeStats_t;
+
+BOOL pdDecodeCapture(const CaptureReader_t *pReader, UInt32 Threads, UInt32 UnitBytes,
+					 FrameCallback_t pCallback, void *pUser, ParallelDecodeStats_t *pStats);
+
+#endif // PARALLELDECODE_H
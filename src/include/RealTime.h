@@ -0,0 +1,66 @@
+/*! \file
+	\brief Real-time run mode for the serial, decode and filter thread.
+
+	On the robot the balance loop shares cores with logging and networking,
+	and a sample that waits behind them is a late angle.  rtEnter() makes
+	the calling thread as hard to delay as the host allows:
+
+	- it is pinned to one core, so it never waits to migrate and keeps its
+	  caches warm,
+	- it runs SCHED_FIFO, so it preempts every normal thread on that core
+	  as soon as its data arrives,
+	- all memory is locked, now and later, so no page is ever swapped or
+	  faulted back in,
+	- its stack and a heap reserve are touched, so the first deep call or
+	  small allocation doesn't take a page fault either, and the heap is
+	  never given back to the system, so freed memory stays faulted in.
+
+	The pipeline itself allocates nothing once it runs.  Threads started
+	earlier keep their affinity and policy, so the background writers
+	started after rtBackground() stay off the pipeline's core:
+
+		rtBackground(&Config);		// Threads started from here avoid Config.Cpu
+		pLog = tlOpen(...);
+		rtEnter(&Config);			// This thread moves to Config.Cpu
+
+	Each step needs privileges the process may not have (CAP_SYS_NICE or
+	an RLIMIT_RTPRIO for SCHED_FIFO, CAP_IPC_LOCK or RLIMIT_MEMLOCK for
+	locking); the steps that fail are skipped and left out of the returned
+	flags, the rest still apply.  On Windows the thread is pinned and set
+	to time critical priority, memory isn't locked.
+
+	src/tools/rtjitter.c measures what it buys under a synthetic load.
+*/
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <stdio.h>
+#include "IMUExternalTypes.h"
+
+#define RT_STACK_BYTES		(128 * 1024)	//!< Stack prefaulted by rtEnter()
+#define RT_HEAP_BYTES		(1024 * 1024)	//!< Default heap reserve
+
+//! Steps rtEnter() applied
+#define RT_PINNED			0x01
+#define RT_FIFO				0x02
+#define RT_LOCKED			0x04
+#define RT_PREFAULTED		0x08
+
+//! Real-time settings, see rtDefaultConfig()
+typedef struct
+{
+	int Cpu;								//!< Core for the pipeline thread, -1 to leave it unpinned
+	int Priority;							//!< SCHED_FIFO priority 1 to 99, 0 to stay a normal thread
+	BOOL LockMemory;						//!< Lock all memory, now and later
+	UInt32 HeapBytes;						//!< Heap to prefault and keep, 0 for none
+} RealTimeConfig_t;
+
+void rtDefaultConfig(RealTimeConfig_t *pConfig);
+BOOL rtParse(const char *pText, RealTimeConfig_t *pConfig);
+BOOL rtBackground(const RealTimeConfig_t *pConfig);
+UInt32 rtEnter(const RealTimeConfig_t *pConfig);
+void rtPrefault(void *pMemory, size_t Bytes);
+void rtPrintApplied(FILE *pFile, const RealTimeConfig_t *pConfig, UInt32 Applied);
+
+#endif // REALTIME_H
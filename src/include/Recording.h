@@ -0,0 +1,60 @@
+/*! \file
+	\brief Read the high speed samples of a recording, whatever its format.
+
+	recRead() takes a capture file (see SerialCapture.h) or a sample log
+	(see SampleLog.h) and calls back once per HS_SERIAL_IMU_MSG sample, in
+	order, with the decoded data.  Samples before the first resolution
+	packet of a capture can't be converted and are left out.  Sample logs
+	carry no host time, their samples come with HostNs 0.
+
+	RecordingClock_t turns the IMU time of successive samples into filter
+	steps, so offline tools filter a recording at the rate it was taken.
+
+	recLoadInputs() reads a whole recording into arrays of the filter
+	inputs main.c uses, the roll from the accelerometers, the X gyro rate
+	and the step from the IMU clock, for tools that go over a run more
+	than once, and recLoadTruth() the matching angles of an imugen truth
+	file.
+*/
+
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include "IMUExternalTypes.h"
+
+#define REC_DEFAULT_STEP	0.02f			//!< Step before two samples give one, main.c's rate
+
+typedef void (*SampleCallback_t)(void *pUser, const IMUData_t *pData, UInt64 HostNs);
+
+//! Filter step from the IMU clock
+typedef struct
+{
+	BOOL HaveTime;							//!< LastTime holds a sample time
+	float LastTime;							//!< IMU time of the last sample, seconds since a PPS
+	UInt8 LastPPSCount;
+	float Step;								//!< Last plausible step, seconds
+} RecordingClock_t;
+
+//! Filter inputs of a whole recording, one entry per sample in each array
+typedef struct
+{
+	float *pTilt;							//!< Accelerometer roll, deg
+	float *pRate;							//!< X gyro rate, deg/s
+	float *pStep;							//!< Filter step, s
+	UInt32 Count;
+	UInt32 Capacity;
+	double Elapsed;							//!< Sum of the steps after the first, s
+	RecordingClock_t Clock;
+	BOOL Ok;
+} RecordingInputs_t;
+
+BOOL recRead(const char *pPath, UInt32 Threads, SampleCallback_t pCallback, void *pUser, UInt64 *pSkipped);
+
+void recClockInit(RecordingClock_t *pClock);
+float recClockStep(RecordingClock_t *pClock, const IMUData_t *pData);
+
+BOOL recLoadInputs(const char *pPath, UInt32 Threads, RecordingInputs_t *pInputs);
+void recFreeInputs(RecordingInputs_t *pInputs);
+BOOL recLoadTruth(const char *pPath, float *pAngle, UInt32 Count);
+
+#endif // RECORDING_H
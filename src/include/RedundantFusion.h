@@ -0,0 +1,111 @@
+/*! \file
+	\brief Fused tilt and rate from redundant IMUs, voting out faulty ones.
+
+	rfUpdate() takes each time aligned set from the aggregator, see
+	ImuAggregator.h, checks every unit in it and gives the weighted mean of
+	the filtered angle and rate of the units it still trusts.  A unit is
+	left out, from the very set that shows the fault, when it:
+
+	  - has no sample at the set's time (RF_MISSING),
+	  - has had all six channels unchanged for StuckNs (RF_STUCK),
+	  - reads within SaturationFraction of its gyro or accelerometer range
+	    (RF_SATURATED), where the filter can no longer be believed,
+	  - has lost more than MaxMissed samples by sequence number since its
+	    previous sample (RF_DROPOUT),
+	  - or, with at least three units left to vote, is further than
+	    DivergeDeg or DivergeRateDps from the median of the units with no
+	    fault of their own (RF_DIVERGED).  Two units that disagree can't
+	    say which is wrong, so both stay in and the disagreement is
+	    counted.
+
+	A faulted unit comes back once it has been clean for RecoverNs, except
+	that a unit only missing from a set, or outvoted in its first RecoverNs
+	while its filter converges, is back in the next set.  If every unit with
+	no fault of its own is still recovering, the one with the least angle
+	variance is used alone rather than giving no estimate.  The weights are
+	the inverse of each filter's angle variance, so a unit whose filter has
+	just started counts for little.
+
+	Every check costs a few comparisons per unit and set and the exclusion
+	takes effect in the set that shows the fault, so the fused estimate
+	fails over within a set period, well inside a control tick; only a
+	stuck unit waits out StuckNs first.  If no unit is left the estimate is
+	not Valid and the controller should stop balancing.
+*/
+
+#ifndef REDUNDANTFUSION_H
+#define REDUNDANTFUSION_H
+
+#include "ImuAggregator.h"
+
+//! Why a unit is left out
+typedef enum
+{
+	RF_OK,
+	RF_MISSING,								//!< No sample at the set's time
+	RF_STUCK,								//!< Every channel unchanged for StuckNs
+	RF_SATURATED,							//!< A channel near its range
+	RF_DROPOUT,								//!< Samples lost by sequence number
+	RF_DIVERGED,							//!< Outvoted by the other units
+	RF_FAULTS
+} FusionFault_t;
+
+//! Fusion settings, see rfDefaultConfig()
+typedef struct
+{
+	UInt64 StuckNs;							//!< Unchanged time that marks a unit stuck
+	float  StuckEpsilon;					//!< Change smaller than this is no change
+	float  SaturationFraction;				//!< Fraction of the range counted as saturated
+	UInt32 MaxMissed;						//!< Samples a unit may lose in a row
+	float  DivergeDeg;						//!< Angle difference from the median that outvotes a unit
+	float  DivergeRateDps;					//!< Rate difference from the median that outvotes a unit
+	float  MinAngleVar;						//!< Floor of the variance weights, deg^2
+	UInt64 RecoverNs;						//!< Clean time before a faulted unit is trusted again
+} FusionConfig_t;
+
+//! Fused estimate from one set
+typedef struct
+{
+	BOOL   Valid;							//!< FALSE if no unit could be trusted
+	UInt64 TimeNs;							//!< Time of the set
+	float  Angle;							//!< Fused roll angle, degrees
+	float  Rate;							//!< Fused roll rate, deg/s
+	UInt32 Units;							//!< Units in the set
+	UInt32 UsedMask;						//!< Bit per unit in the estimate
+	UInt8  Fault[AG_MAX_PORTS];				//!< FusionFault_t of each unit in this set
+	float  Weight[AG_MAX_PORTS];			//!< Each unit's share of the estimate
+} FusedEstimate_t;
+
+//! Fusion counters
+typedef struct
+{
+	UInt64 Sets;							//!< Sets fused
+	UInt64 Invalid;							//!< Sets with no unit to trust
+	UInt64 Disagreements;					//!< Sets where two units diverged with no third to vote
+	UInt64 Fallbacks;						//!< Sets fused from one recovering unit
+	UInt64 Faults[AG_MAX_PORTS][RF_FAULTS];	//!< Faults started, by unit and kind
+} FusionStats_t;
+
+typedef struct
+{
+	BOOL   Seen;							//!< Had a valid sample
+	UInt64 FirstNs;							//!< Set time of its first valid sample
+	float  Last[N_SENSOR_IDX];				//!< Channels when they last changed
+	UInt64 ChangedNs;						//!< When they last changed
+	UInt8  Fault;							//!< FusionFault_t of the last set
+	UInt64 FaultNs;							//!< Last set with a fault
+} FusionUnit_t;
+
+typedef struct
+{
+	FusionConfig_t Config;
+	FusionUnit_t Unit[AG_MAX_PORTS];
+	FusionStats_t Stats;
+} RedundantFusion_t;
+
+void rfDefaultConfig(FusionConfig_t *pConfig, double SampleHz);
+void rfInit(RedundantFusion_t *pFusion, const FusionConfig_t *pConfig);
+BOOL rfUpdate(RedundantFusion_t *pFusion, const AggSet_t *pSet, FusedEstimate_t *pEstimate);
+const char *rfFaultName(FusionFault_t Fault);
+
+#endif // REDUNDANTFUSION_H
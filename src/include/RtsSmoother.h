@@ -0,0 +1,48 @@
+/*! \file
+	\brief Rauch-Tung-Striebel smoother for the angle filter.
+
+	kfGetAngle() only sees the samples up to the current one.  Offline the
+	whole run is known, and the RTS smoother gives the best estimate of
+	angle and bias at every sample from all of them.  It runs the filter
+	forward, then walks back from the last sample correcting each filtered
+	estimate with the smoothed one after it:
+
+	    C[k]  = P[k] F' inv(Pp[k+1])
+	    xs[k] = x[k] + C[k] (xs[k+1] - xp[k+1])
+	    Ps[k] = P[k] + C[k] (Ps[k+1] - Pp[k+1]) C[k]'
+
+	where x and P are the filtered state and covariance, xp and Pp the
+	prediction to the next sample, and F = [1 -dt; 0 1] the same 2-state
+	model as kfGetAngle(), with the process noise it adds, Q_angle dt and
+	Q_bias dt.  The forward pass is kfGetAngle() itself, so the filtered
+	values are exactly those the filter gives.
+
+	The backward pass needs the filtered state and covariance of every
+	sample, five floats, which for a long log is more than the log.  So the
+	forward pass only keeps a checkpoint, the filter as a KFilter_t, at the
+	start of each block of samples.  The backward pass then reruns the
+	filter over one block at a time, last block first, from its checkpoint
+	into a structure of arrays the size of a block, and smooths the block
+	back to front.  Each sample is filtered twice, but the memory is the
+	checkpoints plus one block, about 200 kB for ten million samples with
+	the default block of sqrt(samples).  The rerun is bit-identical to the
+	first pass, so the block size doesn't change the result.
+
+	The smoothed values are written after every input of their block has
+	been read, so the angle output may be the tilt input array.
+*/
+
+#ifndef RTSSMOOTHER_H
+#define RTSSMOOTHER_H
+
+#include "CalcAngle.h"
+#include "IMUExternalTypes.h"
+
+#define RTS_MIN_BLOCK		1024			//!< Smallest default block, samples
+
+BOOL rtsSmooth(const KFilter_t *pInit, const float *pTilt, const float *pRate, const float *pStep,
+			   UInt32 Count, UInt32 BlockSamples, float *pAngle, float *pBias, float *pAngleStd);
+UInt32 rtsDefaultBlock(UInt32 Count);
+UInt64 rtsMemory(UInt32 Count, UInt32 BlockSamples);
+
+#endif // RTSSMOOTHER_H
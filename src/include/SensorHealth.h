@@ -0,0 +1,126 @@
+/*! \file
+	\brief Online sanity checks of the IMU's channels.
+
+	hmUpdate() looks at each high speed sample once, at a fixed cost of a
+	few comparisons per channel, no window of past samples kept, and keeps
+	four checks:
+
+	  - HM_SATURATED: a gyro or accelerometer channel at or beyond
+	    SaturationFraction of the range the IMU reported in its resolution
+	    packet, see DecodeResolutionPacket(), for SaturationSamples in a
+	    row.  A pinned channel reads the range, not the motion.
+	  - HM_FLAT: a channel that hasn't moved more than FlatEpsilon from
+	    where it started for FlatSamples, zero variance over that window.
+	    A live sensor always has some noise; a flat one is disconnected or
+	    frozen.  Only the run length is kept, so this costs the same at any
+	    window.
+	  - HM_DROPOUT: more than MaxMissed samples missing by SequenceNumber
+	    between two samples.  It clears after DropoutClearSamples samples
+	    with no gap.
+	  - HM_TEMP_DRIFT: a GyroTempVolts reading more than TempDriftVolts from
+	    its reference, the first reading or the one hmSetTempReference()
+	    took when the bias was calibrated.  The gyro bias moves with
+	    temperature, so the calibration no longer holds.
+
+	hmUpdateQ() runs the first three checks on a sample of the fixed point
+	pipeline, see IMUFixed.h, in integers: saturation on the raw counts,
+	which span the range whatever it is, and the flat line on the Q16.16
+	readings.  The temperatures only come decoded to float, so with it
+	call hmCheckTemp(), which hmUpdate() runs for every sample, as the
+	temperature packets arrive.
+
+	Every check is raised within its sample count, one sample for the
+	last two, and the callback is told on raising and on clearing.  Each
+	raise also counts, in the monitor's own counters and, if the thread is
+	registered, in the Prometheus metrics, see Metrics.h.  The active
+	checks are a bit mask, HM_BIT(check, channel), so the controller can
+	drop to a safe state on the checks it can't balance through,
+	HM_CHECK_MASK() of each, with a single test.  A dropout or a drifting
+	temperature degrades the estimate rather than invalidating it.
+*/
+
+#ifndef SENSORHEALTH_H
+#define SENSORHEALTH_H
+
+#include "IMUExternalTypes.h"
+#include "IMUFixed.h"
+
+//! The checks
+typedef enum
+{
+	HM_SATURATED,							//!< Channel at its range
+	HM_FLAT,								//!< Channel not moving
+	HM_DROPOUT,								//!< Samples missing by sequence number
+	HM_TEMP_DRIFT,							//!< Gyro temperature away from its reference
+	HM_CHECKS
+} HealthCheck_t;
+
+//! Bit of a check on a channel in the active mask
+#define HM_BIT(Check, Channel)	(1u << ((Check) * 8 + (Channel)))
+
+//! Bits of a check on every channel in the active mask
+#define HM_CHECK_MASK(Check)	(0xFFu << ((Check) * 8))
+
+//! A check raised or cleared
+typedef struct
+{
+	HealthCheck_t Check;
+	UInt32 Channel;							//!< Sensor index, temperature index for HM_TEMP_DRIFT, 0 for HM_DROPOUT
+	BOOL   Raised;							//!< TRUE when raised, FALSE when cleared
+	UInt64 Sample;							//!< Samples checked before this one
+	float  Value;							//!< Reading, drift in volts, or samples missed
+} HealthEvent_t;
+
+//! Called from hmUpdate() as checks are raised and cleared
+typedef void (*HealthCallback_t)(void *pArg, const HealthEvent_t *pEvent);
+
+//! Monitor settings, see hmDefaultConfig()
+typedef struct
+{
+	float  SaturationFraction;				//!< Fraction of the range counted as saturated
+	UInt32 SaturationSamples;				//!< Saturated samples in a row that raise HM_SATURATED
+	float  FlatEpsilon;						//!< Change no larger than this is no change
+	UInt32 FlatSamples;						//!< Unchanged samples in a row that raise HM_FLAT
+	UInt32 MaxMissed;						//!< Samples a gap may miss without raising HM_DROPOUT
+	UInt32 DropoutClearSamples;				//!< Samples without a gap that clear HM_DROPOUT
+	float  TempDriftVolts;					//!< Temperature reading change that raises HM_TEMP_DRIFT
+	HealthCallback_t pCallback;				//!< NULL for none
+	void  *pArg;							//!< Passed to the callback
+} HealthConfig_t;
+
+//! Monitor counters
+typedef struct
+{
+	UInt64 Samples;							//!< Samples checked
+	UInt64 Missed;							//!< Samples missing by sequence number
+	UInt64 Raised[HM_CHECKS];				//!< Times each check was raised, any channel
+} HealthStats_t;
+
+typedef struct
+{
+	HealthConfig_t Config;
+	UInt32 Active;							//!< HM_BIT() of every raised check
+	UInt32 ActiveCount;						//!< Checks raised now
+	float  RunStart[N_SENSOR_IDX];			//!< Reading a flat run started at
+	UInt32 FlatRun[N_SENSOR_IDX];			//!< Samples within FlatEpsilon of it
+	UInt32 SaturatedRun[N_SENSOR_IDX];		//!< Saturated samples in a row
+	UInt32 CleanRun;						//!< Samples since the last gap
+	float  TempReference[N_TEMP_IDX];		//!< 0 until a reading arrives
+	UInt8  LastSequence;
+	HealthStats_t Stats;
+
+	// hmUpdateQ() only
+	SInt32 SaturationCounts;				//!< Raw count at SaturationFraction of the range
+	Q16_t  FlatEpsilonQ;					//!< FlatEpsilon in Q16.16
+	Q16_t  RunStartQ[N_SENSOR_IDX];			//!< Reading a flat run started at
+} SensorHealth_t;
+
+void hmDefaultConfig(HealthConfig_t *pConfig, double SampleHz);
+void hmInit(SensorHealth_t *pHealth, const HealthConfig_t *pConfig);
+UInt32 hmUpdate(SensorHealth_t *pHealth, const IMUData_t *pData);
+UInt32 hmUpdateQ(SensorHealth_t *pHealth, const IMUDataQ_t *pData);
+UInt32 hmCheckTemp(SensorHealth_t *pHealth, const float *pVolts);
+void hmSetTempReference(SensorHealth_t *pHealth, const IMUData_t *pData);
+const char *hmCheckName(HealthCheck_t Check);
+
+#endif // SENSORHEALTH_H
@@ -0,0 +1,83 @@
+/*! \file
+	\brief Raw serial capture with host timestamps.
+
+	Every chunk returned by the serial layer is appended to a capture file
+	together with the monotonic host time at which it was read, so the exact
+	byte stream the parser saw can be replayed later.
+
+	The serial thread only copies the chunk into a lock-free byte ring; a
+	background thread writes the ring to disk.  If the writer falls behind
+	the chunk is dropped and counted, the read path never waits on the disk.
+	A failed write is counted too, see capLostBytes(); the file ends at the
+	last chunk written whole, and capClose() says whether anything is
+	missing.
+
+	Capture file:   CaptureFileHeader_t, then CaptureChunkHeader_t + data,
+	                repeated, each chunk padded to a multiple of 8 bytes.
+	Index file:     <capture>.idx, CaptureIndexHeader_t, then one
+	                CaptureIndexEntry_t about every CAP_INDEX_INTERVAL_NS of
+	                capture time or CAP_INDEX_INTERVAL_BYTES of file.  Entries
+	                are sorted by time, so a reader can binary search them and
+	                then walk at most one interval of chunks.
+
+	All values are in host byte order, identified by the byte order mark.
+*/
+
+#ifndef SERIALCAPTURE_H
+#define SERIALCAPTURE_H
+
+#include <stdint.h>
+#include "Types.h"
+
+#define CAP_MAGIC				"CIMUCAP1"
+#define CAP_INDEX_MAGIC			"CIMUIDX1"
+#define CAP_BYTE_ORDER_MARK		0x01020304u
+
+#define CAP_INDEX_INTERVAL_NS		100000000ULL	//!< 100 ms between index entries
+#define CAP_INDEX_INTERVAL_BYTES	(1UL << 20)		//!< or 1 MB, whichever comes first
+
+//! Capture file header
+typedef struct
+{
+	char     Magic[8];		//!< CAP_MAGIC
+	uint32_t ByteOrder;		//!< CAP_BYTE_ORDER_MARK as written by the host
+	uint32_t HeaderBytes;	//!< Size of this header, first chunk follows
+	uint64_t StartNs;		//!< Host time the capture was opened
+} CaptureFileHeader_t;
+
+//! Header in front of every captured chunk
+typedef struct
+{
+	uint64_t HostNs;		//!< Host time the chunk was read
+	uint32_t Length;		//!< Number of data bytes that follow
+	uint32_t Dropped;		//!< Bytes dropped just before this chunk
+} CaptureChunkHeader_t;
+
+//! Index file header
+typedef struct
+{
+	char     Magic[8];		//!< CAP_INDEX_MAGIC
+	uint32_t ByteOrder;		//!< CAP_BYTE_ORDER_MARK as written by the host
+	uint32_t EntryBytes;	//!< Size of one CaptureIndexEntry_t
+} CaptureIndexHeader_t;
+
+//! Time to file offset index entry
+typedef struct
+{
+	uint64_t HostNs;		//!< Time of the chunk at Offset
+	uint64_t Offset;		//!< File offset of a CaptureChunkHeader_t
+} CaptureIndexEntry_t;
+
+//! Chunks are padded so chunk headers stay 8-byte aligned when mapped
+#define CAP_CHUNK_BYTES(len)	((sizeof(CaptureChunkHeader_t) + (len) + 7) & ~(size_t)7)
+
+typedef struct SerialCapture_t SerialCapture_t;
+
+SerialCapture_t *capOpen(const char *pPath, UInt32 RingBytes);
+BOOL capWrite(SerialCapture_t *pCap, const UInt8 *pData, UInt32 Length);
+void capWriteAt(SerialCapture_t *pCap, const UInt8 *pData, UInt32 Length, UInt64 HostNs);
+UInt64 capDroppedBytes(const SerialCapture_t *pCap);
+UInt64 capLostBytes(const SerialCapture_t *pCap);
+BOOL capClose(SerialCapture_t *pCap);
+
+#endif // SERIALCAPTURE_H
@@ -0,0 +1,42 @@
+/*! \file
+	\brief Replay backend for the Serial_PS.h interface.
+
+	Serial_Replay.c implements the serial port functions on top of a capture
+	file written by SerialCapture.c, so the application and every stage after
+	it run unmodified against recorded data.  Link it in place of the
+	platform serial module.
+
+	Each captured chunk is delivered once the replay clock reaches its
+	recorded arrival time.  The replay clock runs at Speed times real time;
+	a Speed of 0 delivers data as fast as it is read, which turns a replay
+	into a throughput benchmark for the whole pipeline.  Once the last byte
+	has been read psIsCOMMOpen() returns FALSE, as for a port whose device
+	went away.
+
+	Without a call to psReplaySetup() the capture named by the
+	IMU_REPLAY_FILE environment variable is opened at the speed given by
+	IMU_REPLAY_SPEED (default 1), which must be a number, 0 or more; the
+	port doesn't open otherwise.
+*/
+
+#ifndef SERIALREPLAY_H
+#define SERIALREPLAY_H
+
+#include "Serial_PS.h"
+
+#define REPLAY_SPEED_MAX	0.0		//!< Deliver data as fast as it is read
+
+//! Replay progress
+typedef struct
+{
+	UInt64 Bytes;		//!< Bytes delivered
+	UInt64 Chunks;		//!< Chunks fully delivered
+	UInt64 Dropped;		//!< Bytes the capture itself lost
+	UInt64 ElapsedNs;	//!< Host time since the port was opened
+	BOOL Finished;		//!< TRUE once every chunk has been delivered
+} ReplayStats_t;
+
+BOOL psReplaySetup(const char *pPath, double Speed);
+void psReplayGetStats(UInt32 Handle, ReplayStats_t *pStats);
+
+#endif // SERIALREPLAY_H
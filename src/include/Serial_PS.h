@@ -14,6 +14,7 @@
 #define _SERIAL_PS_H
 
 #include "Types.h"
+#include "SerialCapture.h"
 
 // We define these constants here so that use of this module does not require
 //   importing serial.h
@@ -86,6 +87,7 @@ void psPurgeRxQ(UInt32 Handle);
 void psPurgeTxQ(UInt32 Handle);
 BOOL psCheckForResponse(UInt32 Handle, const char *pString);
 BOOL psCheckForMultipleResponse(UInt32 Handle, const char *pString, UInt32 NumResponse);
+void psSetCapture(UInt32 Handle, SerialCapture_t *pCapture);
 
 
 
@@ -0,0 +1,99 @@
+/*! \file
+	\brief Shared memory ring publishing IMU samples to other processes.
+
+	Only one process can own the serial port, but the controller, the logger
+	and the UI all want the data.  The pipeline publishes every sample, the
+	decoded IMUData_t with the filter's angle, rate and bias, into a ring in
+	a named POSIX shared memory object (a named file mapping on Windows).
+	Any number of local readers map it read-only and take samples straight
+	from it, with no copy and no system call per sample.
+
+	The object is a SharedRingHeader_t followed by a power of two slots of
+	SlotBytes each.  Head counts the samples published.  Sample n goes in
+	slot n & (Slots - 1), guarded by its own sequence lock: the slot's
+	Sequence is 2n + 1 while the writer fills it and 2n + 2 once done.  A
+	reader checks Sequence is 2n + 2 before and after using the sample; if
+	it changed the writer lapped it and the sample is lost, never torn.  The
+	writer never waits for readers, so a slow reader loses samples and a
+	fast one costs the writer nothing.
+
+	Readers either copy a sample with shRead() or shNext(), or use it in
+	place between shPeek() and shIntact().  shNext() follows the ring with a
+	cursor, skipping ahead to the oldest sample still held when lapped and
+	counting what was lost.
+
+	Readers must be built with the same IMUData_t layout as the writer;
+	shOpen() refuses a ring whose sample size differs.  Stale objects left
+	by a writer that died are replaced when the next writer creates its
+	ring.
+*/
+
+#ifndef SHAREDRING_H
+#define SHAREDRING_H
+
+#include "Atomic.h"
+#include "IMUPacket.h"
+
+#define SH_MAGIC			"CIMUSHM1"
+#define SH_DEFAULT_NAME		"/cristaimu"	//!< Default object name
+#define SH_DEFAULT_SLOTS	1024			//!< Default ring size, 10 s at 100 Hz
+
+//! shRead() and shNext() results
+typedef enum
+{
+	SH_OK,									//!< Sample copied
+	SH_NOT_YET,								//!< Not published yet
+	SH_OVERWRITTEN							//!< Lapped by the writer, lost
+} SharedStatus_t;
+
+//! One published sample
+typedef struct
+{
+	UInt64 Index;							//!< Sample number
+	UInt64 HostNs;							//!< Host arrival time, htNowNs()
+	IMUData_t Data;							//!< Decoded IMU data
+	float Angle;							//!< Filtered angle, degrees
+	float Rate;								//!< Bias corrected rate, deg/s
+	float Bias;								//!< Estimated gyro bias, deg/s
+} SharedSample_t;
+
+//! Start of the shared object
+typedef struct
+{
+	char Magic[8];							//!< SH_MAGIC
+	UInt32 HeaderBytes;						//!< Offset of the first slot
+	UInt32 SlotBytes;						//!< Slot stride, a multiple of the cache line
+	UInt32 SampleBytes;						//!< sizeof(SharedSample_t) of the writer
+	UInt32 Slots;							//!< Number of slots, a power of two
+	volatile UInt32 Open;					//!< 1 while the writer runs
+	char Pad0[CACHE_LINE_BYTES - 28];
+	volatile UInt64 Head;					//!< Samples published
+	char Pad1[CACHE_LINE_BYTES - 8];
+} SharedRingHeader_t;
+
+//! One slot
+typedef struct
+{
+	volatile UInt64 Sequence;				//!< 2n + 1 while sample n is written, 2n + 2 after
+	SharedSample_t Sample;
+} SharedSlot_t;
+
+typedef struct SharedRingWriter_t SharedRingWriter_t;
+typedef struct SharedRingReader_t SharedRingReader_t;
+
+SharedRingWriter_t *shCreate(const char *pName, UInt32 Slots);
+void shPublish(SharedRingWriter_t *pWriter, const IMUData_t *pData, UInt64 HostNs,
+			   float Angle, float Rate, float Bias);
+void shClose(SharedRingWriter_t *pWriter);
+
+SharedRingReader_t *shOpen(const char *pName);
+UInt64 shHead(const SharedRingReader_t *pReader);
+BOOL shWriterOpen(const SharedRingReader_t *pReader);
+UInt32 shSlots(const SharedRingReader_t *pReader);
+SharedStatus_t shRead(const SharedRingReader_t *pReader, UInt64 Index, SharedSample_t *pSample);
+SharedStatus_t shNext(const SharedRingReader_t *pReader, UInt64 *pCursor, SharedSample_t *pSample, UInt64 *pLost);
+const SharedSample_t *shPeek(const SharedRingReader_t *pReader, UInt64 Index);
+BOOL shIntact(const SharedRingReader_t *pReader, UInt64 Index);
+void shCloseReader(SharedRingReader_t *pReader);
+
+#endif // SHAREDRING_H
@@ -0,0 +1,68 @@
+/*! \file
+	\brief Startup gyro bias calibration and filter warm start.
+
+	While the robot is held still after power up, the gyro reading is the
+	gyro bias and the accelerometer tilt is the true angle.  Averaging a short
+	run of stationary samples seeds the filter with both, along with a
+	covariance that matches the averaging, instead of starting from zero and
+	waiting seconds for the filter to converge.  Any sample that fails the
+	stationarity test restarts the average.
+
+	The converged bias and covariance can also be saved to a small text file
+	and reloaded on the next start, in which case only a few samples are
+	needed to seed the angle.
+
+	StartupCalQ_t does the same averaging in integers on the Q16.16 samples
+	of the fixed point pipeline and seeds a KFilterQ_t, see CalcAngleFixed.h.
+*/
+
+#ifndef STARTUPCAL_H
+#define STARTUPCAL_H
+
+#include "CalcAngle.h"
+#include "CalcAngleFixed.h"
+
+typedef struct
+{
+	UInt32 Needed;      //!< Number of stationary samples to average
+	float  RateTol;     //!< Max deviation of a rate sample from the running mean, deg/s
+	float  AccelTol;    //!< Max deviation of the acceleration magnitude from 1 g, m/s/s
+
+	UInt32 Count;       //!< Stationary samples averaged so far
+	UInt32 Restarts;    //!< Number of times motion restarted the average
+	double SumRate;     //!< Sum of rate samples
+	double SumSqRate;   //!< Sum of squared rate samples
+	double SumTilt;     //!< Sum of tilt samples
+	double SumSqTilt;   //!< Sum of squared tilt samples
+} StartupCal_t;
+
+//! Fixed point counterpart of StartupCal_t
+typedef struct
+{
+	UInt32 Needed;      //!< Number of stationary samples to average
+	Q16_t  RateTol;     //!< Max deviation of a rate sample from the running mean, deg/s
+	Q16_t  AccelTol;    //!< Max deviation of the acceleration magnitude from 1 g, m/s/s
+
+	UInt32 Count;       //!< Stationary samples averaged so far
+	UInt32 Restarts;    //!< Number of times motion restarted the average
+	SInt64 SumRate;     //!< Sum of rate samples, Q16.16
+	SInt64 SumSqRate;   //!< Sum of squared rate samples, Q32.32
+	SInt64 SumTilt;     //!< Sum of tilt samples, Q16.16
+	SInt64 SumSqTilt;   //!< Sum of squared tilt samples, Q32.32
+} StartupCalQ_t;
+
+void calInit(StartupCal_t *pCal, UInt32 Samples);
+BOOL calAddSample(StartupCal_t *pCal, float Tilt, float Rate, const float Accel[3]);
+void calApply(const StartupCal_t *pCal, KFilter_t *pKF);
+float calGetTilt(const StartupCal_t *pCal);
+float calGetBias(const StartupCal_t *pCal);
+
+void calInitQ(StartupCalQ_t *pCal, UInt32 Samples);
+BOOL calAddSampleQ(StartupCalQ_t *pCal, Q16_t Tilt, Q16_t Rate, const Q16_t Accel[3]);
+void calApplyQ(const StartupCalQ_t *pCal, KFilterQ_t *pKF);
+Q16_t calGetTiltQ(const StartupCalQ_t *pCal);
+
+BOOL calSaveState(const KFilter_t *pKF, const char *pPath);
+BOOL calLoadState(KFilter_t *pKF, const char *pPath);
+
+#endif // STARTUPCAL_H
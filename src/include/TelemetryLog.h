@@ -0,0 +1,88 @@
+/*! \file
+	\brief Asynchronous binary telemetry logger.
+
+	The serial thread copies one fixed size record per sample into a single
+	producer, single consumer lock-free queue and moves on; it never formats
+	text or touches a file.  A background thread writes the queued records
+	to disk in batches.  If the writer falls behind, records are dropped and
+	counted instead of stalling the serial thread; the record index shows
+	where.  Records a failed write leaves out of the file are counted too,
+	tlLost(), and tlClose() reports either.  The writer thread also runs the odd job handed to it with
+	tlDefer(), such as saving a file, so that stays off the serial thread
+	too.
+
+	The file starts with a TelemetryFileHeader_t followed by the field
+	descriptors, then the records back to back.  All values are in host
+	byte order, identified by the byte order mark.  src/tools/tlm2csv.c
+	converts a log to CSV using only the header.
+*/
+
+#ifndef TELEMETRYLOG_H
+#define TELEMETRYLOG_H
+
+#include <stdint.h>
+#include "IMUExternalTypes.h"
+
+#define TLM_MAGIC			"CIMUTLM1"
+#define TLM_BYTE_ORDER_MARK	0x01020304u
+#define TLM_NAME_LEN		16
+
+//! One logged sample.  Exact width types so the layout is the same on every host.
+typedef struct
+{
+	uint64_t HostNs;					//!< Host arrival time in nanoseconds
+	uint32_t Index;						//!< Record number; gaps mean dropped records
+	float    TimeSincePPS;				//!< IMU time in milliseconds
+	float    Sensors[N_SENSOR_IDX];		//!< Converted gyro and accelerometer readings
+	float    Angle;						//!< Filtered angle in degrees
+	float    Bias;						//!< Estimated gyro bias in deg/s
+	uint8_t  SequenceNumber;			//!< IMU packet sequence number
+	uint8_t  PPSCount;					//!< Number of PPS signals captured
+	uint8_t  Reserved[6];
+} TelemetryRecord_t;
+
+//! Field type codes used in the schema
+enum TelemetryFieldType_t
+{
+	TLM_TYPE_U8 = 1,
+	TLM_TYPE_U32,
+	TLM_TYPE_U64,
+	TLM_TYPE_F32
+};
+
+//! Describes one field of the record
+typedef struct
+{
+	char     Name[TLM_NAME_LEN];		//!< NULL padded field name
+	uint8_t  Type;						//!< TelemetryFieldType_t
+	uint8_t  Count;						//!< Number of array elements
+	uint16_t Offset;					//!< Byte offset in the record
+} TelemetryField_t;
+
+//! File header, followed by FieldCount TelemetryField_t
+typedef struct
+{
+	char     Magic[8];					//!< TLM_MAGIC
+	uint32_t ByteOrder;					//!< TLM_BYTE_ORDER_MARK as written by the host
+	uint16_t HeaderBytes;				//!< Size of this header plus the field table
+	uint16_t RecordBytes;				//!< Size of one record
+	uint16_t FieldCount;				//!< Number of field descriptors
+	uint16_t Reserved[3];
+} TelemetryFileHeader_t;
+
+typedef struct TelemetryLog_t TelemetryLog_t;
+
+//! Job run on the writer thread, see tlDefer()
+typedef void (*TelemetryJob_t)(void *pArg);
+
+TelemetryLog_t *tlOpen(const char *pPath, UInt32 Capacity);
+BOOL tlPush(TelemetryLog_t *pLog, const TelemetryRecord_t *pRecord);
+void tlFillRecord(TelemetryRecord_t *pRecord, const IMUData_t *pData, UInt64 HostNs,
+				  float Angle, float Bias);
+BOOL tlDefer(TelemetryLog_t *pLog, TelemetryJob_t pJob, void *pArg);
+UInt32 tlDropped(const TelemetryLog_t *pLog);
+UInt32 tlLost(const TelemetryLog_t *pLog);
+UInt32 tlDepth(const TelemetryLog_t *pLog);
+BOOL tlClose(TelemetryLog_t *pLog);
+
+#endif // TELEMETRYLOG_H
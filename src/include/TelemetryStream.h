@@ -0,0 +1,128 @@
+/*! \file
+	\brief Batched telemetry streaming over UDP or Unix datagram sockets.
+
+	Like the telemetry log, see TelemetryLog.h, the serial thread only
+	copies a TelemetryRecord_t into a single producer, single consumer
+	lock-free queue with tsPush(); it never formats text or makes a system
+	call.  A background sender thread packs the queued records into
+	datagrams of up to MaxSamples compact samples each and sends every
+	datagram it has ready with one sendmmsg() call (a sendto() each on
+	Windows).
+
+	A datagram goes out once it is full, or once its oldest sample has
+	waited MaxDelayUs, which bounds the latency batching adds.  MaxRateHz,
+	if set, limits the samples sent with a token bucket refilled by sample
+	time, so a 10 kHz feed limited to 1 kHz goes out as every tenth sample.
+	Samples the queue had no room for and samples over the rate are
+	dropped and counted, never waited for.
+
+	A datagram is a TelemetryDatagramHeader_t followed by Count
+	TelemetrySample_t, in host byte order identified by the byte order
+	mark.  Each sample carries its record index, so index gaps show lost
+	samples; the header's Dropped, the gaps the sender made itself, tells
+	those apart from samples the network lost, and its Sequence numbers the
+	datagrams.  Times are nanoseconds after the header's BaseNs.
+
+	The receiver side, tsListen() and tsReceive(), takes datagrams with
+	recvmmsg() where there is one and keeps the loss counts, see
+	src/tools/tlmstream.c.
+
+	Destinations are "udp:host:port" or, off Windows, "unix:path".  A
+	receiver given port 0 binds any free one, see tsReceiverName().
+*/
+
+#ifndef TELEMETRYSTREAM_H
+#define TELEMETRYSTREAM_H
+
+#include <stdint.h>
+#include "TelemetryLog.h"
+
+#define TS_MAGIC				"CIS1"
+#define TS_MAX_DATAGRAM			1472		//!< Largest datagram, an Ethernet frame's UDP payload
+#define TS_NAME_BYTES			128			//!< Space tsReceiverName() needs
+
+//! Datagram header
+typedef struct
+{
+	char     Magic[4];					//!< TS_MAGIC
+	uint32_t ByteOrder;					//!< TLM_BYTE_ORDER_MARK as written by the sender
+	uint32_t Sequence;					//!< Datagram number
+	uint16_t Count;						//!< Samples that follow
+	uint16_t SampleBytes;				//!< sizeof(TelemetrySample_t) of the sender
+	uint64_t BaseNs;					//!< Host time the sample times count from
+	uint32_t Dropped;					//!< Samples the sender dropped up to the last one here
+	uint32_t Reserved;
+} TelemetryDatagramHeader_t;
+
+//! One sample in a datagram
+typedef struct
+{
+	uint32_t Index;						//!< Record number, gaps mean lost samples
+	uint32_t OffsetNs;					//!< Host arrival time after BaseNs
+	float    TimeSincePPS;				//!< IMU time in milliseconds
+	float    Sensors[N_SENSOR_IDX];		//!< Converted gyro and accelerometer readings
+	float    Angle;						//!< Filtered angle in degrees
+	float    Bias;						//!< Estimated gyro bias in deg/s
+	uint8_t  SequenceNumber;			//!< IMU packet sequence number
+	uint8_t  PPSCount;					//!< Number of PPS signals captured
+	uint8_t  Reserved[2];
+} TelemetrySample_t;
+
+#define TS_MAX_SAMPLES	((TS_MAX_DATAGRAM - sizeof(TelemetryDatagramHeader_t)) / sizeof(TelemetrySample_t))
+
+//! Sender settings
+typedef struct
+{
+	UInt32 Capacity;					//!< Records the queue holds, rounded up to a power of two
+	UInt32 MaxSamples;					//!< Samples per datagram, at most TS_MAX_SAMPLES
+	UInt32 MaxDelayUs;					//!< Longest a sample waits for its datagram to fill
+	double MaxRateHz;					//!< Samples sent per second, 0 for no limit
+} TelemetryStreamConfig_t;
+
+//! Sender counters
+typedef struct
+{
+	UInt64 Samples;						//!< Samples sent
+	UInt64 Datagrams;					//!< Datagrams sent
+	UInt64 Calls;						//!< System calls sending them
+	UInt64 QueueDropped;				//!< Samples dropped because the queue was full
+	UInt64 RateLimited;					//!< Samples dropped over MaxRateHz
+	UInt64 SendErrors;					//!< Datagrams the socket refused
+	UInt64 CpuNs;						//!< CPU time of the sender thread
+} TelemetryStreamStats_t;
+
+//! Receiver counters
+typedef struct
+{
+	UInt64 Datagrams;					//!< Datagrams received
+	UInt64 Samples;						//!< Samples received
+	UInt64 DatagramsLost;				//!< Gaps in the datagram sequence
+	UInt64 SamplesLost;					//!< Samples lost on the way, not dropped by the sender
+	UInt64 SenderDropped;				//!< Samples the sender dropped, from the headers
+	UInt64 Reordered;					//!< Datagrams arriving after a later one, not counted as received
+	UInt64 Malformed;					//!< Datagrams that aren't ours or are cut short
+	UInt64 Calls;						//!< System calls receiving them
+} TelemetryReceiverStats_t;
+
+//! Called by tsReceive() for each sample
+typedef void (*TelemetrySampleCallback_t)(void *pArg, const TelemetryDatagramHeader_t *pHeader,
+										  const TelemetrySample_t *pSample);
+
+typedef struct TelemetryStream_t TelemetryStream_t;
+typedef struct TelemetryReceiver_t TelemetryReceiver_t;
+
+void tsDefaultConfig(TelemetryStreamConfig_t *pConfig);
+TelemetryStream_t *tsOpen(const char *pDest, const TelemetryStreamConfig_t *pConfig);
+BOOL tsPush(TelemetryStream_t *pStream, const TelemetryRecord_t *pRecord);
+UInt32 tsDepth(const TelemetryStream_t *pStream);
+void tsGetStats(const TelemetryStream_t *pStream, TelemetryStreamStats_t *pStats);
+void tsClose(TelemetryStream_t *pStream);
+
+TelemetryReceiver_t *tsListen(const char *pName);
+const char *tsReceiverName(const TelemetryReceiver_t *pReceiver, char *pName);
+UInt32 tsReceive(TelemetryReceiver_t *pReceiver, UInt32 TimeoutMs,
+				 TelemetrySampleCallback_t pCallback, void *pArg);
+void tsGetReceiverStats(const TelemetryReceiver_t *pReceiver, TelemetryReceiverStats_t *pStats);
+void tsCloseReceiver(TelemetryReceiver_t *pReceiver);
+
+#endif // TELEMETRYSTREAM_H
@@ -0,0 +1,35 @@
+/*! \file
+	\brief Fixed size pool of worker threads for offline batch work.
+
+	Jobs are function and argument pairs taken from a FIFO queue by whichever
+	worker is free.  tpWait() blocks until every submitted job has finished,
+	which is how callers join a batch before using its results.  Jobs must
+	not submit further jobs and wait for them.
+
+	tpForEach() runs an index job over a range with work stealing, for
+	batches whose items take uneven time.  The range is dealt out evenly,
+	one slice per worker.  A worker takes items from the front of its own
+	slice.  Once its slice is empty it takes the back half of the fullest
+	slice it can find.  Each slice is one 64-bit word changed by compare
+	and swap, so taking an item costs no lock.
+*/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "Types.h"
+
+typedef void (*ThreadJob_t)(void *pArg);
+typedef void (*ThreadIndexJob_t)(void *pArg, UInt32 Index);
+
+typedef struct ThreadPool_t ThreadPool_t;
+
+ThreadPool_t *tpCreate(UInt32 Threads);
+BOOL tpSubmit(ThreadPool_t *pPool, ThreadJob_t pJob, void *pArg);
+void tpWait(ThreadPool_t *pPool);
+BOOL tpForEach(ThreadPool_t *pPool, UInt32 Count, ThreadIndexJob_t pJob, void *pArg);
+UInt32 tpThreads(const ThreadPool_t *pPool);
+void tpDestroy(ThreadPool_t *pPool);
+UInt32 tpCpuCount(void);
+
+#endif // THREADPOOL_H
@@ -0,0 +1,57 @@
+/*! \file
+	\brief Accelerometer tilt computation using a fast atan2 approximation.
+
+	FastAtan2f() replaces the libm atan()/atan2f() call on the per-packet path.
+	It evaluates an odd 11th order minimax polynomial for atan() on [0, 1] and
+	folds the result into the correct quadrant.  The maximum absolute error is
+	1.0e-5 radians (about 0.0006 degrees) over the whole plane, which is far
+	below the noise of the accelerometer derived tilt.  FastAtan2f(0, 0)
+	returns 0 instead of dividing by zero.
+
+	Mounting: TiltRollDeg() is atan2(ay, az), 0 with the IMU's Z axis up
+	(az = +g) and valid for tilts within +-180 degrees of that.  Mounted Z
+	down (az = -g) the upright robot would sit on the wrap, where the angle
+	jumps between +180 and -180 with the noise, so TiltSetMounting() with
+	TILT_Z_DOWN negates ay and az first, turning the frame half a turn
+	about X; the gyro X rate is the same in both.  The mounting applies to
+	every roll taken after it, TiltRollQ() too, so set it before any.
+	segway sets it from the first sample of its startup calibration.
+	imubench measures the speed of FastAtan2f() and checks its error
+	bound.
+*/
+
+#ifndef TILT_H
+#define TILT_H
+
+#include "IMUExternalTypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Maximum absolute error of FastAtan2f() in radians
+#define FAST_ATAN2_MAX_ERROR_RAD	(1.0e-5f)
+
+//! Which way the IMU's Z axis points with the robot upright
+typedef enum
+{
+	TILT_Z_UP,								//!< az = +g, the default
+	TILT_Z_DOWN								//!< az = -g
+} TiltMounting_t;
+
+float FastAtan2f(float y, float x);
+void FastAtan2fBatch(const float *pY, const float *pX, float *pOut, UInt32 Count);
+
+void TiltSetMounting(TiltMounting_t Mounting);
+TiltMounting_t TiltGetMounting(void);
+
+float TiltRollDeg(const IMUData_t *pData);
+float TiltPitchDeg(const IMUData_t *pData);
+void TiltBatchDeg(const float *pAccelX, const float *pAccelY, const float *pAccelZ,
+				  float *pRoll, float *pPitch, UInt32 Count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TILT_H
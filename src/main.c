@@ -11,87 +11,523 @@
 // http://www.cloudcaptech.com   //
 ///////////////////////////////////
 
-#define RAD_TO_DEG  57.295779513
-
 #include "IMUPacket.h"
 #include "CRC16.h"
-#include "ImuSerial.h"
+#include "IMUSerial.h"
 #include "Serial_PS.h"
 #include <stdio.h>
-#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "CalcAngle.h"
+#include "AnglePredict.h"
+#include "ControlTick.h"
+#include "HostTime.h"
+#include "LatencyTrace.h"
+#include "Metrics.h"
+#include "RealTime.h"
+#include "SensorHealth.h"
+#include "SharedRing.h"
+#include "StartupCal.h"
+#include "TelemetryLog.h"
+#include "TelemetryStream.h"
+#include "Tilt.h"
+
+#ifdef IMU_FIXED_POINT
+#include "CalcAngleFixed.h"
+#endif
+
+#define STARTUP_SAMPLES     16              // Stationary samples averaged at startup (~0.3 s at 50 Hz)
+#define WARM_START_SAMPLES  4               // Samples needed to seed the angle when a saved state exists
+#define SAVE_AFTER_SAMPLES  500             // Save the filter state once it has run this long (~10 s)
+#define FILTER_STATE_FILE   "kfstate.txt"   // Saved bias and covariance
+#define TELEMETRY_FILE      "telemetry.tlm" // Binary telemetry log, see tools/tlm2csv.c
+#define TELEMETRY_QUEUE     4096            // Records buffered for the log writer (~80 s at 50 Hz)
+#define CAPTURE_RING        (1 << 20)       // Bytes buffered for the capture writer
+#define READ_CHUNK          256             // Largest block read from the serial port at once
+#define REPORT_SAMPLES      3000            // Samples between latency and control tick reports (~60 s at 50 Hz)
+#define CONTROL_LEAD_NS     0               // Command to torque delay the controller predicts across
+#define HEALTH_PRINTS       10              // Health events printed a second, the rest only counted
+#define HIGH_SPEED_HZ       50.0            // IMU sample rate the filter step of 0.02 s assumes
+
+// Health checks the controller can't balance through; a dropout or a
+//   temperature drift only degrades the angle
+#define SAFE_STATE_CHECKS   (HM_CHECK_MASK(HM_SATURATED) | HM_CHECK_MASK(HM_FLAT))
+
+// Health events printed in the current second
+typedef struct
+{
+	UInt64 WindowNs;            // Host time the second started
+	UInt32 Printed;             // Events printed in it
+	UInt32 Skipped;             // Events not printed in it
+} HealthPrintLimit_t;
 
+// Runs at the control rate from its own thread with the angle predicted
+//   for the tick, see ControlTick.h.  The balance controller goes here.
+//   pArg points to the sensor health checks raised, see SensorHealth.h.
+static void Control(void *pArg, const ControlTickInfo_t *pTick)
+{
+	const volatile UInt32 *pHealthActive = (const volatile UInt32 *)pArg;
+
+	(void)pTick;
+
+	// Hold a safe state rather than balance on a channel that isn't sane
+	if (atomicLoadAcquire(pHealthActive) & SAFE_STATE_CHECKS)
+		return;
+}
+
+// Starts a new second of health events once the last is over, saying
+//   how many of its events weren't printed.
+static void NextHealthSecond(HealthPrintLimit_t *pLimit, UInt64 Now)
+{
+	if (Now - pLimit->WindowNs < 1000000000ULL)
+		return;
+
+	if (pLimit->Skipped)
+		printf("Sensor health: %lu more events not shown\n", (unsigned long)pLimit->Skipped);
+	pLimit->WindowNs = Now;
+	pLimit->Printed = 0;
+	pLimit->Skipped = 0;
+}
+
+// Saves the converged filter state, on the telemetry writer thread so the
+//   loop does no file I/O.  pArg points to a copy of the filter.
+static void SaveFilterState(void *pArg)
+{
+	if (!calSaveState((const KFilter_t *)pArg, FILTER_STATE_FILE))
+		printf("Can't save the filter state to %s\n", FILTER_STATE_FILE);
+}
+
+// Prints the latency summary, if tracing, and the control tick report.
+//   Run on the telemetry writer thread in real-time mode, so the loop
+//   never waits on the console.  pArg points to the tick, NULL for none.
+static void PrintReports(void *pArg)
+{
+	const ControlTick_t *pTick = (const ControlTick_t *)pArg;
+
+#ifdef IMU_LATENCY_TRACE
+	ltPrintSummary(stdout);
+#endif
+	if (pTick)
+		ctPrintStats(pTick, stdout);
+}
+
+// Reports sensor health checks as they are raised and cleared, at most
+//   HEALTH_PRINTS a second so a bad link can't flood the console; the
+//   metrics count every one.  pArg points to a HealthPrintLimit_t.
+static void HealthEvent(void *pArg, const HealthEvent_t *pEvent)
+{
+	HealthPrintLimit_t *pLimit = (HealthPrintLimit_t *)pArg;
+
+	NextHealthSecond(pLimit, htNowNs());
+	if (pLimit->Printed >= HEALTH_PRINTS)
+	{
+		pLimit->Skipped++;
+		return;
+	}
+
+	pLimit->Printed++;
+	printf("Sensor health: %s %s on channel %u at sample %llu (%g)\n", hmCheckName(pEvent->Check),
+		   pEvent->Raised ? "raised" : "cleared", (unsigned)pEvent->Channel,
+		   (unsigned long long)pEvent->Sample, pEvent->Value);
+}
+
+// Usage: main [-r cpu[:priority]] [-c rate] [-s name] [-t dest] [-m where]
+//            [capture file]
+//   With a capture file name, every byte received is also recorded there
+//   with its arrival time, see SerialCapture.h.
+//   -r runs the loop in real-time mode on that core, SCHED_FIFO at that
+//   priority (80 by default) with memory locked, see RealTime.h.
+//   -c runs Control() at that rate in Hz, see ControlTick.h.
+//   -s publishes every filtered sample to other processes in a shared
+//   memory ring of that name, see SharedRing.h.
+//   -t streams the telemetry to dest, "udp:host:port" or "unix:path", see
+//   TelemetryStream.h; tools/tlmstream.c receives it.
+//   -m serves health metrics for Prometheus, "http:[host:]port" or
+//   "file:path", see Metrics.h.
 int main(int argc, char *argv[])
 {
 	IMUPacket_t Pkt;     // IMU packet storage
 	IMUData_t IMU;       // Current IMU state data
-	SInt16 Byte;         // Current incoming byte
+	UInt8 Buffer[READ_CHUNK]; // Incoming bytes
+	UInt32 Count, n;     // Number of incoming bytes, current byte
+	SerialCapture_t *pCapture = NULL; // Raw data capture, if requested
 	BOOL Waiting = TRUE; // Flag to wait for configuration data
-	float lastTime = 0;  // PPS time from the last packet (for dT measurement)
+	RealTimeConfig_t RealTime;  // Real-time mode settings
+	BOOL UseRealTime = FALSE;   // Flag to run the loop in real-time mode
+	int Arg = 1;                // Next command line argument
+	UInt32 Handle;              // Serial port
+	ControlTickConfig_t TickConfig; // Control tick settings, RateHz 0 for no tick
+	RealTimeConfig_t TickRealTime;  // Real-time settings of the tick thread
+	ControlSnapshot_t Snapshot;     // Latest sample, handed to the tick
+	ControlTick_t *pTick = NULL;    // Control tick, if running
+	const char *pShareName = NULL;  // Shared memory ring name, if requested
+	SharedRingWriter_t *pShare = NULL; // Samples published to other processes
+	const char *pStreamDest = NULL; // Telemetry stream destination, if requested
+	TelemetryStream_t *pStream = NULL; // Telemetry sent off-board
+	const char *pMetricsWhere = NULL; // Metrics endpoint, if requested
+	MetricsExporter_t *pMetrics = NULL; // Serves the metrics
 
 	float angle;
+	AnglePredictor_t Predictor; // Extrapolates the angle past the pipeline latency
+	StartupCal_t Cal;           // Startup bias and angle calibration
+	BOOL Calibrating = TRUE;    // Flag to hold the filter until the robot has been still
+	BOOL Mounted = FALSE;       // Flag set once the IMU mounting is taken from a sample
+	BOOL WarmStart;             // TRUE if the bias and covariance came from the last run
+	UInt32 Filtered = 0;        // Number of samples filtered since calibration
+	KFilter_t SavedFilter;      // Filter state being saved by the telemetry writer
+	TelemetryLog_t *pLog;       // Background telemetry writer
+	TelemetryRecord_t Record;   // Telemetry for the current sample
+	HealthConfig_t HealthConfig; // Sensor health thresholds
+	SensorHealth_t Health;      // Saturation, flat line, dropout and temperature checks
+	volatile UInt32 HealthActive = 0; // Checks raised, read by the control tick
+	HealthPrintLimit_t HealthPrints = { 0, 0, 0 }; // Limits the health events printed
+
+#ifdef IMU_FIXED_POINT
+	IMUFixedScale_t Scale;      // Count to Q16.16 multipliers from the sensor ranges
+	IMUDataQ_t IMUQ;            // Fixed point high speed data
+	KFilterQ_t KFilterQ;        // Fixed point filter, copied to getKFilter() for the float consumers
+	StartupCalQ_t CalQ;         // Startup calibration in fixed point
+#endif
+
+	rtDefaultConfig(&RealTime);
+	memset(&TickConfig, 0, sizeof(TickConfig));
+
+	while (Arg + 1 < argc && argv[Arg][0] == '-')
+	{
+		if (strcmp(argv[Arg], "-r") == 0 && rtParse(argv[Arg + 1], &RealTime))
+			UseRealTime = TRUE;
+		else if (strcmp(argv[Arg], "-c") == 0 && atof(argv[Arg + 1]) > 0)
+			TickConfig.RateHz = atof(argv[Arg + 1]);
+		else if (strcmp(argv[Arg], "-s") == 0)
+			pShareName = argv[Arg + 1];
+		else if (strcmp(argv[Arg], "-t") == 0)
+			pStreamDest = argv[Arg + 1];
+		else if (strcmp(argv[Arg], "-m") == 0)
+			pMetricsWhere = argv[Arg + 1];
+		else
+		{
+			printf("Usage: %s [-r cpu[:priority]] [-c rate] [-s name] [-t dest] [-m where] [capture file]\n", argv[0]);
+			return 1;
+		}
+
+		Arg += 2;
+	}
+
+	// The writer threads started below stay off the loop's core
+	if (UseRealTime)
+		rtBackground(&RealTime);
 
 	// Open the serial port on COM1
-	UInt32 Handle = psOpenCOMM(0, BOTH_DIR, 115200, PARITY_NONE, 8, FLOW_NONE, 1024);
+	Handle = psOpenCOMM(0, BOTH_DIR, 115200, NO_PARITY, 8, FLOW_NONE, 1024);
+	if (!psIsCOMMOpen(Handle))
+	{
+		printf("Can't open the serial port\n");
+		return 1;
+	}
+
+	if (Arg < argc)
+	{
+		pCapture = capOpen(argv[Arg], CAPTURE_RING);
+		if (pCapture)
+			psSetCapture(Handle, pCapture);
+		else
+			printf("Can't create %s, nothing will be captured\n", argv[Arg]);
+	}
 
 	initKFilter();
 
-	// Loop forever
-	while (TRUE)
+	// Reuse the last converged bias if we have one, then we only need the angle
+	WarmStart = calLoadState(getKFilter(), FILTER_STATE_FILE);
+	calInit(&Cal, WarmStart ? WARM_START_SAMPLES : STARTUP_SAMPLES);
+#ifdef IMU_FIXED_POINT
+	kfqFromFloat(&KFilterQ, getKFilter());
+	calInitQ(&CalQ, WarmStart ? WARM_START_SAMPLES : STARTUP_SAMPLES);
+#endif
+
+	// The events are printed from the loop, so a real-time one only counts them
+	hmDefaultConfig(&HealthConfig, HIGH_SPEED_HZ);
+	if (UseRealTime)
+		printf("Real-time mode, sensor health events only go to the metrics\n");
+	else
+	{
+		HealthConfig.pCallback = HealthEvent;
+		HealthConfig.pArg = &HealthPrints;
+	}
+	hmInit(&Health, &HealthConfig);
+
+	// One HS packet is the payload plus sync, type, length and CRC bytes
+	apInit(&Predictor, (MAX_PAYLOAD_BYTES + 6) * 10 * 1000.0f / 115200);
+
+	// Telemetry goes to a file from a background thread, keeping this loop free of I/O
+	pLog = tlOpen(TELEMETRY_FILE, TELEMETRY_QUEUE);
+	if (pLog == NULL)
+		printf("Can't create %s, telemetry will not be logged\n", TELEMETRY_FILE);
+
+	// This thread counts into its own block, the exporter only reads it
+	if (pMetricsWhere)
+	{
+		pMetrics = mtStart(pMetricsWhere);
+		if (pMetrics)
+			mtRegister("serial");
+		else
+			printf("Can't serve metrics at %s\n", pMetricsWhere);
+	}
+
+	// Like the log, the stream is sent from a background thread
+	if (pStreamDest)
+	{
+		pStream = tsOpen(pStreamDest, NULL);
+		if (pStream == NULL)
+			printf("Can't stream to %s, telemetry will not be streamed\n", pStreamDest);
+	}
+
+	// Readers map the ring themselves, publishing only copies into it
+	if (pShareName)
+	{
+		pShare = shCreate(pShareName, SH_DEFAULT_SLOTS);
+		if (pShare == NULL)
+			printf("Can't create shared memory %s, samples will not be shared\n", pShareName);
+	}
+
+	// The tick shares the loop's core one priority above it, so it runs on time
+	if (TickConfig.RateHz > 0)
+	{
+		TickRealTime = RealTime;
+		if (TickRealTime.Priority > 0 && TickRealTime.Priority < 99)
+			TickRealTime.Priority++;
+
+		ctInitSnapshot(&Snapshot);
+		TickConfig.LeadNs = CONTROL_LEAD_NS;
+		TickConfig.pCallback = Control;
+		TickConfig.pArg = (void *)&HealthActive;
+		TickConfig.pSnapshot = &Snapshot;
+		TickConfig.pRealTime = UseRealTime ? &TickRealTime : NULL;
+
+		pTick = ctStart(&TickConfig);
+		if (pTick == NULL)
+			printf("Can't start the control tick\n");
+	}
+
+	// Everything the loop uses is allocated, now make it hard to delay
+	if (UseRealTime)
+	{
+		LT_READ(); // Makes this thread's latency ring, if tracing
+		rtPrintApplied(stdout, &RealTime, rtEnter(&RealTime));
+	}
+
+	// Loop until the port closes, which a replay does at the end of its capture
+	while (psIsCOMMOpen(Handle))
 	{
 		// While there are bytes to be read from the serial port
-		while ((Byte = psReadByteQuick(Handle)) >= 0)
+		while ((Count = psReadBlockQuick(Handle, Buffer, sizeof(Buffer))) > 0)
 		{
-			// If this byte has completed a packet
-			if (LookForIMUPacketInByte((Byte & 0xFF), &Pkt))
-			{
-				// Decode the data contained in this packet
-				DecodeIMUPacket(&Pkt, &IMU);
+			LT_READ();
+			mtCount(MT_SERIAL_BYTES, Count);
 
-				// If we're waiting for configuration data
-				if (Waiting)
+			// Run each of those bytes through the packet state machine
+			for (n = 0; n < Count; n++)
+			{
+				// If this byte has completed a packet
+				if (LookForIMUPacketInByte(Buffer[n], &Pkt))
 				{
-					// If this packet contains the sensor ranges, we're done waiting
-					if (Pkt.type == RESOLUTION_IMU_MSG)
+					UInt64 ArrivalNs = htNowNs();
+
+					LT_FRAME(Pkt.type);
+
+					// Decode the data contained in this packet
+#ifdef IMU_FIXED_POINT
+					// High speed packets only ever go through the integer decoder
+					if (!Waiting && Pkt.type == HS_SERIAL_IMU_MSG)
+						DecodeHighSpeedDataPacketQ(&Pkt, &Scale, &IMUQ);
+					else
+						DecodeIMUPacket(&Pkt, &IMU);
+#else
+					DecodeIMUPacket(&Pkt, &IMU);
+#endif
+					LT_STAGE(LT_DECODE_DONE);
+
+					// If we're waiting for configuration data
+					if (Waiting)
 					{
-						printf("   gx[d/s]   gy[d/s]   gz[d/s] ax[m/s/s] ay[m/s/s] az[m/s/s] dT[ms]\n");
-						Waiting = FALSE;
+						// If this packet contains the sensor ranges, we're done waiting
+						if (Pkt.type == RESOLUTION_IMU_MSG)
+						{
+#ifdef IMU_FIXED_POINT
+							SetFixedScale(&Scale, &IMU);
+#endif
+							printf("Configuration received, logging to %s\n", TELEMETRY_FILE);
+							Waiting = FALSE;
+						}
+						else // Otherwise, keep asking the IMU for its configuration data
+						{
+							FormConfigurationRequestPacket(&Pkt, &IMU);
+							psWriteBlockQuick(Handle, (UInt8 *)&Pkt, Pkt.len + 6);
+						}
 					}
-					else // Otherwise, keep asking the IMU for its configuration data
+					else if (Pkt.type == HS_SERIAL_IMU_MSG) // If high-speed (converted) telemetry
 					{
-						FormConfigurationRequestPacket(&Pkt, &IMU);
-						psWriteBlockQuick(Handle, (UInt8 *)&Pkt, Pkt.len + 6);
+						// Check the channels before anything uses them
+#ifdef IMU_FIXED_POINT
+						atomicStoreRelease(&HealthActive, hmUpdateQ(&Health, &IMUQ));
+#else
+						atomicStoreRelease(&HealthActive, hmUpdate(&Health, &IMU));
+#endif
+
+						// Hold off filtering until we've seen the robot sit still
+						if (Calibrating)
+						{
+							// Roll is atan2(ay, az), which wraps around az = -g, so take which
+							//   way Z points before the first roll, see Tilt.h
+							if (!Mounted)
+							{
+#ifdef IMU_FIXED_POINT
+								if (IMUQ.Converted[ACCELZ_IDX] < 0)
+#else
+								if (IMU.SensorsConverted[ACCELZ_IDX] < 0.0f)
+#endif
+								{
+									TiltSetMounting(TILT_Z_DOWN);
+									printf("IMU mounted Z down, taking the roll half a turn about X (see Tilt.h)\n");
+								}
+								Mounted = TRUE;
+							}
+
+#ifdef IMU_FIXED_POINT
+							if (calAddSampleQ(&CalQ, TiltRollQ(&IMUQ), IMUQ.Converted[GYROX_IDX],
+											  &IMUQ.Converted[ACCELX_IDX]))
+							{
+								if (WarmStart)
+									KFilterQ.angle = calGetTiltQ(&CalQ);
+								else
+									calApplyQ(&CalQ, &KFilterQ);
+#else
+							if (calAddSample(&Cal, TiltRollDeg(&IMU), IMU.SensorsConverted[GYROX_IDX],
+											 &IMU.SensorsConverted[ACCELX_IDX]))
+							{
+								if (WarmStart)
+									setAngle(calGetTilt(&Cal));
+								else
+									calApply(&Cal, getKFilter());
+#endif
+
+								// The bias just calibrated holds at this temperature
+								hmSetTempReference(&Health, &IMU);
+								Calibrating = FALSE;
+							}
+
+							LT_END();
+							continue;
+						}
+
+#ifdef IMU_FIXED_POINT
+						kfqGetAngle(&KFilterQ, TiltRollQ(&IMUQ), IMUQ.Converted[GYROX_IDX], FLOAT_TO_Q16(0.02));
+						angle = Q16_TO_FLOAT(KFilterQ.angle);
+						LT_STAGE(LT_FILTER_DONE);
+
+						// Floats from here on, and only for whatever takes the sample
+						if (pLog || pStream || pShare || pMetrics || pTick)
+						{
+							kfqToFloat(&KFilterQ, getKFilter());
+							IMUDataFromQ(&IMU, &IMUQ);
+						}
+#else
+						angle = getAngle(TiltRollDeg(&IMU), IMU.SensorsConverted[GYROX_IDX], 0.02);
+						LT_STAGE(LT_FILTER_DONE);
+#endif
+
+						// Remember the converged state for a fast start next time,
+						//   written from the telemetry writer rather than this loop
+						if (++Filtered == SAVE_AFTER_SAMPLES)
+						{
+#ifdef IMU_FIXED_POINT
+							kfqToFloat(&KFilterQ, &SavedFilter);
+#else
+							SavedFilter = *getKFilter();
+#endif
+							if (pLog == NULL || !tlDefer(pLog, SaveFilterState, &SavedFilter))
+							{
+								// Without a writer only a normal mode loop may block on the file
+								if (!UseRealTime)
+									SaveFilterState(&SavedFilter);
+							}
+						}
+
+						// The control tick predicts the angle at its command time from this
+						if (pTick)
+						{
+							apUpdate(&Predictor, getKFilter(), IMU.TimeSincePPS, ArrivalNs);
+							ctPublish(&Snapshot, &Predictor);
+						}
+
+						if (pShare)
+							shPublish(pShare, &IMU, ArrivalNs, angle, getKFilter()->rate, getKFilter()->bias);
+
+						// Hand the sample to the logger and the stream; this only copies the record
+						if (pLog || pStream)
+							tlFillRecord(&Record, &IMU, ArrivalNs, angle, getKFilter()->bias);
+						if (pLog && !tlPush(pLog, &Record))
+							mtCount(MT_LOG_DROPPED, 1);
+						if (pStream && !tsPush(pStream, &Record))
+							mtCount(MT_STREAM_DROPPED, 1);
+
+						if (pMetrics)
+						{
+							mtCount(MT_SAMPLES_FILTERED, 1);
+							mtGauge(MT_FILTER_ANGLE, angle);
+							mtGauge(MT_FILTER_RATE, getKFilter()->rate);
+							mtGauge(MT_FILTER_BIAS, getKFilter()->bias);
+							mtGauge(MT_HEALTH_ACTIVE, Health.ActiveCount);
+							if (pLog)
+							{
+								mtGauge(MT_LOG_DEPTH, tlDepth(pLog));
+								mtGauge(MT_LOG_LOST, tlLost(pLog));
+							}
+							if (pStream)
+								mtGauge(MT_STREAM_DEPTH, tsDepth(pStream));
+							mtLatency(htNowNs() - ArrivalNs);
+						}
+
+						// A real-time loop leaves the reports to the writer, or skips them
+						if (Filtered % REPORT_SAMPLES == 0)
+						{
+							if (!UseRealTime)
+								PrintReports(pTick);
+							else if (pLog)
+								tlDefer(pLog, PrintReports, pTick);
+						}
 					}
-				}
-				else if (Pkt.type == HS_SERIAL_IMU_MSG) // If high-speed (converted) telemetry
-				{
-					// Print the data to the screen in tidy columns
-					printf("%10.2f:%10.2f:%10.2f:%10.2f:%10.2f:%10.2f",
-						IMU.SensorsConverted[GYROX_IDX],
-						IMU.SensorsConverted[GYROY_IDX],
-						IMU.SensorsConverted[GYROZ_IDX],
-						IMU.SensorsConverted[ACCELX_IDX],
-						IMU.SensorsConverted[ACCELY_IDX],
-						IMU.SensorsConverted[ACCELZ_IDX]);
-
-					angle = getAngle(atan(IMU.SensorsConverted[ACCELY_IDX] / IMU.SensorsConverted[ACCELZ_IDX]) * RAD_TO_DEG, IMU.SensorsConverted[GYROX_IDX], 0.02);
-
-					printf("%10.2f", angle);
-					
-					// Only print the time delta if we've got a good "last time" reading
-					if (lastTime > 0)
-						printf("%10.1f\n", IMU.TimeSincePPS - lastTime);
-					else
-						printf("%10.1f\n", 0);
+#ifdef IMU_FIXED_POINT
+					// hmUpdateQ() has no temperatures, check them as they arrive
+					else if (Pkt.type == RAWGYROTEMPX_IMU_MSG || Pkt.type == RAWGYROTEMPY_IMU_MSG ||
+							 Pkt.type == RAWGYROTEMPZ_IMU_MSG)
+						atomicStoreRelease(&HealthActive, hmCheckTemp(&Health, IMU.GyroTempVolts));
+#endif
 
-					// Store the current timestamp as the new previous timestamp
-					lastTime = IMU.TimeSincePPS;
+					LT_END();
 				}
 			}
 		}
 
+		// Own up to health events left unprinted once no more come
+		if (HealthPrints.Skipped)
+			NextHealthSecond(&HealthPrints, htNowNs());
+
 		// Give the rest of the system time to do its thing
-		Sleep(1);
+		htSleepMs(1);
 	}
+
+	// Stop what reads the loop's state, then write out what it queued
+	printf("Serial port closed, stopping\n");
+	ctStop(pTick);
+	mtStop(pMetrics);
+	shClose(pShare);
+	tsClose(pStream);
+	psCloseCOMM(Handle);
+	if (pCapture && !capClose(pCapture))
+		printf("Capture incomplete, bytes were dropped or a write failed\n");
+	if (pLog && !tlClose(pLog))
+		printf("Telemetry log incomplete, records were dropped or a write failed\n");
+
+	return 0;
 }
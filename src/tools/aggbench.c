@@ -0,0 +1,537 @@
+/*! \file
+	\brief Benchmark of the multi-IMU aggregator.
+
+	Usage: aggbench [-n ports] [-r rate] [-b baud] [-s seconds] [-f port:fault:at]
+
+	-n synthetic IMUs (8) sample the same roll motion, a 10 degree 1 Hz
+	sine, at -r Hz (400) each, their sample times staggered evenly across a
+	period.  A feeder thread writes each IMU's bytes into its own pipe when
+	they are due, as a -b baud (115200) serial port would deliver them, for
+	-s seconds (5), and the main thread runs agPoll() on the read ends.
+
+	Every set goes through the redundant IMU fusion, see
+	RedundantFusion.h.  -f makes one port fail -at seconds into the run:
+	"stuck" freezes its readings, "saturate" pins its X gyro at the range,
+	"diverge" adds 5 degrees to its angle, all applied to the sets on their
+	way to the fusion, and "drop" stops feeding its pipe.  The sine starts
+	with a step in rate that the staggered ports see at different times, so
+	some ports are outvoted for a set there, and the ports that start last
+	are missing from the first sets, which the fusion doesn't count.
+
+	It reports each port's samples and sequence gaps, the CPU the polling
+	thread used, the latency from the set's time to the callback having
+	it, and how far apart the ports' angles are: in the aligned sets and,
+	for comparison, taking every port's newest sample at the same moments.
+	Then the faults the fusion found, how long after the injection the
+	failing port was left out, and the error of the fused angle against the
+	true motion next to that of a plain mean of every port.  It exits
+	non-zero if any port lost a sample it was sent, an injected fault
+	wasn't caught, or, with more than one port or no fault injected, the
+	fusion had no estimate for a set after the filters' start up.
+*/
+
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "Atomic.h"
+#include "HostTime.h"
+#include "IMUGenerator.h"
+#include "ImuAggregator.h"
+#include "LatencyHistogram.h"
+#include "RedundantFusion.h"
+
+#define DEFAULT_PORTS		8
+#define DEFAULT_RATE		400.0
+#define DEFAULT_BAUD		115200
+#define DEFAULT_SECONDS		5.0
+
+#define LEAD_SECONDS		0.1				// Hold before the motion starts
+#define SINE_DEGREES		10.0
+#define SINE_HZ				1.0
+#define FEED_PERIOD_NS		250000			// Feeder wakeup period
+#define SETTLE_SECONDS		0.5				// Filter start up left out of the errors
+#define DIVERGE_DEGREES		5.0f
+
+//! Injected faults
+typedef enum
+{
+	INJECT_NONE,
+	INJECT_STUCK,
+	INJECT_SATURATE,
+	INJECT_DIVERGE,
+	INJECT_DROP
+} Inject_t;
+
+//! One synthetic IMU's bytes and how far they have been written
+typedef struct
+{
+	int Fd;									//!< Write end of the port's pipe
+	UInt8 *pBytes;							//!< Configuration response, then every sample
+	UInt32 *pEnd;							//!< Byte offset after each sample
+	UInt32 Samples;							//!< Samples generated
+	UInt32 Sent;							//!< Samples to write, fewer if dropped
+	UInt32 Written;							//!< Bytes written
+	double OffsetNs;						//!< Sample time stagger
+} FeedPort_t;
+
+//! Feeder thread
+typedef struct
+{
+	FeedPort_t Port[AG_MAX_PORTS];
+	UInt32 Ports;
+	double Rate;
+	UInt64 StartNs;
+	volatile UInt32 Done;
+} Feeder_t;
+
+//! What the set callback measures
+typedef struct
+{
+	Aggregator_t *pAgg;
+	UInt64 StartNs;
+	Inject_t Inject;						//!< Fault to inject
+	UInt32 InjectPort;
+	UInt64 InjectNs;						//!< When
+	AggSample_t Frozen;						//!< Sample a stuck port repeats
+	BOOL HaveFrozen;
+	UInt64 CaughtNs;						//!< Set time the fusion first left the port out after InjectNs
+	UInt64 CaughtWallNs;					//!< Host time it did
+	AggSet_t Set;							//!< Set with the fault injected
+	RedundantFusion_t Fusion;
+	FusedEstimate_t Estimate;
+	UInt64 Errors;							//!< Sets the errors were taken over
+	UInt64 LateInvalid;						//!< Sets with no estimate after the start up
+	double FusedSq, FusedMax;				//!< Fused angle against the truth
+	double MeanSq, MeanMax;					//!< Mean of every valid port against the truth
+	UInt64 Sets;
+	UInt64 FullSets;						//!< Sets with every port valid
+	double AlignedSpread, AlignedMax;		//!< Angle range across ports in the sets
+	double NewestSpread, NewestMax;			//!< Same taking each port's newest sample
+	LatencyHistogram_t Latency;				//!< Set time to the callback
+} SetStats_t;
+
+
+/*! Write each port's bytes as they fall due, then close the pipes.
+	\param pArg points to the Feeder_t.
+	\return NULL.*/
+static void *FeederThread(void *pArg)
+{
+	Feeder_t *pFeed = (Feeder_t *)pArg;
+	struct timespec Ts = { 0, FEED_PERIOD_NS };
+	UInt32 p, Left = pFeed->Ports;
+
+	while (Left)
+	{
+		double Elapsed = (double)(htNowNs() - pFeed->StartNs);
+
+		for (Left = 0, p = 0; p < pFeed->Ports; p++)
+		{
+			FeedPort_t *pPort = &pFeed->Port[p];
+			double Due = floor((Elapsed - pPort->OffsetNs) * pFeed->Rate / 1.0e9) + 1;
+			UInt32 End = Due < 1 ? pPort->pEnd[0] : Due > pPort->Sent ? pPort->pEnd[pPort->Sent]
+																  : pPort->pEnd[(UInt32)Due];
+			ssize_t Count;
+
+			if (End > pPort->Written)
+			{
+				Count = write(pPort->Fd, pPort->pBytes + pPort->Written, End - pPort->Written);
+				if (Count > 0)
+					pPort->Written += (UInt32)Count;
+			}
+
+			if (pPort->Written < pPort->pEnd[pPort->Sent])
+				Left++;
+		}
+
+		nanosleep(&Ts, NULL);
+	}
+
+	for (p = 0; p < pFeed->Ports; p++)
+		close(pFeed->Port[p].Fd);
+
+	atomicStoreRelease(&pFeed->Done, 1);
+	return NULL;
+
+}// FeederThread
+
+
+/*! Damage a port's part of a set as the injected fault would.
+	\param pStats points to the measurements.
+	\param pPort is the port's part of the set.*/
+static void Inject(SetStats_t *pStats, AggPortSample_t *pPort)
+{
+	switch (pStats->Inject)
+	{
+	case INJECT_STUCK:
+		if (!pStats->HaveFrozen)
+		{
+			pStats->Frozen = pPort->Sample;
+			pStats->HaveFrozen = TRUE;
+		}
+		pPort->Sample = pStats->Frozen;
+		break;
+
+	case INJECT_SATURATE:
+		pPort->Sample.Sensors[GYROX_IDX] = pPort->GyroRange;
+		break;
+
+	case INJECT_DIVERGE:
+		pPort->Sample.Angle += DIVERGE_DEGREES;
+		break;
+
+	default:
+		break;
+	}
+
+}// Inject
+
+
+/*! Fuse a set, with the fault injected, and measure the estimate.
+	\param pStats points to the measurements.
+	\param pSet is the set from the aggregator.*/
+static void FuseSet(SetStats_t *pStats, const AggSet_t *pSet)
+{
+	double Time = (pSet->TimeNs - pStats->StartNs) / 1.0e9 - LEAD_SECONDS, Truth, Error, Mean = 0;
+	UInt32 p, Valid = 0;
+
+	pStats->Set = *pSet;
+	if (pStats->Inject != INJECT_NONE && pSet->TimeNs >= pStats->InjectNs &&
+		pStats->Set.Port[pStats->InjectPort].Valid)
+		Inject(pStats, &pStats->Set.Port[pStats->InjectPort]);
+
+	rfUpdate(&pStats->Fusion, &pStats->Set, &pStats->Estimate);
+
+	if (pStats->Inject != INJECT_NONE && pStats->CaughtNs == 0 && pSet->TimeNs >= pStats->InjectNs &&
+		!(pStats->Estimate.UsedMask & (1u << pStats->InjectPort)))
+	{
+		pStats->CaughtNs = pSet->TimeNs;
+		pStats->CaughtWallNs = htNowNs();
+	}
+
+	if (Time < SETTLE_SECONDS)
+		return;
+	if (!pStats->Estimate.Valid)
+	{
+		pStats->LateInvalid++;
+		return;
+	}
+
+	Truth = SINE_DEGREES * sin(2.0 * M_PI * SINE_HZ * Time);
+	for (p = 0; p < pSet->Ports; p++)
+	{
+		if (pStats->Set.Port[p].Valid)
+		{
+			Mean += pStats->Set.Port[p].Sample.Angle;
+			Valid++;
+		}
+	}
+	Mean /= Valid;
+
+	Error = fabs(pStats->Estimate.Angle - Truth);
+	pStats->FusedSq += Error * Error;
+	if (Error > pStats->FusedMax)
+		pStats->FusedMax = Error;
+
+	Error = fabs(Mean - Truth);
+	pStats->MeanSq += Error * Error;
+	if (Error > pStats->MeanMax)
+		pStats->MeanMax = Error;
+
+	pStats->Errors++;
+
+}// FuseSet
+
+
+/*! Measure a set.
+	\param pArg points to the SetStats_t.
+	\param pSet is the set.*/
+static void MeasureSet(void *pArg, const AggSet_t *pSet)
+{
+	SetStats_t *pStats = (SetStats_t *)pArg;
+	float Min = 1.0e9f, Max = -1.0e9f, NewMin = 1.0e9f, NewMax = -1.0e9f;
+	AggSample_t Newest;
+	UInt32 p;
+
+	lhAdd(&pStats->Latency, htNowNs() - pSet->TimeNs);
+	pStats->Sets++;
+
+	FuseSet(pStats, pSet);
+
+	if (pSet->ValidPorts != pSet->Ports)
+		return;
+
+	for (p = 0; p < pSet->Ports; p++)
+	{
+		float Angle = pSet->Port[p].Sample.Angle;
+
+		Min = Angle < Min ? Angle : Min;
+		Max = Angle > Max ? Angle : Max;
+
+		agNewest(pStats->pAgg, p, &Newest);
+		NewMin = Newest.Angle < NewMin ? Newest.Angle : NewMin;
+		NewMax = Newest.Angle > NewMax ? Newest.Angle : NewMax;
+	}
+
+	pStats->FullSets++;
+	pStats->AlignedSpread += Max - Min;
+	pStats->NewestSpread += NewMax - NewMin;
+	if (Max - Min > pStats->AlignedMax)
+		pStats->AlignedMax = Max - Min;
+	if (NewMax - NewMin > pStats->NewestMax)
+		pStats->NewestMax = NewMax - NewMin;
+
+}// MeasureSet
+
+
+/*! Generate one IMU's bytes.
+	\param pPort points to the port to fill.
+	\param Rate is the sample rate.
+	\param Seconds is how long to generate for.
+	\param Seed is the noise seed.
+	\return TRUE if generated.*/
+static BOOL Generate(FeedPort_t *pPort, double Rate, double Seconds, UInt32 Seed)
+{
+	GenSegment_t Profile[2] =
+	{
+		{ GEN_HOLD, 0.0, 0.0, 0.0 },
+		{ GEN_SINE, 0.0, SINE_DEGREES, SINE_HZ },
+	};
+	IMUGenerator_t *pGen = (IMUGenerator_t *)malloc(sizeof(IMUGenerator_t));
+	GenConfig_t Config;
+	UInt32 n, Bytes;
+
+	pPort->Samples = (UInt32)(Rate * Seconds);
+	pPort->pBytes = (UInt8 *)malloc(GEN_MAX_CONFIG_BYTES + (size_t)pPort->Samples * GEN_MAX_STEP_BYTES);
+	pPort->pEnd = (UInt32 *)malloc(((size_t)pPort->Samples + 1) * sizeof(UInt32));
+	if (pGen == NULL || pPort->pBytes == NULL || pPort->pEnd == NULL)
+	{
+		free(pGen);
+		return FALSE;
+	}
+
+	// Every port sees the sine start at the same moment, sampling it at its own times
+	Profile[0].Duration = LEAD_SECONDS - pPort->OffsetNs / 1.0e9;
+	Profile[1].Duration = Seconds;
+
+	genDefaultConfig(&Config);
+	Config.RateHz = Rate;
+	Config.Seed = Seed;
+	Config.pProfile = Profile;
+	Config.ProfileCount = 2;
+	genInit(pGen, &Config);
+
+	Bytes = genConfigResponse(pGen, pPort->pBytes);
+	pPort->pEnd[0] = Bytes;
+	for (n = 0; n < pPort->Samples; n++)
+	{
+		Bytes += genStep(pGen, pPort->pBytes + Bytes, NULL);
+		pPort->pEnd[n + 1] = Bytes;
+	}
+
+	free(pGen);
+	return TRUE;
+
+}// Generate
+
+
+/*! Parse a fault to inject, "port:fault:at".
+	\param pText is the text.
+	\param pStats receives the fault and port.
+	\param pAt receives the seconds into the run.
+	\return TRUE if it parsed.*/
+static BOOL ParseInject(const char *pText, SetStats_t *pStats, double *pAt)
+{
+	static const char *Names[] = { "", "stuck", "saturate", "diverge", "drop" };
+	char Fault[16];
+	unsigned Port;
+	UInt32 i;
+
+	if (sscanf(pText, "%u:%15[a-z]:%lf", &Port, Fault, pAt) != 3 || Port >= AG_MAX_PORTS)
+		return FALSE;
+
+	for (i = INJECT_STUCK; i <= INJECT_DROP; i++)
+	{
+		if (strcmp(Fault, Names[i]) == 0)
+		{
+			pStats->Inject = (Inject_t)i;
+			pStats->InjectPort = Port;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+
+}// ParseInject
+
+
+static void Usage(const char *pName)
+{
+	fprintf(stderr, "usage: %s [-n ports] [-r rate] [-b baud] [-s seconds] [-f port:fault:at]\n"
+			"       faults are stuck, saturate, diverge and drop\n", pName);
+
+}// Usage
+
+
+int main(int argc, char *argv[])
+{
+	static Feeder_t Feed;
+	static SetStats_t Stats;
+	FusionConfig_t FusionConfig;
+	Aggregator_t *pAgg;
+	AggPortStats_t PortStats;
+	pthread_t Thread;
+	struct timespec CpuBefore, CpuAfter;
+	double Rate = DEFAULT_RATE, Seconds = DEFAULT_SECONDS, At = 0, WallNs, CpuNs;
+	UInt32 Ports = DEFAULT_PORTS, Baud = DEFAULT_BAUD, p, f;
+	UInt64 Samples = 0, Lost = 0, Reads = 0;
+	int Opt;
+
+	while ((Opt = getopt(argc, argv, "n:r:b:s:f:")) != -1)
+	{
+		switch (Opt)
+		{
+		case 'n': Ports = (UInt32)atoi(optarg); break;
+		case 'r': Rate = atof(optarg); break;
+		case 'b': Baud = (UInt32)atoi(optarg); break;
+		case 's': Seconds = atof(optarg); break;
+		case 'f':
+			if (ParseInject(optarg, &Stats, &At))
+				break;
+			// Fall through
+		default:
+			Usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (Ports == 0 || Ports > AG_MAX_PORTS || Rate <= 0 || Seconds <= 0 ||
+		(Stats.Inject != INJECT_NONE && (Stats.InjectPort >= Ports || At < 0 || At >= Seconds)))
+	{
+		Usage(argv[0]);
+		return 1;
+	}
+
+	// A port is silent for a sample period at most while the feeder keeps up
+	pAgg = agCreate((UInt64)(4.0e9 / Rate), MeasureSet, &Stats);
+	if (pAgg == NULL)
+	{
+		fprintf(stderr, "%s: can't create the aggregator\n", argv[0]);
+		return 1;
+	}
+	Stats.pAgg = pAgg;
+	lhReset(&Stats.Latency);
+	rfDefaultConfig(&FusionConfig, Rate);
+	rfInit(&Stats.Fusion, &FusionConfig);
+
+	Feed.Ports = Ports;
+	Feed.Rate = Rate;
+	for (p = 0; p < Ports; p++)
+	{
+		FeedPort_t *pPort = &Feed.Port[p];
+		char Name[AG_NAME_BYTES];
+		int Fds[2];
+
+		pPort->OffsetNs = 1.0e9 * p / (Ports * Rate);
+		snprintf(Name, sizeof(Name), "imu%u", (unsigned)p);
+
+		if (!Generate(pPort, Rate, Seconds, p + 1) || pipe(Fds) < 0 ||
+			agAddPort(pAgg, Fds[0], Name, Baud, Rate) < 0)
+		{
+			fprintf(stderr, "%s: can't set up port %u\n", argv[0], (unsigned)p);
+			return 1;
+		}
+		pPort->Fd = Fds[1];
+		pPort->Sent = pPort->Samples;
+	}
+
+	if (Stats.Inject == INJECT_DROP)
+		Feed.Port[Stats.InjectPort].Sent = (UInt32)(At * Rate);
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &CpuBefore);
+	Feed.StartNs = Stats.StartNs = htNowNs();
+	Stats.InjectNs = Feed.StartNs + (UInt64)(At * 1.0e9);
+	if (pthread_create(&Thread, NULL, FeederThread, &Feed) != 0)
+	{
+		fprintf(stderr, "%s: can't start the feeder\n", argv[0]);
+		return 1;
+	}
+
+	while (!atomicLoadAcquire(&Feed.Done))
+		agPoll(pAgg, 10);
+	while (agPoll(pAgg, 10) > 0)
+		;
+
+	WallNs = (double)(htNowNs() - Feed.StartNs);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &CpuAfter);
+	CpuNs = (CpuAfter.tv_sec - CpuBefore.tv_sec) * 1.0e9 + (CpuAfter.tv_nsec - CpuBefore.tv_nsec);
+	pthread_join(Thread, NULL);
+
+	printf("%u ports at %.0f Hz, %u baud, for %.1f s\n\n", (unsigned)Ports, Rate, (unsigned)Baud, Seconds);
+
+	for (p = 0; p < Ports; p++)
+	{
+		agGetPortStats(pAgg, p, &PortStats);
+		printf("%-8s %8llu bytes in %6llu reads, %6llu of %6lu samples, %llu sequence gaps\n",
+			   agPortName(pAgg, p), (unsigned long long)PortStats.Bytes, (unsigned long long)PortStats.Reads,
+			   (unsigned long long)PortStats.Samples, (unsigned long)Feed.Port[p].Sent,
+			   (unsigned long long)PortStats.SequenceGaps);
+
+		Samples += PortStats.Samples;
+		Reads += PortStats.Reads;
+		Lost += Feed.Port[p].Sent - PortStats.Samples + PortStats.SequenceGaps;
+	}
+
+	printf("\npolling thread %.2f%% of a core, %.0f ns per sample, %.0f reads/s\n",
+		   100.0 * CpuNs / WallNs, Samples ? CpuNs / Samples : 0.0, Reads * 1.0e9 / WallNs);
+	printf("%llu sets, %.0f/s, %llu with every port\n", (unsigned long long)Stats.Sets,
+		   Stats.Sets * 1.0e9 / WallNs, (unsigned long long)Stats.FullSets);
+	if (Stats.FullSets)
+		printf("angle range across ports: aligned %.4f mean %.4f max, newest samples %.4f mean %.4f max degrees\n\n",
+			   Stats.AlignedSpread / Stats.FullSets, Stats.AlignedMax,
+			   Stats.NewestSpread / Stats.FullSets, Stats.NewestMax);
+	lhPrintSummary(stdout, "set time to callback", &Stats.Latency);
+
+	printf("\nfusion: %llu sets, %llu with no unit to trust (%llu after start up), %llu from one recovering unit, "
+		   "%llu two unit disagreements\n",
+		   (unsigned long long)Stats.Fusion.Stats.Sets, (unsigned long long)Stats.Fusion.Stats.Invalid,
+		   (unsigned long long)Stats.LateInvalid, (unsigned long long)Stats.Fusion.Stats.Fallbacks,
+		   (unsigned long long)Stats.Fusion.Stats.Disagreements);
+	for (p = 0; p < Ports; p++)
+	{
+		for (f = RF_OK + 1; f < RF_FAULTS; f++)
+		{
+			if (Stats.Fusion.Stats.Faults[p][f])
+				printf("%-8s %llu %s\n", agPortName(pAgg, p),
+					   (unsigned long long)Stats.Fusion.Stats.Faults[p][f], rfFaultName((FusionFault_t)f));
+		}
+	}
+	if (Stats.Inject != INJECT_NONE)
+	{
+		if (Stats.CaughtNs)
+			printf("%s left out %.2f ms of set time, %.2f ms of host time after the fault\n",
+				   agPortName(pAgg, Stats.InjectPort), (Stats.CaughtNs - Stats.InjectNs) / 1.0e6,
+				   (Stats.CaughtWallNs - Stats.InjectNs) / 1.0e6);
+		else
+			printf("%s never left out\n", agPortName(pAgg, Stats.InjectPort));
+	}
+	if (Stats.Errors)
+		printf("angle error: fused %.4f rms %.4f max, mean of every port %.4f rms %.4f max degrees\n",
+			   sqrt(Stats.FusedSq / Stats.Errors), Stats.FusedMax,
+			   sqrt(Stats.MeanSq / Stats.Errors), Stats.MeanMax);
+
+	agDestroy(pAgg);
+	for (p = 0; p < Ports; p++)
+	{
+		free(Feed.Port[p].pBytes);
+		free(Feed.Port[p].pEnd);
+	}
+
+	return (Lost || (Stats.Inject != INJECT_NONE && Stats.CaughtNs == 0) ||
+			((Ports > 1 || Stats.Inject == INJECT_NONE) && Stats.LateInvalid)) ? 1 : 0;
+
+}// main
@@ -0,0 +1,216 @@
+/*! \file
+	\brief Allan deviation and noise terms of a recording, and the Kalman
+	filter settings they suggest.
+
+	Usage: allan [-t threads] [-d taus per decade] [-o adev.csv] <capture | log.slg>
+
+	The recording should be of the IMU sitting still, the longer the
+	better; bias instability needs tens of minutes and rate random walk
+	hours.  Both capture files and sample logs (see SampleLog.h) are read,
+	sample logs being the practical way to keep hours of data.
+
+	The suggestions are for the roll filter in main.c, fed the X gyro and
+	the roll angle from the Y and Z accelerometers:
+
+	    Q_angle   = N^2 of the X gyro, the angle variance it adds per second
+	    Q_bias    = K^2 of the X gyro, or B^2 / tau(B) when the recording is
+	                too short to show rate random walk
+	    R_measure = variance of the accelerometer roll angle per sample
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "AllanVariance.h"
+#include "CalcAngle.h"
+#include "Recording.h"
+
+#define MAX_TAUS		256
+#define RAD_TO_DEG		57.29577951308232
+
+static const char *ChannelNames[N_SENSOR_IDX] = { "GyroX", "GyroY", "GyroZ", "AccelX", "AccelY", "AccelZ" };
+
+typedef struct
+{
+	AllanSeries_t *pSeries;
+	BOOL HaveLast;
+	float LastTime;							//!< IMU time of the last sample, ms since a PPS
+	UInt8 LastPPSCount;
+	UInt8 LastSequence;
+	double Elapsed;							//!< IMU time from the first sample to the last, s
+	UInt64 Gaps;							//!< Sequence number gaps
+	BOOL Ok;
+} AllanInput_t;
+
+
+/*! Add one sample, keeping track of the IMU time it covers.
+	\param pUser points to the AllanInput_t.
+	\param pData points to the sample.
+	\param HostNs is not used.*/
+static void AddSample(void *pUser, const IMUData_t *pData, UInt64 HostNs)
+{
+	AllanInput_t *pIn = (AllanInput_t *)pUser;
+
+	if (pIn->HaveLast)
+	{
+		pIn->Elapsed += (pData->TimeSincePPS - pIn->LastTime) / 1000.0 + (UInt8)(pData->PPSCount - pIn->LastPPSCount);
+		if ((UInt8)(pData->SequenceNumber - pIn->LastSequence) != 1)
+			pIn->Gaps++;
+	}
+	pIn->LastTime = pData->TimeSincePPS;
+	pIn->LastPPSCount = pData->PPSCount;
+	pIn->LastSequence = pData->SequenceNumber;
+	pIn->HaveLast = TRUE;
+
+	if (!avAdd(pIn->pSeries, pData->SensorsConverted))
+		pIn->Ok = FALSE;
+
+}// AddSample
+
+
+int main(int argc, char *argv[])
+{
+	AllanInput_t In;
+	AllanNoise_t Noise[N_SENSOR_IDX];
+	KFilter_t Defaults;
+	UInt32 M[MAX_TAUS], Threads = 0, PerDecade = AV_TAUS_PER_DECADE, Taus, t, n;
+	double Tau[MAX_TAUS], *pAdev, Tau0, g, SigmaRoll;
+	const char *pCsv = NULL;
+	FILE *pOut;
+	int Option;
+	BOOL BadArgs = FALSE;
+
+	while (!BadArgs && ((Option = getopt(argc, argv, "t:d:o:")) != -1))
+	{
+		switch (Option)
+		{
+		case 't': Threads = (UInt32)atoi(optarg); break;
+		case 'd': PerDecade = (UInt32)atoi(optarg); break;
+		case 'o': pCsv = optarg; break;
+		default:  BadArgs = TRUE; break;
+		}
+	}
+
+	if (BadArgs || (optind != argc - 1) || (PerDecade == 0))
+	{
+		fprintf(stderr, "usage: %s [-t threads] [-d taus per decade] [-o adev.csv] <capture | log.slg>\n", argv[0]);
+		return 1;
+	}
+
+	memset(&In, 0, sizeof(In));
+	In.Ok = TRUE;
+	In.pSeries = avCreate();
+
+	if ((In.pSeries == NULL) || !recRead(argv[optind], Threads, AddSample, &In, NULL))
+	{
+		fprintf(stderr, "%s: not a capture or sample log\n", argv[optind]);
+		return 1;
+	}
+
+	Taus = avTaus(avCount(In.pSeries), PerDecade, M, MAX_TAUS);
+	if (!In.Ok || (Taus < 3))
+	{
+		fprintf(stderr, "%s: %s\n", argv[optind], In.Ok ? "too few samples" : "out of memory");
+		return 1;
+	}
+
+	Tau0 = In.Elapsed / (avCount(In.pSeries) - 1);
+	for (t = 0; t < Taus; t++)
+		Tau[t] = M[t] * Tau0;
+
+	pAdev = (double *)malloc((size_t)N_SENSOR_IDX * Taus * sizeof(double));
+	if ((pAdev == NULL) || !avCompute(In.pSeries, M, Taus, Threads, pAdev))
+	{
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	printf("%llu samples over %.1f s, %.1f Hz", (unsigned long long)avCount(In.pSeries), In.Elapsed, 1.0 / Tau0);
+	if (In.Gaps)
+		printf(", %llu sequence gaps, the curve assumes even sampling", (unsigned long long)In.Gaps);
+	printf("\n\n");
+
+	// The curve
+	pOut = pCsv ? fopen(pCsv, "w") : NULL;
+	if (pCsv && (pOut == NULL))
+		fprintf(stderr, "%s: can't create\n", pCsv);
+
+	printf("%10s", "tau s");
+	for (n = 0; n < N_SENSOR_IDX; n++)
+		printf(" %11s", ChannelNames[n]);
+	printf("\n");
+	if (pOut)
+		fprintf(pOut, "Tau,%s,%s,%s,%s,%s,%s\n", ChannelNames[0], ChannelNames[1], ChannelNames[2],
+				ChannelNames[3], ChannelNames[4], ChannelNames[5]);
+
+	for (t = 0; t < Taus; t++)
+	{
+		printf("%10.4g", Tau[t]);
+		if (pOut)
+			fprintf(pOut, "%.6g", Tau[t]);
+		for (n = 0; n < N_SENSOR_IDX; n++)
+		{
+			printf(" %11.4g", pAdev[n * Taus + t]);
+			if (pOut)
+				fprintf(pOut, ",%.6g", pAdev[n * Taus + t]);
+		}
+		printf("\n");
+		if (pOut)
+			fprintf(pOut, "\n");
+	}
+	if (pOut)
+		fclose(pOut);
+
+	// The noise terms, gyros in deg and s, accelerometers in m/s^2 and s
+	printf("\n%-7s %-24s %-24s %s\n", "", "white noise N", "bias instability B", "rate random walk K");
+	for (n = 0; n < N_SENSOR_IDX; n++)
+	{
+		char White[48] = "-", Instability[48] = "-", RateWalk[48] = "-";
+		BOOL Gyro = (n <= GYROZ_IDX);
+
+		avFitNoise(Tau, &pAdev[n * Taus], Taus, &Noise[n]);
+
+		// Gyros also in the per hour units datasheets use
+		if (Noise[n].HaveWhite)
+			sprintf(White, Gyro ? "%.3g /rt s (%.3g /rt h)" : "%.3g /rt s", Noise[n].White, Noise[n].White * 60.0);
+		if (Noise[n].HaveInstability && Gyro)
+			sprintf(Instability, "%.3g (%.3g /h) @%.3gs", Noise[n].Instability, Noise[n].Instability * 3600.0,
+					Noise[n].InstabilityTau);
+		else if (Noise[n].HaveInstability)
+			sprintf(Instability, "%.3g @%.3gs", Noise[n].Instability, Noise[n].InstabilityTau);
+		if (Noise[n].HaveRateWalk)
+			sprintf(RateWalk, "%.3g /s /rt s", Noise[n].RateWalk);
+
+		printf("%-7s %-24s %-24s %s\n", ChannelNames[n], White, Instability, RateWalk);
+	}
+
+	// Filter settings for the X gyro and the roll from Y and Z
+	kfInit(&Defaults);
+	g = sqrt(avMean(In.pSeries, ACCELY_IDX) * avMean(In.pSeries, ACCELY_IDX) +
+			 avMean(In.pSeries, ACCELZ_IDX) * avMean(In.pSeries, ACCELZ_IDX));
+	SigmaRoll = (g > 0.0) ? Noise[ACCELY_IDX].SampleDev / g * RAD_TO_DEG : 0.0;
+
+	printf("\nsuggested      now        from\n");
+	if (Noise[GYROX_IDX].HaveWhite)
+		printf("Q_angle   %10.3g %10.3g  GyroX N^2\n", Noise[GYROX_IDX].White * Noise[GYROX_IDX].White, Defaults.Q_angle);
+	else
+		printf("Q_angle   %10s %10.3g  no white noise slope in GyroX\n", "-", Defaults.Q_angle);
+
+	if (Noise[GYROX_IDX].HaveRateWalk)
+		printf("Q_bias    %10.3g %10.3g  GyroX K^2\n", Noise[GYROX_IDX].RateWalk * Noise[GYROX_IDX].RateWalk, Defaults.Q_bias);
+	else if (Noise[GYROX_IDX].HaveInstability)
+		printf("Q_bias    %10.3g %10.3g  GyroX B^2 / tau(B), record longer for K\n",
+			   Noise[GYROX_IDX].Instability * Noise[GYROX_IDX].Instability / Noise[GYROX_IDX].InstabilityTau, Defaults.Q_bias);
+	else
+		printf("Q_bias    %10s %10.3g  record longer\n", "-", Defaults.Q_bias);
+
+	printf("R_measure %10.3g %10.3g  AccelY noise / g, squared, in deg^2\n", SigmaRoll * SigmaRoll, Defaults.R_measure);
+
+	free(pAdev);
+	avDestroy(In.pSeries);
+
+	return 0;
+
+}// main
@@ -0,0 +1,167 @@
+/*! \file
+	\brief Export a capture to a columnar file for analysis tools.
+
+	Usage: cap2col <capture | log.slg> <out.col> [threads]
+	           decode and filter every HS_SERIAL_IMU_MSG sample as main.c
+	           does, and write one column per field, see ColumnExport.h.
+	           Captures are framed with the parallel decoder.
+	       cap2col -l <file.col>
+	           list the columns and the first few rows
+
+	The filter step is taken from the IMU time of successive samples, so
+	recordings at any rate give the right angle.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "CalcAngle.h"
+#include "ColumnExport.h"
+#include "HostTime.h"
+#include "Recording.h"
+#include "Tilt.h"
+
+#define LIST_ROWS		5
+
+typedef struct
+{
+	ColumnWriter_t *pWriter;
+	KFilter_t KF;
+	RecordingClock_t Clock;
+	BOOL Ok;
+} ExportState_t;
+
+
+/*! Filter and export each HS sample.
+	\param pUser points to the ExportState_t.
+	\param pData points to the sample.
+	\param HostNs is the host arrival time.*/
+static void ExportSample(void *pUser, const IMUData_t *pData, UInt64 HostNs)
+{
+	ExportState_t *pState = (ExportState_t *)pUser;
+	ColumnRow_t Row;
+	float Angle;
+
+	Angle = kfGetAngle(&pState->KF, TiltRollDeg(pData), pData->SensorsConverted[GYROX_IDX],
+					   recClockStep(&pState->Clock, pData));
+
+	ceFillRow(&Row, pData, HostNs, Angle, pState->KF.bias);
+	if (!cePut(pState->pWriter, &Row))
+		pState->Ok = FALSE;
+
+}// ExportSample
+
+
+static int Export(const char *pRecording, const char *pOut, UInt32 Threads)
+{
+	ExportState_t State;
+	UInt64 Rows, Skipped, Start = htNowNs();
+	BOOL Read;
+
+	memset(&State, 0, sizeof(State));
+	State.Ok = TRUE;
+	kfInit(&State.KF);
+	recClockInit(&State.Clock);
+	State.pWriter = ceOpen(pOut);
+	if (State.pWriter == NULL)
+	{
+		fprintf(stderr, "%s: can't create\n", pOut);
+		return 1;
+	}
+
+	Read = recRead(pRecording, Threads, ExportSample, &State, &Skipped);
+
+	Rows = ceRows(State.pWriter);
+	if (!ceClose(State.pWriter))
+		State.Ok = FALSE;
+
+	if (!Read)
+	{
+		fprintf(stderr, "%s: not a capture or sample log\n", pRecording);
+		return 1;
+	}
+
+	printf("%llu rows in %.3f s\n", (unsigned long long)Rows, (htNowNs() - Start) / 1.0e9);
+	if (Skipped)
+		printf("%llu samples before the first resolution packet left out\n", (unsigned long long)Skipped);
+	if (!State.Ok)
+		fprintf(stderr, "%s: write failed\n", pOut);
+
+	return State.Ok ? 0 : 1;
+
+}// Export
+
+
+static int List(const char *pPath)
+{
+	ColumnFileHeader_t Header;
+	ColumnDesc_t Columns[CE_COLUMNS];
+	FILE *pFile = fopen(pPath, "rb");
+	UInt8 Value[8];
+	UInt32 c, Count;
+	UInt64 r;
+
+	if ((pFile == NULL) || !ceReadHeader(pFile, &Header, Columns, CE_COLUMNS))
+	{
+		fprintf(stderr, "%s: not a column file\n", pPath);
+		if (pFile)
+			fclose(pFile);
+		return 1;
+	}
+
+	Count = (Header.ColumnCount < CE_COLUMNS) ? Header.ColumnCount : CE_COLUMNS;
+	printf("%llu rows, %u columns\n", (unsigned long long)Header.Rows, (unsigned)Header.ColumnCount);
+	printf("name              dtype      offset  first values\n");
+
+	for (c = 0; c < Count; c++)
+	{
+		printf("%-16.16s  %-4.4s %11llu ", Columns[c].Name, Columns[c].DType, (unsigned long long)Columns[c].Offset);
+
+		for (r = 0; (r < Header.Rows) && (r < LIST_ROWS); r++)
+		{
+			// The reader only needs to byte swap on a big-endian host, see ColumnExport.h
+			fseek(pFile, (long)(Columns[c].Offset + r * Columns[c].ElementBytes), SEEK_SET);
+			if ((Columns[c].ElementBytes > sizeof(Value)) ||
+				(fread(Value, Columns[c].ElementBytes, 1, pFile) != 1))
+				break;
+
+			if (Columns[c].DType[1] == 'f')
+			{
+				uint32_t Bits = Value[0] | (Value[1] << 8) | (Value[2] << 16) | ((uint32_t)Value[3] << 24);
+				float f;
+
+				memcpy(&f, &Bits, sizeof(f));
+				printf(" %.6g", f);
+			}
+			else
+			{
+				uint64_t u = 0;
+				int i;
+
+				for (i = Columns[c].ElementBytes - 1; i >= 0; i--)
+					u = (u << 8) | Value[i];
+				printf(" %llu", (unsigned long long)u);
+			}
+		}
+		printf("\n");
+	}
+
+	fclose(pFile);
+
+	return 0;
+
+}// List
+
+
+int main(int argc, char *argv[])
+{
+	if ((argc == 3) && (strcmp(argv[1], "-l") == 0))
+		return List(argv[2]);
+	if ((argc == 3) || (argc == 4))
+		return Export(argv[1], argv[2], (argc == 4) ? (UInt32)atoi(argv[3]) : 0);
+
+	fprintf(stderr, "usage: %s <capture | log.slg> <out.col> [threads]\n"
+					"       %s -l <file.col>\n", argv[0], argv[0]);
+	return 1;
+
+}// main
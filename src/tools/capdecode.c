@@ -0,0 +1,142 @@
+/*! \file
+	\brief Frame a capture on 1 to N threads, check every run against the
+	serial parser and report the scaling.
+
+	Usage: capdecode <capture> [max threads] [unit bytes]
+	       max threads defaults to the number of CPUs.
+
+	The reference is LookForIMUPacketInByte() fed the whole capture byte by
+	byte.  A run matches when it produces the same number of frames with
+	the same contents, time stamps and stream positions.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "HostTime.h"
+#include "IMUSerial.h"
+#include "ParallelDecode.h"
+#include "ThreadPool.h"
+
+#define FNV_OFFSET	14695981039346656037ULL
+#define FNV_PRIME	1099511628211ULL
+
+typedef struct
+{
+	UInt64 Hash;
+	UInt64 Frames;
+} FrameDigest_t;
+
+
+/*! Fold bytes into an FNV-1a hash.
+	\param Hash is the hash so far.
+	\param pData points to the bytes.
+	\param Length is the number of bytes.
+	\return The new hash.*/
+static UInt64 Fnv(UInt64 Hash, const void *pData, size_t Length)
+{
+	const UInt8 *p = (const UInt8 *)pData;
+
+	while (Length--)
+		Hash = (Hash ^ *p++) * FNV_PRIME;
+
+	return Hash;
+
+}// Fnv
+
+
+/*! Fold a frame into a digest.
+	\param pUser points to the FrameDigest_t.
+	\param pFrame points to the frame.*/
+static void DigestFrame(void *pUser, const DecodedFrame_t *pFrame)
+{
+	FrameDigest_t *pDigest = (FrameDigest_t *)pUser;
+	UInt64 Hash = pDigest->Hash;
+
+	Hash = Fnv(Hash, &pFrame->Pkt.type, 1);
+	Hash = Fnv(Hash, pFrame->Pkt.data, (size_t)pFrame->Pkt.len + 2);
+	Hash = Fnv(Hash, &pFrame->HostNs, sizeof(pFrame->HostNs));
+	Hash = Fnv(Hash, &pFrame->Position, sizeof(pFrame->Position));
+
+	pDigest->Hash = Hash;
+	pDigest->Frames++;
+
+}// DigestFrame
+
+
+int main(int argc, char *argv[])
+{
+	CaptureReader_t Reader;
+	CaptureChunk_t Chunk;
+	DecodedFrame_t Frame;
+	FrameDigest_t Reference = { FNV_OFFSET, 0 }, Digest;
+	ParallelDecodeStats_t Stats;
+	UInt32 MaxThreads, UnitBytes, Threads, i;
+	UInt64 Offset, Position = 0, Start;
+	double Serial, Seconds;
+	BOOL AllMatch = TRUE;
+
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <capture> [max threads] [unit bytes]\n", argv[0]);
+		return 1;
+	}
+
+	if (!crOpen(&Reader, argv[1]))
+	{
+		fprintf(stderr, "%s: not a capture file\n", argv[1]);
+		return 1;
+	}
+
+	MaxThreads = (argc > 2) ? (UInt32)atoi(argv[2]) : tpCpuCount();
+	UnitBytes = (argc > 3) ? (UInt32)atoi(argv[3]) : 0;
+	if (MaxThreads == 0)
+		MaxThreads = 1;
+
+	// Reference: the serial parser over the whole stream
+	Start = htNowNs();
+	Frame.Pkt.state = SERIAL_STATE_SYNC0;
+	for (Offset = crFirstChunk(&Reader); crChunkAt(&Reader, Offset, &Chunk); Offset = Chunk.Next)
+	{
+		for (i = 0; i < Chunk.Length; i++, Position++)
+		{
+			if (LookForIMUPacketInByte(Chunk.pData[i], &Frame.Pkt))
+			{
+				Frame.HostNs = Chunk.HostNs;
+				Frame.Position = Position;
+				DigestFrame(&Reference, &Frame);
+			}
+		}
+	}
+	Serial = (htNowNs() - Start) / 1.0e9;
+
+	printf("%llu bytes, %llu frames\n", (unsigned long long)Position, (unsigned long long)Reference.Frames);
+	printf("threads   seconds     MB/s  speedup  fixup bytes  match\n");
+	printf("serial  %9.3f %8.1f %8.2f\n", Serial, Position / Serial / 1.0e6, 1.0);
+
+	for (Threads = 1; ; Threads = (Threads * 2 > MaxThreads) ? MaxThreads : Threads * 2)
+	{
+		Digest.Hash = FNV_OFFSET;
+		Digest.Frames = 0;
+
+		if (!pdDecodeCapture(&Reader, Threads, UnitBytes, DigestFrame, &Digest, &Stats))
+		{
+			fprintf(stderr, "decode failed with %u threads\n", (unsigned)Threads);
+			return 1;
+		}
+
+		Seconds = Stats.ElapsedNs / 1.0e9;
+		AllMatch = AllMatch && (Digest.Hash == Reference.Hash) && (Digest.Frames == Reference.Frames);
+
+		printf("%-7u %9.3f %8.1f %8.2f %12llu  %s\n", (unsigned)Threads, Seconds,
+			   Stats.Bytes / Seconds / 1.0e6, Serial / Seconds, (unsigned long long)Stats.FixupBytes,
+			   ((Digest.Hash == Reference.Hash) && (Digest.Frames == Reference.Frames)) ? "yes" : "NO");
+
+		if (Threads == MaxThreads)
+			break;
+	}
+
+	crClose(&Reader);
+
+	return AllMatch ? 0 : 1;
+
+}// main
@@ -0,0 +1,432 @@
+/*! \file
+	\brief Golden-trace regression harness for the decode and filter
+	pipeline.
+
+	Usage: golden [-d corpus dir] [-p min ratio] [-o results.csv]
+	              check | record [name ...]
+
+	Runs every entry of the corpus, or the named ones, through gtRun(), see
+	GoldenTrace.h.  "record" writes <name>.gold in the corpus directory,
+	"check" compares against it and exits non-zero on any difference.
+	Either way the pipeline throughput of each entry is measured from
+	memory, the best of several runs, and printed against the throughput
+	stored in the golden file.  With -p a check also fails when an entry
+	runs slower than that fraction of it.  -o appends one CSV row per entry
+	for tracking throughput over time.
+
+	The corpus directory (default "golden") holds corpus.txt, one entry per
+	line, '#' starts a comment:
+
+	    synthetic <name> [key=value ...]
+	        a stream made with the IMU generator, see IMUGenerator.h, from
+	        its defaults and these keys
+	            profile=<script>  motion profile in the corpus directory
+	            rate=<Hz> seed=<n> gyro=<deg/s> accel=<m/s^2> bias=<deg/s>
+	            walk=<deg/s/rt s> raw=<N> timing=<N>   as imugen's options
+	            flip=<N>          corrupt the last byte of every N
+	            drop=<N>          leave out the last byte of every N
+	    capture <name> <file> [key=value ...]
+	        the bytes of a capture file in the corpus directory, e.g. a
+	        recording from the robot
+
+	and for both
+	            every=<N>         trace one sample in N, the golden file
+	                              keeps the means of all of them
+	            tol_<field>=<x>   tolerance of a field, e.g. tol_angle=0.01,
+	                              field names as in the golden files
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "CaptureReader.h"
+#include "GoldenTrace.h"
+#include "HostTime.h"
+#include "IMUGenerator.h"
+
+#define CORPUS_DIR		"golden"
+#define CORPUS_FILE		"corpus.txt"
+#define MAX_SEGMENTS	256
+#define MAX_PATH		512
+#define MIN_RUNS		3
+#define MIN_SECONDS		0.1					//!< Throughput is measured over at least this long
+
+//! One entry of the corpus
+typedef struct
+{
+	char Name[64];
+	BOOL Synthetic;
+	char File[MAX_PATH];					//!< Capture or profile script, "" for none
+	GenConfig_t Config;
+	UInt32 Flip;
+	UInt32 Drop;
+	UInt32 Every;
+	GoldenTolerance_t Tol;
+} CorpusEntry_t;
+
+
+/*! Parse the keys of a corpus line.
+	\param pEntry points to the entry to fill in.
+	\param pKeys points to the keys, split by strtok().
+	\return FALSE if a key isn't understood.*/
+static BOOL ParseKeys(CorpusEntry_t *pEntry, char *pKeys)
+{
+	char *pKey, *pValue;
+	UInt32 f;
+
+	for (pKey = strtok(pKeys, " \t\r\n"); pKey; pKey = strtok(NULL, " \t\r\n"))
+	{
+		if ((pValue = strchr(pKey, '=')) == NULL)
+			return FALSE;
+		*pValue++ = 0;
+
+		if (strncmp(pKey, "tol_", 4) == 0)
+		{
+			for (f = 0; (f < GT_FIELDS) && (strcmp(pKey + 4, GoldenFieldNames[f]) != 0); f++)
+				;
+			if (f == GT_FIELDS)
+				return FALSE;
+			pEntry->Tol.Field[f] = atof(pValue);
+		}
+		else if (strcmp(pKey, "every") == 0)
+			pEntry->Every = (UInt32)atoi(pValue);
+		else if (!pEntry->Synthetic)
+			return FALSE;
+		else if (strcmp(pKey, "profile") == 0)
+			snprintf(pEntry->File, sizeof(pEntry->File), "%s", pValue);
+		else if (strcmp(pKey, "rate") == 0)
+			pEntry->Config.RateHz = atof(pValue);
+		else if (strcmp(pKey, "seed") == 0)
+			pEntry->Config.Seed = (UInt32)atoi(pValue);
+		else if (strcmp(pKey, "gyro") == 0)
+			pEntry->Config.GyroNoise = atof(pValue);
+		else if (strcmp(pKey, "accel") == 0)
+			pEntry->Config.AccelNoise = atof(pValue);
+		else if (strcmp(pKey, "bias") == 0)
+			pEntry->Config.GyroBias = atof(pValue);
+		else if (strcmp(pKey, "walk") == 0)
+			pEntry->Config.BiasWalk = atof(pValue);
+		else if (strcmp(pKey, "raw") == 0)
+			pEntry->Config.RawEvery = (UInt32)atoi(pValue);
+		else if (strcmp(pKey, "timing") == 0)
+			pEntry->Config.TimingEvery = (UInt32)atoi(pValue);
+		else if (strcmp(pKey, "flip") == 0)
+			pEntry->Flip = (UInt32)atoi(pValue);
+		else if (strcmp(pKey, "drop") == 0)
+			pEntry->Drop = (UInt32)atoi(pValue);
+		else
+			return FALSE;
+	}
+
+	return TRUE;
+
+}// ParseKeys
+
+
+/*! Parse one line of the corpus file.
+	\param pLine is the line, changed.
+	\param pEntry points to the entry to fill in.
+	\return 1 for an entry, 0 for a blank line, -1 if not understood.*/
+static int ParseLine(char *pLine, CorpusEntry_t *pEntry)
+{
+	char Kind[16];
+	int Used = 0;
+	char *p;
+
+	if ((p = strchr(pLine, '#')) != NULL)
+		*p = 0;
+
+	memset(pEntry, 0, sizeof(*pEntry));
+	genDefaultConfig(&pEntry->Config);
+	gtDefaultTolerance(&pEntry->Tol);
+	pEntry->Every = 1;
+
+	if (sscanf(pLine, "%15s", Kind) != 1)
+		return 0;
+
+	if (strcmp(Kind, "synthetic") == 0)
+	{
+		pEntry->Synthetic = TRUE;
+		if (sscanf(pLine, "%*s %63s%n", pEntry->Name, &Used) != 1)
+			return -1;
+	}
+	else if ((strcmp(Kind, "capture") != 0) ||
+			 (sscanf(pLine, "%*s %63s %511s%n", pEntry->Name, pEntry->File, &Used) != 2))
+		return -1;
+
+	return ParseKeys(pEntry, pLine + Used) ? 1 : -1;
+
+}// ParseLine
+
+
+/*! Make the byte stream of a synthetic entry.
+	\param pEntry points to the entry.
+	\param pDir is the corpus directory.
+	\param pCount points to space to receive the stream length.
+	\return The stream, or NULL if it can't be made (reported).*/
+static UInt8 *MakeSynthetic(CorpusEntry_t *pEntry, const char *pDir, UInt64 *pCount)
+{
+	static GenSegment_t Segments[MAX_SEGMENTS];
+	IMUGenerator_t Gen;
+	char Path[2 * MAX_PATH];
+	UInt64 Size, Count, i, Out;
+	UInt32 n;
+	UInt8 *pBytes;
+	int Segs;
+
+	if (pEntry->File[0] == 0)
+	{
+		fprintf(stderr, "%s: no profile\n", pEntry->Name);
+		return NULL;
+	}
+
+	snprintf(Path, sizeof(Path), "%s/%s", pDir, pEntry->File);
+	if ((Segs = genLoadProfile(Path, Segments, MAX_SEGMENTS)) <= 0)
+		return NULL;
+	pEntry->Config.pProfile = Segments;
+	pEntry->Config.ProfileCount = (UInt32)Segs;
+
+	Size = GEN_MAX_CONFIG_BYTES + ((UInt64)(genDuration(&pEntry->Config) * pEntry->Config.RateHz) + 2) * GEN_MAX_STEP_BYTES;
+	pBytes = (UInt8 *)malloc((size_t)Size);
+	if (pBytes == NULL)
+	{
+		fprintf(stderr, "%s: out of memory\n", pEntry->Name);
+		return NULL;
+	}
+
+	genInit(&Gen, &pEntry->Config);
+	Count = genConfigResponse(&Gen, pBytes);
+	while ((Count + GEN_MAX_STEP_BYTES <= Size) && ((n = genStep(&Gen, &pBytes[Count], NULL)) > 0))
+		Count += n;
+
+	// Damage the stream the same way every time
+	for (i = 0, Out = 0; i < Count; i++)
+	{
+		if (pEntry->Drop && (i % pEntry->Drop == pEntry->Drop - 1))
+			continue;
+		pBytes[Out] = pBytes[i];
+		if (pEntry->Flip && (i % pEntry->Flip == pEntry->Flip - 1))
+			pBytes[Out] ^= 0xA5;
+		Out++;
+	}
+
+	*pCount = Out;
+
+	return pBytes;
+
+}// MakeSynthetic
+
+
+/*! Read the bytes of a capture entry.
+	\param pEntry points to the entry.
+	\param pDir is the corpus directory.
+	\param pCount points to space to receive the stream length.
+	\return The stream, or NULL if it can't be read (reported).*/
+static UInt8 *ReadCapture(const CorpusEntry_t *pEntry, const char *pDir, UInt64 *pCount)
+{
+	CaptureReader_t Reader;
+	CaptureChunk_t Chunk;
+	char Path[2 * MAX_PATH];
+	UInt64 Offset, Count = 0;
+	UInt8 *pBytes;
+
+	snprintf(Path, sizeof(Path), "%s/%s", pDir, pEntry->File);
+	if (!crOpen(&Reader, Path))
+	{
+		fprintf(stderr, "%s: can't open %s\n", pEntry->Name, Path);
+		return NULL;
+	}
+
+	// The chunk headers make the file bigger than its bytes
+	pBytes = (UInt8 *)malloc(Reader.Size ? Reader.Size : 1);
+	if (pBytes == NULL)
+	{
+		fprintf(stderr, "%s: out of memory\n", pEntry->Name);
+		crClose(&Reader);
+		return NULL;
+	}
+
+	for (Offset = crFirstChunk(&Reader); crChunkAt(&Reader, Offset, &Chunk); Offset = Chunk.Next)
+	{
+		memcpy(&pBytes[Count], Chunk.pData, Chunk.Length);
+		Count += Chunk.Length;
+	}
+
+	crClose(&Reader);
+	*pCount = Count;
+
+	return pBytes;
+
+}// ReadCapture
+
+
+/*! Run an entry until its throughput is known.
+	\param pBytes points to the stream.
+	\param Count is the stream length.
+	\param Every traces one sample in this many.
+	\param pTrace points to a zeroed trace to fill.
+	\param pSeconds points to space to receive the fastest run time.
+	\return FALSE if out of memory.*/
+static BOOL Measure(const UInt8 *pBytes, UInt64 Count, UInt32 Every, GoldenTrace_t *pTrace, double *pSeconds)
+{
+	double Total = 0.0, Seconds;
+	UInt32 Runs;
+	UInt64 Start;
+
+	*pSeconds = 0.0;
+	for (Runs = 0; (Runs < MIN_RUNS) || (Total < MIN_SECONDS); Runs++)
+	{
+		Start = htNowNs();
+		if (!gtRun(pBytes, Count, Every, pTrace))
+			return FALSE;
+		Seconds = (htNowNs() - Start) / 1.0e9;
+
+		Total += Seconds;
+		if ((Runs == 0) || (Seconds < *pSeconds))
+			*pSeconds = Seconds;
+	}
+
+	return TRUE;
+
+}// Measure
+
+
+int main(int argc, char *argv[])
+{
+	const char *pDir = CORPUS_DIR, *pResults = NULL, *pWhy;
+	char Path[2 * MAX_PATH], Line[1024];
+	double MinRatio = 0.0, Seconds, Ratio;
+	CorpusEntry_t Entry;
+	GoldenTrace_t Trace, Golden;
+	FILE *pCorpus, *pCsv = NULL;
+	BOOL Record, Wanted, Pass;
+	UInt32 Entries = 0, Failed = 0, LineNo = 0;
+	UInt64 Count;
+	UInt8 *pBytes;
+	int Option, i, Parsed;
+
+	while ((Option = getopt(argc, argv, "d:p:o:")) != -1)
+	{
+		switch (Option)
+		{
+		case 'd': pDir = optarg; break;
+		case 'p': MinRatio = atof(optarg); break;
+		case 'o': pResults = optarg; break;
+		default:  optind = argc; break;
+		}
+	}
+
+	if ((optind >= argc) || ((strcmp(argv[optind], "check") != 0) && (strcmp(argv[optind], "record") != 0)))
+	{
+		fprintf(stderr, "usage: %s [-d corpus dir] [-p min ratio] [-o results.csv] check | record [name ...]\n", argv[0]);
+		return 1;
+	}
+	Record = (strcmp(argv[optind], "record") == 0);
+
+	snprintf(Path, sizeof(Path), "%s/%s", pDir, CORPUS_FILE);
+	if ((pCorpus = fopen(Path, "r")) == NULL)
+	{
+		fprintf(stderr, "%s: can't open\n", Path);
+		return 1;
+	}
+
+	if (pResults)
+	{
+		BOOL New = (access(pResults, F_OK) != 0);
+
+		if ((pCsv = fopen(pResults, "a")) == NULL)
+		{
+			fprintf(stderr, "%s: can't open\n", pResults);
+			return 1;
+		}
+		if (New)
+			fprintf(pCsv, "name,result,bytes,samples,mb_per_s,samples_per_s,golden_samples_per_s\n");
+	}
+
+	memset(&Trace, 0, sizeof(Trace));
+	printf("%-12s %-8s %10s %10s %9s %12s %10s\n", "entry", "result", "bytes", "samples", "MB/s", "samples/s", "vs golden");
+
+	while (fgets(Line, sizeof(Line), pCorpus))
+	{
+		LineNo++;
+		if ((Parsed = ParseLine(Line, &Entry)) == 0)
+			continue;
+		if (Parsed < 0)
+		{
+			fprintf(stderr, "%s:%lu: not understood\n", Path, (unsigned long)LineNo);
+			Failed++;
+			continue;
+		}
+
+		for (Wanted = (optind + 1 == argc), i = optind + 1; i < argc; i++)
+			if (strcmp(argv[i], Entry.Name) == 0)
+				Wanted = TRUE;
+		if (!Wanted)
+			continue;
+		Entries++;
+
+		pBytes = Entry.Synthetic ? MakeSynthetic(&Entry, pDir, &Count) : ReadCapture(&Entry, pDir, &Count);
+		if ((pBytes == NULL) || !Measure(pBytes, Count, Entry.Every, &Trace, &Seconds))
+		{
+			printf("%-12s %-8s\n", Entry.Name, "error");
+			free(pBytes);
+			Failed++;
+			continue;
+		}
+		Trace.SamplesPerSec = Trace.Samples / Seconds;
+
+		snprintf(Path, sizeof(Path), "%s/%s.gold", pDir, Entry.Name);
+		memset(&Golden, 0, sizeof(Golden));
+		Ratio = 0.0;
+
+		if (Record)
+		{
+			Pass = gtWrite(Path, Entry.Name, &Trace);
+			pWhy = Pass ? "recorded" : "error";
+		}
+		else if (!gtRead(Path, &Golden))
+		{
+			Pass = FALSE;
+			pWhy = "no gold";
+		}
+		else
+		{
+			Pass = (gtCompare(&Golden, &Trace, &Entry.Tol, NULL) == 0);
+			Ratio = (Golden.SamplesPerSec > 0.0) ? Trace.SamplesPerSec / Golden.SamplesPerSec : 0.0;
+			pWhy = !Pass ? "FAIL" : ((MinRatio > 0.0) && (Ratio < MinRatio)) ? "SLOW" : "ok";
+		}
+
+		printf("%-12s %-8s %10llu %10llu %9.1f %12.0f", Entry.Name, pWhy, (unsigned long long)Count,
+			   (unsigned long long)Trace.Samples, Count / Seconds / 1.0e6, Trace.SamplesPerSec);
+		if (Ratio > 0.0)
+			printf(" %9.2fx", Ratio);
+		printf("\n");
+
+		// The differences go under the entry
+		if (!Pass && Golden.Bytes)
+			gtCompare(&Golden, &Trace, &Entry.Tol, stdout);
+		if (strcmp(pWhy, "SLOW") == 0)
+			Pass = FALSE;
+
+		if (pCsv)
+			fprintf(pCsv, "%s,%s,%llu,%llu,%.3f,%.0f,%.0f\n", Entry.Name, pWhy, (unsigned long long)Count,
+					(unsigned long long)Trace.Samples, Count / Seconds / 1.0e6, Trace.SamplesPerSec,
+					Golden.SamplesPerSec);
+
+		if (!Pass)
+			Failed++;
+		gtFree(&Golden);
+		free(pBytes);
+	}
+
+	fclose(pCorpus);
+	gtFree(&Trace);
+	if (pCsv)
+		fclose(pCsv);
+
+	printf("%lu entries, %lu failed\n", (unsigned long)Entries, (unsigned long)Failed);
+
+	return ((Failed == 0) && (Entries > 0)) ? 0 : 1;
+
+}// main
@@ -0,0 +1,754 @@
+/*! \file
+	\brief Microbenchmarks of the hot path functions.
+
+	Usage: imubench [-c cpu] [-n samples] [-t ms] [-f table | csv | json]
+	                [name ...]
+
+	Covers CRC16() and CRC16OneByte(), LookForIMUPacketInByte() over a clean
+	and a damaged generated stream, DecodeIMUPacket() for each packet type
+	it decodes, the DataTo* byte order helpers, FloatToFloat16() and
+	Float16ToFloat(), getAngle(), and FastAtan2f() one at a time and in a
+	batch against the libm atan(y / x) and atan2f() it replaces.  Names on
+	the command line pick the benchmarks whose names contain one of them.
+
+	Before measuring, FastAtan2f() is checked against atan2() over a dense
+	sweep of the circle; if it strays past FAST_ATAN2_MAX_ERROR_RAD, see
+	Tilt.h, nothing is measured and the exit code is 1.
+
+	Method, so numbers from different runs can be compared:
+
+	- The thread is pinned to one CPU (-c, by default the one it starts
+	  on) so it never migrates and its caches stay warm.
+	- Each benchmark runs once to warm up, then the number of rounds is
+	  doubled until one measurement takes at least -t ms (20).
+	- That is measured -n times (11).  The median is reported, with the
+	  fastest and the spread, the median absolute deviation over the
+	  median.  A spread of more than a few percent means something else
+	  was running.
+	- Cycles come from the CPU cycle counter through perf_event_open() if
+	  the kernel allows it, otherwise from the time stamp counter, which
+	  counts at a fixed rate rather than the core clock.  The source is
+	  reported with the results, as is the CPU frequency governor; use
+	  "performance" for stable numbers.
+
+	csv and json give the same fields as the table for tracking over time.
+*/
+
+#define _GNU_SOURCE
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ByteOrder.h"
+#include "CRC16.h"
+#include "CalcAngle.h"
+#include "HostTime.h"
+#include "IMUGenerator.h"
+#include "IMUPacket.h"
+#include "IMUSerial.h"
+#include "Tilt.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define STREAM_BYTES	65536				//!< Bytes of generated stream parsed per round
+#define BLOCK_BYTES		4096				//!< Bytes per round of the block benchmarks
+#define ARRAY_COUNT		1024				//!< Values per round of the array benchmarks
+#define MAX_SAMPLES		101
+#define DEFAULT_SAMPLES	11
+#define DEFAULT_MS		20.0
+#define DAMAGE_EVERY	997					//!< Every how many bytes the damaged stream is corrupted
+#define ATAN_SWEEP		1000000				//!< Angles FastAtan2f() is checked at
+
+typedef void (*BenchRun_t)(const void *pArg, UInt64 Rounds);
+
+//! One benchmark
+typedef struct
+{
+	const char *pName;
+	BenchRun_t pRun;
+	const void *pArg;
+	UInt32 OpsPerRound;
+	UInt32 BytesPerOp;						//!< Bytes an op consumes, 0 where it means nothing
+} Bench_t;
+
+//! Result of one benchmark
+typedef struct
+{
+	UInt64 Ops;								//!< Ops per measurement
+	double NsPerOp;							//!< Median
+	double MinNsPerOp;
+	double Spread;							//!< Median absolute deviation / median
+	double CyclesPerOp;						//!< Median, 0 without a counter
+} BenchResult_t;
+
+// Inputs, made once
+static UInt8 Stream[STREAM_BYTES];
+static UInt8 Damaged[STREAM_BYTES];
+static UInt8 Bytes[ARRAY_COUNT * 8 + 8];
+static IMUPacket_t HSPacket;
+static float Floats[ARRAY_COUNT];
+static UInt16 Halves[ARRAY_COUNT];
+static float Tilts[ARRAY_COUNT];
+static float Rates[ARRAY_COUNT];
+static float AccelY[ARRAY_COUNT];
+static float AccelZ[ARRAY_COUNT];
+
+// Outputs, so nothing is optimised away
+static volatile UInt32 Sink;
+static UInt64 Out64[ARRAY_COUNT];
+static double OutDouble[ARRAY_COUNT];
+static float OutFloat[ARRAY_COUNT];
+static UInt16 Out16[ARRAY_COUNT];
+
+//! Packets of each type DecodeIMUPacket() handles
+static struct
+{
+	UInt8 Type;
+	const char *pName;
+	IMUPacket_t Pkt;
+} Decodes[] =
+{
+	{ HS_SERIAL_IMU_MSG,       "decode_hs_serial"    },
+	{ HS_RAW_IMU_MSG,          "decode_hs_raw"       },
+	{ TIMING_IMU_MSG,          "decode_timing"       },
+	{ RAWGYRO_IMU_MSG,         "decode_raw_gyro"     },
+	{ RAWACCEL_IMU_MSG,        "decode_raw_accel"    },
+	{ RAWGYROTEMPX_IMU_MSG,    "decode_gyro_temp"    },
+	{ RESOLUTION_IMU_MSG,      "decode_resolution"   },
+	{ SETTINGS_IMU_MSG,        "decode_settings"     },
+	{ SWVERSION_IMU_MSG,       "decode_sw_version"   },
+	{ SERIALNUMCONFIG_IMU_MSG, "decode_hw_config"    },
+	{ MFRCALDATE_IMU_MSG,      "decode_dates"        },
+};
+#define DECODE_COUNT	(sizeof(Decodes) / sizeof(Decodes[0]))
+
+#if defined(__linux__)
+static int PerfFd = -1;
+#endif
+static const char *pCycleSource = "none";
+
+
+/*! Start the cycle counter, the core clock if perf allows it, else the
+	time stamp counter.*/
+static void CyclesInit(void)
+{
+#if defined(__linux__)
+	struct perf_event_attr Attr;
+
+	memset(&Attr, 0, sizeof(Attr));
+	Attr.type = PERF_TYPE_HARDWARE;
+	Attr.size = sizeof(Attr);
+	Attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	Attr.exclude_kernel = 1;
+	Attr.exclude_hv = 1;
+
+	PerfFd = (int)syscall(__NR_perf_event_open, &Attr, 0, -1, -1, 0);
+	if (PerfFd >= 0)
+	{
+		pCycleSource = "perf";
+		return;
+	}
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+	pCycleSource = "tsc";
+#endif
+
+}// CyclesInit
+
+
+/*! Read the cycle counter.
+	\return The count, 0 without a counter.*/
+static UInt64 Cycles(void)
+{
+#if defined(__linux__)
+	if (PerfFd >= 0)
+	{
+		unsigned long long Count;
+
+		if (read(PerfFd, &Count, sizeof(Count)) == sizeof(Count))
+			return Count;
+		return 0;
+	}
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+
+}// Cycles
+
+
+// Benchmarks, each does Rounds times OpsPerRound ops
+
+static void BenchCRC16Packet(const void *pArg, UInt64 Rounds)
+{
+	UInt32 Sum = 0;
+
+	while (Rounds--)
+		Sum += CRC16((const UInt8 *)&HSPacket, HSPacket.len + 4);
+	Sink += Sum;
+
+}// BenchCRC16Packet
+
+
+static void BenchCRC16Block(const void *pArg, UInt64 Rounds)
+{
+	UInt32 Sum = 0;
+
+	while (Rounds--)
+		Sum += CRC16(Stream, BLOCK_BYTES);
+	Sink += Sum;
+
+}// BenchCRC16Block
+
+
+static void BenchCRC16OneByte(const void *pArg, UInt64 Rounds)
+{
+	UInt16 Crc = 0;
+	UInt32 i;
+
+	while (Rounds--)
+		for (i = 0; i < BLOCK_BYTES; i++)
+			Crc = CRC16OneByte(Stream[i], Crc);
+	Sink += Crc;
+
+}// BenchCRC16OneByte
+
+
+static void BenchParse(const void *pArg, UInt64 Rounds)
+{
+	static IMUPacket_t Pkt;
+	const UInt8 *pStream = (const UInt8 *)pArg;
+	UInt32 i, Packets = 0;
+
+	while (Rounds--)
+		for (i = 0; i < STREAM_BYTES; i++)
+			Packets += LookForIMUPacketInByte(pStream[i], &Pkt);
+	Sink += Packets;
+
+}// BenchParse
+
+
+static void BenchDecode(const void *pArg, UInt64 Rounds)
+{
+	static IMUData_t IMU;
+	const IMUPacket_t *pPkt = (const IMUPacket_t *)pArg;
+
+	while (Rounds--)
+		DecodeIMUPacket(pPkt, &IMU);
+	Sink += IMU.SequenceNumber;
+
+}// BenchDecode
+
+
+static float BeFloat(const UInt8 *pData)
+{
+	BOOL Invalid;
+
+	return DataToFloat(pData, &Invalid);
+
+}// BeFloat
+
+
+static double BeDouble(const UInt8 *pData)
+{
+	BOOL Invalid;
+
+	return DataToDouble(pData, &Invalid);
+
+}// BeDouble
+
+
+static float LeFloat(const UInt8 *pData)
+{
+	BOOL Invalid;
+
+	return leDataToFloat(pData, &Invalid);
+
+}// LeFloat
+
+
+static double LeDouble(const UInt8 *pData)
+{
+	BOOL Invalid;
+
+	return leDataToDouble(pData, &Invalid);
+
+}// LeDouble
+
+
+// One benchmark per conversion, each reads ARRAY_COUNT values 8 bytes apart
+#define BYTE_ORDER_BENCH(Name, Call, pOut, Type)					\
+	static void Name(const void *pArg, UInt64 Rounds)				\
+	{																\
+		UInt32 i;													\
+		while (Rounds--)											\
+			for (i = 0; i < ARRAY_COUNT; i++)						\
+				pOut[i] = (Type)Call(&Bytes[8 * i]);				\
+	}
+
+BYTE_ORDER_BENCH(BenchDataToUInt16, DataToUInt16, Out64, UInt64)
+BYTE_ORDER_BENCH(BenchDataToSInt16, DataToSInt16, Out64, UInt64)
+BYTE_ORDER_BENCH(BenchDataToUInt24, DataToUInt24, Out64, UInt64)
+BYTE_ORDER_BENCH(BenchDataToUInt32, DataToUInt32, Out64, UInt64)
+BYTE_ORDER_BENCH(BenchDataToSInt32, DataToSInt32, Out64, UInt64)
+BYTE_ORDER_BENCH(BenchDataToUInt64, DataToUInt64, Out64, UInt64)
+BYTE_ORDER_BENCH(BenchDataToSInt64, DataToSInt64, Out64, UInt64)
+BYTE_ORDER_BENCH(BenchDataToFloat, BeFloat, OutFloat, float)
+BYTE_ORDER_BENCH(BenchDataToDouble, BeDouble, OutDouble, double)
+BYTE_ORDER_BENCH(BenchLeDataToUInt32, leDataToUInt32, Out64, UInt64)
+BYTE_ORDER_BENCH(BenchLeDataToSInt32, leDataToSInt32, Out64, UInt64)
+BYTE_ORDER_BENCH(BenchLeDataToUInt64, leDataToUInt64, Out64, UInt64)
+BYTE_ORDER_BENCH(BenchLeDataToFloat, LeFloat, OutFloat, float)
+BYTE_ORDER_BENCH(BenchLeDataToDouble, LeDouble, OutDouble, double)
+
+
+static void BenchFloatToFloat16(const void *pArg, UInt64 Rounds)
+{
+	UInt32 i;
+
+	while (Rounds--)
+		for (i = 0; i < ARRAY_COUNT; i++)
+			Out16[i] = FloatToFloat16(Floats[i]);
+
+}// BenchFloatToFloat16
+
+
+static void BenchFloat16ToFloat(const void *pArg, UInt64 Rounds)
+{
+	UInt32 i;
+
+	while (Rounds--)
+		for (i = 0; i < ARRAY_COUNT; i++)
+			OutFloat[i] = Float16ToFloat(Halves[i]);
+
+}// BenchFloat16ToFloat
+
+
+static void BenchGetAngle(const void *pArg, UInt64 Rounds)
+{
+	float Angle = 0.0f;
+	UInt32 i;
+
+	while (Rounds--)
+		for (i = 0; i < ARRAY_COUNT; i++)
+			Angle = getAngle(Tilts[i], Rates[i], 0.01f);
+	OutFloat[0] = Angle;
+
+}// BenchGetAngle
+
+
+static void BenchAtanDivide(const void *pArg, UInt64 Rounds)
+{
+	float Sum = 0.0f;
+	UInt32 i;
+
+	// Summed so the calls can't be hoisted out of the rounds
+	while (Rounds--)
+		for (i = 0; i < ARRAY_COUNT; i++)
+			Sum += (float)atan(AccelY[i] / AccelZ[i]);
+	OutFloat[0] = Sum;
+
+}// BenchAtanDivide
+
+
+static void BenchAtan2f(const void *pArg, UInt64 Rounds)
+{
+	float Sum = 0.0f;
+	UInt32 i;
+
+	while (Rounds--)
+		for (i = 0; i < ARRAY_COUNT; i++)
+			Sum += atan2f(AccelY[i], AccelZ[i]);
+	OutFloat[0] = Sum;
+
+}// BenchAtan2f
+
+
+static void BenchFastAtan2f(const void *pArg, UInt64 Rounds)
+{
+	float Sum = 0.0f;
+	UInt32 i;
+
+	while (Rounds--)
+		for (i = 0; i < ARRAY_COUNT; i++)
+			Sum += FastAtan2f(AccelY[i], AccelZ[i]);
+	OutFloat[0] = Sum;
+
+}// BenchFastAtan2f
+
+
+static void BenchFastAtan2fBatch(const void *pArg, UInt64 Rounds)
+{
+	while (Rounds--)
+		FastAtan2fBatch(AccelY, AccelZ, OutFloat, ARRAY_COUNT);
+
+}// BenchFastAtan2fBatch
+
+
+static Bench_t Benches[64];				//!< In the order they run
+static UInt32 BenchCount;
+
+
+static void Add(const char *pName, BenchRun_t pRun, const void *pArg, UInt32 OpsPerRound, UInt32 BytesPerOp)
+{
+	Bench_t *pBench = &Benches[BenchCount++];
+
+	pBench->pName = pName;
+	pBench->pRun = pRun;
+	pBench->pArg = pArg;
+	pBench->OpsPerRound = OpsPerRound;
+	pBench->BytesPerOp = BytesPerOp;
+
+}// Add
+
+
+/*! List the benchmarks, once the inputs are made.*/
+static void ListBenches(void)
+{
+	UInt32 n;
+
+	Add("crc16_packet",         BenchCRC16Packet,    NULL,    1,            HSPacket.len + 4);
+	Add("crc16_block",          BenchCRC16Block,     NULL,    1,            BLOCK_BYTES);
+	Add("crc16_onebyte",        BenchCRC16OneByte,   NULL,    BLOCK_BYTES,  1);
+	Add("parse_stream",         BenchParse,          Stream,  STREAM_BYTES, 1);
+	Add("parse_damaged_stream", BenchParse,          Damaged, STREAM_BYTES, 1);
+
+	for (n = 0; n < DECODE_COUNT; n++)
+		Add(Decodes[n].pName, BenchDecode, &Decodes[n].Pkt, 1, Decodes[n].Pkt.len);
+
+	Add("data_to_uint16",       BenchDataToUInt16,   NULL,    ARRAY_COUNT,  2);
+	Add("data_to_sint16",       BenchDataToSInt16,   NULL,    ARRAY_COUNT,  2);
+	Add("data_to_uint24",       BenchDataToUInt24,   NULL,    ARRAY_COUNT,  3);
+	Add("data_to_uint32",       BenchDataToUInt32,   NULL,    ARRAY_COUNT,  4);
+	Add("data_to_sint32",       BenchDataToSInt32,   NULL,    ARRAY_COUNT,  4);
+	Add("data_to_uint64",       BenchDataToUInt64,   NULL,    ARRAY_COUNT,  8);
+	Add("data_to_sint64",       BenchDataToSInt64,   NULL,    ARRAY_COUNT,  8);
+	Add("data_to_float",        BenchDataToFloat,    NULL,    ARRAY_COUNT,  4);
+	Add("data_to_double",       BenchDataToDouble,   NULL,    ARRAY_COUNT,  8);
+	Add("le_data_to_uint32",    BenchLeDataToUInt32, NULL,    ARRAY_COUNT,  4);
+	Add("le_data_to_sint32",    BenchLeDataToSInt32, NULL,    ARRAY_COUNT,  4);
+	Add("le_data_to_uint64",    BenchLeDataToUInt64, NULL,    ARRAY_COUNT,  8);
+	Add("le_data_to_float",     BenchLeDataToFloat,  NULL,    ARRAY_COUNT,  4);
+	Add("le_data_to_double",    BenchLeDataToDouble, NULL,    ARRAY_COUNT,  8);
+	Add("float_to_float16",     BenchFloatToFloat16, NULL,    ARRAY_COUNT,  4);
+	Add("float16_to_float",     BenchFloat16ToFloat, NULL,    ARRAY_COUNT,  2);
+	Add("get_angle",            BenchGetAngle,       NULL,    ARRAY_COUNT,  0);
+	Add("atan_divide",          BenchAtanDivide,     NULL,    ARRAY_COUNT,  0);
+	Add("atan2f",               BenchAtan2f,         NULL,    ARRAY_COUNT,  0);
+	Add("fast_atan2f",          BenchFastAtan2f,     NULL,    ARRAY_COUNT,  0);
+	Add("fast_atan2f_batch",    BenchFastAtan2fBatch, NULL,   ARRAY_COUNT,  0);
+
+}// ListBenches
+
+
+/*! Make the inputs: a generated stream with raw and timing packets mixed
+	in, a copy of it with bytes corrupted, one packet of each type and
+	arrays of values.*/
+static void MakeInputs(void)
+{
+	static GenSegment_t Profile = { GEN_SINE, 1.0e6, 10.0, 0.5 };
+	GenConfig_t Config;
+	IMUGenerator_t Gen;
+	IMUPacket_t Pkt;
+	UInt8 Config0[GEN_MAX_CONFIG_BYTES];
+	UInt32 i, n, Count;
+	unsigned Rng = 1;
+
+	genDefaultConfig(&Config);
+	Config.RawEvery = 4;
+	Config.TimingEvery = 25;
+	Config.pProfile = &Profile;
+	Config.ProfileCount = 1;
+	genInit(&Gen, &Config);
+
+	// The configuration responses, then samples to fill the stream
+	Count = genConfigResponse(&Gen, Config0);
+	memcpy(Stream, Config0, Count);
+	Count += genFill(&Gen, &Stream[Count], STREAM_BYTES - Count, NULL);
+	while (Count < STREAM_BYTES)
+		Stream[Count++] = 0;
+
+	for (i = 0; i < STREAM_BYTES; i++)
+		Damaged[i] = (i % DAMAGE_EVERY == DAMAGE_EVERY - 1) ? (UInt8)(Stream[i] ^ 0xA5) : Stream[i];
+
+	// The first packet of each type in the stream
+	Pkt.state = SERIAL_STATE_SYNC0;
+	for (i = 0; i < STREAM_BYTES; i++)
+	{
+		if (!LookForIMUPacketInByte(Stream[i], &Pkt))
+			continue;
+		for (n = 0; n < DECODE_COUNT; n++)
+			if ((Decodes[n].Type == Pkt.type) && (Decodes[n].Pkt.sync0 == 0))
+				Decodes[n].Pkt = Pkt;
+	}
+
+	// The generator doesn't send the rest, make them with a plausible payload
+	for (n = 0; n < DECODE_COUNT; n++)
+	{
+		if (Decodes[n].Pkt.sync0)
+			continue;
+		for (i = 0; i < MAX_PAYLOAD_BYTES; i++)
+			Decodes[n].Pkt.data[i] = (UInt8)(0x40 + 7 * i);
+		MakeIMUPacket(&Decodes[n].Pkt, Decodes[n].Type,
+					  (Decodes[n].Type == RAWGYROTEMPX_IMU_MSG) ? 4 : 7);
+	}
+	HSPacket = Decodes[0].Pkt;
+
+	for (i = 0; i < sizeof(Bytes); i++)
+	{
+		Rng = Rng * 1103515245u + 12345u;
+		Bytes[i] = (UInt8)(Rng >> 16);
+	}
+	// Keep the float and double benchmarks on valid numbers, either byte order
+	for (i = 0; i < ARRAY_COUNT; i++)
+	{
+		Bytes[8 * i] &= 0x3F;
+		Bytes[8 * i + 3] &= 0x3F;
+		Bytes[8 * i + 7] &= 0x3F;
+	}
+
+	for (i = 0; i < ARRAY_COUNT; i++)
+	{
+		Floats[i] = (float)(i - ARRAY_COUNT / 2) * 0.37f;
+		Halves[i] = FloatToFloat16(Floats[i]);
+		Tilts[i] = 5.0f + (float)(i % 17) * 0.1f;
+		Rates[i] = 0.5f - (float)(i % 13) * 0.05f;
+		AccelY[i] = (float)sin(i * 0.0123) * 9.81f;
+		AccelZ[i] = (float)cos(i * 0.0123) * 9.81f;
+	}
+
+}// MakeInputs
+
+
+/*! Check FastAtan2f() against atan2() around the whole circle.
+	\return The largest error in radians.*/
+static double FastAtan2Error(void)
+{
+	double MaxErr = 0;
+	UInt32 i;
+
+	for (i = 0; i < ATAN_SWEEP; i++)
+	{
+		double t = (i / (double)ATAN_SWEEP) * 2.0 * 3.14159265358979 - 3.14159265358979;
+		float y = (float)sin(t), x = (float)cos(t);
+		double Err = fabs(FastAtan2f(y, x) - atan2(y, x));
+
+		if (Err > MaxErr)
+			MaxErr = Err;
+	}
+
+	return MaxErr;
+
+}// FastAtan2Error
+
+
+static int CompareDoubles(const void *pA, const void *pB)
+{
+	double a = *(const double *)pA, b = *(const double *)pB;
+
+	return (a < b) ? -1 : (a > b);
+
+}// CompareDoubles
+
+
+/*! Median of an array, which is sorted.
+	\return The median.*/
+static double Median(double *pValues, UInt32 Count)
+{
+	qsort(pValues, Count, sizeof(double), CompareDoubles);
+
+	return (Count & 1) ? pValues[Count / 2] : 0.5 * (pValues[Count / 2 - 1] + pValues[Count / 2]);
+
+}// Median
+
+
+/*! Measure one benchmark.
+	\param pBench points to the benchmark.
+	\param Samples is the number of measurements.
+	\param TargetNs is the least time of one measurement.
+	\param pResult points to space to receive the result.*/
+static void Measure(const Bench_t *pBench, UInt32 Samples, double TargetNs, BenchResult_t *pResult)
+{
+	double Ns[MAX_SAMPLES], Cyc[MAX_SAMPLES], Dev[MAX_SAMPLES], Elapsed;
+	UInt64 Rounds = 1, Start, StartCycles;
+	UInt32 s;
+
+	// Warm up, then find how many rounds take long enough
+	pBench->pRun(pBench->pArg, 1);
+	for (;;)
+	{
+		Start = htNowNs();
+		pBench->pRun(pBench->pArg, Rounds);
+		Elapsed = (double)(htNowNs() - Start);
+		if ((Elapsed >= TargetNs) || (Rounds >= ((UInt64)1 << 40)))
+			break;
+		Rounds *= (Elapsed < TargetNs / 16) ? 8 : 2;
+	}
+
+	pResult->Ops = Rounds * pBench->OpsPerRound;
+	for (s = 0; s < Samples; s++)
+	{
+		StartCycles = Cycles();
+		Start = htNowNs();
+		pBench->pRun(pBench->pArg, Rounds);
+		Ns[s] = (double)(htNowNs() - Start) / pResult->Ops;
+		Cyc[s] = (double)(Cycles() - StartCycles) / pResult->Ops;
+	}
+
+	pResult->NsPerOp = Median(Ns, Samples);
+	pResult->MinNsPerOp = Ns[0];
+	pResult->CyclesPerOp = Median(Cyc, Samples);
+	for (s = 0; s < Samples; s++)
+		Dev[s] = (Ns[s] > pResult->NsPerOp) ? Ns[s] - pResult->NsPerOp : pResult->NsPerOp - Ns[s];
+	pResult->Spread = (pResult->NsPerOp > 0.0) ? Median(Dev, Samples) / pResult->NsPerOp : 0.0;
+
+}// Measure
+
+
+/*! Get the frequency governor of a CPU.
+	\param Cpu is the CPU.
+	\param pOut points to space for the name.
+	\param Size is the size of that space.*/
+static void Governor(int Cpu, char *pOut, size_t Size)
+{
+	char Path[128];
+	FILE *pFile;
+
+	snprintf(pOut, Size, "unknown");
+	snprintf(Path, sizeof(Path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor", Cpu);
+	if ((pFile = fopen(Path, "r")) != NULL)
+	{
+		if (fgets(pOut, (int)Size, pFile))
+			pOut[strcspn(pOut, "\r\n")] = 0;
+		fclose(pFile);
+	}
+
+}// Governor
+
+
+int main(int argc, char *argv[])
+{
+	static BenchResult_t Results[sizeof(Benches) / sizeof(Benches[0])];
+	static BOOL Wanted[sizeof(Benches) / sizeof(Benches[0])];
+	const char *pFormat = "table";
+	char Gov[64];
+	double TargetMs = DEFAULT_MS;
+	UInt32 Samples = DEFAULT_SAMPLES, b, Run = 0;
+	BOOL Pinned = FALSE, BadArgs = FALSE;
+	cpu_set_t Set;
+	double AtanErr;
+	int Cpu = -1, Option, i;
+
+	while (!BadArgs && ((Option = getopt(argc, argv, "c:n:t:f:")) != -1))
+	{
+		switch (Option)
+		{
+		case 'c': Cpu = atoi(optarg); break;
+		case 'n': Samples = (UInt32)atoi(optarg); break;
+		case 't': TargetMs = atof(optarg); break;
+		case 'f': pFormat = optarg; break;
+		default:  BadArgs = TRUE; break;
+		}
+	}
+
+	if (BadArgs || (Samples < 1) || (Samples > MAX_SAMPLES) || (TargetMs <= 0.0) ||
+		((strcmp(pFormat, "table") != 0) && (strcmp(pFormat, "csv") != 0) && (strcmp(pFormat, "json") != 0)))
+	{
+		fprintf(stderr, "usage: %s [-c cpu] [-n samples] [-t ms] [-f table | csv | json] [name ...]\n"
+						"       at most %d samples\n", argv[0], MAX_SAMPLES);
+		return 1;
+	}
+
+	// Stay on one CPU
+	if (Cpu < 0)
+		Cpu = sched_getcpu();
+	if (Cpu >= 0)
+	{
+		CPU_ZERO(&Set);
+		CPU_SET(Cpu, &Set);
+		Pinned = (sched_setaffinity(0, sizeof(Set), &Set) == 0);
+	}
+	Governor(Cpu < 0 ? 0 : Cpu, Gov, sizeof(Gov));
+
+	AtanErr = FastAtan2Error();
+	if ((AtanErr > FAST_ATAN2_MAX_ERROR_RAD) || (FastAtan2f(0, 0) != 0.0f))
+	{
+		fprintf(stderr, "FastAtan2f() error %.3g rad, bound %.3g, atan2(0, 0) = %g\n",
+				AtanErr, FAST_ATAN2_MAX_ERROR_RAD, FastAtan2f(0, 0));
+		return 1;
+	}
+
+	CyclesInit();
+	MakeInputs();
+	ListBenches();
+	initKFilter();
+
+	for (b = 0; b < BenchCount; b++)
+	{
+		Wanted[b] = (optind == argc);
+		for (i = optind; i < argc; i++)
+			if (strstr(Benches[b].pName, argv[i]))
+				Wanted[b] = TRUE;
+	}
+
+	for (b = 0; b < BenchCount; b++)
+		if (Wanted[b])
+		{
+			Measure(&Benches[b], Samples, TargetMs * 1.0e6, &Results[b]);
+			Run++;
+		}
+	if (strcmp(pFormat, "json") == 0)
+		printf("{\n  \"cpu\": %d,\n  \"pinned\": %s,\n  \"governor\": \"%s\",\n  \"cycle_source\": \"%s\",\n"
+			   "  \"samples\": %lu,\n  \"target_ms\": %g,\n  \"results\": [", Cpu, Pinned ? "true" : "false", Gov,
+			   pCycleSource, (unsigned long)Samples, TargetMs);
+	else if (strcmp(pFormat, "csv") == 0)
+		printf("name,ops,ns_per_op,min_ns_per_op,spread,bytes_per_s,cycles_per_op,cpu,cycle_source\n");
+	else
+		printf("cpu %d%s, governor %s, cycles from %s, median of %lu x %g ms\n\n"
+			   "%-22s %12s %10s %10s %7s %12s %10s\n", Cpu, Pinned ? " pinned" : " NOT pinned", Gov, pCycleSource,
+			   (unsigned long)Samples, TargetMs, "name", "ops", "ns/op", "min ns/op", "spread", "MB/s", "cycles/op");
+
+	for (b = 0, i = 0; b < BenchCount; b++)
+	{
+		const BenchResult_t *pR = &Results[b];
+		double BytesPerSec = Benches[b].BytesPerOp ? Benches[b].BytesPerOp / pR->NsPerOp * 1.0e9 : 0.0;
+
+		if (!Wanted[b])
+			continue;
+
+		if (strcmp(pFormat, "json") == 0)
+			printf("%s\n    {\"name\": \"%s\", \"ops\": %llu, \"ns_per_op\": %.4f, \"min_ns_per_op\": %.4f, "
+				   "\"spread\": %.4f, \"bytes_per_s\": %.0f, \"cycles_per_op\": %.3f}", i++ ? "," : "",
+				   Benches[b].pName, (unsigned long long)pR->Ops, pR->NsPerOp, pR->MinNsPerOp, pR->Spread,
+				   BytesPerSec, pR->CyclesPerOp);
+		else if (strcmp(pFormat, "csv") == 0)
+			printf("%s,%llu,%.4f,%.4f,%.4f,%.0f,%.3f,%d,%s\n", Benches[b].pName, (unsigned long long)pR->Ops,
+				   pR->NsPerOp, pR->MinNsPerOp, pR->Spread, BytesPerSec, pR->CyclesPerOp, Cpu, pCycleSource);
+		else
+		{
+			printf("%-22s %12llu %10.3f %10.3f %6.1f%%", Benches[b].pName, (unsigned long long)pR->Ops,
+				   pR->NsPerOp, pR->MinNsPerOp, 100.0 * pR->Spread);
+			if (BytesPerSec > 0.0)
+				printf(" %12.1f", BytesPerSec / 1.0e6);
+			else
+				printf(" %12s", "-");
+			printf(" %10.2f\n", pR->CyclesPerOp);
+		}
+	}
+
+	if (strcmp(pFormat, "json") == 0)
+		printf("\n  ]\n}\n");
+
+	return (Run > 0) ? 0 : 1;
+
+}// main
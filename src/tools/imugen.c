@@ -0,0 +1,297 @@
+/*! \file
+	\brief Generate a synthetic IMU byte stream.
+
+	Usage: imugen [options]
+	       -r <Hz>       sample rate (100)
+	       -p <script>   motion profile script, see IMUGenerator.h
+	                     (built-in 20 s profile)
+	       -s <seed>     noise seed (1)
+	       -g <deg/s>    gyro noise per sample (0.2)
+	       -a <m/s^2>    accel noise per sample (0.05)
+	       -b <deg/s>    initial gyro bias (0.5)
+	       -d <deg/s/rt s> gyro bias random walk (0.01)
+	       -w <N>        add a HS_RAW_IMU_MSG every N samples
+	       -t <N>        add a TIMING_IMU_MSG every N samples
+	       -o <file>     write the byte stream to a file
+	       -c <file>     write a capture file for the replay backend
+	       -y            serve the stream on a pty, paced in real time
+	       -R            pace file output in real time too
+	       -T <file>     write the ground truth as CSV
+	       -m            generate into memory, then time the parser, decoder
+	                     and filter over it and check the angle against the
+	                     ground truth
+
+	The stream starts with the configuration responses, then one group of
+	packets per sample.
+*/
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#include "CalcAngle.h"
+#include "HostTime.h"
+#include "IMUGenerator.h"
+#include "IMUSerial.h"
+#include "SerialCapture.h"
+#include "Tilt.h"
+
+#define MAX_SEGMENTS	256
+
+// Seconds of filter convergence left out of the angle error
+#define SETTLE_SECONDS	1.0
+
+static const GenSegment_t DefaultProfile[] =
+{
+	{ GEN_HOLD, 2.0,  0.0, 0.0 },
+	{ GEN_RAMP, 2.0, 10.0, 0.0 },
+	{ GEN_SINE, 10.0, 5.0, 0.5 },
+	{ GEN_RAMP, 2.0, -5.0, 0.0 },
+	{ GEN_HOLD, 4.0, -5.0, 0.0 },
+};
+
+
+/*! Open a pty for a consumer to read the stream from.
+	\return The master descriptor, or -1.*/
+static int OpenPty(void)
+{
+	struct termios Tio;
+	int fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+	if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0)
+	{
+		perror("pty");
+		return -1;
+	}
+
+	// Binary data, no line discipline
+	if (tcgetattr(fd, &Tio) == 0)
+	{
+		cfmakeraw(&Tio);
+		tcsetattr(fd, TCSANOW, &Tio);
+	}
+
+	printf("streaming on %s\n", ptsname(fd));
+	fflush(stdout);
+
+	return fd;
+
+}// OpenPty
+
+
+/*! Generate the whole profile into memory, then run it through the parser,
+	decoder and filter and compare the filter angle with the truth.
+	\param pConfig points to the generator settings.
+	\return The process exit code.*/
+static int MemoryBench(const GenConfig_t *pConfig)
+{
+	IMUGenerator_t Gen;
+	IMUPacket_t Pkt;
+	IMUData_t IMU;
+	KFilter_t KF;
+	GenTruth_t *pTruth;
+	UInt8 *pBuf;
+	UInt64 Samples = (UInt64)(genDuration(pConfig) * pConfig->RateHz) + 1;
+	UInt64 Size = GEN_MAX_CONFIG_BYTES + Samples * GEN_MAX_STEP_BYTES;
+	UInt64 Bytes, i, HS = 0, Start;
+	float dt = (float)(1.0 / pConfig->RateHz);
+	double GenSeconds, RunSeconds, Err, SumSq = 0, MaxErr = 0;
+	UInt64 Compared = 0;
+	UInt32 n;
+
+	pBuf = (UInt8 *)malloc((size_t)Size);
+	pTruth = (GenTruth_t *)malloc((size_t)Samples * sizeof(GenTruth_t));
+	if (pBuf == NULL || pTruth == NULL)
+	{
+		fprintf(stderr, "out of memory for %llu samples\n", (unsigned long long)Samples);
+		return 1;
+	}
+
+	Start = htNowNs();
+	genInit(&Gen, pConfig);
+	Bytes = genConfigResponse(&Gen, pBuf);
+	for (i = 0; i < Samples && (n = genStep(&Gen, &pBuf[Bytes], &pTruth[i])) > 0; i++)
+		Bytes += n;
+	Samples = i;
+	GenSeconds = (htNowNs() - Start) / 1.0e9;
+
+	Pkt.state = SERIAL_STATE_SYNC0;
+	kfInit(&KF);
+
+	Start = htNowNs();
+	for (i = 0; i < Bytes; i++)
+	{
+		if (!LookForIMUPacketInByte(pBuf[i], &Pkt))
+			continue;
+
+		DecodeIMUPacket(&Pkt, &IMU);
+		if (Pkt.type != HS_SERIAL_IMU_MSG)
+			continue;
+
+		kfGetAngle(&KF, TiltRollDeg(&IMU), IMU.SensorsConverted[GYROX_IDX], dt);
+
+		if (HS < Samples && pTruth[HS].Time >= SETTLE_SECONDS)
+		{
+			Err = fabs(KF.angle - pTruth[HS].Angle);
+			SumSq += Err * Err;
+			if (Err > MaxErr)
+				MaxErr = Err;
+			Compared++;
+		}
+		HS++;
+	}
+	RunSeconds = (htNowNs() - Start) / 1.0e9;
+
+	printf("samples     %llu at %.0f Hz (%.1f s of data)\n",
+		   (unsigned long long)Samples, pConfig->RateHz, Samples / pConfig->RateHz);
+	printf("bytes       %llu (%.1f x 115200 baud)\n", (unsigned long long)Bytes,
+		   Bytes * 10.0 / (Samples / pConfig->RateHz) / 115200.0);
+	printf("generate    %.1f MB/s, %.0f samples/s\n", Bytes / GenSeconds / 1.0e6, Samples / GenSeconds);
+	printf("pipeline    %.1f MB/s, %.0f samples/s\n", Bytes / RunSeconds / 1.0e6, HS / RunSeconds);
+	printf("decoded     %llu of %llu HS packets\n", (unsigned long long)HS, (unsigned long long)Samples);
+	if (Compared)
+		printf("angle error %.3f deg RMS, %.3f deg max (after %.1f s)\n",
+			   sqrt(SumSq / Compared), MaxErr, SETTLE_SECONDS);
+
+	free(pBuf);
+	free(pTruth);
+
+	return (HS == Samples) ? 0 : 1;
+
+}// MemoryBench
+
+
+int main(int argc, char *argv[])
+{
+	static GenSegment_t Segments[MAX_SEGMENTS];
+	GenConfig_t Config;
+	IMUGenerator_t Gen;
+	GenTruth_t Truth;
+	UInt8 Buf[GEN_MAX_CONFIG_BYTES + GEN_MAX_STEP_BYTES];
+	const char *pOutPath = NULL, *pCapPath = NULL, *pTruthPath = NULL;
+	FILE *pOut = NULL, *pTruthFile = NULL;
+	SerialCapture_t *pCap = NULL;
+	BOOL Memory = FALSE, Pty = FALSE, Paced = FALSE, Failed = FALSE;
+	UInt64 StartNs, DueNs, Samples = 0, Bytes = 0;
+	int Opt, Count, PtyFd = -1;
+	UInt32 n;
+
+	genDefaultConfig(&Config);
+	Config.pProfile = DefaultProfile;
+	Config.ProfileCount = sizeof(DefaultProfile) / sizeof(DefaultProfile[0]);
+
+	while ((Opt = getopt(argc, argv, "r:p:s:g:a:b:d:w:t:o:c:yRT:m")) != -1)
+	{
+		switch (Opt)
+		{
+		case 'r': Config.RateHz = atof(optarg);                 break;
+		case 's': Config.Seed = (UInt32)strtoul(optarg, NULL, 0); break;
+		case 'g': Config.GyroNoise = atof(optarg);              break;
+		case 'a': Config.AccelNoise = atof(optarg);             break;
+		case 'b': Config.GyroBias = atof(optarg);               break;
+		case 'd': Config.BiasWalk = atof(optarg);               break;
+		case 'w': Config.RawEvery = (UInt32)atoi(optarg);       break;
+		case 't': Config.TimingEvery = (UInt32)atoi(optarg);    break;
+		case 'o': pOutPath = optarg;                            break;
+		case 'c': pCapPath = optarg;                            break;
+		case 'y': Pty = TRUE;                                   break;
+		case 'R': Paced = TRUE;                                 break;
+		case 'T': pTruthPath = optarg;                          break;
+		case 'm': Memory = TRUE;                                break;
+		case 'p':
+			if ((Count = genLoadProfile(optarg, Segments, MAX_SEGMENTS)) <= 0)
+				return 1;
+			Config.pProfile = Segments;
+			Config.ProfileCount = (UInt32)Count;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-r Hz] [-p script] [-s seed] [-g n] [-a n] [-b n] [-d n]\n"
+							"       [-w N] [-t N] [-o file] [-c capture] [-y] [-R] [-T truth.csv] [-m]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (Config.RateHz <= 0)
+	{
+		fprintf(stderr, "bad rate\n");
+		return 1;
+	}
+
+	if (Memory)
+		return MemoryBench(&Config);
+
+	if (!pOutPath && !pCapPath && !Pty)
+		pOut = stdout;
+	else if (pOutPath && (pOut = fopen(pOutPath, "wb")) == NULL)
+	{
+		fprintf(stderr, "Can't create %s\n", pOutPath);
+		return 1;
+	}
+
+	if (pCapPath && (pCap = capOpen(pCapPath, 1 << 20)) == NULL)
+		return 1;
+
+	if (Pty && (PtyFd = OpenPty()) < 0)
+		return 1;
+
+	if (pTruthPath)
+	{
+		if ((pTruthFile = fopen(pTruthPath, "w")) == NULL)
+		{
+			fprintf(stderr, "Can't create %s\n", pTruthPath);
+			return 1;
+		}
+		fprintf(pTruthFile, "Time,Angle,Rate,Bias,SequenceNumber\n");
+	}
+
+	Paced = Paced || Pty;
+
+	genInit(&Gen, &Config);
+	StartNs = htNowNs();
+	n = genConfigResponse(&Gen, Buf);
+	DueNs = StartNs;
+
+	for (;;)
+	{
+		if (pOut)
+			fwrite(Buf, 1, n, pOut);
+		if (pCap)
+			capWriteAt(pCap, Buf, n, DueNs);
+		if (PtyFd >= 0 && write(PtyFd, Buf, n) < 0)
+			break;
+		Bytes += n;
+
+		if ((n = genStep(&Gen, Buf, &Truth)) == 0)
+			break;
+		Samples++;
+
+		if (pTruthFile)
+			fprintf(pTruthFile, "%.6f,%.4f,%.4f,%.5f,%u\n", Truth.Time, Truth.Angle,
+					Truth.Rate, Truth.Bias, Truth.SequenceNumber);
+
+		// Capture time stamps follow the sample clock, not the host
+		DueNs = StartNs + (UInt64)(Truth.Time * 1.0e9);
+		while (Paced && htNowNs() < DueNs)
+			htSleepMs(1);
+	}
+
+	fprintf(stderr, "%llu samples, %llu bytes\n", (unsigned long long)Samples, (unsigned long long)Bytes);
+
+	if (pOut && pOut != stdout)
+		fclose(pOut);
+	if (pTruthFile)
+		fclose(pTruthFile);
+	if (pCap && !capClose(pCap))
+	{
+		fprintf(stderr, "Capture file incomplete, a write failed\n");
+		Failed = TRUE;
+	}
+	if (PtyFd >= 0)
+		close(PtyFd);
+
+	return Failed ? 1 : 0;
+
+}// main
@@ -0,0 +1,143 @@
+/*! \file
+	\brief Reconstruct the angle of a recording with the RTS smoother.
+
+	Usage: kfsmooth [-j threads] [-b block] [-q Q_angle,Q_bias,R_measure]
+	                [-T truth.csv] [-o out.csv] <capture | log.slg>
+
+	Smooths the filter inputs of the recording, see RtsSmoother.h, with
+	the kfInit() parameters or those given with -q, and prints the time
+	taken, the working memory for the block size (-b, sqrt(samples) by
+	default) and how far the causal filter is from the smoothed angle.
+	With an imugen truth file both are also scored against the true angle.
+
+	-o writes one row per sample: Sample,Filtered,Smoothed,Bias,AngleStd.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "CalcAngle.h"
+#include "HostTime.h"
+#include "Recording.h"
+#include "RtsSmoother.h"
+
+
+int main(int argc, char *argv[])
+{
+	RecordingInputs_t Run;
+	KFilter_t Init, KF;
+	float *pSmoothed, *pBias, *pStd, *pTruth = NULL;
+	double Seconds, Lag = 0.0, FilteredErr = 0.0, SmoothedErr = 0.0;
+	UInt32 Threads = 0, Block = 0, i;
+	UInt64 Start;
+	const char *pTruthPath = NULL, *pOut = NULL;
+	FILE *pCsv = NULL;
+	int Option;
+	BOOL BadArgs = FALSE;
+
+	kfInit(&Init);
+	while (!BadArgs && ((Option = getopt(argc, argv, "j:b:q:T:o:")) != -1))
+	{
+		switch (Option)
+		{
+		case 'j': Threads = (UInt32)atoi(optarg); break;
+		case 'b': Block = (UInt32)atoi(optarg); break;
+		case 'q':
+			if (sscanf(optarg, "%f,%f,%f", &Init.Q_angle, &Init.Q_bias, &Init.R_measure) != 3)
+				BadArgs = TRUE;
+			break;
+		case 'T': pTruthPath = optarg; break;
+		case 'o': pOut = optarg; break;
+		default:  BadArgs = TRUE; break;
+		}
+	}
+
+	if (BadArgs || (optind + 1 != argc))
+	{
+		fprintf(stderr, "usage: %s [-j threads] [-b block] [-q Q_angle,Q_bias,R_measure]\n"
+						"       [-T truth.csv] [-o out.csv] <capture | log.slg>\n", argv[0]);
+		return 1;
+	}
+
+	if (!recLoadInputs(argv[optind], Threads, &Run) || (Run.Count == 0))
+	{
+		fprintf(stderr, "%s: not a capture or sample log, or no samples\n", argv[optind]);
+		return 1;
+	}
+
+	pSmoothed = (float *)malloc(Run.Count * sizeof(float));
+	pBias = (float *)malloc(Run.Count * sizeof(float));
+	pStd = (float *)malloc(Run.Count * sizeof(float));
+	if (pTruthPath)
+		pTruth = (float *)malloc(Run.Count * sizeof(float));
+	if ((pSmoothed == NULL) || (pBias == NULL) || (pStd == NULL) || (pTruthPath && (pTruth == NULL)))
+	{
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	if (pTruth && !recLoadTruth(pTruthPath, pTruth, Run.Count))
+	{
+		fprintf(stderr, "%s: not a truth file for %lu samples\n", pTruthPath, (unsigned long)Run.Count);
+		return 1;
+	}
+
+	Start = htNowNs();
+	if (!rtsSmooth(&Init, Run.pTilt, Run.pRate, Run.pStep, Run.Count, Block, pSmoothed, pBias, pStd))
+	{
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	Seconds = (htNowNs() - Start) / 1.0e9;
+
+	if (pOut)
+	{
+		pCsv = fopen(pOut, "w");
+		if (pCsv == NULL)
+		{
+			fprintf(stderr, "%s: can't create\n", pOut);
+			return 1;
+		}
+		fprintf(pCsv, "Sample,Filtered,Smoothed,Bias,AngleStd\n");
+	}
+
+	// The causal filter against the smoothed angle, and both against the truth
+	KF = Init;
+	for (i = 0; i < Run.Count; i++)
+	{
+		float Filtered = kfGetAngle(&KF, Run.pTilt[i], Run.pRate[i], Run.pStep[i]);
+
+		Lag += (double)(Filtered - pSmoothed[i]) * (Filtered - pSmoothed[i]);
+		if (pTruth)
+		{
+			FilteredErr += (double)(Filtered - pTruth[i]) * (Filtered - pTruth[i]);
+			SmoothedErr += (double)(pSmoothed[i] - pTruth[i]) * (pSmoothed[i] - pTruth[i]);
+		}
+		if (pCsv)
+			fprintf(pCsv, "%lu,%.6f,%.6f,%.6f,%.6f\n", (unsigned long)i, Filtered, pSmoothed[i], pBias[i], pStd[i]);
+	}
+
+	printf("%lu samples, %.1f s of data\n", (unsigned long)Run.Count, Run.Elapsed);
+	printf("Q_angle %g Q_bias %g R_measure %g\n", Init.Q_angle, Init.Q_bias, Init.R_measure);
+	printf("smoothed in %.3f s, %.1f M samples/s, %.1f kB working memory\n", Seconds,
+		   Run.Count / Seconds / 1.0e6, rtsMemory(Run.Count, Block) / 1024.0);
+	printf("filtered - smoothed RMS %.4f deg\n", sqrt(Lag / Run.Count));
+	if (pTruth)
+		printf("against the truth RMS   filtered %.4f deg, smoothed %.4f deg\n",
+			   sqrt(FilteredErr / Run.Count), sqrt(SmoothedErr / Run.Count));
+
+	if (pCsv && (fclose(pCsv) != 0))
+	{
+		fprintf(stderr, "%s: write failed\n", pOut);
+		return 1;
+	}
+
+	recFreeInputs(&Run);
+	free(pSmoothed);
+	free(pBias);
+	free(pStd);
+	free(pTruth);
+
+	return 0;
+
+}// main
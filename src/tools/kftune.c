@@ -0,0 +1,242 @@
+/*! \file
+	\brief Find the Kalman filter noise parameters that best fit recorded
+	runs.
+
+	Usage: kftune [-j threads] [-g grid steps] [-k settle s] [-w window s]
+	              [-s] [-q Q_angle,Q_bias,R_measure] [-T truth.csv]
+	              <capture | log.slg> ...
+
+	Each recording is decoded once into arrays of the filter inputs main.c
+	uses, see recLoadInputs().  The reference angle is one of
+
+	- the Angle column of an imugen truth file (-T, one recording only),
+	- the RTS smoothed angle of the recording (-s), with the kfInit()
+	  parameters or those given with -q, see RtsSmoother.h,
+	- by default, a centred moving average of the accelerometer roll over
+	  -w seconds, which has no lag but no gyro in it either.
+
+	The search scores a log spaced grid of grid steps^3 candidates, refines
+	the best with Nelder-Mead, then prints the result with the scores of
+	the kfInit() defaults and of each parameter scaled around the best.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "CalcAngle.h"
+#include "HostTime.h"
+#include "KalmanTune.h"
+#include "Recording.h"
+#include "RtsSmoother.h"
+
+#define MAX_RUNS		64
+#define GRID_STEPS		8
+#define SETTLE_SECONDS	2.0
+#define WINDOW_SECONDS	1.0
+#define NM_SPREAD		0.5					//!< Starting simplex size in decades
+#define NM_MAX_STEPS	200
+
+//! Search range of the grid
+static const KalmanParams_t GridLo = { 1.0e-6f, 1.0e-7f, 1.0e-4f };
+static const KalmanParams_t GridHi = { 1.0f, 1.0e-1f, 1.0e+1f };
+
+//! Scales tried around the best candidate
+static const float Around[] = { 0.25f, 0.5f, 1.0f, 2.0f, 4.0f };
+#define AROUND_COUNT	(sizeof(Around) / sizeof(Around[0]))
+
+/*! Reference from a centred moving average of the accelerometer roll.
+	\param pRun points to the run.
+	\param Window is the averaging window in seconds.
+	\param pReference points to space to receive the reference.*/
+static void AverageReference(const RecordingInputs_t *pRun, double Window, float *pReference)
+{
+	UInt32 Half, i, Lo, Hi;
+	double Sum = 0.0;
+
+	Half = (pRun->Count > 1) ? (UInt32)(Window / 2.0 / (pRun->Elapsed / (pRun->Count - 1)) + 0.5) : 0;
+
+	// Sum over [Lo, Hi), the window shrinks at the ends
+	for (Lo = 0, Hi = 0, i = 0; i < pRun->Count; i++)
+	{
+		while ((Hi < pRun->Count) && (Hi <= i + Half))
+			Sum += pRun->pTilt[Hi++];
+		while (Lo + Half < i)
+			Sum -= pRun->pTilt[Lo++];
+		pReference[i] = (float)(Sum / (Hi - Lo));
+	}
+
+}// AverageReference
+
+
+int main(int argc, char *argv[])
+{
+	static RecordingInputs_t Inputs[MAX_RUNS];
+	static float *pReferences[MAX_RUNS];
+	TuneRun_t Runs[MAX_RUNS];
+	ThreadPool_t *pPool;
+	KalmanParams_t *pGrid, Best, Defaults, Trial[3 * AROUND_COUNT];
+	KFilter_t Init, Smoother;
+	double *pScores, Score, Default, TrialScores[3 * AROUND_COUNT], Settle = SETTLE_SECONDS, Window = WINDOW_SECONDS;
+	UInt32 Threads = 0, Steps = GRID_STEPS, RunCount, Candidates, i, p, BestAt, NMSteps;
+	UInt64 Start, Samples = 0;
+	const char *pTruth = NULL;
+	BOOL Smooth = FALSE, BadArgs = FALSE;
+	int Option;
+
+	kfInit(&Smoother);
+	while (!BadArgs && ((Option = getopt(argc, argv, "j:g:k:w:sq:T:")) != -1))
+	{
+		switch (Option)
+		{
+		case 'j': Threads = (UInt32)atoi(optarg); break;
+		case 'g': Steps = (UInt32)atoi(optarg); break;
+		case 'k': Settle = atof(optarg); break;
+		case 'w': Window = atof(optarg); break;
+		case 's': Smooth = TRUE; break;
+		case 'q':
+			Smooth = TRUE;
+			if (sscanf(optarg, "%f,%f,%f", &Smoother.Q_angle, &Smoother.Q_bias, &Smoother.R_measure) != 3)
+				BadArgs = TRUE;
+			break;
+		case 'T': pTruth = optarg; break;
+		default:  BadArgs = TRUE; break;
+		}
+	}
+
+	RunCount = (optind < argc) ? (UInt32)(argc - optind) : 0;
+	if (BadArgs || (RunCount == 0) || (RunCount > MAX_RUNS) || (Steps < 2) || (pTruth && ((RunCount > 1) || Smooth)))
+	{
+		fprintf(stderr, "usage: %s [-j threads] [-g grid steps] [-k settle s] [-w window s]\n"
+						"       [-s] [-q Q_angle,Q_bias,R_measure] [-T truth.csv] <capture | log.slg> ...\n"
+						"       -T needs a single recording and no -s, at most %d recordings\n", argv[0], MAX_RUNS);
+		return 1;
+	}
+
+	for (i = 0; i < RunCount; i++)
+	{
+		RecordingInputs_t *pRun = &Inputs[i];
+		BOOL Ok;
+
+		if (!recLoadInputs(argv[optind + i], Threads, pRun) || (pRun->Count < 2))
+		{
+			fprintf(stderr, "%s: not a capture or sample log, or no samples\n", argv[optind + i]);
+			return 1;
+		}
+
+		pReferences[i] = (float *)malloc(pRun->Count * sizeof(float));
+		if (pReferences[i] == NULL)
+			Ok = FALSE;
+		else if (pTruth)
+			Ok = recLoadTruth(pTruth, pReferences[i], pRun->Count);
+		else if (Smooth)
+			Ok = rtsSmooth(&Smoother, pRun->pTilt, pRun->pRate, pRun->pStep, pRun->Count, 0,
+						   pReferences[i], NULL, NULL);
+		else
+		{
+			AverageReference(pRun, Window, pReferences[i]);
+			Ok = TRUE;
+		}
+		if (!Ok)
+		{
+			fprintf(stderr, "%s: no reference\n", pTruth ? pTruth : argv[optind + i]);
+			return 1;
+		}
+
+		Runs[i].pTilt = pRun->pTilt;
+		Runs[i].pRate = pRun->pRate;
+		Runs[i].pStep = pRun->pStep;
+		Runs[i].pReference = pReferences[i];
+		Runs[i].Count = pRun->Count;
+		Runs[i].Skip = (UInt32)(Settle / (pRun->Elapsed / (pRun->Count - 1)));
+		Samples += pRun->Count;
+
+		printf("%-30s %9lu samples, %.1f s\n", argv[optind + i], (unsigned long)pRun->Count, pRun->Elapsed);
+	}
+
+	pPool = tpCreate(Threads);
+	Candidates = Steps * Steps * Steps;
+	pGrid = (KalmanParams_t *)malloc(Candidates * sizeof(KalmanParams_t));
+	pScores = (double *)malloc(Candidates * sizeof(double));
+	if ((pPool == NULL) || (pGrid == NULL) || (pScores == NULL))
+	{
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	// The defaults, for comparison
+	kfInit(&Init);
+	Defaults.Q_angle = Init.Q_angle;
+	Defaults.Q_bias = Init.Q_bias;
+	Defaults.R_measure = Init.R_measure;
+	ktScore(Runs, RunCount, &Defaults, 1, pPool, &Default);
+
+	// Grid
+	Start = htNowNs();
+	ktGrid(&GridLo, &GridHi, Steps, pGrid);
+	if (!ktScore(Runs, RunCount, pGrid, Candidates, pPool, pScores))
+	{
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	for (BestAt = 0, i = 1; i < Candidates; i++)
+		if (pScores[i] < pScores[BestAt])
+			BestAt = i;
+
+	printf("\n%u threads, grid of %lu scored in %.3f s, %.1f M filter steps/s\n", (unsigned)tpThreads(pPool),
+		   (unsigned long)Candidates, (htNowNs() - Start) / 1.0e9,
+		   (double)Samples * ((Candidates + KT_LANES - 1) / KT_LANES * KT_LANES) / ((htNowNs() - Start) / 1.0e9) / 1.0e6);
+	printf("grid best    Q_angle %-10.4g Q_bias %-10.4g R_measure %-10.4g RMS %.4f deg\n",
+		   pGrid[BestAt].Q_angle, pGrid[BestAt].Q_bias, pGrid[BestAt].R_measure, pScores[BestAt]);
+
+	// Refine
+	Start = htNowNs();
+	Best = pGrid[BestAt];
+	Score = ktNelderMead(Runs, RunCount, pPool, &Best, NM_SPREAD, NM_MAX_STEPS, &NMSteps);
+	printf("refined      Q_angle %-10.4g Q_bias %-10.4g R_measure %-10.4g RMS %.4f deg (%lu steps, %.3f s)\n",
+		   Best.Q_angle, Best.Q_bias, Best.R_measure, Score, (unsigned long)NMSteps, (htNowNs() - Start) / 1.0e9);
+	printf("defaults     Q_angle %-10.4g Q_bias %-10.4g R_measure %-10.4g RMS %.4f deg\n",
+		   Defaults.Q_angle, Defaults.Q_bias, Defaults.R_measure, Default);
+
+	// Each parameter scaled with the others held at the best
+	for (p = 0; p < 3; p++)
+	{
+		for (i = 0; i < AROUND_COUNT; i++)
+		{
+			KalmanParams_t *pTrial = &Trial[p * AROUND_COUNT + i];
+
+			*pTrial = Best;
+			if (p == 0)
+				pTrial->Q_angle *= Around[i];
+			else if (p == 1)
+				pTrial->Q_bias *= Around[i];
+			else
+				pTrial->R_measure *= Around[i];
+		}
+	}
+	ktScore(Runs, RunCount, Trial, 3 * AROUND_COUNT, pPool, TrialScores);
+
+	printf("\nRMS deg around the best");
+	for (i = 0; i < AROUND_COUNT; i++)
+		printf("   x%-6g", Around[i]);
+	for (p = 0; p < 3; p++)
+	{
+		printf("\n%-23s", (p == 0) ? "Q_angle" : (p == 1) ? "Q_bias" : "R_measure");
+		for (i = 0; i < AROUND_COUNT; i++)
+			printf(" %9.4f", TrialScores[p * AROUND_COUNT + i]);
+	}
+	printf("\n");
+
+	tpDestroy(pPool);
+	free(pGrid);
+	free(pScores);
+	for (i = 0; i < RunCount; i++)
+	{
+		recFreeInputs(&Inputs[i]);
+		free(pReferences[i]);
+	}
+
+	return 0;
+
+}// main
@@ -0,0 +1,256 @@
+/*! \file
+	\brief Scrape the metrics endpoint, or check it survives rude clients.
+
+	Usage: mtprobe scrape [host:]port
+	       mtprobe check [-n resets]
+
+	"scrape" fetches /metrics from a running segway -m http:port, see
+	Metrics.h, and prints it.
+
+	"check" starts an exporter on a free local port with a registered
+	thread that has counted something, then -n times (20) opens a scrape
+	and resets it mid-response: half of them send part of the request and
+	reset at once, the others send the whole request, read a few bytes of
+	the answer and reset.  The exporter then has to answer a normal scrape
+	with the counter in it.  A send() to a reset connection raises SIGPIPE
+	unless the exporter prevents it, which would kill this process, so
+	ctest sees a crash rather than a pass.  Last, a client connects and
+	sends nothing; the exporter has to time it out and answer a scrape
+	behind it within PROBE_WAIT_S, or the check fails rather than hangs.
+*/
+
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "HostTime.h"
+#include "Metrics.h"
+
+#define PROBE_HOST			"127.0.0.1"
+#define PROBE_FIRST_PORT	19464			// Ports tried for the check's exporter...
+#define PROBE_PORTS			64				// ...this many of them
+#define PROBE_RESETS		20
+#define PROBE_BYTES			65536
+#define PROBE_WAIT_S		5				// Longest a scrape waits for its answer
+
+static const char Request[] = "GET /metrics HTTP/1.0\r\nHost: localhost\r\n\r\n";
+
+
+/*! Connect to the exporter.
+	\param pHost is the host.
+	\param pPort is the port.
+	\return The socket, or -1.*/
+static int Connect(const char *pHost, const char *pPort)
+{
+	struct addrinfo Hints, *pInfo;
+	int Socket;
+
+	memset(&Hints, 0, sizeof(Hints));
+	Hints.ai_family = AF_UNSPEC;
+	Hints.ai_socktype = SOCK_STREAM;
+
+	if (getaddrinfo(pHost, pPort, &Hints, &pInfo) != 0)
+		return -1;
+
+	Socket = socket(pInfo->ai_family, SOCK_STREAM, 0);
+	if (Socket >= 0 && connect(Socket, pInfo->ai_addr, pInfo->ai_addrlen) != 0)
+	{
+		close(Socket);
+		Socket = -1;
+	}
+
+	freeaddrinfo(pInfo);
+
+	return Socket;
+
+}// Connect
+
+
+/*! Close a connection with a reset rather than an orderly shutdown.
+	\param Socket is the connection.*/
+static void Reset(int Socket)
+{
+	struct linger Linger = { 1, 0 };
+
+	setsockopt(Socket, SOL_SOCKET, SO_LINGER, &Linger, sizeof(Linger));
+	close(Socket);
+
+}// Reset
+
+
+/*! Fetch the metrics.
+	\param pHost is the host.
+	\param pPort is the port.
+	\param pText receives the answer, headers and all, terminated.
+	\param Bytes is the space at pText.
+	\return The length of the answer, 0 if there was none.*/
+static size_t Scrape(const char *pHost, const char *pPort, char *pText, size_t Bytes)
+{
+	int Socket = Connect(pHost, pPort);
+	size_t Used = 0;
+	ssize_t Got;
+
+	struct timeval Timeout = { PROBE_WAIT_S, 0 };
+
+	if (Socket < 0)
+		return 0;
+
+	setsockopt(Socket, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
+	if (send(Socket, Request, sizeof(Request) - 1, 0) == (ssize_t)sizeof(Request) - 1)
+	{
+		while (Used + 1 < Bytes && (Got = recv(Socket, pText + Used, Bytes - 1 - Used, 0)) > 0)
+			Used += (size_t)Got;
+	}
+	pText[Used] = 0;
+	close(Socket);
+
+	return Used;
+
+}// Scrape
+
+
+/*! Print the usage.
+	\param pName is the program name.*/
+static void Usage(const char *pName)
+{
+	fprintf(stderr, "Usage: %s scrape [host:]port\n"
+					"       %s check [-n resets]\n", pName, pName);
+
+}// Usage
+
+
+/*! Reset scrapes mid-response, then check the exporter still answers.
+	\return The exit code.*/
+static int Check(int argc, char *argv[], const char *pProgram)
+{
+	MetricsExporter_t *pExporter = NULL;
+	UInt64 Start;
+	int Idle;
+	UInt32 Resets = PROBE_RESETS, i;
+	char Where[64], Port[16], *pText;
+	size_t Length;
+	int Option, Bad = 0;
+
+	while ((Option = getopt(argc, argv, "n:")) != -1)
+	{
+		if (Option == 'n')
+			Resets = (UInt32)strtoul(optarg, NULL, 0);
+		else
+		{
+			Usage(pProgram);
+			return 2;
+		}
+	}
+
+	mtRegister("probe");
+	mtCount(MT_PACKETS, 42);
+
+	for (i = 0; i < PROBE_PORTS && pExporter == NULL; i++)
+	{
+		snprintf(Port, sizeof(Port), "%u", PROBE_FIRST_PORT + (unsigned)i);
+		snprintf(Where, sizeof(Where), "http:%s:%s", PROBE_HOST, Port);
+		pExporter = mtStart(Where);
+	}
+	if (pExporter == NULL)
+	{
+		fprintf(stderr, "No free port from %u for the exporter\n", PROBE_FIRST_PORT);
+		return 1;
+	}
+
+	for (i = 0; i < Resets; i++)
+	{
+		int Socket = Connect(PROBE_HOST, Port);
+		char Head[16];
+
+		if (Socket < 0)
+		{
+			fprintf(stderr, "Connection %lu refused\n", (unsigned long)i);
+			Bad++;
+			continue;
+		}
+
+		// The request line alone is enough for an answer, which meets the reset
+		if (i & 1)
+		{
+			send(Socket, Request, sizeof(Request) - 1, 0);
+			recv(Socket, Head, sizeof(Head), 0);
+		}
+		else
+			send(Socket, Request, 24, 0);
+		Reset(Socket);
+	}
+
+	// Give the exporter time to answer the last of them
+	htSleepMs(50);
+
+	pText = (char *)malloc(PROBE_BYTES);
+	if (pText == NULL)
+		return 1;
+
+	Length = Scrape(PROBE_HOST, Port, pText, PROBE_BYTES);
+	if (Length == 0 || strncmp(pText, "HTTP/1.0 200", 12) != 0 ||
+		strstr(pText, "cristaimu_packets_total{thread=\"probe\"} 42") == NULL)
+	{
+		fprintf(stderr, "Scrape after the resets failed:\n%s\n", pText);
+		Bad++;
+	}
+
+	// A client that connects and says nothing mustn't hold up the next one
+	Idle = Connect(PROBE_HOST, Port);
+	Start = htNowNs();
+	Length = Scrape(PROBE_HOST, Port, pText, PROBE_BYTES);
+	if (Length == 0 || strncmp(pText, "HTTP/1.0 200", 12) != 0)
+	{
+		fprintf(stderr, "Scrape behind an idle client failed after %.1f s\n", (htNowNs() - Start) / 1.0e9);
+		Bad++;
+	}
+	if (Idle >= 0)
+		close(Idle);
+
+	mtStop(pExporter);
+	free(pText);
+
+	printf("%lu scrapes reset mid-response and one idle client, exporter %s\n", (unsigned long)Resets,
+		   Bad ? "FAILED" : "still answering");
+
+	return Bad ? 1 : 0;
+
+}// Check
+
+
+int main(int argc, char *argv[])
+{
+	if (argc >= 3 && strcmp(argv[1], "scrape") == 0)
+	{
+		const char *pColon = strrchr(argv[2], ':');
+		char Host[128], *pText = (char *)malloc(PROBE_BYTES);
+		size_t Length;
+
+		if (pText == NULL)
+			return 1;
+
+		strcpy(Host, PROBE_HOST);
+		if (pColon && (size_t)(pColon - argv[2]) < sizeof(Host))
+		{
+			memcpy(Host, argv[2], (size_t)(pColon - argv[2]));
+			Host[pColon - argv[2]] = 0;
+		}
+
+		Length = Scrape(Host, pColon ? pColon + 1 : argv[2], pText, PROBE_BYTES);
+		fwrite(pText, 1, Length, stdout);
+		free(pText);
+
+		return Length ? 0 : 1;
+	}
+	if (argc >= 2 && strcmp(argv[1], "check") == 0)
+		return Check(argc - 1, argv + 1, argv[0]);
+
+	Usage(argv[0]);
+
+	return 2;
+
+}// main
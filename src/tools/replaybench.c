@@ -0,0 +1,112 @@
+/*! \file
+	\brief Replay a capture through the parser, decoder and filter and report
+	the throughput of the whole pipeline.
+
+	Usage: replaybench <capture> [speed] [trace.json]
+	       speed is the replay rate relative to real time, 0 (the default)
+	       replays as fast as possible.
+
+	Built with IMU_LATENCY_TRACE, the latency of each stage is printed as
+	histograms and written to trace.json if named, see LatencyTrace.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "CalcAngle.h"
+#include "HostTime.h"
+#include "IMUSerial.h"
+#include "LatencyTrace.h"
+#include "SerialReplay.h"
+#include "Tilt.h"
+
+int main(int argc, char *argv[])
+{
+	IMUPacket_t Pkt;
+	IMUData_t IMU;
+	KFilter_t KF;
+	UInt8 Buffer[4096];
+	ReplayStats_t Stats;
+	UInt64 Packets = 0, HSPackets = 0;
+	UInt32 Handle, Count, n;
+	double Seconds;
+
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <capture> [speed] [trace.json]\n", argv[0]);
+		return 1;
+	}
+
+	if (!psReplaySetup(argv[1], (argc > 2) ? atof(argv[2]) : REPLAY_SPEED_MAX))
+		return 1;
+
+	Handle = psOpenCOMM(0, BOTH_DIR, 115200, NO_PARITY, 8, FLOW_NONE, 0);
+	if (!psIsCOMMOpen(Handle))
+	{
+		fprintf(stderr, "%s: not a capture file\n", argv[1]);
+		return 1;
+	}
+
+	Pkt.state = SERIAL_STATE_SYNC0;
+	kfInit(&KF);
+
+	do
+	{
+		while ((Count = psReadBlockQuick(Handle, Buffer, sizeof(Buffer))) > 0)
+		{
+			LT_READ();
+
+			for (n = 0; n < Count; n++)
+			{
+				if (LookForIMUPacketInByte(Buffer[n], &Pkt))
+				{
+					LT_FRAME(Pkt.type);
+					DecodeIMUPacket(&Pkt, &IMU);
+					LT_STAGE(LT_DECODE_DONE);
+					Packets++;
+
+					if (Pkt.type == HS_SERIAL_IMU_MSG)
+					{
+						kfGetAngle(&KF, TiltRollDeg(&IMU), IMU.SensorsConverted[GYROX_IDX], 0.02f);
+						LT_STAGE(LT_FILTER_DONE);
+						HSPackets++;
+					}
+
+					LT_END();
+				}
+			}
+		}
+
+		psReplayGetStats(Handle, &Stats);
+
+		// Paced replays wait for the next chunk to come due
+		if (!Stats.Finished)
+			htSleepMs(1);
+
+	} while (!Stats.Finished);
+
+	Seconds = Stats.ElapsedNs / 1.0e9;
+
+	printf("bytes       %llu\n", (unsigned long long)Stats.Bytes);
+	printf("chunks      %llu\n", (unsigned long long)Stats.Chunks);
+	printf("packets     %llu (%llu HS)\n", (unsigned long long)Packets, (unsigned long long)HSPackets);
+	printf("dropped     %llu bytes in capture\n", (unsigned long long)Stats.Dropped);
+	printf("elapsed     %.3f s\n", Seconds);
+	printf("throughput  %.1f MB/s, %.0f packets/s\n",
+		   Stats.Bytes / Seconds / 1.0e6, Packets / Seconds);
+
+#ifdef IMU_LATENCY_TRACE
+	printf("\n");
+	ltPrintHistograms(stdout);
+
+	if (argc > 3 && !ltWriteChromeTrace(argv[3]))
+		fprintf(stderr, "%s: can't write the trace\n", argv[3]);
+#else
+	if (argc > 3)
+		fprintf(stderr, "built without IMU_LATENCY_TRACE, no trace written\n");
+#endif
+
+	psCloseCOMM(Handle);
+
+	return 0;
+
+}// main
@@ -0,0 +1,374 @@
+/*! \file
+	\brief Worst case pipeline latency in normal and real-time mode under a
+	synthetic load.
+
+	Usage: rtjitter [-c cpu] [-p priority] [-r rate] [-s seconds]
+	                [-l threads] [-m normal | rt | both]
+
+	A generated HS stream is fed to the parser, decoder and filter one
+	sample per period at -r Hz (1000), as if each sample arrived on time.
+	Each sample's latency is measured from its due time to the thread
+	waking up, and to the filtered angle.  Meanwhile -l load threads (one
+	per core) keep every core busy mapping, touching and unmapping memory,
+	the page faults, TLB flushes and cache misses that logging and
+	networking bring.
+
+	The run is done -s seconds (5) in normal mode, then in real-time mode
+	on core -c (the last) at SCHED_FIFO -p (80), see RealTime.h, and the
+	percentiles and worst case of both are reported.  The page faults and
+	heap growth of the pipeline thread during each run show the loop
+	neither faults nor allocates once in real-time mode.
+*/
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "Atomic.h"
+#include "CalcAngle.h"
+#include "HostTime.h"
+#include "IMUGenerator.h"
+#include "IMUSerial.h"
+#include "RealTime.h"
+#include "Tilt.h"
+
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+#define HAVE_MALLINFO2
+#endif
+
+#define DEFAULT_RATE		1000.0
+#define DEFAULT_SECONDS		5.0
+#define LOAD_BYTES			(8 << 20)		//!< Memory each load thread maps per round
+#define MAX_LOAD_THREADS	256
+
+//! Latencies of one run
+typedef struct
+{
+	const char *pMode;
+	UInt32 Samples;
+	UInt32 *pWakeNs;						//!< Due time to wake up, per sample
+	UInt32 *pAngleNs;						//!< Due time to filtered angle, per sample
+	long Faults;							//!< Page faults of the pipeline thread
+	long long HeapGrowth;					//!< Heap in use after minus before, bytes
+	UInt32 Applied;							//!< RT_ flags, real-time run only
+} JitterRun_t;
+
+static volatile UInt32 StopLoad;
+
+
+/*! Keep a core busy with page faults, TLB flushes and cache misses.
+	\param pArg is unused.
+	\return NULL.*/
+static void *LoadThread(void *pArg)
+{
+	UInt32 Round = 0, i;
+
+	(void)pArg;
+
+	while (!atomicLoadRelaxed(&StopLoad))
+	{
+		UInt8 *pMemory = (UInt8 *)mmap(NULL, LOAD_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (pMemory == MAP_FAILED)
+		{
+			sched_yield();
+			continue;
+		}
+
+		for (i = 0; i < LOAD_BYTES; i += 64)
+			pMemory[i] = (UInt8)(i + Round);
+
+		munmap(pMemory, LOAD_BYTES);
+
+		if (++Round % 16 == 0)
+			sched_yield();
+	}
+
+	return NULL;
+
+}// LoadThread
+
+
+/*! Get the heap in use.
+	\return Bytes, 0 where the C library can't tell.*/
+static long long HeapInUse(void)
+{
+#ifdef HAVE_MALLINFO2
+	return (long long)mallinfo2().uordblks;
+#else
+	return 0;
+#endif
+
+}// HeapInUse
+
+
+/*! Get the page faults of the calling thread.
+	\return Minor plus major faults.*/
+static long ThreadFaults(void)
+{
+	struct rusage Usage;
+
+	getrusage(RUSAGE_THREAD, &Usage);
+
+	return Usage.ru_minflt + Usage.ru_majflt;
+
+}// ThreadFaults
+
+
+/*! Feed the stream to the pipeline one sample per period and measure the
+	latency of each.
+	\param pStream is the generated stream.
+	\param pOffsets is the offset of each sample in it, Samples + 1 of them.
+	\param PeriodNs is the sample period.
+	\param pRun receives the latencies, its arrays already allocated.*/
+static void RunPipeline(const UInt8 *pStream, const UInt32 *pOffsets, UInt64 PeriodNs, JitterRun_t *pRun)
+{
+	IMUPacket_t Pkt;
+	IMUData_t IMU;
+	KFilter_t KF;
+	struct timespec Due;
+	UInt64 DueNs, WakeNs;
+	long long Heap = HeapInUse();
+	long Faults = ThreadFaults();
+	UInt32 s, n;
+
+	Pkt.state = SERIAL_STATE_SYNC0;
+	kfInit(&KF);
+
+	for (n = 0; n < pOffsets[0]; n++)
+		if (LookForIMUPacketInByte(pStream[n], &Pkt))
+			DecodeIMUPacket(&Pkt, &IMU);
+
+	DueNs = htNowNs() + 10 * PeriodNs;
+
+	for (s = 0; s < pRun->Samples; s++, DueNs += PeriodNs)
+	{
+		Due.tv_sec = (time_t)(DueNs / 1000000000ULL);
+		Due.tv_nsec = (long)(DueNs % 1000000000ULL);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &Due, NULL) != 0)
+			;
+
+		WakeNs = htNowNs();
+
+		for (n = pOffsets[s]; n < pOffsets[s + 1]; n++)
+		{
+			if (LookForIMUPacketInByte(pStream[n], &Pkt))
+			{
+				DecodeIMUPacket(&Pkt, &IMU);
+				if (Pkt.type == HS_SERIAL_IMU_MSG)
+					kfGetAngle(&KF, TiltRollDeg(&IMU), IMU.SensorsConverted[GYROX_IDX], 0.02f);
+			}
+		}
+
+		pRun->pAngleNs[s] = (UInt32)(htNowNs() - DueNs);
+		pRun->pWakeNs[s] = (UInt32)(WakeNs - DueNs);
+	}
+
+	pRun->Faults = ThreadFaults() - Faults;
+	pRun->HeapGrowth = HeapInUse() - Heap;
+
+}// RunPipeline
+
+
+static int CompareUInt32(const void *pA, const void *pB)
+{
+	UInt32 A = *(const UInt32 *)pA, B = *(const UInt32 *)pB;
+
+	return (A > B) - (A < B);
+
+}// CompareUInt32
+
+
+/*! Print the distribution of one set of latencies, sorting them.
+	\param pName is what was measured.
+	\param pNs is the latencies.
+	\param Count is how many.
+	\return The worst.*/
+static UInt32 PrintLatencies(const char *pName, UInt32 *pNs, UInt32 Count)
+{
+	UInt32 Over100us = 0, Over1ms = 0, i;
+
+	qsort(pNs, Count, sizeof(UInt32), CompareUInt32);
+
+	for (i = 0; i < Count; i++)
+	{
+		Over100us += (pNs[i] > 100000);
+		Over1ms += (pNs[i] > 1000000);
+	}
+
+	printf("  %-6s p50 %8.1f  p99 %8.1f  p99.9 %8.1f  max %9.1f us  >100us %u  >1ms %u\n", pName,
+		   pNs[Count / 2] / 1.0e3, pNs[(UInt32)(Count * 0.99)] / 1.0e3,
+		   pNs[(UInt32)(Count * 0.999)] / 1.0e3, pNs[Count - 1] / 1.0e3,
+		   (unsigned)Over100us, (unsigned)Over1ms);
+
+	return pNs[Count - 1];
+
+}// PrintLatencies
+
+
+/*! Print one run.
+	\param pRun is the run.
+	\return Its worst due time to angle latency.*/
+static UInt32 PrintRun(JitterRun_t *pRun)
+{
+	UInt32 Worst;
+
+	printf("%s mode, %u samples, %ld page faults", pRun->pMode, (unsigned)pRun->Samples, pRun->Faults);
+#ifdef HAVE_MALLINFO2
+	printf(", heap %+lld bytes", pRun->HeapGrowth);
+#endif
+	printf("\n");
+
+	PrintLatencies("wake", pRun->pWakeNs, pRun->Samples);
+	Worst = PrintLatencies("angle", pRun->pAngleNs, pRun->Samples);
+
+	return Worst;
+
+}// PrintRun
+
+
+static void Usage(const char *pName)
+{
+	fprintf(stderr, "usage: %s [-c cpu] [-p priority] [-r rate] [-s seconds] [-l threads] [-m normal|rt|both]\n", pName);
+
+}// Usage
+
+
+int main(int argc, char *argv[])
+{
+	static const GenSegment_t Profile = { GEN_SINE, 1.0e6, 10.0, 0.5 };
+	RealTimeConfig_t Config;
+	GenConfig_t GenConfig;
+	IMUGenerator_t Gen;
+	JitterRun_t Runs[2];
+	pthread_t Load[MAX_LOAD_THREADS];
+	UInt8 *pStream;
+	UInt32 *pOffsets;
+	double Rate = DEFAULT_RATE, Seconds = DEFAULT_SECONDS;
+	long Cores = sysconf(_SC_NPROCESSORS_ONLN);
+	int LoadThreads = (int)Cores, Started, Opt;
+	BOOL DoNormal = TRUE, DoRealTime = TRUE;
+	UInt32 Samples, Worst[2] = { 0, 0 }, s, r, RunCount = 0;
+
+	rtDefaultConfig(&Config);
+	Config.Cpu = (int)Cores - 1;
+
+	while ((Opt = getopt(argc, argv, "c:p:r:s:l:m:")) != -1)
+	{
+		switch (Opt)
+		{
+		case 'c': Config.Cpu = atoi(optarg); break;
+		case 'p': Config.Priority = atoi(optarg); break;
+		case 'r': Rate = atof(optarg); break;
+		case 's': Seconds = atof(optarg); break;
+		case 'l': LoadThreads = atoi(optarg); break;
+		case 'm':
+			DoNormal = (strcmp(optarg, "rt") != 0);
+			DoRealTime = (strcmp(optarg, "normal") != 0);
+			if (strcmp(optarg, "normal") && strcmp(optarg, "rt") && strcmp(optarg, "both"))
+			{
+				Usage(argv[0]);
+				return 1;
+			}
+			break;
+		default:
+			Usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (Rate <= 0 || Seconds <= 0 || LoadThreads < 0 || LoadThreads > MAX_LOAD_THREADS ||
+		Config.Priority < 1 || Config.Priority > 99)
+	{
+		Usage(argv[0]);
+		return 1;
+	}
+
+	// Everything is generated and allocated before either run
+	Samples = (UInt32)(Rate * Seconds);
+	if (Samples < 2)
+		Samples = 2;
+
+	genDefaultConfig(&GenConfig);
+	GenConfig.RateHz = Rate;
+	GenConfig.pProfile = &Profile;
+	GenConfig.ProfileCount = 1;
+	genInit(&Gen, &GenConfig);
+
+	pStream = (UInt8 *)malloc(GEN_MAX_CONFIG_BYTES + (size_t)Samples * GEN_MAX_STEP_BYTES);
+	pOffsets = (UInt32 *)malloc(((size_t)Samples + 1) * sizeof(UInt32));
+	for (r = 0; r < 2; r++)
+	{
+		Runs[r].Samples = Samples;
+		Runs[r].pWakeNs = (UInt32 *)calloc(Samples, sizeof(UInt32));
+		Runs[r].pAngleNs = (UInt32 *)calloc(Samples, sizeof(UInt32));
+		Runs[r].Applied = 0;
+	}
+
+	if (pStream == NULL || pOffsets == NULL || Runs[0].pWakeNs == NULL || Runs[0].pAngleNs == NULL ||
+		Runs[1].pWakeNs == NULL || Runs[1].pAngleNs == NULL)
+	{
+		fprintf(stderr, "%s: out of memory\n", argv[0]);
+		return 1;
+	}
+
+	// The sensor ranges come first, HS packets don't decode without them
+	for (pOffsets[0] = genConfigResponse(&Gen, pStream), s = 0; s < Samples; s++)
+		pOffsets[s + 1] = pOffsets[s] + genStep(&Gen, pStream + pOffsets[s], NULL);
+
+	printf("%u samples at %.0f Hz per run, %d load threads on %ld cores\n",
+		   (unsigned)Samples, Rate, LoadThreads, Cores);
+
+	for (Started = 0; Started < LoadThreads; Started++)
+		if (pthread_create(&Load[Started], NULL, LoadThread, NULL) != 0)
+			break;
+
+	if (DoNormal)
+	{
+		Runs[RunCount].pMode = "normal";
+		RunPipeline(pStream, pOffsets, (UInt64)(1.0e9 / Rate), &Runs[RunCount]);
+		RunCount++;
+	}
+
+	// Real-time last, as it can't be undone
+	if (DoRealTime)
+	{
+		rtPrefault(pStream, pOffsets[Samples]);
+		rtPrefault(pOffsets, ((size_t)Samples + 1) * sizeof(UInt32));
+		rtPrefault(Runs[RunCount].pWakeNs, Samples * sizeof(UInt32));
+		rtPrefault(Runs[RunCount].pAngleNs, Samples * sizeof(UInt32));
+
+		Runs[RunCount].pMode = "real-time";
+		Runs[RunCount].Applied = rtEnter(&Config);
+		RunPipeline(pStream, pOffsets, (UInt64)(1.0e9 / Rate), &Runs[RunCount]);
+		RunCount++;
+	}
+
+	atomicStoreRelaxed(&StopLoad, 1);
+	while (Started > 0)
+		pthread_join(Load[--Started], NULL);
+
+	for (r = 0; r < RunCount; r++)
+	{
+		printf("\n");
+		if (strcmp(Runs[r].pMode, "real-time") == 0)
+			rtPrintApplied(stdout, &Config, Runs[r].Applied);
+		Worst[r] = PrintRun(&Runs[r]);
+	}
+
+	if (RunCount == 2)
+		printf("\nworst case %.1f us normal, %.1f us real-time, %.1fx\n",
+			   Worst[0] / 1.0e3, Worst[1] / 1.0e3, Worst[1] ? (double)Worst[0] / Worst[1] : 0.0);
+
+	return 0;
+
+}// main
@@ -0,0 +1,49 @@
+/*! \file
+	\brief Run the self tests compiled into the modules.
+
+	Usage: selftest
+
+	Some modules carry a test of their own behind a define:
+	TestKFilterFixed() in CalcAngleFixed.c behind KFIXED_TEST, and
+	TestTelemetryLog() in TelemetryLog.c behind TELEMETRYLOG_TEST.  The
+	build compiles those modules again with the define into this tool,
+	which runs each test and exits non-zero if any of them fails, so ctest
+	holds them to their bounds.
+*/
+
+#include <stdio.h>
+#include "IMUExternalTypes.h"
+
+BOOL TestKFilterFixed(void);
+BOOL TestTelemetryLog(void);
+
+//! A test compiled into a module
+typedef struct
+{
+	const char *pName;
+	BOOL (*pTest)(void);
+} SelfTest_t;
+
+static const SelfTest_t Tests[] =
+{
+	{ "fixed point filter", TestKFilterFixed },
+	{ "telemetry log",      TestTelemetryLog },
+};
+
+
+int main(void)
+{
+	UInt32 i, Failed = 0;
+
+	for (i = 0; i < sizeof(Tests) / sizeof(Tests[0]); i++)
+	{
+		BOOL Passed = Tests[i].pTest();
+
+		printf("%-24s %s\n", Tests[i].pName, Passed ? "passed" : "FAILED");
+		if (!Passed)
+			Failed++;
+	}
+
+	return Failed ? 1 : 0;
+
+}// main
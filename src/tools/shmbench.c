@@ -0,0 +1,306 @@
+/*! \file
+	\brief Fan-out benchmark of the shared memory sample ring.
+
+	Usage: shmbench [-r readers] [-R rate] [-s seconds] [-n slots] [-z]
+
+	-r reader processes (4) are forked, each mapping the ring and following
+	it with shNext(), or with shPeek() and shIntact() in place with -z.
+	Once they are all ready the writer publishes samples at -R Hz (1000)
+	for -s seconds (5) into a ring of -n slots (SH_DEFAULT_SLOTS), sleeping
+	to each sample's due time.  Readers poll, yielding the core when they
+	are up to date.
+
+	Every field of sample n holds n, so a reader can tell a torn sample,
+	which the sequence lock must never let through.  Each reader reports
+	the samples received, lost to being lapped and torn, and the latency
+	from publication, the sample's HostNs, to the reader having it.  The
+	writer reports the time shPublish() takes, which doesn't depend on the
+	number of readers.
+*/
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "HostTime.h"
+#include "LatencyHistogram.h"
+#include "SharedRing.h"
+
+#define DEFAULT_READERS		4
+#define DEFAULT_RATE		1000.0
+#define DEFAULT_SECONDS		5.0
+#define MAX_READERS			64
+
+//! What a reader sends back, in one pipe write
+typedef struct
+{
+	UInt32 Reader;
+	UInt64 Received;
+	UInt64 Lost;
+	UInt64 Torn;							//!< Samples not all holding their index
+	LatencyHistogram_t Latency;				//!< Publication to read
+} ReaderResult_t;
+
+
+/*! Fill a sample so every field holds its index.
+	\param pData receives the sample.
+	\param Index is the sample number.*/
+static void FillSample(IMUData_t *pData, UInt64 Index)
+{
+	float Value = (float)(Index & 0xFFFFFF);
+	UInt32 i;
+
+	for (i = 0; i < N_SENSOR_IDX; i++)
+		pData->SensorsConverted[i] = Value;
+	pData->TimeSincePPS = Value;
+
+}// FillSample
+
+
+/*! Check a sample was filled by FillSample() for its index.
+	\param pSample is the sample.
+	\param Index is the sample number expected.
+	\return TRUE if it's whole.*/
+static BOOL SampleWhole(const SharedSample_t *pSample, UInt64 Index)
+{
+	float Value = (float)(Index & 0xFFFFFF);
+	UInt32 i;
+
+	if (pSample->Index != Index || pSample->Angle != Value || pSample->Data.TimeSincePPS != Value)
+		return FALSE;
+
+	for (i = 0; i < N_SENSOR_IDX; i++)
+		if (pSample->Data.SensorsConverted[i] != Value)
+			return FALSE;
+
+	return TRUE;
+
+}// SampleWhole
+
+
+/*! Follow the ring until the writer closes it and everything was read.
+	\param pName is the ring's name.
+	\param ZeroCopy is TRUE to use samples in place.
+	\param Ready is the pipe to say the ring is mapped on.
+	\param pResult receives the counts.
+	\return 0, or 1 if the ring couldn't be opened.*/
+static int RunReader(const char *pName, BOOL ZeroCopy, int Ready, ReaderResult_t *pResult)
+{
+	SharedRingReader_t *pReader = shOpen(pName);
+	SharedSample_t Sample;
+	UInt64 Cursor, Head;
+	BOOL Open;
+	char Byte = 1;
+
+	if (pReader == NULL)
+		return 1;
+
+	// Only samples published from now on
+	Cursor = shHead(pReader);
+	if (write(Ready, &Byte, 1) != 1)
+		return 1;
+
+	do
+	{
+		// Read whether the writer is open before the head, so the last samples aren't missed
+		Open = shWriterOpen(pReader);
+		Head = shHead(pReader);
+
+		if (Cursor >= Head)
+		{
+			sched_yield();
+			continue;
+		}
+
+		while (Cursor < Head)
+		{
+			if (ZeroCopy)
+			{
+				const SharedSample_t *pSample;
+				UInt64 Oldest = (Head > shSlots(pReader)) ? Head - shSlots(pReader) : 0;
+				UInt64 Now;
+				BOOL Whole;
+
+				if (Cursor < Oldest)
+				{
+					pResult->Lost += Oldest - Cursor;
+					Cursor = Oldest;
+				}
+
+				pSample = shPeek(pReader, Cursor);
+				if (pSample)
+				{
+					Now = htNowNs();
+					Whole = SampleWhole(pSample, Cursor);
+
+					if (shIntact(pReader, Cursor))
+					{
+						lhAdd(&pResult->Latency, Now - pSample->HostNs);
+						pResult->Received++;
+						pResult->Torn += !Whole;
+						Cursor++;
+						continue;
+					}
+				}
+
+				pResult->Lost++;
+				Cursor++;
+			}
+			else
+			{
+				if (shNext(pReader, &Cursor, &Sample, &pResult->Lost) != SH_OK)
+					break;
+
+				lhAdd(&pResult->Latency, htNowNs() - Sample.HostNs);
+				pResult->Received++;
+				pResult->Torn += !SampleWhole(&Sample, Cursor - 1);
+			}
+		}
+	} while (Open || Cursor < shHead(pReader));
+
+	shCloseReader(pReader);
+
+	return 0;
+
+}// RunReader
+
+
+static void Usage(const char *pName)
+{
+	fprintf(stderr, "usage: %s [-r readers] [-R rate] [-s seconds] [-n slots] [-z]\n", pName);
+
+}// Usage
+
+
+int main(int argc, char *argv[])
+{
+	static ReaderResult_t Result;
+	LatencyHistogram_t Publish;
+	SharedRingWriter_t *pWriter;
+	IMUData_t IMU;
+	pid_t Pids[MAX_READERS];
+	char Name[64], Byte;
+	double Rate = DEFAULT_RATE, Seconds = DEFAULT_SECONDS;
+	UInt32 Readers = DEFAULT_READERS, Slots = SH_DEFAULT_SLOTS, r;
+	UInt64 Samples, StartNs, Index;
+	BOOL ZeroCopy = FALSE;
+	int ReadyPipe[2], ResultPipe[2], Opt;
+
+	while ((Opt = getopt(argc, argv, "r:R:s:n:z")) != -1)
+	{
+		switch (Opt)
+		{
+		case 'r': Readers = (UInt32)atoi(optarg); break;
+		case 'R': Rate = atof(optarg); break;
+		case 's': Seconds = atof(optarg); break;
+		case 'n': Slots = (UInt32)atoi(optarg); break;
+		case 'z': ZeroCopy = TRUE; break;
+		default:
+			Usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (Readers > MAX_READERS || Rate <= 0 || Seconds <= 0 || Slots == 0)
+	{
+		Usage(argv[0]);
+		return 1;
+	}
+
+	snprintf(Name, sizeof(Name), "/shmbench.%d", (int)getpid());
+	pWriter = shCreate(Name, Slots);
+	if (pWriter == NULL || pipe(ReadyPipe) != 0 || pipe(ResultPipe) != 0)
+	{
+		fprintf(stderr, "%s: can't create the ring\n", argv[0]);
+		return 1;
+	}
+
+	for (r = 0; r < Readers; r++)
+	{
+		Pids[r] = fork();
+		if (Pids[r] < 0)
+		{
+			fprintf(stderr, "%s: can't fork\n", argv[0]);
+			return 1;
+		}
+
+		if (Pids[r] == 0)
+		{
+			memset(&Result, 0, sizeof(Result));
+			Result.Reader = r;
+			lhReset(&Result.Latency);
+
+			if (RunReader(Name, ZeroCopy, ReadyPipe[1], &Result) != 0)
+				_exit(1);
+
+			// Smaller than PIPE_BUF, so results from several readers don't mix
+			_exit(write(ResultPipe[1], &Result, sizeof(Result)) == sizeof(Result) ? 0 : 1);
+		}
+	}
+
+	for (r = 0; r < Readers; r++)
+		if (read(ReadyPipe[0], &Byte, 1) != 1)
+		{
+			fprintf(stderr, "%s: a reader couldn't open the ring\n", argv[0]);
+			return 1;
+		}
+
+	memset(&IMU, 0, sizeof(IMU));
+	lhReset(&Publish);
+
+	Samples = (UInt64)(Rate * Seconds);
+	StartNs = htNowNs();
+
+	for (Index = 0; Index < Samples; Index++)
+	{
+		UInt64 DueNs = StartNs + (UInt64)(Index * 1.0e9 / Rate);
+		UInt64 Now = htNowNs(), Before;
+
+		if (DueNs > Now)
+		{
+			struct timespec Ts;
+
+			Ts.tv_sec = (time_t)((DueNs - Now) / 1000000000ULL);
+			Ts.tv_nsec = (long)((DueNs - Now) % 1000000000ULL);
+			nanosleep(&Ts, NULL);
+		}
+
+		FillSample(&IMU, Index);
+
+		Before = htNowNs();
+		shPublish(pWriter, &IMU, Before, IMU.TimeSincePPS, 0, 0);
+		lhAdd(&Publish, htNowNs() - Before);
+	}
+
+	shClose(pWriter);
+
+	printf("%llu samples at %.0f Hz to %u %s readers, %u slots\n\n", (unsigned long long)Samples, Rate,
+		   (unsigned)Readers, ZeroCopy ? "zero-copy" : "copying", (unsigned)Slots);
+	lhPrint(stdout, "publish", &Publish);
+
+	for (r = 0; r < Readers; r++)
+	{
+		char Label[32];
+
+		if (read(ResultPipe[0], &Result, sizeof(Result)) != sizeof(Result))
+		{
+			fprintf(stderr, "%s: a reader failed\n", argv[0]);
+			break;
+		}
+
+		printf("reader %u: %llu received, %llu lost, %llu torn\n", (unsigned)Result.Reader,
+			   (unsigned long long)Result.Received, (unsigned long long)Result.Lost,
+			   (unsigned long long)Result.Torn);
+		snprintf(Label, sizeof(Label), "reader %u latency", (unsigned)Result.Reader);
+		lhPrintSummary(stdout, Label, &Result.Latency);
+	}
+
+	for (r = 0; r < Readers; r++)
+		waitpid(Pids[r], NULL, 0);
+
+	return 0;
+
+}// main
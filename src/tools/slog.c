@@ -0,0 +1,287 @@
+/*! \file
+	\brief Build, convert and benchmark compact sample logs.
+
+	Usage: slog encode <capture> <log.slg>
+	           frame the capture with the parallel decoder and log every
+	           HS_SERIAL_IMU_MSG sample with the ranges in effect
+	       slog csv <log.slg> [out.csv]
+	           write TimeSincePPS, PPSCount, SequenceNumber and the six
+	           converted readings as CSV, %.6g like tlm2csv
+	       slog bench <log.slg>
+	           decode the log from memory repeatedly and report samples/s,
+	           and the size against the same samples as CSV
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "HostTime.h"
+#include "ParallelDecode.h"
+#include "SampleLog.h"
+
+#define BENCH_SECONDS	1.0
+
+static const char *CsvHeader =
+	"TimeSincePPS,PPSCount,SequenceNumber,GyroX,GyroY,GyroZ,AccelX,AccelY,AccelZ\n";
+
+typedef struct
+{
+	SampleLogWriter_t *pWriter;
+	IMUData_t IMU;							//!< Holds the ranges from RESOLUTION_IMU_MSG
+	BOOL HaveRanges;
+	UInt64 Samples;
+	UInt64 Skipped;							//!< HS samples before the first resolution packet
+	BOOL Ok;
+} EncodeState_t;
+
+
+/*! Log the samples of each frame.
+	\param pUser points to the EncodeState_t.
+	\param pFrame points to the frame.*/
+static void EncodeFrame(void *pUser, const DecodedFrame_t *pFrame)
+{
+	EncodeState_t *pState = (EncodeState_t *)pUser;
+	RawSample_t Sample;
+
+	if (pFrame->Pkt.type == RESOLUTION_IMU_MSG)
+	{
+		DecodeIMUPacket(&pFrame->Pkt, &pState->IMU);
+		pState->HaveRanges = TRUE;
+	}
+	else if (pFrame->Pkt.type == HS_SERIAL_IMU_MSG)
+	{
+		// Without the ranges the readings can't be converted later
+		if (!pState->HaveRanges)
+		{
+			pState->Skipped++;
+			return;
+		}
+
+		slRawFromPacket(&pFrame->Pkt, &Sample);
+		if (!slwPut(pState->pWriter, &Sample, pState->IMU.GyroRange, pState->IMU.AccelRange))
+			pState->Ok = FALSE;
+		pState->Samples++;
+	}
+
+}// EncodeFrame
+
+
+/*! Format one sample as a CSV line.
+	\return The line length.*/
+static int FormatLine(char *pLine, size_t Size, const SampleBlock_t *pBlock, float *pConverted[N_SENSOR_IDX], UInt32 i)
+{
+	return snprintf(pLine, Size, "%.6g,%u,%u,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g\n",
+					(float)(pBlock->PPSTicks[i] / 10000.0), pBlock->PPSCount[i], pBlock->SequenceNumber[i],
+					pConverted[0][i], pConverted[1][i], pConverted[2][i],
+					pConverted[3][i], pConverted[4][i], pConverted[5][i]);
+
+}// FormatLine
+
+
+static int Encode(const char *pCapture, const char *pLog)
+{
+	CaptureReader_t Reader;
+	ParallelDecodeStats_t Stats;
+	EncodeState_t State;
+	UInt64 Bytes;
+
+	if (!crOpen(&Reader, pCapture))
+	{
+		fprintf(stderr, "%s: not a capture file\n", pCapture);
+		return 1;
+	}
+
+	memset(&State, 0, sizeof(State));
+	State.Ok = TRUE;
+	State.pWriter = slwOpen(pLog);
+	if (State.pWriter == NULL)
+	{
+		fprintf(stderr, "%s: can't create\n", pLog);
+		crClose(&Reader);
+		return 1;
+	}
+
+	if (!pdDecodeCapture(&Reader, 0, 0, EncodeFrame, &State, &Stats))
+		State.Ok = FALSE;
+
+	// Size before closing would leave out the last block
+	slwClose(State.pWriter);
+	State.pWriter = NULL;
+
+	{
+		FILE *pFile = fopen(pLog, "rb");
+
+		fseek(pFile, 0, SEEK_END);
+		Bytes = (UInt64)ftell(pFile);
+		fclose(pFile);
+	}
+
+	printf("%llu samples, %llu bytes, %.2f bytes/sample (%.2f in the capture stream)\n",
+		   (unsigned long long)State.Samples, (unsigned long long)Bytes,
+		   State.Samples ? (double)Bytes / State.Samples : 0.0,
+		   State.Samples ? (double)Stats.Bytes / State.Samples : 0.0);
+	if (State.Skipped)
+		printf("%llu samples before the first resolution packet left out\n", (unsigned long long)State.Skipped);
+
+	crClose(&Reader);
+
+	return State.Ok ? 0 : 1;
+
+}// Encode
+
+
+static int ToCsv(const char *pLog, const char *pCsv)
+{
+	static SampleBlock_t Block;
+	static float Converted[N_SENSOR_IDX][SL_BLOCK_SAMPLES];
+	float *pConverted[N_SENSOR_IDX];
+	SampleLogReader_t *pReader = slrOpen(pLog);
+	FILE *pOut = stdout;
+	char Line[256];
+	UInt64 Samples = 0;
+	UInt32 i;
+
+	if (pReader == NULL)
+	{
+		fprintf(stderr, "%s: not a sample log\n", pLog);
+		return 1;
+	}
+
+	if (pCsv && (pOut = fopen(pCsv, "w")) == NULL)
+	{
+		fprintf(stderr, "%s: can't create\n", pCsv);
+		slrClose(pReader);
+		return 1;
+	}
+
+	for (i = 0; i < N_SENSOR_IDX; i++)
+		pConverted[i] = Converted[i];
+
+	fputs(CsvHeader, pOut);
+
+	while (slrNext(pReader, &Block))
+	{
+		slConvertBlock(&Block, pConverted);
+		for (i = 0; i < Block.Count; i++)
+		{
+			FormatLine(Line, sizeof(Line), &Block, pConverted, i);
+			fputs(Line, pOut);
+		}
+		Samples += Block.Count;
+	}
+
+	if (pOut != stdout)
+		fclose(pOut);
+	slrClose(pReader);
+
+	fprintf(stderr, "%llu samples\n", (unsigned long long)Samples);
+
+	return 0;
+
+}// ToCsv
+
+
+static int Bench(const char *pLog)
+{
+	static SampleBlock_t Block;
+	static float Converted[N_SENSOR_IDX][SL_BLOCK_SAMPLES];
+	float *pConverted[N_SENSOR_IDX];
+	FILE *pFile = fopen(pLog, "rb");
+	uint64_t *pData;
+	const SampleLogHeader_t *pHeader;
+	UInt64 Size, Samples = 0, CsvBytes, Passes = 0, Start, Elapsed, Offset;
+	UInt32 Bytes, i;
+	char Line[256];
+	volatile SInt32 Sink = 0;
+
+	if (pFile == NULL)
+	{
+		fprintf(stderr, "%s: can't open\n", pLog);
+		return 1;
+	}
+
+	fseek(pFile, 0, SEEK_END);
+	Size = (UInt64)ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+
+	pData = (uint64_t *)malloc((size_t)Size + sizeof(uint64_t));
+	if ((pData == NULL) || (fread(pData, 1, (size_t)Size, pFile) != Size))
+	{
+		fprintf(stderr, "%s: can't read\n", pLog);
+		fclose(pFile);
+		free(pData);
+		return 1;
+	}
+	fclose(pFile);
+
+	pHeader = (const SampleLogHeader_t *)pData;
+	if ((Size < sizeof(*pHeader)) || (memcmp(pHeader->Magic, SL_MAGIC, sizeof(pHeader->Magic)) != 0) ||
+		(pHeader->ByteOrder != SL_BYTE_ORDER_MARK))
+	{
+		fprintf(stderr, "%s: not a sample log\n", pLog);
+		free(pData);
+		return 1;
+	}
+
+	for (i = 0; i < N_SENSOR_IDX; i++)
+		pConverted[i] = Converted[i];
+
+	// One pass to size the same samples as CSV
+	CsvBytes = strlen(CsvHeader);
+	for (Offset = pHeader->HeaderBytes; Offset < Size; Offset += Bytes)
+	{
+		Bytes = slDecodeBlock(pData + Offset / 8, (UInt32)(Size - Offset), &Block);
+		if (Bytes == 0)
+			break;
+
+		slConvertBlock(&Block, pConverted);
+		for (i = 0; i < Block.Count; i++)
+			CsvBytes += FormatLine(Line, sizeof(Line), &Block, pConverted, i);
+		Samples += Block.Count;
+	}
+
+	// Decode passes until enough time has gone by
+	Start = htNowNs();
+	do
+	{
+		for (Offset = pHeader->HeaderBytes; Offset < Size; Offset += Bytes)
+		{
+			Bytes = slDecodeBlock(pData + Offset / 8, (UInt32)(Size - Offset), &Block);
+			if (Bytes == 0)
+				break;
+			Sink += Block.Raw[0][Block.Count - 1];
+		}
+		Passes++;
+		Elapsed = htNowNs() - Start;
+
+	} while (Elapsed < BENCH_SECONDS * 1.0e9);
+
+	printf("samples     %llu\n", (unsigned long long)Samples);
+	printf("log         %llu bytes, %.2f bytes/sample\n", (unsigned long long)Size, (double)Size / Samples);
+	printf("csv         %llu bytes, %.2f bytes/sample, %.1fx larger\n",
+		   (unsigned long long)CsvBytes, (double)CsvBytes / Samples, (double)CsvBytes / Size);
+	printf("decode      %.1f M samples/s, %.0f MB/s of log\n",
+		   Samples * Passes / (Elapsed / 1.0e9) / 1.0e6, Size * Passes / (Elapsed / 1.0e9) / 1.0e6);
+
+	free(pData);
+
+	return 0;
+
+}// Bench
+
+
+int main(int argc, char *argv[])
+{
+	if ((argc == 4) && (strcmp(argv[1], "encode") == 0))
+		return Encode(argv[2], argv[3]);
+	if ((argc >= 3) && (argc <= 4) && (strcmp(argv[1], "csv") == 0))
+		return ToCsv(argv[2], (argc == 4) ? argv[3] : NULL);
+	if ((argc == 3) && (strcmp(argv[1], "bench") == 0))
+		return Bench(argv[2]);
+
+	fprintf(stderr, "usage: %s encode <capture> <log.slg>\n"
+					"       %s csv <log.slg> [out.csv]\n"
+					"       %s bench <log.slg>\n", argv[0], argv[0], argv[0]);
+	return 1;
+
+}// main
@@ -0,0 +1,261 @@
+/*! \file
+	\brief Run the control tick against a generated IMU feed and report its
+	jitter, missed deadlines and how well the prediction aligns the angle
+	to tick time.
+
+	Usage: tickbench [-r tick Hz] [-i imu Hz] [-s seconds] [-l lead ms]
+	                 [-R cpu[:priority]] [-c]
+
+	The main thread plays the serial thread: it sends a generated roll sine
+	through the parser, decoder and filter at -i Hz (100) on schedule and
+	publishes each sample, while the tick runs at -r Hz (250) for -s seconds
+	(5).  At every tick the predicted angle and the newest sample's angle
+	are compared with the true angle at the deadline plus -l ms (0), the
+	RMS of both showing what the prediction buys.  -R runs the tick thread
+	in real-time mode, see RealTime.h.  -c exits non-zero unless the
+	prediction beats the newest sample.
+
+	With no lead the newest sample is at most one IMU period old, 5 ms on
+	average at 100 Hz, which on this sine is less than the filter's own
+	error, so the two come out alike.  The prediction earns its keep once
+	the tick looks ahead, e.g. over a 20 ms command delay from a 500 Hz tick
+	on a 50 Hz IMU, which ctest runs:
+
+	    tickbench -r 500 -i 50 -l 20 -s 2 -c
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "CalcAngle.h"
+#include "ControlTick.h"
+#include "HostTime.h"
+#include "IMUGenerator.h"
+#include "IMUSerial.h"
+#include "Tilt.h"
+
+#define DEFAULT_TICK_HZ		250.0
+#define DEFAULT_IMU_HZ		100.0
+#define DEFAULT_SECONDS		5.0
+
+//! Truth and error sums shared with the tick callback
+typedef struct
+{
+	const float *pTruth;					//!< True angle of each sample
+	UInt32 Samples;
+	UInt64 StartNs;							//!< Host time of sample 0
+	double SamplePeriodNs;
+	UInt64 LeadNs;
+	double PredictedSquares;				//!< Sum of squared prediction errors
+	double SampleSquares;					//!< Sum of squared newest sample errors
+	UInt32 Compared;
+} TickCheck_t;
+
+
+/*! Compare the tick's angles with the truth at the time they're for.
+	\param pArg points to the TickCheck_t.
+	\param pTick is the tick.*/
+static void CheckTick(void *pArg, const ControlTickInfo_t *pTick)
+{
+	TickCheck_t *pCheck = (TickCheck_t *)pArg;
+	double Index, Fraction, Truth;
+	UInt32 k;
+
+	if (pTick->Samples == 0 || pTick->DeadlineNs + pCheck->LeadNs < pCheck->StartNs)
+		return;
+
+	Index = (pTick->DeadlineNs + pCheck->LeadNs - pCheck->StartNs) / pCheck->SamplePeriodNs;
+	k = (UInt32)Index;
+	if (k + 1 >= pCheck->Samples)
+		return;
+
+	Fraction = Index - k;
+	Truth = pCheck->pTruth[k] + Fraction * (pCheck->pTruth[k + 1] - pCheck->pTruth[k]);
+
+	pCheck->PredictedSquares += (pTick->Angle - Truth) * (pTick->Angle - Truth);
+	pCheck->SampleSquares += (pTick->SampleAngle - Truth) * (pTick->SampleAngle - Truth);
+	pCheck->Compared++;
+
+}// CheckTick
+
+
+static void Usage(const char *pName)
+{
+	fprintf(stderr, "usage: %s [-r tick Hz] [-i imu Hz] [-s seconds] [-l lead ms] [-R cpu[:priority]] [-c]\n", pName);
+
+}// Usage
+
+
+int main(int argc, char *argv[])
+{
+	static const GenSegment_t Profile = { GEN_SINE, 1.0e6, 10.0, 0.5 };
+	ControlTickConfig_t TickConfig;
+	ControlTickStats_t Stats;
+	ControlSnapshot_t Snapshot;
+	RealTimeConfig_t RealTime;
+	AnglePredictor_t Predictor;
+	TickCheck_t Check;
+	GenConfig_t GenConfig;
+	IMUGenerator_t Gen;
+	GenTruth_t Truth;
+	IMUPacket_t Pkt;
+	IMUData_t IMU;
+	KFilter_t KF;
+	ControlTick_t *pTick;
+	UInt8 *pStream;
+	UInt32 *pOffsets;
+	float *pTruth;
+	double TickHz = DEFAULT_TICK_HZ, ImuHz = DEFAULT_IMU_HZ, Seconds = DEFAULT_SECONDS, LeadMs = 0;
+	BOOL UseRealTime = FALSE, CheckGain = FALSE;
+	UInt32 Samples, s, n;
+	int Opt;
+
+	rtDefaultConfig(&RealTime);
+
+	while ((Opt = getopt(argc, argv, "r:i:s:l:R:c")) != -1)
+	{
+		switch (Opt)
+		{
+		case 'r': TickHz = atof(optarg); break;
+		case 'i': ImuHz = atof(optarg); break;
+		case 's': Seconds = atof(optarg); break;
+		case 'l': LeadMs = atof(optarg); break;
+		case 'c': CheckGain = TRUE; break;
+		case 'R':
+			if (!rtParse(optarg, &RealTime))
+			{
+				Usage(argv[0]);
+				return 1;
+			}
+			UseRealTime = TRUE;
+			break;
+		default:
+			Usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (TickHz <= 0 || ImuHz <= 0 || Seconds <= 0 || LeadMs < 0)
+	{
+		Usage(argv[0]);
+		return 1;
+	}
+
+	// The whole feed and its truth are generated up front
+	Samples = (UInt32)(ImuHz * Seconds) + 2;
+
+	genDefaultConfig(&GenConfig);
+	GenConfig.RateHz = ImuHz;
+	GenConfig.pProfile = &Profile;
+	GenConfig.ProfileCount = 1;
+	genInit(&Gen, &GenConfig);
+
+	pStream = (UInt8 *)malloc(GEN_MAX_CONFIG_BYTES + (size_t)Samples * GEN_MAX_STEP_BYTES);
+	pOffsets = (UInt32 *)malloc(((size_t)Samples + 1) * sizeof(UInt32));
+	pTruth = (float *)malloc(Samples * sizeof(float));
+	if (pStream == NULL || pOffsets == NULL || pTruth == NULL)
+	{
+		fprintf(stderr, "%s: out of memory\n", argv[0]);
+		return 1;
+	}
+
+	// The sensor ranges come first, HS packets don't decode without them
+	for (pOffsets[0] = genConfigResponse(&Gen, pStream), s = 0; s < Samples; s++)
+	{
+		pOffsets[s + 1] = pOffsets[s] + genStep(&Gen, pStream + pOffsets[s], &Truth);
+		pTruth[s] = Truth.Angle;
+	}
+
+	memset(&Check, 0, sizeof(Check));
+	Check.pTruth = pTruth;
+	Check.Samples = Samples;
+	Check.SamplePeriodNs = 1.0e9 / ImuHz;
+	Check.LeadNs = (UInt64)(LeadMs * 1.0e6);
+
+	ctInitSnapshot(&Snapshot);
+
+	memset(&TickConfig, 0, sizeof(TickConfig));
+	TickConfig.RateHz = TickHz;
+	TickConfig.LeadNs = Check.LeadNs;
+	TickConfig.pCallback = CheckTick;
+	TickConfig.pArg = &Check;
+	TickConfig.pSnapshot = &Snapshot;
+	TickConfig.pRealTime = UseRealTime ? &RealTime : NULL;
+
+	Pkt.state = SERIAL_STATE_SYNC0;
+	kfInit(&KF);
+	apInit(&Predictor, 0);
+
+	for (n = 0; n < pOffsets[0]; n++)
+		if (LookForIMUPacketInByte(pStream[n], &Pkt))
+			DecodeIMUPacket(&Pkt, &IMU);
+
+	// Sample 0 is due a little after the tick starts
+	Check.StartNs = htNowNs() + 20000000;
+
+	pTick = ctStart(&TickConfig);
+	if (pTick == NULL)
+	{
+		fprintf(stderr, "%s: can't start the tick\n", argv[0]);
+		return 1;
+	}
+
+	for (s = 0; s < Samples; s++)
+	{
+		UInt64 DueNs = Check.StartNs + (UInt64)(s * Check.SamplePeriodNs);
+		UInt64 Now = htNowNs();
+
+		if (DueNs > Now)
+		{
+			struct timespec Ts;
+
+			Ts.tv_sec = (time_t)((DueNs - Now) / 1000000000ULL);
+			Ts.tv_nsec = (long)((DueNs - Now) % 1000000000ULL);
+			nanosleep(&Ts, NULL);
+		}
+
+		for (n = pOffsets[s]; n < pOffsets[s + 1]; n++)
+		{
+			if (LookForIMUPacketInByte(pStream[n], &Pkt))
+			{
+				DecodeIMUPacket(&Pkt, &IMU);
+				if (Pkt.type == HS_SERIAL_IMU_MSG)
+				{
+					kfGetAngle(&KF, TiltRollDeg(&IMU), IMU.SensorsConverted[GYROX_IDX], (float)(1.0 / ImuHz));
+					apUpdate(&Predictor, &KF, IMU.TimeSincePPS, htNowNs());
+					ctPublish(&Snapshot, &Predictor);
+				}
+			}
+		}
+	}
+
+	ctGetStats(pTick, &Stats);
+	ctStop(pTick);
+
+	printf("%u IMU samples at %.0f Hz, tick at %.0f Hz, lead %.1f ms\n\n", (unsigned)Samples, ImuHz, TickHz, LeadMs);
+	if (UseRealTime)
+		rtPrintApplied(stdout, &RealTime, Stats.RealTime);
+
+	printf("%llu ticks, %llu missed, %llu overruns, %llu without a new sample\n\n",
+		   (unsigned long long)Stats.Ticks, (unsigned long long)Stats.Missed,
+		   (unsigned long long)Stats.Overruns, (unsigned long long)Stats.Stale);
+	lhPrint(stdout, "tick jitter", &Stats.Jitter);
+	lhPrint(stdout, "tick run", &Stats.Run);
+
+	if (Check.Compared)
+		printf("angle error at tick time over %u ticks: predicted %.4f deg RMS, newest sample %.4f deg RMS\n",
+			   (unsigned)Check.Compared, sqrt(Check.PredictedSquares / Check.Compared),
+			   sqrt(Check.SampleSquares / Check.Compared));
+
+	if (CheckGain && !(Check.Compared && Check.PredictedSquares < Check.SampleSquares))
+	{
+		printf("the prediction didn't beat the newest sample\n");
+		return 1;
+	}
+
+	return 0;
+
+}// main
@@ -0,0 +1,161 @@
+/*! \file
+	\brief Convert a binary telemetry log written by TelemetryLog.c to CSV.
+
+	The conversion is driven entirely by the schema in the file header, so
+	logs written by older or newer record layouts convert as well.
+
+	Usage: tlm2csv <log.tlm> [out.csv]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "TelemetryLog.h"
+
+/*! Get the size of one element of a field type.
+	\param Type is a TelemetryFieldType_t.
+	\return The size in bytes, 0 for an unknown type.*/
+static UInt32 TypeBytes(uint8_t Type)
+{
+	switch (Type)
+	{
+	case TLM_TYPE_U8:  return 1;
+	case TLM_TYPE_U32: return 4;
+	case TLM_TYPE_U64: return 8;
+	case TLM_TYPE_F32: return 4;
+	default:           return 0;
+	}
+
+}// TypeBytes
+
+
+/*! Print one field of a record.
+	\param pFile is the output stream.
+	\param pField describes the field.
+	\param pRecord points to the start of the record.*/
+static void PrintField(FILE *pFile, const TelemetryField_t *pField, const UInt8 *pRecord)
+{
+	const UInt8 *p = pRecord + pField->Offset;
+	int i;
+
+	for (i = 0; i < pField->Count; i++)
+	{
+		uint32_t u32;
+		uint64_t u64;
+		float f;
+
+		if (i)
+			fputc(',', pFile);
+
+		switch (pField->Type)
+		{
+		case TLM_TYPE_U8:  fprintf(pFile, "%u", p[i]); break;
+		case TLM_TYPE_U32: memcpy(&u32, p + 4 * i, 4); fprintf(pFile, "%lu", (unsigned long)u32); break;
+		case TLM_TYPE_U64: memcpy(&u64, p + 8 * i, 8); fprintf(pFile, "%llu", (unsigned long long)u64); break;
+		case TLM_TYPE_F32: memcpy(&f, p + 4 * i, 4); fprintf(pFile, "%.6g", f); break;
+		default: break;
+		}
+	}
+
+}// PrintField
+
+
+int main(int argc, char *argv[])
+{
+	TelemetryFileHeader_t Header;
+	TelemetryField_t *pFields;
+	UInt8 *pRecord;
+	FILE *pIn, *pOut = stdout;
+	unsigned long Records = 0;
+	int f, i;
+
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <log.tlm> [out.csv]\n", argv[0]);
+		return 1;
+	}
+
+	pIn = fopen(argv[1], "rb");
+	if ((pIn == NULL) || (fread(&Header, sizeof(Header), 1, pIn) != 1) ||
+		(memcmp(Header.Magic, TLM_MAGIC, sizeof(Header.Magic)) != 0))
+	{
+		fprintf(stderr, "%s: not a telemetry log\n", argv[1]);
+		return 1;
+	}
+
+	if (Header.ByteOrder != TLM_BYTE_ORDER_MARK)
+	{
+		fprintf(stderr, "%s: written with a different byte order\n", argv[1]);
+		return 1;
+	}
+
+	pFields = (TelemetryField_t *)calloc(Header.FieldCount, sizeof(TelemetryField_t));
+	pRecord = (UInt8 *)malloc(Header.RecordBytes);
+	if ((pFields == NULL) || (pRecord == NULL) ||
+		(fread(pFields, sizeof(TelemetryField_t), Header.FieldCount, pIn) != Header.FieldCount))
+	{
+		fprintf(stderr, "%s: truncated header\n", argv[1]);
+		return 1;
+	}
+
+	// A field must lie within the record, whatever the header claims
+	for (f = 0; f < Header.FieldCount; f++)
+	{
+		UInt32 Bytes = TypeBytes(pFields[f].Type);
+
+		// Types from a newer writer print empty and are never read
+		if ((UInt32)pFields[f].Offset + Bytes * pFields[f].Count > Header.RecordBytes)
+		{
+			fprintf(stderr, "%s: field %d (%.*s) doesn't fit a %u byte record\n", argv[1], f,
+					TLM_NAME_LEN, pFields[f].Name, (unsigned)Header.RecordBytes);
+			return 1;
+		}
+	}
+
+	// Skip anything a newer header might carry after the field table
+	fseek(pIn, Header.HeaderBytes, SEEK_SET);
+
+	if ((argc > 2) && ((pOut = fopen(argv[2], "w")) == NULL))
+	{
+		fprintf(stderr, "%s: can't create\n", argv[2]);
+		return 1;
+	}
+
+	// Column names, arrays get an index suffix
+	for (f = 0; f < Header.FieldCount; f++)
+	{
+		for (i = 0; i < pFields[f].Count; i++)
+		{
+			if (f || i)
+				fputc(',', pOut);
+			if (pFields[f].Count > 1)
+				fprintf(pOut, "%.*s%d", TLM_NAME_LEN, pFields[f].Name, i);
+			else
+				fprintf(pOut, "%.*s", TLM_NAME_LEN, pFields[f].Name);
+		}
+	}
+	fputc('\n', pOut);
+
+	while (fread(pRecord, Header.RecordBytes, 1, pIn) == 1)
+	{
+		for (f = 0; f < Header.FieldCount; f++)
+		{
+			if (f)
+				fputc(',', pOut);
+			PrintField(pOut, &pFields[f], pRecord);
+		}
+		fputc('\n', pOut);
+		Records++;
+	}
+
+	fprintf(stderr, "%lu records\n", Records);
+
+	if (pOut != stdout)
+		fclose(pOut);
+	fclose(pIn);
+	free(pRecord);
+	free(pFields);
+
+	return 0;
+
+}// main
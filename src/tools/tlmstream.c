@@ -0,0 +1,302 @@
+/*! \file
+	\brief Receive a telemetry stream, or benchmark one over loopback.
+
+	Usage: tlmstream recv [-s seconds] name
+	       tlmstream bench [-r rate] [-s seconds] [-b samples] [-d delay us]
+	                       [-l limit Hz] [name]
+
+	"recv" binds name, e.g. "udp::5600" or "unix:/tmp/imu.sock", and prints
+	the samples received and lost each second, for -s seconds or until
+	interrupted.  segway -t name streams to it, see TelemetryStream.h.
+
+	"bench" receives on name (default "udp:127.0.0.1:0", any free port) in
+	one thread while the main thread pushes records at -r Hz (10000) for -s
+	seconds (2) to a stream of -b samples per datagram (as many as fit),
+	sent at least every -d us (5000) and limited to -l samples a second
+	(none).  It reports the cost of tsPush(), the CPU the sender and
+	receiver threads used, the system calls made, loss and the latency from
+	push to receipt, and exits non-zero if any sample the sender sent was
+	lost.
+*/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "Atomic.h"
+#include "HostTime.h"
+#include "LatencyHistogram.h"
+#include "TelemetryStream.h"
+
+#define DEFAULT_RATE		10000.0
+#define DEFAULT_SECONDS		2.0
+#define DEFAULT_BENCH_NAME	"udp:127.0.0.1:0"
+
+//! Receiver thread of the benchmark
+typedef struct
+{
+	TelemetryReceiver_t *pReceiver;
+	volatile UInt32 Stop;
+	LatencyHistogram_t Latency;				//!< Push to receipt
+	UInt64 CpuNs;							//!< CPU time of the thread
+} BenchReceiver_t;
+
+
+/*! Time a received sample from its push.
+	\param pArg points to the latency histogram.
+	\param pHeader is the sample's datagram header.
+	\param pSample is the sample.*/
+static void TimeSample(void *pArg, const TelemetryDatagramHeader_t *pHeader, const TelemetrySample_t *pSample)
+{
+	lhAdd((LatencyHistogram_t *)pArg, htNowNs() - (pHeader->BaseNs + pSample->OffsetNs));
+
+}// TimeSample
+
+
+/*! Receive until asked to stop.
+	\param pArg points to the BenchReceiver_t.
+	\return NULL.*/
+static void *ReceiverThread(void *pArg)
+{
+	BenchReceiver_t *pBench = (BenchReceiver_t *)pArg;
+	struct timespec Ts;
+
+	while (!atomicLoadAcquire(&pBench->Stop))
+		tsReceive(pBench->pReceiver, 10, TimeSample, &pBench->Latency);
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &Ts);
+	pBench->CpuNs = (UInt64)Ts.tv_sec * 1000000000ULL + (UInt64)Ts.tv_nsec;
+
+	return NULL;
+
+}// ReceiverThread
+
+
+/*! Print the receiver's counters.
+	\param pStats is the counters.*/
+static void PrintReceived(const TelemetryReceiverStats_t *pStats)
+{
+	printf("received %llu samples in %llu datagrams, %llu calls; lost %llu samples, %llu datagrams; "
+		   "sender dropped %llu; %llu reordered, %llu malformed\n",
+		   (unsigned long long)pStats->Samples, (unsigned long long)pStats->Datagrams,
+		   (unsigned long long)pStats->Calls, (unsigned long long)pStats->SamplesLost,
+		   (unsigned long long)pStats->DatagramsLost, (unsigned long long)pStats->SenderDropped,
+		   (unsigned long long)pStats->Reordered, (unsigned long long)pStats->Malformed);
+
+}// PrintReceived
+
+
+static void Usage(const char *pName)
+{
+	fprintf(stderr, "usage: %s recv [-s seconds] name\n"
+			"       %s bench [-r rate] [-s seconds] [-b samples] [-d delay us] [-l limit Hz] [name]\n",
+			pName, pName);
+
+}// Usage
+
+
+/*! Print what arrives on a name every second.
+	\return The exit status.*/
+static int Receive(int argc, char *argv[], const char *pProgram)
+{
+	TelemetryReceiverStats_t Stats, Last;
+	TelemetryReceiver_t *pReceiver;
+	double Seconds = 0;
+	UInt64 StartNs, ReportNs;
+	int Opt;
+
+	while ((Opt = getopt(argc, argv, "s:")) != -1)
+	{
+		if (Opt != 's')
+		{
+			Usage(pProgram);
+			return 1;
+		}
+		Seconds = atof(optarg);
+	}
+
+	if (optind + 1 != argc)
+	{
+		Usage(pProgram);
+		return 1;
+	}
+
+	pReceiver = tsListen(argv[optind]);
+	if (pReceiver == NULL)
+	{
+		fprintf(stderr, "%s: can't bind %s\n", pProgram, argv[optind]);
+		return 1;
+	}
+
+	memset(&Last, 0, sizeof(Last));
+	StartNs = ReportNs = htNowNs();
+
+	while (Seconds <= 0 || htNowNs() - StartNs < (UInt64)(Seconds * 1.0e9))
+	{
+		tsReceive(pReceiver, 100, NULL, NULL);
+
+		if (htNowNs() - ReportNs >= 1000000000ULL)
+		{
+			ReportNs += 1000000000ULL;
+			tsGetReceiverStats(pReceiver, &Stats);
+			printf("%llu samples/s, %llu lost, %llu dropped by the sender, %llu datagrams lost\n",
+				   (unsigned long long)(Stats.Samples - Last.Samples),
+				   (unsigned long long)(Stats.SamplesLost - Last.SamplesLost),
+				   (unsigned long long)(Stats.SenderDropped - Last.SenderDropped),
+				   (unsigned long long)(Stats.DatagramsLost - Last.DatagramsLost));
+			fflush(stdout);
+			Last = Stats;
+		}
+	}
+
+	tsGetReceiverStats(pReceiver, &Stats);
+	PrintReceived(&Stats);
+	tsCloseReceiver(pReceiver);
+
+	return 0;
+
+}// Receive
+
+
+/*! Stream over loopback at a rate and report the cost and loss.
+	\return The exit status.*/
+static int Bench(int argc, char *argv[], const char *pProgram)
+{
+	static BenchReceiver_t Receiver;
+	TelemetryStreamConfig_t Config;
+	TelemetryStreamStats_t Sent;
+	TelemetryReceiverStats_t Received;
+	TelemetryStream_t *pStream;
+	TelemetryRecord_t Record;
+	IMUData_t IMU;
+	pthread_t Thread;
+	struct timespec CpuBefore, CpuAfter;
+	const char *pName = DEFAULT_BENCH_NAME;
+	char Name[TS_NAME_BYTES];
+	double Rate = DEFAULT_RATE, Seconds = DEFAULT_SECONDS, WallNs;
+	UInt64 Samples, StartNs, PushNs = 0, Index, Before;
+	int Opt;
+
+	tsDefaultConfig(&Config);
+
+	while ((Opt = getopt(argc, argv, "r:s:b:d:l:")) != -1)
+	{
+		switch (Opt)
+		{
+		case 'r': Rate = atof(optarg); break;
+		case 's': Seconds = atof(optarg); break;
+		case 'b': Config.MaxSamples = (UInt32)atoi(optarg); break;
+		case 'd': Config.MaxDelayUs = (UInt32)atoi(optarg); break;
+		case 'l': Config.MaxRateHz = atof(optarg); break;
+		default:
+			Usage(pProgram);
+			return 1;
+		}
+	}
+
+	if (optind < argc)
+		pName = argv[optind];
+
+	if (Rate <= 0 || Seconds <= 0)
+	{
+		Usage(pProgram);
+		return 1;
+	}
+
+	Receiver.pReceiver = tsListen(pName);
+	if (Receiver.pReceiver == NULL)
+	{
+		fprintf(stderr, "%s: can't bind %s\n", pProgram, pName);
+		return 1;
+	}
+	lhReset(&Receiver.Latency);
+
+	// Sized for the whole run, the bench measures the stream, not the queue
+	Config.Capacity = (UInt32)(Rate * Seconds) + 1;
+	pStream = tsOpen(tsReceiverName(Receiver.pReceiver, Name), &Config);
+	if (pStream == NULL || pthread_create(&Thread, NULL, ReceiverThread, &Receiver) != 0)
+	{
+		fprintf(stderr, "%s: can't stream to %s\n", pProgram, Name);
+		return 1;
+	}
+
+	memset(&IMU, 0, sizeof(IMU));
+	Samples = (UInt64)(Rate * Seconds);
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &CpuBefore);
+	StartNs = htNowNs();
+
+	for (Index = 0; Index < Samples; Index++)
+	{
+		UInt64 DueNs = StartNs + (UInt64)(Index * 1.0e9 / Rate);
+		UInt64 Now = htNowNs();
+
+		if (DueNs > Now)
+		{
+			struct timespec Ts;
+
+			Ts.tv_sec = (time_t)((DueNs - Now) / 1000000000ULL);
+			Ts.tv_nsec = (long)((DueNs - Now) % 1000000000ULL);
+			nanosleep(&Ts, NULL);
+		}
+
+		IMU.SensorsConverted[GYROX_IDX] = (float)Index;
+
+		Before = htNowNs();
+		tlFillRecord(&Record, &IMU, Before, (float)Index, 0.0f);
+		tsPush(pStream, &Record);
+		PushNs += htNowNs() - Before;
+	}
+
+	WallNs = (double)(htNowNs() - StartNs);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &CpuAfter);
+
+	// Let the last partial datagram go and arrive
+	htSleepMs(Config.MaxDelayUs / 1000 + 20);
+	tsGetStats(pStream, &Sent);
+	tsClose(pStream);
+	htSleepMs(20);
+
+	atomicStoreRelease(&Receiver.Stop, 1);
+	pthread_join(Thread, NULL);
+	tsGetReceiverStats(Receiver.pReceiver, &Received);
+
+	printf("%llu samples at %.0f Hz over %s, %u per datagram, %u us batching",
+		   (unsigned long long)Samples, Rate, Name, (unsigned)Config.MaxSamples, (unsigned)Config.MaxDelayUs);
+	if (Config.MaxRateHz > 0)
+		printf(", limited to %.0f Hz", Config.MaxRateHz);
+	printf("\n\n");
+
+	printf("push %.1f ns/sample, producer thread %.1f%% of a core including its sleeps\n",
+		   (double)PushNs / Samples,
+		   100.0 * ((CpuAfter.tv_sec - CpuBefore.tv_sec) * 1.0e9 + (CpuAfter.tv_nsec - CpuBefore.tv_nsec)) / WallNs);
+	printf("sent %llu samples in %llu datagrams, %llu calls; %llu queue full, %llu over the rate, %llu send errors; "
+		   "sender thread %.2f%% of a core\n",
+		   (unsigned long long)Sent.Samples, (unsigned long long)Sent.Datagrams, (unsigned long long)Sent.Calls,
+		   (unsigned long long)Sent.QueueDropped, (unsigned long long)Sent.RateLimited,
+		   (unsigned long long)Sent.SendErrors, 100.0 * Sent.CpuNs / WallNs);
+	PrintReceived(&Received);
+	printf("receiver thread %.2f%% of a core\n\n", 100.0 * Receiver.CpuNs / WallNs);
+	lhPrintSummary(stdout, "push to receipt", &Receiver.Latency);
+
+	tsCloseReceiver(Receiver.pReceiver);
+
+	return (Received.Samples == Sent.Samples && Received.SamplesLost == 0) ? 0 : 1;
+
+}// Bench
+
+
+int main(int argc, char *argv[])
+{
+	if (argc >= 2 && strcmp(argv[1], "recv") == 0)
+		return Receive(argc - 1, argv + 1, argv[0]);
+
+	if (argc >= 2 && strcmp(argv[1], "bench") == 0)
+		return Bench(argc - 1, argv + 1, argv[0]);
+
+	Usage(argv[0]);
+	return 1;
+
+}// main